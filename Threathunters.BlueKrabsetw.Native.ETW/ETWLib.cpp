@@ -17,6 +17,7 @@
 #include "EventRecord.hpp"
 #include "EventRecordError.hpp"
 #include "Property.hpp"
+#include "StringCache.hpp"
 
 #include "Filtering/Predicate.hpp"
 #include "Filtering/EventFilter.hpp"
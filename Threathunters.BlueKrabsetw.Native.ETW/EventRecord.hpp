@@ -8,6 +8,7 @@
 #include "EventRecordMetadata.hpp"
 #include "IEventRecord.hpp"
 #include "Property.hpp"
+#include "StringCache.hpp"
 
 #include <msclr\marshal.h>
 #include <msclr\marshal_cppstd.h>
@@ -30,6 +31,10 @@ namespace Microsoft { namespace O365 { namespace Security { namespace ETW {
         const krabs::schema* schema_;
         krabs::parser* parser_;
 
+        // The instance handed out on this thread when records are reused.
+        [ThreadStatic]
+        static EventRecord^ threadRecord_;
+
     internal:
 
         EventRecord(
@@ -40,6 +45,45 @@ namespace Microsoft { namespace O365 { namespace Security { namespace ETW {
             , schema_(&schema)
             , parser_(&parser) { }
 
+        /// <summary>
+        /// Returns an EventRecord for the event, either a new one or, when
+        /// reuse is true, the one the calling thread used for its previous
+        /// event, which then no longer refers to that event.
+        /// </summary>
+        static EventRecord^ Create(
+            const EVENT_RECORD& record,
+            const krabs::schema& schema,
+            krabs::parser& parser,
+            bool reuse)
+        {
+            if (!reuse)
+                return gcnew EventRecord(record, schema, parser);
+
+            auto instance = threadRecord_;
+            if (instance == nullptr)
+            {
+                instance = gcnew EventRecord(record, schema, parser);
+                threadRecord_ = instance;
+            }
+            else
+            {
+                instance->Reset(record, schema, parser);
+            }
+
+            return instance;
+        }
+
+        void Reset(
+            const EVENT_RECORD& record,
+            const krabs::schema& schema,
+            krabs::parser& parser)
+        {
+            record_ = &record;
+            header_ = &record.EventHeader;
+            schema_ = &schema;
+            parser_ = &parser;
+        }
+
     public:
 
 #pragma region Schema
@@ -48,7 +92,7 @@ namespace Microsoft { namespace O365 { namespace Security { namespace ETW {
         /// </summary>
         virtual property String^ Name
         {
-            String^ get() { return gcnew String(schema_->event_name()); }
+            String^ get() { return StringCache::InternSchemaName(schema_->event_name()); }
         }
 
         /// <summary>
@@ -56,7 +100,7 @@ namespace Microsoft { namespace O365 { namespace Security { namespace ETW {
         /// </summary>
         virtual property String^ OpcodeName
         {
-            String^ get() { return gcnew String(schema_->opcode_name()); }
+            String^ get() { return StringCache::InternSchemaName(schema_->opcode_name()); }
         }
 
         /// <summary>
@@ -64,7 +108,7 @@ namespace Microsoft { namespace O365 { namespace Security { namespace ETW {
         /// </summary>
         virtual property String^ TaskName
         {
-            String^ get() { return gcnew String(schema_->task_name()); }
+            String^ get() { return StringCache::InternSchemaName(schema_->task_name()); }
         }
 
         /// <summary>
@@ -72,7 +116,7 @@ namespace Microsoft { namespace O365 { namespace Security { namespace ETW {
         /// </summary>
         virtual property String^ ProviderName
         {
-            String^ get() { return gcnew String(schema_->provider_name()); }
+            String^ get() { return StringCache::InternSchemaName(schema_->provider_name()); }
         }
 
 #pragma endregion
@@ -125,6 +169,109 @@ namespace Microsoft { namespace O365 { namespace Security { namespace ETW {
             return success;
         }
 
+        /// <summary>
+        /// Attempt to copy a unicode string from the specified property name
+        /// into a buffer, without creating a String.
+        /// </summary>
+        /// <param name="name">property name</param>
+        /// <param name="buffer">the buffer to copy the characters to</param>
+        /// <param name="offset">the position in the buffer of the first character</param>
+        /// <param name="length">the length of the string, set whenever the property exists</param>
+        /// <returns>true if the property exists and fits in the buffer, false otherwise</returns>
+        virtual bool TryGetUnicodeString(String^ name, array<wchar_t>^ buffer, int offset, [Out] int% length)
+        {
+            const wchar_t* data;
+            int size;
+
+            length = 0;
+            if (!TryViewUnicodeString(name, data, size))
+                return false;
+
+            length = size;
+            if (buffer == nullptr || offset < 0 || offset > buffer->Length || buffer->Length - offset < size)
+                return false;
+
+            if (size != 0)
+                Marshal::Copy(IntPtr((void*)data), buffer, offset, size);
+
+            return true;
+        }
+
+        /// <summary>
+        /// Get the characters of a unicode string from the specified property
+        /// name where they are in the event, without copying them.
+        /// </summary>
+        /// <param name="name">property name</param>
+        /// <param name="length">the length of the string in characters</param>
+        /// <returns>a pointer to the first character, only valid while the event is being handled</returns>
+        virtual IntPtr GetUnicodeStringRaw(String^ name, [Out] int% length)
+        {
+            const wchar_t* data;
+            int size;
+
+            ViewUnicodeString(name, data, size);
+
+            length = size;
+            return IntPtr((void*)data);
+        }
+
+        /// <summary>
+        /// Attempt to get the characters of a unicode string from the specified
+        /// property name where they are in the event, without copying them.
+        /// </summary>
+        /// <param name="name">property name</param>
+        /// <param name="data">a pointer to the first character, only valid while the event is being handled</param>
+        /// <param name="length">the length of the string in characters</param>
+        /// <returns>true if fetching the string succeeded, false otherwise</returns>
+        virtual bool TryGetUnicodeStringRaw(String^ name, [Out] IntPtr% data, [Out] int% length)
+        {
+            const wchar_t* chars;
+            int size;
+
+            if (!TryViewUnicodeString(name, chars, size))
+                return false;
+
+            data = IntPtr((void*)chars);
+            length = size;
+            return true;
+        }
+
+        /// <summary>
+        /// Get a unicode string from the specified property name, returning
+        /// the same instance for values seen before. Meant for properties
+        /// with few distinct values, like image or file names.
+        /// </summary>
+        /// <param name="name">property name</param>
+        /// <returns>the unicode string value associated with the specified property</returns>
+        /// <remarks>see <see cref="StringCache"/></remarks>
+        virtual String^ GetInternedUnicodeString(String^ name)
+        {
+            const wchar_t* data;
+            int length;
+
+            ViewUnicodeString(name, data, length);
+            return StringCache::Intern(data, length);
+        }
+
+        /// <summary>
+        /// Attempt to get a unicode string from the specified property name,
+        /// returning the same instance for values seen before.
+        /// </summary>
+        /// <param name="name">property name</param>
+        /// <param name="result">the resulting string</param>
+        /// <returns>true if fetching the string succeeded, false otherwise</returns>
+        virtual bool TryGetInternedUnicodeString(String^ name, [Out] String^% result)
+        {
+            const wchar_t* data;
+            int length;
+
+            if (!TryViewUnicodeString(name, data, length))
+                return false;
+
+            result = StringCache::Intern(data, length);
+            return true;
+        }
+
 #pragma endregion
 
 #pragma region Ansi String
@@ -787,6 +934,44 @@ namespace Microsoft { namespace O365 { namespace Security { namespace ETW {
 #pragma endregion
 
     private:
+        void ViewUnicodeString(String^ name, const wchar_t*& data, int& length)
+        {
+            try
+            {
+                // The name is read in place rather than copied into a
+                // std::wstring, which would allocate for most names.
+                pin_ptr<const wchar_t> propName = PtrToStringChars(name);
+                krabs::predicates::adapters::generic_string<wchar_t> adapter;
+                auto view = parser_->view_of(propName, name->Length, adapter);
+
+                data = view.begin();
+                length = static_cast<int>(view.end() - view.begin());
+            }
+            catch (const std::exception& ex)
+            {
+                auto msg = gcnew String(ex.what());
+                throw gcnew ParserException(msg);
+            }
+        }
+
+        bool TryViewUnicodeString(String^ name, const wchar_t*& data, int& length)
+        {
+            try
+            {
+                pin_ptr<const wchar_t> propName = PtrToStringChars(name);
+                krabs::predicates::adapters::generic_string<wchar_t> adapter;
+                auto view = parser_->view_of(propName, name->Length, adapter);
+
+                data = view.begin();
+                length = static_cast<int>(view.end() - view.begin());
+                return true;
+            }
+            catch (const std::exception&)
+            {
+                return false;
+            }
+        }
+
         template <typename T>
         T GetValue(String^ name)
         {
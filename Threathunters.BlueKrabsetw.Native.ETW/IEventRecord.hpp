@@ -67,6 +67,54 @@ namespace Microsoft { namespace O365 { namespace Security { namespace ETW {
         /// <returns>true if fetching the string succeeded, false otherwise</returns>
         bool TryGetUnicodeString(String^ name, [Out] String^% result);
 
+        /// <summary>
+        /// Attempt to copy a unicode string from the specified property name
+        /// into a buffer, without creating a String.
+        /// </summary>
+        /// <param name="name">property name</param>
+        /// <param name="buffer">the buffer to copy the characters to</param>
+        /// <param name="offset">the position in the buffer of the first character</param>
+        /// <param name="length">the length of the string, set whenever the property exists</param>
+        /// <returns>true if the property exists and fits in the buffer, false otherwise</returns>
+        bool TryGetUnicodeString(String^ name, array<wchar_t>^ buffer, int offset, [Out] int% length);
+
+        /// <summary>
+        /// Get the characters of a unicode string from the specified property
+        /// name where they are in the event, without copying them.
+        /// </summary>
+        /// <param name="name">property name</param>
+        /// <param name="length">the length of the string in characters</param>
+        /// <returns>a pointer to the first character, only valid while the event is being handled</returns>
+        IntPtr GetUnicodeStringRaw(String^ name, [Out] int% length);
+
+        /// <summary>
+        /// Attempt to get the characters of a unicode string from the specified
+        /// property name where they are in the event, without copying them.
+        /// </summary>
+        /// <param name="name">property name</param>
+        /// <param name="data">a pointer to the first character, only valid while the event is being handled</param>
+        /// <param name="length">the length of the string in characters</param>
+        /// <returns>true if fetching the string succeeded, false otherwise</returns>
+        bool TryGetUnicodeStringRaw(String^ name, [Out] IntPtr% data, [Out] int% length);
+
+        /// <summary>
+        /// Get a unicode string from the specified property name, returning
+        /// the same instance for values seen before. Meant for properties
+        /// with few distinct values, like image or file names.
+        /// </summary>
+        /// <param name="name">property name</param>
+        /// <returns>the unicode string value associated with the specified property</returns>
+        String^ GetInternedUnicodeString(String^ name);
+
+        /// <summary>
+        /// Attempt to get a unicode string from the specified property name,
+        /// returning the same instance for values seen before.
+        /// </summary>
+        /// <param name="name">property name</param>
+        /// <param name="result">the resulting string</param>
+        /// <returns>true if fetching the string succeeded, false otherwise</returns>
+        bool TryGetInternedUnicodeString(String^ name, [Out] String^% result);
+
         /// <summary>
         /// Get a ANSI string from the specified property name.
         /// </summary>
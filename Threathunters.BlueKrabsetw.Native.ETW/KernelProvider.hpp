@@ -62,6 +62,14 @@ namespace Microsoft { namespace O365 { namespace Security { namespace ETW {
             provider_->add_filter(filter);
         }
 
+        /// <summary>
+        /// When set, every event is delivered through the same EventRecord
+        /// instance per thread instead of a new one, which saves an allocation
+        /// per event. The record is then only valid until OnEvent returns and
+        /// must not be kept.
+        /// </summary>
+        property bool ReuseEventRecords;
+
         /// <summary>
         /// An event that is invoked when an ETW event is fired in this
         /// provider.
@@ -147,7 +155,7 @@ namespace Microsoft { namespace O365 { namespace Security { namespace ETW {
             krabs::schema schema(record, trace_context.schema_locator);
             krabs::parser parser(schema);
 
-            OnEvent(gcnew EventRecord(record, schema, parser));
+            OnEvent(EventRecord::Create(record, schema, parser, ReuseEventRecords));
         }
         catch (const krabs::could_not_find_schema& ex)
         {
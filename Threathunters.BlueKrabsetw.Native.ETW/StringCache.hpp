@@ -0,0 +1,234 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <cwchar>
+#include <vcclr.h>
+#include <msclr/lock.h>
+
+using namespace System;
+using namespace System::Collections::Generic;
+using namespace System::Threading;
+
+namespace Microsoft { namespace O365 { namespace Security { namespace ETW {
+
+    /// <summary>
+    /// A bounded table of strings that hands out the same String instance
+    /// for values that keep repeating, like provider, task and image names,
+    /// instead of allocating a new one for every event.
+    /// </summary>
+    /// <remarks>
+    /// Strings are found by a hash of their UTF-16 characters in a fixed
+    /// number of slots, and a string that lands on a taken slot replaces the
+    /// one that was there. Names that come from an event schema are also
+    /// remembered by the address they live at, so a repeated schema does not
+    /// have to be hashed again. Lookups never take a lock, and the table is
+    /// shared by every trace in the process. Each thread counts its hits
+    /// and misses on its own, and the totals are added up when they are read.
+    /// </remarks>
+    public ref class StringCache abstract sealed
+    {
+    public:
+        /// <summary>
+        /// The number of lookups that returned a cached string.
+        /// </summary>
+        static property int64_t Hits
+        {
+            int64_t get() { return Total(true); }
+        }
+
+        /// <summary>
+        /// The number of lookups that had to allocate a string.
+        /// </summary>
+        static property int64_t Misses
+        {
+            int64_t get() { return Total(false); }
+        }
+
+        /// <summary>
+        /// The number of strings the table holds at most.
+        /// </summary>
+        static property int Capacity
+        {
+            int get() { return SlotCount; }
+        }
+
+        /// <summary>
+        /// Sets the hit and miss counts back to zero.
+        /// </summary>
+        static void ResetStatistics()
+        {
+            // The per-thread counts belong to their threads, so rather than
+            // writing to them the current totals become the new zero.
+            msclr::lock l(counters_);
+            hitsBase_ = 0;
+            missesBase_ = 0;
+            hitsBase_ = Total(true);
+            missesBase_ = Total(false);
+        }
+
+    internal:
+        /// <summary>
+        /// Returns a string with the given characters, from the table when
+        /// it holds one. Strings longer than MaxLength are never cached.
+        /// </summary>
+        static String^ Intern(const wchar_t* data, int length)
+        {
+            if (length > MaxLength)
+            {
+                ++Counters()->Misses;
+                return gcnew String(data, 0, length);
+            }
+
+            auto slot = static_cast<int>(Hash(data, length) & (SlotCount - 1));
+            auto cached = strings_[slot];
+
+            if (cached != nullptr && Matches(cached, data, length))
+            {
+                ++Counters()->Hits;
+                return cached;
+            }
+
+            ++Counters()->Misses;
+            auto str = gcnew String(data, 0, length);
+            strings_[slot] = str;
+            return str;
+        }
+
+        /// <summary>
+        /// Returns a string for a name that points into an event schema.
+        /// </summary>
+        static String^ InternSchemaName(const wchar_t* name)
+        {
+            if (name == nullptr)
+                return String::Empty;
+
+            // Schemas stay put while their trace runs, but the memory may be
+            // reused for another one later, so the characters are compared too.
+            auto key = reinterpret_cast<uintptr_t>(name);
+            auto slot = static_cast<int>((key >> 3) * 0x9E3779B1u & (SchemaSlotCount - 1));
+            auto entry = schemaNames_[slot];
+
+            if (entry != nullptr && entry->Key == IntPtr(const_cast<wchar_t*>(name)) && Matches(entry->Value, name))
+            {
+                ++Counters()->Hits;
+                return entry->Value;
+            }
+
+            auto str = Intern(name, static_cast<int>(wcslen(name)));
+            schemaNames_[slot] = gcnew SchemaName(name, str);
+            return str;
+        }
+
+    private:
+        literal int SlotCount = 4096;
+        literal int SchemaSlotCount = 1024;
+        literal int MaxLength = 256;
+
+        ref class SchemaName sealed
+        {
+        public:
+            SchemaName(const wchar_t* key, String^ value)
+                : Key(IntPtr(const_cast<wchar_t*>(key)))
+                , Value(value) { }
+
+            initonly IntPtr Key;
+            initonly String^ Value;
+        };
+
+        ref class ThreadCounters sealed
+        {
+        public:
+            int64_t Hits;
+            int64_t Misses;
+        };
+
+        static StringCache()
+        {
+            strings_ = gcnew array<String^>(SlotCount);
+            schemaNames_ = gcnew array<SchemaName^>(SchemaSlotCount);
+            counters_ = gcnew List<ThreadCounters^>();
+        }
+
+        static ThreadCounters^ Counters()
+        {
+            auto counters = threadCounters_;
+            if (counters == nullptr)
+            {
+                // Only the first lookup on a thread gets here. The counts of
+                // threads that have exited stay in the list so the totals
+                // do not go backwards.
+                counters = gcnew ThreadCounters();
+                msclr::lock l(counters_);
+                counters_->Add(counters);
+                threadCounters_ = counters;
+            }
+
+            return counters;
+        }
+
+        static int64_t Total(bool hits)
+        {
+            msclr::lock l(counters_);
+
+            int64_t total = 0;
+            for each (ThreadCounters^ counters in counters_)
+            {
+                total += hits
+                    ? Volatile::Read(counters->Hits)
+                    : Volatile::Read(counters->Misses);
+            }
+
+            return total - (hits ? hitsBase_ : missesBase_);
+        }
+
+        static uint32_t Hash(const wchar_t* data, int length)
+        {
+            // FNV-1a over the UTF-16 code units.
+            uint32_t hash = 2166136261u;
+            for (int i = 0; i < length; ++i)
+            {
+                hash ^= static_cast<uint32_t>(data[i]);
+                hash *= 16777619u;
+            }
+
+            return hash;
+        }
+
+        static bool Matches(String^ str, const wchar_t* data, int length)
+        {
+            if (str->Length != length)
+                return false;
+
+            pin_ptr<const wchar_t> chars = PtrToStringChars(str);
+            return wmemcmp(chars, data, length) == 0;
+        }
+
+        static bool Matches(String^ str, const wchar_t* data)
+        {
+            // data is only known to be terminated, so stop at the first
+            // character that differs rather than reading length characters.
+            int length = str->Length;
+
+            pin_ptr<const wchar_t> chars = PtrToStringChars(str);
+            for (int i = 0; i < length; ++i)
+            {
+                if (chars[i] != data[i])
+                    return false;
+            }
+
+            return data[length] == L'\0';
+        }
+
+        static array<String^>^ strings_;
+        static array<SchemaName^>^ schemaNames_;
+        static List<ThreadCounters^>^ counters_;
+        static int64_t hitsBase_;
+        static int64_t missesBase_;
+
+        [ThreadStatic]
+        static ThreadCounters^ threadCounters_;
+    };
+
+} } } }
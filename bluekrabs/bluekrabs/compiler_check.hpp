@@ -3,6 +3,12 @@
 
 #pragma once
 
-#if (_MSC_VER < 1900)
+#if defined(_MSC_VER) && (_MSC_VER < 1900)
 #error "krabsetw is only supported with Visual Studio 2015 and above (MSVC++ 14.0)"
 #endif
+
+// Parsing strings into std::wstring_view and std::string_view needs C++17,
+// MSVC only reports the language version in _MSVC_LANG.
+#if (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L) || __cplusplus >= 201703L
+#define KRABS_HAS_STRING_VIEW 1
+#endif
@@ -3,9 +3,12 @@
 
 #pragma once
 
+#include <sstream>
 #include <stdexcept>
+#include <string>
 
 #include "compiler_check.hpp"
+#include "guid.hpp"
 
 namespace krabs {
 
@@ -73,6 +76,20 @@ namespace krabs {
         {}
     };
 
+    class unsupported_worker_pool : public std::logic_error {
+    public:
+        unsupported_worker_pool()
+            : std::logic_error("Batch callbacks need a worker pool sharded by provider")
+        {}
+    };
+
+    class invalid_manifest : public std::runtime_error {
+    public:
+        invalid_manifest(const std::string &context)
+            : std::runtime_error(std::string("Invalid event manifest: ") + context)
+        {}
+    };
+
     class unexpected_error : public std::runtime_error {
     public:
         unexpected_error(ULONG status)
@@ -187,6 +187,13 @@ namespace krabs { namespace details {
          */
         void on_event(const EVENT_RECORD &record);
 
+        /**
+         * <summary>
+         * Notifies the underlying trace that ETW is done with a buffer.
+         * </summary>
+         */
+        void on_buffer_processed();
+
     private:
         trace_info fill_trace_update_info();
         trace_info fill_trace_info();
@@ -253,6 +260,7 @@ namespace krabs { namespace details {
 
         // NOTE: EventsLost is not set on this type
         trace.set_buffers_processed(pLogFile->BuffersRead);
+        trace.on_buffer_processed();
         return TRUE;
     }
 
@@ -401,6 +409,12 @@ namespace krabs { namespace details {
         trace_.on_event(record);
     }
 
+    template <typename T>
+    void trace_manager<T>::on_buffer_processed()
+    {
+        trace_.on_buffer_processed();
+    }
+
     template <typename T>
     trace_info trace_manager<T>::fill_trace_info()
     {
@@ -692,7 +706,11 @@ namespace krabs { namespace details {
         // before ProcessTrace() in order for the rundown events to be generated.
         T::trace_type::enable_rundown(trace_);
 
+        // Workers run the callbacks while ProcessTrace copies events to them
+        // and finish whatever is queued once it returns.
+        trace_.start_workers();
         ULONG status = ProcessTrace(&trace_.sessionHandle_, 1, trace_.start_time_, trace_.end_time_);
+        trace_.stop_workers();
         error_check_common_conditions(status);
     }
 
@@ -0,0 +1,226 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntcons.h>
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "compiler_check.hpp"
+#include "owned_record.hpp"
+#include "trace_context.hpp"
+
+namespace krabs { namespace details {
+    class event_batch;
+} /* namespace details */ } /* namespace krabs */
+
+namespace krabs {
+
+    /**
+     * <summary>
+     *   A copy of an event made for batch delivery. The record, its user
+     *   data and its extended data items live in the arena of the batch the
+     *   event belongs to.
+     * </summary>
+     * <remarks>
+     *   The record can be handed to krabs::schema and krabs::parser like
+     *   the one ETW delivers, but only while the batch callback runs.
+     * </remarks>
+     */
+    class event_view {
+    public:
+
+        /**
+         * <summary>Returns the copied record.</summary>
+         */
+        const EVENT_RECORD &record() const;
+
+    private:
+        const EVENT_RECORD *record_;
+
+        friend class details::event_batch;
+    };
+
+    /**
+     * <summary>
+     *   A contiguous run of events handed to a batch callback.
+     * </summary>
+     */
+    class event_span {
+    public:
+        event_span(const event_view *first, size_t size);
+
+        const event_view *begin() const;
+        const event_view *end() const;
+        size_t size() const;
+        bool empty() const;
+        const event_view &operator[](size_t index) const;
+
+    private:
+        const event_view *first_;
+        size_t size_;
+    };
+
+    typedef void(*c_provider_batch_callback)(const event_span &, const krabs::trace_context &);
+    typedef std::function<void(const event_span &, const krabs::trace_context &)> provider_batch_callback;
+
+    namespace details {
+
+        /**
+         * <summary>
+         *   Collects copies of the events of a provider so they can be
+         *   delivered together, once per ETW buffer or every few events.
+         * </summary>
+         * <remarks>
+         *   Each event is copied with details::copy_record, like an
+         *   owned_record, into chunks of memory that never move and are kept
+         *   from batch to batch, so a steady stream of events does not
+         *   allocate. The batch is only touched by the thread that processes
+         *   the trace.
+         * </remarks>
+         */
+        class event_batch {
+        public:
+            event_batch();
+
+            /**
+             * <summary>Copies an event into the batch.</summary>
+             */
+            void add(const EVENT_RECORD &record);
+
+            /**
+             * <summary>
+             *   Returns the number of events in the batch.
+             * </summary>
+             */
+            size_t size() const;
+
+            /**
+             * <summary>
+             *   Returns the copied records. The span is valid until the batch
+             *   is cleared or added to.
+             * </summary>
+             */
+            event_span seal();
+
+            /**
+             * <summary>
+             *   Drops the events but keeps the storage for the next batch.
+             * </summary>
+             */
+            void clear();
+
+        private:
+            BYTE *reserve(size_t size);
+
+            std::vector<std::vector<BYTE>> chunks_;
+            size_t chunk_;
+            size_t used_;
+            size_t capacity_;
+            std::vector<event_view> views_;
+        };
+
+    } /* namespace details */
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline const EVENT_RECORD &event_view::record() const
+    {
+        return *record_;
+    }
+
+    inline event_span::event_span(const event_view *first, size_t size)
+        : first_(first)
+        , size_(size)
+    {}
+
+    inline const event_view *event_span::begin() const
+    {
+        return first_;
+    }
+
+    inline const event_view *event_span::end() const
+    {
+        return first_ + size_;
+    }
+
+    inline size_t event_span::size() const
+    {
+        return size_;
+    }
+
+    inline bool event_span::empty() const
+    {
+        return size_ == 0;
+    }
+
+    inline const event_view &event_span::operator[](size_t index) const
+    {
+        return first_[index];
+    }
+
+    namespace details {
+
+        inline event_batch::event_batch()
+            : chunk_(0)
+            , used_(0)
+            , capacity_(0)
+        {}
+
+        inline void event_batch::add(const EVENT_RECORD &record)
+        {
+            event_view view;
+            view.record_ = copy_record(record, reserve(copied_record_size(record)));
+            views_.push_back(view);
+        }
+
+        inline size_t event_batch::size() const
+        {
+            return views_.size();
+        }
+
+        inline event_span event_batch::seal()
+        {
+            return event_span(views_.data(), views_.size());
+        }
+
+        inline void event_batch::clear()
+        {
+            views_.clear();
+            chunk_ = 0;
+            used_ = 0;
+        }
+
+        inline BYTE *event_batch::reserve(size_t size)
+        {
+            for (; chunk_ < chunks_.size(); ++chunk_, used_ = 0) {
+                auto &chunk = chunks_[chunk_];
+                if (chunk.size() - used_ >= size) {
+                    auto destination = chunk.data() + used_;
+                    used_ += size;
+                    return destination;
+                }
+            }
+
+            // Each new chunk is at least as large as all the others, so a
+            // batch settles on a few chunks. The sizes copy_record asks for
+            // are multiples of 8, which keeps every copy 8 byte aligned.
+            auto capacity = (std::max)(size, capacity_);
+            chunks_.emplace_back(capacity);
+            capacity_ += capacity;
+            chunk_ = chunks_.size() - 1;
+            used_ = size;
+            return chunks_.back().data();
+        }
+
+    } /* namespace details */
+}
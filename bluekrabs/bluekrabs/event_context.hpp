@@ -0,0 +1,173 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "compiler_check.hpp"
+#include "parser.hpp"
+#include "schema.hpp"
+#include "trace_context.hpp"
+
+namespace krabs {
+
+    /**
+     * <summary>
+     *   Everything known about a single event while it is being filtered
+     *   and handed to callbacks. The schema and parser are created the
+     *   first time they are asked for and then shared, so a tree of
+     *   property predicates followed by a callback resolves the schema and
+     *   walks the event's properties at most once.
+     * </summary>
+     * <example>
+     *   krabs::event_filter filter(
+     *       krabs::predicates::property_is(L"ClassName", std::wstring(L"Foo")));
+     *
+     *   filter.add_on_event_callback([](krabs::event_context &context) {
+     *       auto message = context.parser().parse<std::wstring>(L"Message");
+     *   });
+     * </example>
+     * <remarks>
+     *   An event_context lives on the stack of the thread processing the
+     *   event and must not outlive the record it was created for.
+     * </remarks>
+     */
+    class event_context {
+    public:
+        event_context(const EVENT_RECORD &record, const krabs::trace_context &trace_context);
+        ~event_context();
+
+        event_context(const event_context &) = delete;
+        event_context &operator=(const event_context &) = delete;
+
+        /**
+         * <summary>Returns the event being processed.</summary>
+         */
+        const EVENT_RECORD &record() const;
+
+        /**
+         * <summary>Returns the context of the trace the event came from.</summary>
+         */
+        const krabs::trace_context &trace_context() const;
+
+        /**
+         * <summary>
+         *   Returns the schema of the event, looking it up on first use.
+         *   Throws could_not_find_schema if the event has no schema.
+         * </summary>
+         */
+        const krabs::schema &schema();
+
+        /**
+         * <summary>
+         *   Returns a parser over the event, shared by everyone that reads
+         *   properties from this event.
+         * </summary>
+         */
+        krabs::parser &parser();
+
+    private:
+        const EVENT_RECORD &record_;
+        const krabs::trace_context &traceContext_;
+
+        typename std::aligned_storage<sizeof(krabs::schema), alignof(krabs::schema)>::type schemaStorage_;
+        typename std::aligned_storage<sizeof(krabs::parser), alignof(krabs::parser)>::type parserStorage_;
+        krabs::schema *pSchema_;
+        krabs::parser *pParser_;
+    };
+
+    namespace details {
+
+        template <int N> struct evaluation_rank : evaluation_rank<N - 1> {};
+        template <> struct evaluation_rank<0> {};
+
+        // Predicates that know how to use an event_context (everything in
+        // krabs::predicates) are handed the context itself.
+        template <typename T>
+        auto evaluate_predicate(const T &predicate, event_context &context, evaluation_rank<2>)
+            -> decltype(predicate.evaluate(context))
+        {
+            return predicate.evaluate(context);
+        }
+
+        template <typename T>
+        auto evaluate_predicate(const T &predicate, event_context &context, evaluation_rank<1>)
+            -> decltype(predicate(context))
+        {
+            return predicate(context);
+        }
+
+        // Anything else is a plain (record, trace_context) predicate.
+        template <typename T>
+        auto evaluate_predicate(const T &predicate, event_context &context, evaluation_rank<0>)
+            -> decltype(predicate(context.record(), context.trace_context()))
+        {
+            return predicate(context.record(), context.trace_context());
+        }
+
+        /**
+         * <summary>
+         *   Evaluates any kind of filter predicate against an event_context.
+         * </summary>
+         */
+        template <typename T>
+        auto evaluate_predicate(const T &predicate, event_context &context)
+            -> decltype(evaluate_predicate(predicate, context, evaluation_rank<2>()))
+        {
+            return evaluate_predicate(predicate, context, evaluation_rank<2>());
+        }
+
+    } /* namespace details */
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline event_context::event_context(const EVENT_RECORD &record, const krabs::trace_context &trace_context)
+        : record_(record)
+        , traceContext_(trace_context)
+        , pSchema_(nullptr)
+        , pParser_(nullptr)
+    {}
+
+    inline event_context::~event_context()
+    {
+        if (pParser_ != nullptr) {
+            pParser_->~parser();
+        }
+
+        if (pSchema_ != nullptr) {
+            pSchema_->~schema();
+        }
+    }
+
+    inline const EVENT_RECORD &event_context::record() const
+    {
+        return record_;
+    }
+
+    inline const krabs::trace_context &event_context::trace_context() const
+    {
+        return traceContext_;
+    }
+
+    inline const krabs::schema &event_context::schema()
+    {
+        if (pSchema_ == nullptr) {
+            pSchema_ = new (&schemaStorage_) krabs::schema(record_, traceContext_.schema_locator);
+        }
+
+        return *pSchema_;
+    }
+
+    inline krabs::parser &event_context::parser()
+    {
+        if (pParser_ == nullptr) {
+            pParser_ = new (&parserStorage_) krabs::parser(schema());
+        }
+
+        return *pParser_;
+    }
+}
@@ -0,0 +1,716 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntcons.h>
+
+#include <cstdint>
+
+#if !defined(_M_CEE)
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#endif
+
+#include "compiler_check.hpp"
+#include "errors.hpp"
+#include "event_batch.hpp"
+
+namespace krabs {
+
+    /**
+     * <summary>
+     *   Decides which worker of a trace's worker pool gets an event. Events
+     *   that go to the same worker are delivered in the order ETW gave them.
+     * </summary>
+     */
+    enum class worker_sharding {
+        // All the events of a provider go to the same worker.
+        by_provider,
+
+        // All the events of a process go to the same worker. Callbacks of
+        // one provider may then run on several workers at once.
+        by_process,
+    };
+
+    /**
+     * <summary>
+     *   What the thread that processes the trace does when the queue of a
+     *   worker is full.
+     * </summary>
+     */
+    enum class backpressure_policy {
+        // Wait for the worker to make room. ETW buffers back up meanwhile.
+        block,
+
+        // Drop the incoming event.
+        drop_newest,
+
+        // Drop the oldest event the worker has not started on yet. The
+        // incoming event is dropped instead when that event is the one the
+        // worker is busy with.
+        drop_oldest,
+    };
+
+    /**
+     * <summary>
+     *   Configures the workers that run provider callbacks away from the
+     *   thread that processes the trace.
+     * </summary>
+     */
+    struct worker_pool_options {
+        size_t worker_count = 2;
+
+        // Number of events each worker can have queued, rounded up to a
+        // power of two.
+        size_t queue_capacity = 4096;
+
+        worker_sharding sharding = worker_sharding::by_provider;
+        backpressure_policy backpressure = backpressure_policy::block;
+    };
+
+    namespace details {
+
+        /**
+         * <summary>
+         *   Counters of a trace's worker pool, all zero without one.
+         * </summary>
+         */
+        struct pipeline_stats {
+            // Events that were queued for a worker and not dropped later.
+            uint64_t events_queued;
+
+            // Events dropped because the queue of their worker was full.
+            uint64_t events_dropped;
+
+            // Events the trace thread had to wait to queue.
+            uint64_t events_blocked;
+        };
+
+#if !defined(_M_CEE)
+
+        /**
+         * <summary>
+         *   A bounded queue between one producer and one consumer. Slots are
+         *   filled and drained in place so that their storage is reused.
+         * </summary>
+         * <remarks>
+         *   Every slot carries a sequence number that says whether it is free
+         *   for the producer or full for the consumer in the current lap of
+         *   the ring. The consumer claims a slot by advancing the tail, which
+         *   lets the producer discard the oldest slot the consumer has not
+         *   claimed yet by advancing the tail itself.
+         * </remarks>
+         */
+        template <typename T>
+        class spsc_ring {
+        public:
+            explicit spsc_ring(size_t capacity);
+
+            spsc_ring(const spsc_ring &) = delete;
+            spsc_ring &operator=(const spsc_ring &) = delete;
+
+            /**
+             * <summary>Returns the number of slots in the ring.</summary>
+             */
+            size_t capacity() const;
+
+            /**
+             * <summary>
+             *   Returns whether the ring holds no events, as last published.
+             * </summary>
+             */
+            bool empty() const;
+
+            /**
+             * <summary>
+             *   Producer: returns the next free slot or nullptr when the ring
+             *   is full. The slot is handed to the consumer by publish().
+             * </summary>
+             */
+            T *try_reserve();
+
+            /**
+             * <summary>Producer: publishes the reserved slot.</summary>
+             */
+            void publish();
+
+            /**
+             * <summary>
+             *   Producer: frees the oldest slot of a full ring and returns what
+             *   it held, until the next try_reserve(). Returns nullptr when the
+             *   ring is not full or the consumer holds that slot.
+             * </summary>
+             */
+            T *drop_oldest();
+
+            /**
+             * <summary>
+             *   Consumer: claims the oldest full slot or returns nullptr when
+             *   the ring is empty. The slot is handed back by release().
+             * </summary>
+             */
+            T *try_acquire();
+
+            /**
+             * <summary>Consumer: frees the claimed slot.</summary>
+             */
+            void release();
+
+        private:
+            struct slot {
+                std::atomic<uint64_t> sequence;
+                T value;
+            };
+
+            std::unique_ptr<slot[]> slots_;
+            uint64_t capacity_;
+            uint64_t mask_;
+
+            // The producer and the consumer positions are kept a cache line
+            // apart so that they do not bounce between the two threads.
+            std::atomic<uint64_t> head_;
+            char headPadding_[64];
+            std::atomic<uint64_t> tail_;
+            char tailPadding_[64];
+            uint64_t acquired_;
+        };
+
+        /**
+         * <summary>
+         *   Copies the events of a trace into per worker queues and runs the
+         *   provider callbacks on the workers, so that slow callbacks do not
+         *   hold up the thread that processes the trace.
+         * </summary>
+         * <remarks>
+         *   The provider of an event is found on the processing thread and
+         *   travels with the copy. Batched events are delivered by a worker
+         *   when it reaches the end of the ETW buffer they came in.
+         * </remarks>
+         */
+        template <typename Provider>
+        class event_pipeline {
+        public:
+            typedef std::function<void(const Provider *, const EVENT_RECORD &)> event_handler;
+            typedef std::function<void(const Provider &)> flush_handler;
+
+            /**
+             * <summary>
+             *   Creates the queues. The handlers are called on the workers,
+             *   the event handler with a null provider for events that no
+             *   provider was enabled for.
+             * </summary>
+             */
+            event_pipeline(
+                const worker_pool_options &options,
+                event_handler on_event,
+                flush_handler on_flush);
+
+            event_pipeline(const event_pipeline &) = delete;
+            event_pipeline &operator=(const event_pipeline &) = delete;
+
+            ~event_pipeline();
+
+            const worker_pool_options &options() const;
+
+            /**
+             * <summary>Returns whether the worker threads are running.</summary>
+             */
+            bool running() const;
+
+            /**
+             * <summary>Starts the worker threads.</summary>
+             */
+            void start();
+
+            /**
+             * <summary>
+             *   Lets the workers finish their queues and waits for them.
+             *   Rethrows the first exception a callback threw, if any.
+             * </summary>
+             */
+            void stop();
+
+            /**
+             * <summary>
+             *   Copies an event into the queue of the worker it belongs to.
+             * </summary>
+             */
+            void push(const EVENT_RECORD &record, const Provider *provider);
+
+            /**
+             * <summary>
+             *   Tells every worker that ETW is done with a buffer.
+             * </summary>
+             */
+            void end_buffer();
+
+            pipeline_stats stats() const;
+
+        private:
+            struct item {
+                event_batch copy;
+                const Provider *provider = nullptr;
+                bool end_of_buffer = false;
+            };
+
+            struct worker {
+                explicit worker(size_t capacity);
+
+                spsc_ring<item> ring;
+                std::thread thread;
+                std::mutex mutex;
+                std::condition_variable wake;
+                std::atomic<bool> sleeping;
+
+                // The event being delivered. It is swapped out of the ring so
+                // that the slot is free again while the callbacks run.
+                item current;
+
+                // Providers this worker delivered events to since the last
+                // end of buffer, whose batches it has to flush.
+                std::vector<const Provider *> pending;
+            };
+
+            item *reserve(worker &w);
+            void publish(worker &w);
+            void run(worker &w);
+            bool wait(worker &w);
+            void flush_pending(worker &w);
+            void record_error();
+            size_t shard_of(const EVENT_RECORD &record, const Provider *provider) const;
+
+            worker_pool_options options_;
+            event_handler onEvent_;
+            flush_handler onFlush_;
+            std::vector<std::unique_ptr<worker>> workers_;
+            std::atomic<bool> stopping_;
+            bool running_;
+
+            // Only written by the processing thread, read by query_stats.
+            std::atomic<uint64_t> queued_;
+            std::atomic<uint64_t> dropped_;
+            std::atomic<uint64_t> blocked_;
+
+            std::mutex errorMutex_;
+            std::exception_ptr error_;
+        };
+
+#endif
+
+    } /* namespace details */
+
+#if !defined(_M_CEE)
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    namespace details {
+
+        template <typename T>
+        spsc_ring<T>::spsc_ring(size_t capacity)
+            : capacity_(1)
+            , head_(0)
+            , tail_(0)
+            , acquired_(0)
+        {
+            if (capacity == 0) {
+                throw krabs::invalid_parameter();
+            }
+
+            while (capacity_ < capacity) {
+                capacity_ <<= 1;
+            }
+
+            mask_ = capacity_ - 1;
+            slots_.reset(new slot[static_cast<size_t>(capacity_)]);
+            for (uint64_t i = 0; i < capacity_; ++i) {
+                slots_[static_cast<size_t>(i)].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        template <typename T>
+        size_t spsc_ring<T>::capacity() const
+        {
+            return static_cast<size_t>(capacity_);
+        }
+
+        template <typename T>
+        bool spsc_ring<T>::empty() const
+        {
+            return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+        }
+
+        template <typename T>
+        T *spsc_ring<T>::try_reserve()
+        {
+            auto head = head_.load(std::memory_order_relaxed);
+            auto &s = slots_[static_cast<size_t>(head & mask_)];
+            if (s.sequence.load(std::memory_order_acquire) != head) {
+                return nullptr;
+            }
+
+            return &s.value;
+        }
+
+        template <typename T>
+        void spsc_ring<T>::publish()
+        {
+            auto head = head_.load(std::memory_order_relaxed);
+            slots_[static_cast<size_t>(head & mask_)].sequence.store(head + 1, std::memory_order_release);
+            head_.store(head + 1, std::memory_order_release);
+        }
+
+        template <typename T>
+        T *spsc_ring<T>::drop_oldest()
+        {
+            auto tail = tail_.load(std::memory_order_acquire);
+            if (tail + capacity_ != head_.load(std::memory_order_relaxed)) {
+                return nullptr;
+            }
+
+            if (!tail_.compare_exchange_strong(tail, tail + 1, std::memory_order_acq_rel)) {
+                return nullptr;
+            }
+
+            // The slot is free again, but only the producer can reuse it.
+            auto &s = slots_[static_cast<size_t>(tail & mask_)];
+            s.sequence.store(tail + capacity_, std::memory_order_release);
+            return &s.value;
+        }
+
+        template <typename T>
+        T *spsc_ring<T>::try_acquire()
+        {
+            for (;;) {
+                auto tail = tail_.load(std::memory_order_acquire);
+                auto &s = slots_[static_cast<size_t>(tail & mask_)];
+                if (s.sequence.load(std::memory_order_acquire) != tail + 1) {
+                    return nullptr;
+                }
+
+                // Fails when the producer dropped the slot in the meantime.
+                if (tail_.compare_exchange_strong(tail, tail + 1, std::memory_order_acq_rel)) {
+                    acquired_ = tail;
+                    return &s.value;
+                }
+            }
+        }
+
+        template <typename T>
+        void spsc_ring<T>::release()
+        {
+            slots_[static_cast<size_t>(acquired_ & mask_)].sequence.store(
+                acquired_ + capacity_, std::memory_order_release);
+        }
+
+        // ------------------------------------------------------------------------
+
+        template <typename Provider>
+        event_pipeline<Provider>::worker::worker(size_t capacity)
+            : ring(capacity)
+            , sleeping(false)
+        {}
+
+        template <typename Provider>
+        event_pipeline<Provider>::event_pipeline(
+            const worker_pool_options &options,
+            event_handler on_event,
+            flush_handler on_flush)
+            : options_(options)
+            , onEvent_(std::move(on_event))
+            , onFlush_(std::move(on_flush))
+            , stopping_(false)
+            , running_(false)
+            , queued_(0)
+            , dropped_(0)
+            , blocked_(0)
+        {
+            if (options.worker_count == 0) {
+                throw krabs::invalid_parameter();
+            }
+
+            for (size_t i = 0; i < options.worker_count; ++i) {
+                workers_.emplace_back(new worker(options.queue_capacity));
+            }
+        }
+
+        template <typename Provider>
+        event_pipeline<Provider>::~event_pipeline()
+        {
+            try {
+                stop();
+            }
+            catch (...) {
+                // Nobody is left to report a callback failure to.
+            }
+        }
+
+        template <typename Provider>
+        const worker_pool_options &event_pipeline<Provider>::options() const
+        {
+            return options_;
+        }
+
+        template <typename Provider>
+        bool event_pipeline<Provider>::running() const
+        {
+            return running_;
+        }
+
+        template <typename Provider>
+        void event_pipeline<Provider>::start()
+        {
+            if (running_) {
+                return;
+            }
+
+            stopping_.store(false);
+            for (auto &w : workers_) {
+                auto &current = *w;
+                current.thread = std::thread([this, &current] { run(current); });
+            }
+
+            running_ = true;
+        }
+
+        template <typename Provider>
+        void event_pipeline<Provider>::stop()
+        {
+            if (running_) {
+                stopping_.store(true);
+                for (auto &w : workers_) {
+                    {
+                        std::lock_guard<std::mutex> lock(w->mutex);
+                        w->wake.notify_one();
+                    }
+                    w->thread.join();
+                }
+
+                running_ = false;
+            }
+
+            std::exception_ptr error;
+            {
+                std::lock_guard<std::mutex> lock(errorMutex_);
+                std::swap(error, error_);
+            }
+
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+
+        template <typename Provider>
+        void event_pipeline<Provider>::push(const EVENT_RECORD &record, const Provider *provider)
+        {
+            auto &w = *workers_[shard_of(record, provider)];
+
+            auto slot = reserve(w);
+            if (slot == nullptr) {
+                dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return;
+            }
+
+            slot->copy.clear();
+            slot->copy.add(record);
+            slot->provider = provider;
+            slot->end_of_buffer = false;
+
+            publish(w);
+            queued_.store(queued_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        template <typename Provider>
+        void event_pipeline<Provider>::end_buffer()
+        {
+            for (auto &w : workers_) {
+                // A marker that does not fit is not needed, the next one
+                // flushes the same batches.
+                auto slot = w->ring.try_reserve();
+                if (slot == nullptr) {
+                    continue;
+                }
+
+                slot->copy.clear();
+                slot->provider = nullptr;
+                slot->end_of_buffer = true;
+                publish(*w);
+            }
+        }
+
+        template <typename Provider>
+        pipeline_stats event_pipeline<Provider>::stats() const
+        {
+            pipeline_stats stats;
+            stats.events_queued = queued_.load(std::memory_order_relaxed);
+            stats.events_dropped = dropped_.load(std::memory_order_relaxed);
+            stats.events_blocked = blocked_.load(std::memory_order_relaxed);
+            return stats;
+        }
+
+        template <typename Provider>
+        typename event_pipeline<Provider>::item *event_pipeline<Provider>::reserve(worker &w)
+        {
+            auto slot = w.ring.try_reserve();
+            if (slot != nullptr) {
+                return slot;
+            }
+
+            switch (options_.backpressure) {
+            case backpressure_policy::drop_newest:
+                return nullptr;
+
+            case backpressure_policy::drop_oldest:
+                // The worker only holds a slot for as long as it takes to
+                // swap the event out, so this does not wait for callbacks.
+                while ((slot = w.ring.try_reserve()) == nullptr) {
+                    auto oldest = w.ring.drop_oldest();
+                    if (oldest == nullptr) {
+                        std::this_thread::yield();
+                    }
+                    else if (!oldest->end_of_buffer) {
+                        queued_.store(queued_.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+                        dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                    }
+                }
+                return slot;
+
+            case backpressure_policy::block:
+            default:
+                blocked_.store(blocked_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                while ((slot = w.ring.try_reserve()) == nullptr) {
+                    std::this_thread::yield();
+                }
+                return slot;
+            }
+        }
+
+        template <typename Provider>
+        void event_pipeline<Provider>::publish(worker &w)
+        {
+            w.ring.publish();
+
+            // Pairs with the fence in wait(): either the worker sees the
+            // event or this thread sees that the worker is going to sleep.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (w.sleeping.load(std::memory_order_relaxed)) {
+                std::lock_guard<std::mutex> lock(w.mutex);
+                w.wake.notify_one();
+            }
+        }
+
+        template <typename Provider>
+        void event_pipeline<Provider>::run(worker &w)
+        {
+            for (;;) {
+                auto slot = w.ring.try_acquire();
+                if (slot == nullptr) {
+                    if (!wait(w)) {
+                        break;
+                    }
+                    continue;
+                }
+
+                std::swap(*slot, w.current);
+                w.ring.release();
+
+                auto &current = w.current;
+                try {
+                    if (current.end_of_buffer) {
+                        flush_pending(w);
+                    }
+                    else {
+                        auto provider = current.provider;
+                        if (provider != nullptr &&
+                            (w.pending.empty() || w.pending.back() != provider) &&
+                            std::find(w.pending.begin(), w.pending.end(), provider) == w.pending.end()) {
+                            w.pending.push_back(provider);
+                        }
+
+                        onEvent_(provider, current.copy.seal()[0].record());
+                    }
+                }
+                catch (...) {
+                    record_error();
+                }
+            }
+
+            try {
+                flush_pending(w);
+            }
+            catch (...) {
+                record_error();
+            }
+        }
+
+        template <typename Provider>
+        bool event_pipeline<Provider>::wait(worker &w)
+        {
+            std::unique_lock<std::mutex> lock(w.mutex);
+            w.sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            while (w.ring.empty()) {
+                if (stopping_.load()) {
+                    w.sleeping.store(false, std::memory_order_relaxed);
+                    return false;
+                }
+
+                w.wake.wait(lock);
+            }
+
+            w.sleeping.store(false, std::memory_order_relaxed);
+            return true;
+        }
+
+        template <typename Provider>
+        void event_pipeline<Provider>::flush_pending(worker &w)
+        {
+            for (auto provider : w.pending) {
+                onFlush_(*provider);
+            }
+
+            w.pending.clear();
+        }
+
+        template <typename Provider>
+        void event_pipeline<Provider>::record_error()
+        {
+            std::lock_guard<std::mutex> lock(errorMutex_);
+            if (!error_) {
+                error_ = std::current_exception();
+            }
+        }
+
+        template <typename Provider>
+        size_t event_pipeline<Provider>::shard_of(const EVENT_RECORD &record, const Provider *provider) const
+        {
+            if (workers_.size() == 1) {
+                return 0;
+            }
+
+            if (options_.sharding == worker_sharding::by_process) {
+                return record.EventHeader.ProcessId % workers_.size();
+            }
+
+            return std::hash<const Provider *>()(provider) % workers_.size();
+        }
+
+    } /* namespace details */
+
+#endif
+
+}
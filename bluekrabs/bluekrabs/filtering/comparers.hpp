@@ -4,8 +4,116 @@
 #pragma once
 
 #include <algorithm>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <vector>
 
 #include "../compiler_check.hpp"
+#include "../string_kernels.hpp"
+
+namespace krabs { namespace predicates {
+
+    namespace comparers {
+
+        template <typename T>
+        struct iequal_to;
+
+    } /* namespace comparers */
+
+} /* namespace predicates */ } /* namespace krabs */
+
+namespace krabs { namespace details {
+
+    /**
+     * <summary>
+     *   Whether a character comparison has a string kernel, and for
+     *   which character type.
+     * </summary>
+     */
+    template <typename Comparer>
+    struct kernel_comparer : std::false_type {};
+
+    template <> struct kernel_comparer<std::equal_to<char>> : std::true_type { typedef char char_type; };
+    template <> struct kernel_comparer<std::equal_to<wchar_t>> : std::true_type { typedef wchar_t char_type; };
+    template <> struct kernel_comparer<krabs::predicates::comparers::iequal_to<char>> : std::true_type { typedef char char_type; };
+    template <> struct kernel_comparer<krabs::predicates::comparers::iequal_to<wchar_t>> : std::true_type { typedef wchar_t char_type; };
+
+    /**
+     * <summary>
+     *   Whether an iterator walks characters that are stored back to
+     *   back, so the range can be handed to the string kernels as a
+     *   pointer and a length.
+     * </summary>
+     */
+    template <typename Iter, typename T>
+    struct is_contiguous_iterator : std::integral_constant<bool,
+        std::is_same<Iter, const T*>::value ||
+        std::is_same<Iter, T*>::value ||
+        std::is_same<Iter, typename std::basic_string<T>::const_iterator>::value ||
+        std::is_same<Iter, typename std::basic_string<T>::iterator>::value ||
+        std::is_same<Iter, typename std::vector<T>::const_iterator>::value ||
+        std::is_same<Iter, typename std::vector<T>::iterator>::value> {};
+
+    template <typename Comparer, typename Iter1, typename Iter2, bool = kernel_comparer<Comparer>::value>
+    struct use_string_kernels : std::false_type {};
+
+    template <typename Comparer, typename Iter1, typename Iter2>
+    struct use_string_kernels<Comparer, Iter1, Iter2, true> : std::integral_constant<bool,
+        is_contiguous_iterator<Iter1, typename kernel_comparer<Comparer>::char_type>::value &&
+        is_contiguous_iterator<Iter2, typename kernel_comparer<Comparer>::char_type>::value> {};
+
+    // Never dereferences the end of a range, checked iterators
+    // would assert.
+    template <typename Iter>
+    const typename std::iterator_traits<Iter>::value_type *to_pointer(Iter first, Iter last)
+    {
+        return first == last ? nullptr : &*first;
+    }
+
+    template <typename Iter>
+    size_t to_length(Iter first, Iter last)
+    {
+        return static_cast<size_t>(last - first);
+    }
+
+    template <typename T>
+    bool kernel_equal(const T *first, const T *second, size_t length, std::equal_to<T>)
+    {
+        return krabs::details::string_kernels::equal(first, second, length);
+    }
+
+    template <typename T>
+    bool kernel_equal(
+        const T *first,
+        const T *second,
+        size_t length,
+        krabs::predicates::comparers::iequal_to<T> equal)
+    {
+        return krabs::details::string_kernels::iequal(first, second, length, equal);
+    }
+
+    template <typename T>
+    bool kernel_contains(const T *haystack, size_t length, const T *needle, size_t count, std::equal_to<T>)
+    {
+        return krabs::details::string_kernels::find(haystack, length, needle, count)
+            != krabs::details::string_kernels::npos;
+    }
+
+    template <typename T>
+    bool kernel_contains(
+        const T *haystack,
+        size_t length,
+        const T *needle,
+        size_t count,
+        krabs::predicates::comparers::iequal_to<T> equal)
+    {
+        return krabs::details::string_kernels::ifind(haystack, length, needle, count, equal)
+            != krabs::details::string_kernels::npos;
+    }
+
+} /* namespace details */ } /* namespace krabs */
 
 namespace krabs { namespace predicates {
 
@@ -15,20 +123,41 @@ namespace krabs { namespace predicates {
         // --------------------------------------------------------------------
 
         /**
-         * Iterator based equals
+         * Iterator based equals. Contiguous char and wchar_t ranges compared
+         * with std::equal_to or iequal_to go through the string kernels.
          */
         template <typename Comparer>
         struct equals
         {
             template <typename Iter1, typename Iter2>
             bool operator()(Iter1 first1, Iter1 last1, Iter2 first2, Iter2 last2) const
+            {
+                return apply(first1, last1, first2, last2,
+                    krabs::details::use_string_kernels<Comparer, Iter1, Iter2>());
+            }
+
+        private:
+            template <typename Iter1, typename Iter2>
+            bool apply(Iter1 first1, Iter1 last1, Iter2 first2, Iter2 last2, std::false_type) const
             {
                 return std::equal(first1, last1, first2, last2, Comparer());
             }
+
+            template <typename Iter1, typename Iter2>
+            bool apply(Iter1 first1, Iter1 last1, Iter2 first2, Iter2 last2, std::true_type) const
+            {
+                const auto length = krabs::details::to_length(first1, last1);
+                return length == krabs::details::to_length(first2, last2)
+                    && krabs::details::kernel_equal(
+                        krabs::details::to_pointer(first1, last1),
+                        krabs::details::to_pointer(first2, last2),
+                        length,
+                        Comparer());
+            }
         };
 
         /**
-         * Iterator based search
+         * Iterator based search, with the same string kernel fast path as equals
          */
         template <typename Comparer>
         struct contains
@@ -38,7 +167,26 @@ namespace krabs { namespace predicates {
             {
                 // empty test range always contained, even when input range empty
                 return first2 == last2
-                    || std::search(first1, last1, first2, last2, Comparer()) != last1;
+                    || apply(first1, last1, first2, last2,
+                        krabs::details::use_string_kernels<Comparer, Iter1, Iter2>());
+            }
+
+        private:
+            template <typename Iter1, typename Iter2>
+            bool apply(Iter1 first1, Iter1 last1, Iter2 first2, Iter2 last2, std::false_type) const
+            {
+                return std::search(first1, last1, first2, last2, Comparer()) != last1;
+            }
+
+            template <typename Iter1, typename Iter2>
+            bool apply(Iter1 first1, Iter1 last1, Iter2 first2, Iter2 last2, std::true_type) const
+            {
+                return krabs::details::kernel_contains(
+                    krabs::details::to_pointer(first1, last1),
+                    krabs::details::to_length(first1, last1),
+                    krabs::details::to_pointer(first2, last2),
+                    krabs::details::to_length(first2, last2),
+                    Comparer());
             }
         };
 
@@ -50,10 +198,30 @@ namespace krabs { namespace predicates {
         {
             template <typename Iter1, typename Iter2>
             bool operator()(Iter1 first1, Iter1 last1, Iter2 first2, Iter2 last2) const
+            {
+                return apply(first1, last1, first2, last2,
+                    krabs::details::use_string_kernels<Comparer, Iter1, Iter2>());
+            }
+
+        private:
+            template <typename Iter1, typename Iter2>
+            bool apply(Iter1 first1, Iter1 last1, Iter2 first2, Iter2 last2, std::false_type) const
             {
                 const auto first_nonequal = std::mismatch(first1, last1, first2, last2, Comparer());
                 return first_nonequal.second == last2;
             }
+
+            template <typename Iter1, typename Iter2>
+            bool apply(Iter1 first1, Iter1 last1, Iter2 first2, Iter2 last2, std::true_type) const
+            {
+                const auto length = krabs::details::to_length(first2, last2);
+                return length <= krabs::details::to_length(first1, last1)
+                    && krabs::details::kernel_equal(
+                        krabs::details::to_pointer(first1, last1),
+                        krabs::details::to_pointer(first2, last2),
+                        length,
+                        Comparer());
+            }
         };
 
         /**
@@ -64,6 +232,14 @@ namespace krabs { namespace predicates {
         {
             template <typename Iter1, typename Iter2>
             bool operator()(Iter1 first1, Iter1 last1, Iter2 first2, Iter2 last2) const
+            {
+                return apply(first1, last1, first2, last2,
+                    krabs::details::use_string_kernels<Comparer, Iter1, Iter2>());
+            }
+
+        private:
+            template <typename Iter1, typename Iter2>
+            bool apply(Iter1 first1, Iter1 last1, Iter2 first2, Iter2 last2, std::false_type) const
             {
                 const auto dist1 = std::distance(first1, last1);
                 const auto dist2 = std::distance(first2, last2);
@@ -74,6 +250,22 @@ namespace krabs { namespace predicates {
                 const auto suffix_begin = std::next(first1, dist1 - dist2);
                 return std::equal(suffix_begin, last1, first2, last2, Comparer());
             }
+
+            template <typename Iter1, typename Iter2>
+            bool apply(Iter1 first1, Iter1 last1, Iter2 first2, Iter2 last2, std::true_type) const
+            {
+                const auto dist1 = krabs::details::to_length(first1, last1);
+                const auto dist2 = krabs::details::to_length(first2, last2);
+
+                if (dist2 > dist1)
+                    return false;
+
+                return krabs::details::kernel_equal(
+                    krabs::details::to_pointer(first1, last1) + (dist1 - dist2),
+                    krabs::details::to_pointer(first2, last2),
+                    dist2,
+                    Comparer());
+            }
         };
 
         // Custom Comparison
@@ -86,6 +278,7 @@ namespace krabs { namespace predicates {
             {
                 static_assert(sizeof(T) == 0,
                     "iequal_to needs a specialized overload for type");
+                return false;
             }
         };
 
@@ -9,6 +9,7 @@
 #include <vector>
 
 #include "../compiler_check.hpp"
+#include "../event_context.hpp"
 #include "../trace_context.hpp"
 
 namespace krabs { namespace testing {
@@ -27,9 +28,62 @@ namespace krabs {
     typedef std::function<void(const EVENT_RECORD &, const krabs::trace_context &)> provider_event_callback;
     typedef std::function<void(const EVENT_RECORD&, const std::string&)> provider_error_callback;
     typedef std::function<bool(const EVENT_RECORD &, const krabs::trace_context &)> filter_predicate;
+    typedef std::function<void(krabs::event_context &)> context_event_callback;
+    typedef std::function<bool(krabs::event_context &)> context_filter_predicate;
 
     template <typename T> class provider;
 
+    namespace details {
+
+        // Callbacks that take an event_context share the filter's schema
+        // and parser, others are called with the record and trace context.
+        template <typename U>
+        auto make_event_callback(U callback, evaluation_rank<1>)
+            -> decltype(callback(std::declval<krabs::event_context &>()), context_event_callback())
+        {
+            return callback;
+        }
+
+        template <typename U>
+        context_event_callback make_event_callback(U callback, evaluation_rank<0>)
+        {
+            return [callback](krabs::event_context &context) {
+                callback(context.record(), context.trace_context());
+            };
+        }
+
+        template <typename U>
+        context_event_callback make_event_callback(U callback)
+        {
+            return make_event_callback(callback, evaluation_rank<1>());
+        }
+
+        template <typename Predicate>
+        context_filter_predicate make_filter_predicate(Predicate predicate)
+        {
+            return [predicate](krabs::event_context &context) {
+                return evaluate_predicate(predicate, context);
+            };
+        }
+
+        inline context_filter_predicate make_filter_predicate(filter_predicate predicate)
+        {
+            if (predicate == nullptr) {
+                return nullptr;
+            }
+
+            return [predicate](krabs::event_context &context) {
+                return predicate(context.record(), context.trace_context());
+            };
+        }
+
+        template <typename Predicate>
+        using enable_if_filter_predicate = decltype(evaluate_predicate(
+            std::declval<const Predicate &>(),
+            std::declval<krabs::event_context &>()));
+
+    } /* namespace details */
+
     /**
      * <summary>
      *   Use this to provide event filtering before an event bubbles to
@@ -53,30 +107,52 @@ namespace krabs {
          */
         event_filter(filter_predicate predicate);
 
+        /**
+         * <summary>
+         *   Constructs an event_filter from any predicate, keeping its type
+         *   so that predicates from krabs::predicates can share the parsed
+         *   event with each other and with the filter's callbacks.
+         * </summary>
+         */
+        template <typename Predicate, typename = details::enable_if_filter_predicate<Predicate>>
+        event_filter(Predicate predicate);
+
         /**
          * <summary>
          *   Constructs an event_filter that applies event id filtering by event_id
          *   which will be added to list of filtered event ids in ETW API.
          *   This way is more effective from performance point of view.
          *   Given optional predicate will be applied to ETW API filtered results
+         *   The provider only forwards events with these ids to the filter.
          * </summary>
          */
         event_filter(unsigned short event_id, filter_predicate predicate=nullptr);
 
+        template <typename Predicate, typename = details::enable_if_filter_predicate<Predicate>>
+        event_filter(unsigned short event_id, Predicate predicate);
+
         /**
          * <summary>
          *   Constructs an event_filter that applies event id filtering by event_id
          *   which will be added to list of filtered event ids in ETW API.
          *   This way is more effective from performance point of view.
          *   Given optional predicate will be applied to ETW API filtered results
+         *   The provider only forwards events with these ids to the filter.
          * </summary>
          */
         event_filter(std::vector<unsigned short> event_ids, filter_predicate predicate=nullptr);
 
+        template <typename Predicate, typename = details::enable_if_filter_predicate<Predicate>>
+        event_filter(std::vector<unsigned short> event_ids, Predicate predicate);
+
         /**
          * <summary>
          * Adds a function to call when an event for this filter is fired.
          * </summary>
+         * <remarks>
+         * Callbacks may also take a krabs::event_context &amp;, which gives
+         * them the schema and parser the filter's predicate already built.
+         * </remarks>
          */
         void add_on_event_callback(c_provider_callback callback);
 
@@ -122,9 +198,9 @@ namespace krabs {
         void on_error(const EVENT_RECORD& record, const std::string& error_message) const;
 
     private:
-        std::deque<provider_event_callback> event_callbacks_;
+        std::deque<context_event_callback> event_callbacks_;
         std::deque<provider_error_callback> error_callbacks_;
-        filter_predicate predicate_{ nullptr };
+        context_filter_predicate predicate_{ nullptr };
         std::vector<unsigned short> provider_filter_event_ids_;
 
     private:
@@ -138,24 +214,41 @@ namespace krabs {
     // ------------------------------------------------------------------------
 
     inline event_filter::event_filter(filter_predicate predicate)
-    : predicate_(predicate)
+    : predicate_(details::make_filter_predicate(predicate))
+    {}
+
+    template <typename Predicate, typename>
+    event_filter::event_filter(Predicate predicate)
+    : predicate_(details::make_filter_predicate(predicate))
     {}
 
     inline event_filter::event_filter(std::vector<unsigned short> event_ids, filter_predicate predicate/*=nullptr*/)
     : provider_filter_event_ids_{ event_ids },
-      predicate_(predicate)
+      predicate_(details::make_filter_predicate(predicate))
+    {}
+
+    template <typename Predicate, typename>
+    event_filter::event_filter(std::vector<unsigned short> event_ids, Predicate predicate)
+    : provider_filter_event_ids_{ event_ids },
+      predicate_(details::make_filter_predicate(predicate))
     {}
 
     inline event_filter::event_filter(unsigned short event_id, filter_predicate predicate/*=nullptr*/)
     : provider_filter_event_ids_{ event_id },
-      predicate_(predicate)
+      predicate_(details::make_filter_predicate(predicate))
+    {}
+
+    template <typename Predicate, typename>
+    event_filter::event_filter(unsigned short event_id, Predicate predicate)
+    : provider_filter_event_ids_{ event_id },
+      predicate_(details::make_filter_predicate(predicate))
     {}
 
     inline void event_filter::add_on_event_callback(c_provider_callback callback)
     {
         // C function pointers don't interact well with std::ref, so we
         // overload to take care of this scenario.
-        event_callbacks_.push_back(callback);
+        event_callbacks_.push_back(details::make_event_callback(callback));
     }
 
     template <typename U>
@@ -166,7 +259,7 @@ namespace krabs {
         // intended for their particular instance to be called.
         // std::ref lets us get around this and point to a specific instance
         // that they handed us.
-        event_callbacks_.push_back(std::ref(callback));
+        event_callbacks_.push_back(details::make_event_callback(std::ref(callback)));
     }
 
     template <typename U>
@@ -175,7 +268,7 @@ namespace krabs {
         // This is where temporaries bind to. Temporaries can't be wrapped in
         // a std::ref because they'll go away very quickly. We are forced to
         // actually copy these.
-        event_callbacks_.push_back(callback);
+        event_callbacks_.push_back(details::make_event_callback(callback));
     }
 
     inline void event_filter::add_on_error_callback(c_provider_error_callback callback)
@@ -213,12 +306,16 @@ namespace krabs {
 
         try
         {
-            if (predicate_ != nullptr && !predicate_(record, trace_context)) {
+            // One context for the predicate and every callback, so the
+            // schema is looked up and the properties walked only once.
+            krabs::event_context context(record, trace_context);
+
+            if (predicate_ != nullptr && !predicate_(context)) {
                 return;
             }
 
             for (auto& callback : event_callbacks_) {
-                callback(record, trace_context);
+                callback(context);
             }
         }
         catch (const krabs::could_not_find_schema& ex)
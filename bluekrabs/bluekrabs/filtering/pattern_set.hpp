@@ -0,0 +1,379 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cwctype>
+#include <deque>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "../compiler_check.hpp"
+#include "../string_kernels.hpp"
+
+namespace krabs { namespace predicates {
+
+    /**
+     * <summary>
+     *   A set of strings compiled into an Aho-Corasick automaton, so that a
+     *   string can be searched for all of them in a single pass over its
+     *   characters, however many there are.
+     * </summary>
+     * <example>
+     *   krabs::predicates::pattern_set patterns({ L"-enc", L"downloadstring", L"iex" }, true);
+     *   auto ids = patterns.find_all(view.begin(), view.end());
+     * </example>
+     * <remarks>
+     *   Patterns are identified by their position in the vector they were
+     *   created from. Case insensitive sets compare characters the way
+     *   iequal_to&lt;wchar_t&gt; does, through towupper, except that ASCII
+     *   letters are folded without consulting the locale.
+     *
+     *   Characters are first mapped to a class, one for each distinct
+     *   character that appears in a pattern and one for all the others, and
+     *   the automaton has a complete transition table over those classes.
+     *   Scanning is one table load per character.
+     * </remarks>
+     */
+    class pattern_set {
+    public:
+        pattern_set(const std::vector<std::wstring> &patterns, bool case_insensitive = false);
+
+        /**
+         * <summary>Returns the number of patterns in the set.</summary>
+         */
+        size_t size() const;
+
+        /**
+         * <summary>Returns whether the set ignores case.</summary>
+         */
+        bool case_insensitive() const;
+
+        /**
+         * <summary>
+         *   Returns whether any of the patterns occurs in the range. An empty
+         *   pattern occurs in every range.
+         * </summary>
+         */
+        template <typename Iter>
+        bool contains_any(Iter first, Iter last) const;
+
+        /**
+         * <summary>
+         *   Returns the ids of the patterns that occur in the range, in
+         *   ascending order.
+         * </summary>
+         */
+        template <typename Iter>
+        std::vector<size_t> find_all(Iter first, Iter last) const;
+
+    private:
+        wchar_t fold(wchar_t c) const;
+        uint32_t char_class(wchar_t c) const;
+        uint32_t folded_class(wchar_t c) const;
+        uint32_t add_class(wchar_t c);
+        uint16_t next_class();
+        uint32_t state_of(uint32_t entry) const;
+
+        // Whether the character has a slot in asciiClasses_. The whole value
+        // is compared, wchar_t being 32 bits outside of Windows.
+        static bool in_ascii_table(wchar_t c);
+
+        // Transition entries hold the row offset of the next state, with
+        // this bit set when a pattern ends there.
+        static const uint32_t accepting = 0x80000000;
+
+        bool caseInsensitive_;
+        size_t patternCount_;
+        uint32_t classCount_;
+        std::array<uint16_t, 128> asciiClasses_;
+        std::vector<std::pair<wchar_t, uint16_t>> otherClasses_;
+        bool rootAccepting_;
+        std::vector<uint32_t> transitions_;
+        std::vector<uint32_t> outputBegin_;
+        std::vector<uint32_t> outputs_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline pattern_set::pattern_set(const std::vector<std::wstring> &patterns, bool case_insensitive)
+        : caseInsensitive_(case_insensitive)
+        , patternCount_(patterns.size())
+        , classCount_(1)
+        , rootAccepting_(false)
+    {
+        asciiClasses_.fill(0);
+
+        std::vector<std::wstring> folded;
+        folded.reserve(patterns.size());
+        for (auto &pattern : patterns) {
+            std::wstring f;
+            f.reserve(pattern.size());
+            for (auto c : pattern) {
+                f.push_back(fold(c));
+            }
+            folded.push_back(std::move(f));
+        }
+
+        for (auto &pattern : folded) {
+            for (auto c : pattern) {
+                add_class(c);
+            }
+        }
+
+        std::sort(otherClasses_.begin(), otherClasses_.end());
+
+        // Lowercase ASCII letters share the class of their uppercase form.
+        if (caseInsensitive_) {
+            for (wchar_t c = L'a'; c <= L'z'; ++c) {
+                asciiClasses_[c] = asciiClasses_[c - L'a' + L'A'];
+            }
+        }
+
+        // Build the trie. Missing transitions are marked with UINT32_MAX
+        // until the failure links fill them in.
+        const uint32_t missing = UINT32_MAX;
+        transitions_.assign(classCount_, missing);
+        std::vector<std::vector<uint32_t>> own(1);
+
+        for (uint32_t id = 0; id < folded.size(); ++id) {
+            uint32_t state = 0;
+            for (auto c : folded[id]) {
+                auto index = state * classCount_ + folded_class(c);
+                if (transitions_[index] == missing) {
+                    if (transitions_.size() + classCount_ > accepting) {
+                        throw std::length_error("pattern_set has too many states");
+                    }
+
+                    transitions_[index] = static_cast<uint32_t>(own.size());
+                    own.emplace_back();
+                    transitions_.resize(transitions_.size() + classCount_, missing);
+                }
+                state = transitions_[index];
+            }
+            own[state].push_back(id);
+        }
+
+        // Complete the table breadth first. A missing transition goes where
+        // the failure link of the state goes, and each state reports the
+        // patterns of its failure link as well as its own.
+        const auto stateCount = own.size();
+        std::vector<uint32_t> failure(stateCount, 0);
+        std::vector<std::vector<uint32_t>> output(stateCount);
+        output[0] = own[0];
+
+        std::deque<uint32_t> queue;
+        for (uint32_t c = 0; c < classCount_; ++c) {
+            auto &next = transitions_[c];
+            if (c == 0 || next == missing) {
+                next = 0;
+            }
+            else {
+                failure[next] = 0;
+                output[next] = own[next];
+                output[next].insert(output[next].end(), output[0].begin(), output[0].end());
+                queue.push_back(next);
+            }
+        }
+
+        while (!queue.empty()) {
+            auto state = queue.front();
+            queue.pop_front();
+
+            for (uint32_t c = 0; c < classCount_; ++c) {
+                auto &next = transitions_[state * classCount_ + c];
+                auto fallback = transitions_[failure[state] * classCount_ + c];
+
+                if (c == 0 || next == missing) {
+                    next = fallback;
+                }
+                else {
+                    failure[next] = fallback;
+                    output[next] = own[next];
+                    output[next].insert(output[next].end(), output[fallback].begin(), output[fallback].end());
+                    queue.push_back(next);
+                }
+            }
+        }
+
+        outputBegin_.reserve(stateCount + 1);
+        for (auto &ids : output) {
+            outputBegin_.push_back(static_cast<uint32_t>(outputs_.size()));
+            outputs_.insert(outputs_.end(), ids.begin(), ids.end());
+        }
+        outputBegin_.push_back(static_cast<uint32_t>(outputs_.size()));
+
+        // Store row offsets rather than state numbers and flag the states
+        // that end a pattern, so scanning does not touch the outputs.
+        for (auto &entry : transitions_) {
+            auto target = entry;
+            entry = target * classCount_;
+            if (!output[target].empty()) {
+                entry |= accepting;
+            }
+        }
+
+        rootAccepting_ = !output[0].empty();
+    }
+
+    inline size_t pattern_set::size() const
+    {
+        return patternCount_;
+    }
+
+    inline bool pattern_set::case_insensitive() const
+    {
+        return caseInsensitive_;
+    }
+
+    template <typename Iter>
+    bool pattern_set::contains_any(Iter first, Iter last) const
+    {
+        static_assert(std::is_same<typename std::iterator_traits<Iter>::value_type, wchar_t>::value,
+            "pattern_set searches wide strings");
+
+        if (rootAccepting_) {
+            return true;
+        }
+
+        uint32_t row = 0;
+        for (; first != last; ++first) {
+            auto entry = transitions_[row + char_class(*first)];
+            if (entry & accepting) {
+                return true;
+            }
+            row = entry;
+        }
+
+        return false;
+    }
+
+    template <typename Iter>
+    std::vector<size_t> pattern_set::find_all(Iter first, Iter last) const
+    {
+        static_assert(std::is_same<typename std::iterator_traits<Iter>::value_type, wchar_t>::value,
+            "pattern_set searches wide strings");
+
+        std::vector<bool> found(patternCount_, false);
+
+        auto report = [&](uint32_t state) {
+            for (auto i = outputBegin_[state]; i < outputBegin_[state + 1]; ++i) {
+                found[outputs_[i]] = true;
+            }
+        };
+
+        if (rootAccepting_) {
+            report(0);
+        }
+
+        uint32_t row = 0;
+        for (; first != last; ++first) {
+            auto entry = transitions_[row + char_class(*first)];
+            row = entry & ~accepting;
+            if (entry & accepting) {
+                report(state_of(row));
+            }
+        }
+
+        std::vector<size_t> ids;
+        for (size_t id = 0; id < found.size(); ++id) {
+            if (found[id]) {
+                ids.push_back(id);
+            }
+        }
+
+        return ids;
+    }
+
+    inline wchar_t pattern_set::fold(wchar_t c) const
+    {
+        if (!caseInsensitive_) {
+            return c;
+        }
+
+        if (krabs::details::string_kernels::is_ascii(c)) {
+            return krabs::details::string_kernels::ascii_fold(c);
+        }
+
+        return static_cast<wchar_t>(towupper(c));
+    }
+
+    inline bool pattern_set::in_ascii_table(wchar_t c)
+    {
+        return static_cast<uint32_t>(c) < 0x80;
+    }
+
+    inline uint32_t pattern_set::char_class(wchar_t c) const
+    {
+        // The ASCII table already maps lowercase letters to the class of
+        // their uppercase form, so only other characters need folding.
+        if (in_ascii_table(c)) {
+            return asciiClasses_[static_cast<uint32_t>(c)];
+        }
+
+        return folded_class(fold(c));
+    }
+
+    inline uint32_t pattern_set::folded_class(wchar_t c) const
+    {
+        if (in_ascii_table(c)) {
+            return asciiClasses_[static_cast<uint32_t>(c)];
+        }
+
+        auto it = std::lower_bound(
+            otherClasses_.begin(),
+            otherClasses_.end(),
+            std::make_pair(c, uint16_t(0)));
+
+        if (it == otherClasses_.end() || it->first != c) {
+            return 0;
+        }
+
+        return it->second;
+    }
+
+    inline uint32_t pattern_set::add_class(wchar_t c)
+    {
+        if (in_ascii_table(c)) {
+            auto &entry = asciiClasses_[static_cast<uint32_t>(c)];
+            if (entry == 0) {
+                entry = next_class();
+            }
+            return entry;
+        }
+
+        for (auto &entry : otherClasses_) {
+            if (entry.first == c) {
+                return entry.second;
+            }
+        }
+
+        otherClasses_.emplace_back(c, next_class());
+        return otherClasses_.back().second;
+    }
+
+    inline uint16_t pattern_set::next_class()
+    {
+        // Classes are stored as 16 bits, and class 0 is taken by the
+        // characters that appear in no pattern.
+        if (classCount_ > UINT16_MAX) {
+            throw std::length_error("pattern_set has too many distinct characters");
+        }
+
+        return static_cast<uint16_t>(classCount_++);
+    }
+
+    inline uint32_t pattern_set::state_of(uint32_t row) const
+    {
+        return row / classCount_;
+    }
+
+} /* namespace predicates */ } /* namespace krabs */
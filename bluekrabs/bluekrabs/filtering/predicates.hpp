@@ -6,10 +6,14 @@
 #include <evntcons.h>
 #include <functional>
 #include <algorithm>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "../compiler_check.hpp"
 #include "comparers.hpp"
+#include "pattern_set.hpp"
+#include "../event_context.hpp"
 #include "../trace_context.hpp"
 #include "view_adapters.hpp"
 
@@ -25,10 +29,20 @@ namespace krabs { namespace predicates {
          *   The base predicate struct, use to create a vector or list of
          *   Arbitrary predicate types
          * </summary>
+         * <remarks>
+         *   evaluate is what combined predicates and event filters call, so
+         *   that every predicate looking at the same event shares one
+         *   event_context. Predicates that parse properties override it.
+         * </remarks>
          */
         struct predicate_base
         {
             virtual bool operator()(const EVENT_RECORD&, const krabs::trace_context&) const = 0;
+
+            virtual bool evaluate(krabs::event_context &context) const
+            {
+                return (*this)(context.record(), context.trace_context());
+            }
         };
 
         /**
@@ -69,9 +83,19 @@ namespace krabs { namespace predicates {
 
             bool operator()(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const
             {
-                return (t1_(record, trace_context) && t2_(record, trace_context));
+                krabs::event_context context(record, trace_context);
+                return evaluate(context);
+            }
+
+            bool evaluate(krabs::event_context &context) const
+            {
+                return (krabs::details::evaluate_predicate(t1_, context) &&
+                        krabs::details::evaluate_predicate(t2_, context));
             }
 
+            const T1 &left() const { return t1_; }
+            const T2 &right() const { return t2_; }
+
         private:
             const T1 t1_;
             const T2 t2_;
@@ -91,9 +115,19 @@ namespace krabs { namespace predicates {
 
             bool operator()(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const
             {
-                return (t1_(record, trace_context) || t2_(record, trace_context));
+                krabs::event_context context(record, trace_context);
+                return evaluate(context);
+            }
+
+            bool evaluate(krabs::event_context &context) const
+            {
+                return (krabs::details::evaluate_predicate(t1_, context) ||
+                        krabs::details::evaluate_predicate(t2_, context));
             }
 
+            const T1 &left() const { return t1_; }
+            const T2 &right() const { return t2_; }
+
         private:
             const T1 t1_;
             const T2 t2_;
@@ -112,9 +146,17 @@ namespace krabs { namespace predicates {
 
             bool operator()(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const
             {
-                return !t1_(record, trace_context);
+                krabs::event_context context(record, trace_context);
+                return evaluate(context);
             }
 
+            bool evaluate(krabs::event_context &context) const
+            {
+                return !krabs::details::evaluate_predicate(t1_, context);
+            }
+
+            const T1 &operand() const { return t1_; }
+
         private:
             const T1 t1_;
         };
@@ -126,19 +168,23 @@ namespace krabs { namespace predicates {
         */
         template <typename T>
         struct property_is : predicate_base {
-            property_is(const std::wstring &property, const T &expected)
+            property_is(const property_key &property, const T &expected)
                 : property_(property)
                 , expected_(expected)
             {}
 
             bool operator()(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const
             {
-                krabs::schema schema(record, trace_context.schema_locator);
-                krabs::parser parser(schema);
+                krabs::event_context context(record, trace_context);
+                return evaluate(context);
+            }
+
+            bool evaluate(krabs::event_context &context) const
+            {
+                auto &parser = context.parser();
 
                 try {
-                    auto pi = krabs::parser::npos;
-                    return (expected_ == parser.parse<T>(property_, pi));
+                    return (expected_ == parser.parse<T>(property_));
                 }
                 catch (...) {
                     return false;
@@ -146,7 +192,7 @@ namespace krabs { namespace predicates {
             }
 
         private:
-            const std::wstring property_;
+            const property_key property_;
             const T expected_;
         };
 
@@ -162,7 +208,7 @@ namespace krabs { namespace predicates {
         struct property_view_predicate : details::predicate_base
         {
             property_view_predicate(
-                const std::wstring &property,
+                const property_key &property,
                 const T &expected,
                 Adapter adapter,
                 Predicate predicate)
@@ -172,11 +218,15 @@ namespace krabs { namespace predicates {
                 , predicate_(predicate)
             { }
 
-            //bool operator()(const EVENT_RECORD &record, const krabs::trace_context &trace_context)
             bool operator()(const EVENT_RECORD& record, const krabs::trace_context& trace_context) const
             {
-                krabs::schema schema(record, trace_context.schema_locator);
-                krabs::parser parser(schema);
+                krabs::event_context context(record, trace_context);
+                return evaluate(context);
+            }
+
+            bool evaluate(krabs::event_context &context) const
+            {
+                auto &parser = context.parser();
 
                 try {
                     auto view = parser.view_of(property_, adapter_);
@@ -188,11 +238,78 @@ namespace krabs { namespace predicates {
             }
 
         private:
-            const std::wstring property_;
+            const property_key property_;
             const T expected_;
             Adapter adapter_;
             Predicate predicate_;
         };
+
+        /**
+         * <summary>
+         *   Returns true if a string property contains any of the patterns
+         *   of a pattern_set. The property is parsed once and searched for
+         *   all of the patterns in a single pass.
+         * </summary>
+         */
+        template <typename Adapter>
+        struct property_contains_any_predicate : details::predicate_base
+        {
+            property_contains_any_predicate(
+                const property_key &property,
+                std::shared_ptr<const pattern_set> patterns,
+                Adapter adapter)
+                : property_(property)
+                , patterns_(std::move(patterns))
+                , adapter_(adapter)
+            { }
+
+            bool operator()(const EVENT_RECORD& record, const krabs::trace_context& trace_context) const
+            {
+                krabs::event_context context(record, trace_context);
+                return evaluate(context);
+            }
+
+            bool evaluate(krabs::event_context &context) const
+            {
+                auto &parser = context.parser();
+
+                try {
+                    auto view = parser.view_of(property_, adapter_);
+                    return patterns_->contains_any(view.begin(), view.end());
+                }
+                catch (...) {
+                    return false;
+                }
+            }
+
+            /**
+             * <summary>
+             *   Returns the ids of the patterns found in the property of the
+             *   event, for callbacks that need to know which ones matched.
+             *   The ids are positions in the list the predicate was created
+             *   with.
+             * </summary>
+             */
+            std::vector<size_t> matched_patterns(krabs::event_context &context) const
+            {
+                auto &parser = context.parser();
+
+                try {
+                    auto view = parser.view_of(property_, adapter_);
+                    return patterns_->find_all(view.begin(), view.end());
+                }
+                catch (...) {
+                    return {};
+                }
+            }
+
+            const pattern_set &patterns() const { return *patterns_; }
+
+        private:
+            const property_key property_;
+            std::shared_ptr<const pattern_set> patterns_;
+            Adapter adapter_;
+        };
     } /* namespace details */
 
     // Filter factory functions
@@ -261,9 +378,15 @@ namespace krabs { namespace predicates {
         {}
 
         bool operator()(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const
+        {
+            krabs::event_context context(record, trace_context);
+            return evaluate(context);
+        }
+
+        bool evaluate(krabs::event_context &context) const
         {
             for (auto &item : list_) {
-                if (item->operator()(record, trace_context)) {
+                if (item->evaluate(context)) {
                     return true;
                 };
             }
@@ -284,12 +407,18 @@ namespace krabs { namespace predicates {
         {}
 
         bool operator()(const EVENT_RECORD& record, const krabs::trace_context& trace_context) const
+        {
+            krabs::event_context context(record, trace_context);
+            return evaluate(context);
+        }
+
+        bool evaluate(krabs::event_context &context) const
         {
             if (list_.empty()) {
                 return false;
             }
             for (auto& item : list_) {
-                if (!item->operator()(record, trace_context)) {
+                if (!item->evaluate(context)) {
                     return false;
                 };
             }
@@ -310,9 +439,15 @@ namespace krabs { namespace predicates {
         {}
 
         bool operator()(const EVENT_RECORD& record, const krabs::trace_context& trace_context) const
+        {
+            krabs::event_context context(record, trace_context);
+            return evaluate(context);
+        }
+
+        bool evaluate(krabs::event_context &context) const
         {
             for (auto& item : list_) {
-                if (item->operator()(record, trace_context)) {
+                if (item->evaluate(context)) {
                     return false;
                 };
             }
@@ -517,6 +652,23 @@ namespace krabs { namespace predicates {
         return{ prop, expected, Adapter(), Comparer() };
     }
 
+    /**
+     * Accepts events if property contains any of the patterns. All of the
+     * patterns are compiled into one automaton up front, which is much
+     * cheaper per event than a chain of property_contains filters.
+     */
+    template <typename Adapter = adapters::generic_string<wchar_t>>
+    details::property_contains_any_predicate<Adapter> property_contains_any(
+        const std::wstring &prop,
+        const std::vector<std::wstring> &patterns,
+        bool case_insensitive = false)
+    {
+        static_assert(std::is_same<typename Adapter::value_type, wchar_t>::value,
+            "property_contains_any searches wide string properties");
+
+        return{ prop, std::make_shared<const pattern_set>(patterns, case_insensitive), Adapter() };
+    }
+
     /**
      * <summary>
      *   Accepts an event if its two component filters both accept the event.
@@ -0,0 +1,343 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <evntcons.h>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "../compiler_check.hpp"
+#include "../event_context.hpp"
+#include "../trace_context.hpp"
+#include "predicates.hpp"
+
+namespace krabs { namespace details {
+
+    /**
+     * <summary>
+     *   Whether evaluating a predicate may need the event's schema. Only
+     *   predicates known to look at nothing but the event header say no,
+     *   anything else is assumed to parse the event.
+     * </summary>
+     */
+    template <typename T>
+    struct needs_schema : std::true_type {};
+
+    template <> struct needs_schema<krabs::predicates::details::any_event> : std::false_type {};
+    template <> struct needs_schema<krabs::predicates::details::no_event> : std::false_type {};
+    template <> struct needs_schema<krabs::predicates::id_is> : std::false_type {};
+    template <> struct needs_schema<krabs::predicates::opcode_is> : std::false_type {};
+    template <> struct needs_schema<krabs::predicates::version_is> : std::false_type {};
+    template <> struct needs_schema<krabs::predicates::process_id_is> : std::false_type {};
+
+    template <typename T1, typename T2>
+    struct needs_schema<krabs::predicates::details::and_filter<T1, T2>>
+        : std::integral_constant<bool, needs_schema<T1>::value || needs_schema<T2>::value> {};
+
+    template <typename T1, typename T2>
+    struct needs_schema<krabs::predicates::details::or_filter<T1, T2>>
+        : std::integral_constant<bool, needs_schema<T1>::value || needs_schema<T2>::value> {};
+
+    template <typename T1>
+    struct needs_schema<krabs::predicates::details::not_filter<T1>> : needs_schema<T1> {};
+
+    /**
+     * <summary>
+     *   Whether a predicate tree is made of predicates from krabs::predicates
+     *   only, which have no side effects. Lambdas, functors and std::function
+     *   anywhere in the tree say no.
+     * </summary>
+     */
+    template <typename T>
+    struct is_krabs_predicate : std::is_base_of<krabs::predicates::details::predicate_base, T> {};
+
+    template <typename T1, typename T2>
+    struct is_krabs_predicate<krabs::predicates::details::and_filter<T1, T2>>
+        : std::integral_constant<bool, is_krabs_predicate<T1>::value && is_krabs_predicate<T2>::value> {};
+
+    template <typename T1, typename T2>
+    struct is_krabs_predicate<krabs::predicates::details::or_filter<T1, T2>>
+        : std::integral_constant<bool, is_krabs_predicate<T1>::value && is_krabs_predicate<T2>::value> {};
+
+    template <typename T1>
+    struct is_krabs_predicate<krabs::predicates::details::not_filter<T1>> : is_krabs_predicate<T1> {};
+
+    /**
+     * <summary>
+     *   Rewrites a predicate tree so that, at every and/or node, a side
+     *   that only reads the event header is evaluated before a side that
+     *   needs the schema, letting the cheap side short-circuit.
+     * </summary>
+     * <remarks>
+     *   A side is only moved when it is made of krabs::predicates, which
+     *   have no side effects, so the result is the same. A side holding a
+     *   user predicate keeps its place, and is called as often as written.
+     * </remarks>
+     */
+    template <typename T>
+    struct fused_predicate {
+        typedef T type;
+
+        static type fuse(const T &predicate) { return predicate; }
+    };
+
+    template <template <typename, typename> class Filter, typename T1, typename T2>
+    struct fused_binary_predicate {
+        typedef typename fused_predicate<T1>::type left_type;
+        typedef typename fused_predicate<T2>::type right_type;
+
+        typedef std::integral_constant<bool,
+            needs_schema<left_type>::value &&
+            !needs_schema<right_type>::value &&
+            is_krabs_predicate<left_type>::value> swap;
+
+        typedef typename std::conditional<swap::value,
+            Filter<right_type, left_type>,
+            Filter<left_type, right_type>>::type type;
+
+        static type fuse(const Filter<T1, T2> &predicate)
+        {
+            return make(
+                fused_predicate<T1>::fuse(predicate.left()),
+                fused_predicate<T2>::fuse(predicate.right()),
+                swap());
+        }
+
+    private:
+        static type make(const left_type &left, const right_type &right, std::false_type)
+        {
+            return type(left, right);
+        }
+
+        static type make(const left_type &left, const right_type &right, std::true_type)
+        {
+            return type(right, left);
+        }
+    };
+
+    template <typename T1, typename T2>
+    struct fused_predicate<krabs::predicates::details::and_filter<T1, T2>>
+        : fused_binary_predicate<krabs::predicates::details::and_filter, T1, T2> {};
+
+    template <typename T1, typename T2>
+    struct fused_predicate<krabs::predicates::details::or_filter<T1, T2>>
+        : fused_binary_predicate<krabs::predicates::details::or_filter, T1, T2> {};
+
+    template <typename T1>
+    struct fused_predicate<krabs::predicates::details::not_filter<T1>> {
+        typedef krabs::predicates::details::not_filter<typename fused_predicate<T1>::type> type;
+
+        static type fuse(const krabs::predicates::details::not_filter<T1> &predicate)
+        {
+            return type(fused_predicate<T1>::fuse(predicate.operand()));
+        }
+    };
+
+    /**
+     * <summary>
+     *   Evaluates a fused predicate tree with direct calls only. Composite
+     *   nodes are walked here rather than through their virtual evaluate,
+     *   and predicates from krabs::predicates are called by qualified name
+     *   so the compiler can inline them.
+     * </summary>
+     */
+    template <typename T>
+    struct fused_evaluator {
+        static bool evaluate(const T &predicate, krabs::event_context &context)
+        {
+            return evaluate(predicate, context,
+                std::integral_constant<bool, std::is_base_of<krabs::predicates::details::predicate_base, T>::value>(),
+                needs_schema<T>());
+        }
+
+    private:
+        // a header only predicate from krabs::predicates
+        static bool evaluate(const T &predicate, krabs::event_context &context, std::true_type, std::false_type)
+        {
+            return predicate.T::operator()(context.record(), context.trace_context());
+        }
+
+        // any other predicate from krabs::predicates
+        static bool evaluate(const T &predicate, krabs::event_context &context, std::true_type, std::true_type)
+        {
+            return predicate.T::evaluate(context);
+        }
+
+        // lambdas, functors and std::function
+        template <typename NeedsSchema>
+        static bool evaluate(const T &predicate, krabs::event_context &context, std::false_type, NeedsSchema)
+        {
+            return krabs::details::evaluate_predicate(predicate, context);
+        }
+    };
+
+    template <typename T1, typename T2>
+    struct fused_evaluator<krabs::predicates::details::and_filter<T1, T2>> {
+        static bool evaluate(
+            const krabs::predicates::details::and_filter<T1, T2> &predicate,
+            krabs::event_context &context)
+        {
+            return fused_evaluator<T1>::evaluate(predicate.left(), context) &&
+                   fused_evaluator<T2>::evaluate(predicate.right(), context);
+        }
+    };
+
+    template <typename T1, typename T2>
+    struct fused_evaluator<krabs::predicates::details::or_filter<T1, T2>> {
+        static bool evaluate(
+            const krabs::predicates::details::or_filter<T1, T2> &predicate,
+            krabs::event_context &context)
+        {
+            return fused_evaluator<T1>::evaluate(predicate.left(), context) ||
+                   fused_evaluator<T2>::evaluate(predicate.right(), context);
+        }
+    };
+
+    template <typename T1>
+    struct fused_evaluator<krabs::predicates::details::not_filter<T1>> {
+        static bool evaluate(
+            const krabs::predicates::details::not_filter<T1> &predicate,
+            krabs::event_context &context)
+        {
+            return !fused_evaluator<T1>::evaluate(predicate.operand(), context);
+        }
+    };
+
+    // Callbacks that take an event_context share the filter's schema
+    // and parser, others are called with the record and trace context.
+    template <typename U>
+    auto invoke_event_callback(const U &callback, krabs::event_context &context, evaluation_rank<1>)
+        -> decltype(callback(context), void())
+    {
+        callback(context);
+    }
+
+    template <typename U>
+    void invoke_event_callback(const U &callback, krabs::event_context &context, evaluation_rank<0>)
+    {
+        callback(context.record(), context.trace_context());
+    }
+
+} /* namespace details */ } /* namespace krabs */
+
+namespace krabs {
+
+    /**
+     * <summary>
+     *   An event filter whose predicate and callbacks are part of its type.
+     *   Where event_filter erases its predicate into a std::function, this
+     *   keeps the whole and/or/not tree, evaluates the leaves that only
+     *   read the event header before any that need the schema, and calls
+     *   the predicate and callbacks directly so they can be inlined.
+     * </summary>
+     * <example>
+     *   namespace kp = krabs::predicates;
+     *
+     *   auto filter = krabs::make_static_event_filter(
+     *       kp::and_filter(kp::property_is(L"ClassName", L"Foo"), kp::id_is(7942)),
+     *       [](krabs::event_context &context) {
+     *           auto message = context.parser().parse<std::wstring>(L"Message");
+     *       });
+     *
+     *   provider.add_on_event_callback(filter);
+     * </example>
+     * <remarks>
+     *   A static_event_filter is itself an event callback, so it is added to
+     *   a provider with add_on_event_callback. Events without a schema are
+     *   reported to the provider's error callbacks. Only krabs::predicates
+     *   are moved; lambdas and functors in the tree keep their place.
+     * </remarks>
+     */
+    template <typename Predicate, typename... Callbacks>
+    class static_event_filter {
+    public:
+        typedef typename details::fused_predicate<Predicate>::type predicate_type;
+
+        static_event_filter(const Predicate &predicate, Callbacks... callbacks);
+
+        /**
+         * <summary>
+         *   Forwards the event to the callbacks if it satisfies the predicate.
+         * </summary>
+         */
+        void operator()(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const;
+
+        /**
+         * <summary>
+         *   Returns whether the event satisfies the predicate.
+         * </summary>
+         */
+        bool matches(krabs::event_context &context) const;
+
+    private:
+        template <size_t... Indices>
+        void invoke_callbacks(krabs::event_context &context, std::index_sequence<Indices...>) const;
+
+    private:
+        predicate_type predicate_;
+        std::tuple<Callbacks...> callbacks_;
+    };
+
+    /**
+     * <summary>
+     *   Builds a static_event_filter from a predicate and its callbacks.
+     * </summary>
+     */
+    template <typename Predicate, typename... Callbacks>
+    static_event_filter<Predicate, Callbacks...> make_static_event_filter(
+        const Predicate &predicate,
+        Callbacks... callbacks);
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    template <typename Predicate, typename... Callbacks>
+    static_event_filter<Predicate, Callbacks...>::static_event_filter(
+        const Predicate &predicate,
+        Callbacks... callbacks)
+    : predicate_(details::fused_predicate<Predicate>::fuse(predicate))
+    , callbacks_(std::move(callbacks)...)
+    {}
+
+    template <typename Predicate, typename... Callbacks>
+    void static_event_filter<Predicate, Callbacks...>::operator()(
+        const EVENT_RECORD &record,
+        const krabs::trace_context &trace_context) const
+    {
+        krabs::event_context context(record, trace_context);
+
+        if (!matches(context)) {
+            return;
+        }
+
+        invoke_callbacks(context, std::index_sequence_for<Callbacks...>());
+    }
+
+    template <typename Predicate, typename... Callbacks>
+    bool static_event_filter<Predicate, Callbacks...>::matches(krabs::event_context &context) const
+    {
+        return details::fused_evaluator<predicate_type>::evaluate(predicate_, context);
+    }
+
+    template <typename Predicate, typename... Callbacks>
+    template <size_t... Indices>
+    void static_event_filter<Predicate, Callbacks...>::invoke_callbacks(
+        krabs::event_context &context,
+        std::index_sequence<Indices...>) const
+    {
+        // Calls the callbacks in the order they were given.
+        int expand[] = { 0, (details::invoke_event_callback(
+            std::get<Indices>(callbacks_), context, details::evaluation_rank<1>()), 0)... };
+        (void)expand;
+    }
+
+    template <typename Predicate, typename... Callbacks>
+    static_event_filter<Predicate, Callbacks...> make_static_event_filter(
+        const Predicate &predicate,
+        Callbacks... callbacks)
+    {
+        return static_event_filter<Predicate, Callbacks...>(predicate, std::move(callbacks)...);
+    }
+}
@@ -0,0 +1,359 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "compiler_check.hpp"
+
+namespace krabs {
+
+    /**
+     * <summary>
+     * Buffer sizes, including the null terminator, that fit the longest
+     * string each formatter below writes.
+     * </summary>
+     */
+    static const size_t sid_string_size = 184;            // S-1-0x... with 15 sub authorities
+    static const size_t ipv4_string_size = 16;            // 255.255.255.255
+    static const size_t ipv6_string_size = 46;            // INET6_ADDRSTRLEN
+    static const size_t socket_address_string_size = 54;  // [ipv6]:65535
+
+    /**
+     * <summary>
+     * The largest binary SID: the header and 15 sub authorities.
+     * </summary>
+     */
+    static const size_t max_sid_size = 8 + 15 * sizeof(DWORD);
+
+    /**
+     * <summary>
+     * Writes the SDDL form of the binary SID ("S-1-5-21-...") to the buffer
+     * and returns its length, like ConvertSidToStringSid but without
+     * allocating or calling into Windows. Returns zero, leaving the buffer
+     * untouched, when the bytes are not a valid SID or the buffer is smaller
+     * than needed. A buffer of sid_string_size always fits.
+     * </summary>
+     */
+    size_t format_sid(const BYTE *sid, size_t size, char *buffer, size_t buffer_size);
+
+    /**
+     * <summary>
+     * Writes the dotted form of the IPv4 address, given as its four bytes in
+     * network order, and returns its length. Returns zero when the buffer
+     * is smaller than needed.
+     * </summary>
+     */
+    size_t format_ipv4(const BYTE *address, char *buffer, size_t buffer_size);
+
+    /**
+     * <summary>
+     * Writes the IPv6 address, given as its sixteen bytes in network order,
+     * in the RFC 5952 form: lower case, leading zeros dropped and the
+     * longest run of zero groups written as "::". IPv4 mapped addresses end
+     * in the dotted form. Returns the length, or zero when the buffer is
+     * smaller than needed.
+     * </summary>
+     */
+    size_t format_ipv6(const BYTE *address, char *buffer, size_t buffer_size);
+
+    /**
+     * <summary>
+     * Remembers the strings of recently formatted SIDs. Events carry the
+     * SIDs of the few users active on a machine over and over, so most
+     * lookups are hits and skip formatting entirely.
+     * </summary>
+     * <remarks>
+     * All memory is taken when the cache is built. It is direct mapped: a
+     * SID evicts the one it collides with. Not thread safe, use one cache
+     * per thread that processes events.
+     * </remarks>
+     */
+    class sid_cache {
+    public:
+
+        /**
+         * <summary>
+         * Builds a cache holding up to capacity SIDs, rounded up to a power
+         * of two.
+         * </summary>
+         */
+        explicit sid_cache(size_t capacity = 64);
+
+        /**
+         * <summary>
+         * Returns the SDDL form of the binary SID, or nullptr when the bytes
+         * are not a valid SID. The string stays valid until another SID
+         * takes its place, copy it to keep it.
+         * </summary>
+         */
+        const char *format(const BYTE *sid, size_t size);
+
+        /**
+         * <summary>
+         * Returns how many lookups found the SID in the cache and how many
+         * had to format it.
+         * </summary>
+         */
+        uint64_t hits() const { return hits_; }
+        uint64_t misses() const { return misses_; }
+
+    private:
+        struct entry {
+            BYTE sid[max_sid_size];
+            BYTE sid_size;
+            char text[sid_string_size];
+        };
+
+        std::vector<entry> entries_;
+        size_t mask_;
+        uint64_t hits_;
+        uint64_t misses_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    namespace details {
+
+        static const USHORT windows_af_inet = 2;
+        static const USHORT windows_af_inet6 = 23;
+
+        inline char *write_decimal(char *out, uint64_t value)
+        {
+            char digits[20];
+            size_t count = 0;
+            do {
+                digits[count++] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            } while (value != 0);
+
+            while (count != 0) {
+                *out++ = digits[--count];
+            }
+
+            return out;
+        }
+
+        inline char *write_hex(char *out, uint32_t value, size_t min_digits, bool upper = false)
+        {
+            const char *hex = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+            char digits[8];
+            size_t count = 0;
+            do {
+                digits[count++] = hex[value & 0xF];
+                value >>= 4;
+            } while (value != 0 || count < min_digits);
+
+            while (count != 0) {
+                *out++ = digits[--count];
+            }
+
+            return out;
+        }
+
+        // Both formatters write to a scratch buffer of the maximum size first
+        // so that they only bounds check once.
+        inline size_t copy_out(const char *scratch, const char *end, char *buffer, size_t buffer_size)
+        {
+            auto length = static_cast<size_t>(end - scratch);
+            if (buffer == nullptr || length + 1 > buffer_size) {
+                return 0;
+            }
+
+            memcpy(buffer, scratch, length);
+            buffer[length] = '\0';
+            return length;
+        }
+
+        inline size_t sid_hash(const BYTE *sid, size_t size)
+        {
+            // FNV-1a
+            uint64_t hash = 14695981039346656037ull;
+            for (size_t i = 0; i < size; ++i) {
+                hash = (hash ^ sid[i]) * 1099511628211ull;
+            }
+
+            return static_cast<size_t>(hash ^ (hash >> 32));
+        }
+
+    } /* namespace details */
+
+    inline size_t format_sid(const BYTE *sid, size_t size, char *buffer, size_t buffer_size)
+    {
+        if (sid == nullptr || size < 8) {
+            return 0;
+        }
+
+        const auto revision = sid[0];
+        const auto count = sid[1];
+        if (revision != 1 || count > 15 || size < 8 + count * sizeof(DWORD)) {
+            return 0;
+        }
+
+        char scratch[sid_string_size];
+        auto out = scratch;
+        *out++ = 'S';
+        *out++ = '-';
+        out = details::write_decimal(out, revision);
+        *out++ = '-';
+
+        // The authority is 48 bits in network order, written in decimal
+        // when it fits in 32 bits and in upper case hex otherwise, as
+        // ConvertSidToStringSid does.
+        const auto authority = sid + 2;
+        if (authority[0] != 0 || authority[1] != 0) {
+            *out++ = '0';
+            *out++ = 'x';
+            for (size_t i = 0; i < 6; ++i) {
+                out = details::write_hex(out, authority[i], 2, true);
+            }
+        }
+        else {
+            out = details::write_decimal(out,
+                (static_cast<uint32_t>(authority[2]) << 24) |
+                (static_cast<uint32_t>(authority[3]) << 16) |
+                (static_cast<uint32_t>(authority[4]) << 8) |
+                static_cast<uint32_t>(authority[5]));
+        }
+
+        // The sub authorities are in the byte order of the machine.
+        for (size_t i = 0; i < count; ++i) {
+            DWORD value;
+            memcpy(&value, sid + 8 + i * sizeof(DWORD), sizeof(value));
+            *out++ = '-';
+            out = details::write_decimal(out, value);
+        }
+
+        return details::copy_out(scratch, out, buffer, buffer_size);
+    }
+
+    inline size_t format_ipv4(const BYTE *address, char *buffer, size_t buffer_size)
+    {
+        char scratch[ipv4_string_size];
+        auto out = scratch;
+        for (size_t i = 0; i < 4; ++i) {
+            if (i != 0) {
+                *out++ = '.';
+            }
+            out = details::write_decimal(out, address[i]);
+        }
+
+        return details::copy_out(scratch, out, buffer, buffer_size);
+    }
+
+    inline size_t format_ipv6(const BYTE *address, char *buffer, size_t buffer_size)
+    {
+        uint32_t groups[8];
+        for (size_t i = 0; i < 8; ++i) {
+            groups[i] = (static_cast<uint32_t>(address[2 * i]) << 8) | address[2 * i + 1];
+        }
+
+        // ::ffff:a.b.c.d
+        const bool mapped =
+            groups[0] == 0 && groups[1] == 0 && groups[2] == 0 &&
+            groups[3] == 0 && groups[4] == 0 && groups[5] == 0xFFFF;
+        const size_t hexGroups = mapped ? 6 : 8;
+
+        // The longest run of at least two zero groups, the first one on ties.
+        size_t bestStart = hexGroups;
+        size_t bestLength = 1;
+        for (size_t i = 0; i < hexGroups; ) {
+            if (groups[i] != 0) {
+                ++i;
+                continue;
+            }
+
+            auto start = i;
+            while (i < hexGroups && groups[i] == 0) {
+                ++i;
+            }
+
+            if (i - start > bestLength) {
+                bestStart = start;
+                bestLength = i - start;
+            }
+        }
+
+        char scratch[ipv6_string_size];
+        auto out = scratch;
+        for (size_t i = 0; i < hexGroups; ++i) {
+            if (i == bestStart) {
+                *out++ = ':';
+                *out++ = ':';
+                i += bestLength - 1;
+                continue;
+            }
+
+            if (i != 0 && i != bestStart + bestLength) {
+                *out++ = ':';
+            }
+            out = details::write_hex(out, groups[i], 1);
+        }
+
+        if (mapped) {
+            if (bestStart + bestLength != hexGroups) {
+                *out++ = ':';
+            }
+            out += format_ipv4(address + 12, out, ipv4_string_size);
+        }
+
+        return details::copy_out(scratch, out, buffer, buffer_size);
+    }
+
+    inline sid_cache::sid_cache(size_t capacity)
+        : mask_(0)
+        , hits_(0)
+        , misses_(0)
+    {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+
+        entry empty;
+        memset(&empty, 0, sizeof(empty));
+        entries_.assign(size, empty);
+        mask_ = size - 1;
+    }
+
+    inline const char *sid_cache::format(const BYTE *sid, size_t size)
+    {
+        if (sid == nullptr || size < 8) {
+            return nullptr;
+        }
+
+        // Trailing bytes past the sub authorities are not part of the SID.
+        size = (std::min)(size, 8 + sid[1] * sizeof(DWORD));
+        if (size > max_sid_size) {
+            return nullptr;
+        }
+
+        auto &slot = entries_[details::sid_hash(sid, size) & mask_];
+        if (slot.sid_size == size && memcmp(slot.sid, sid, size) == 0) {
+            ++hits_;
+            return slot.text;
+        }
+
+        // An invalid SID leaves the slot as it was.
+        ++misses_;
+        if (format_sid(sid, size, slot.text, sizeof(slot.text)) == 0) {
+            return nullptr;
+        }
+
+        memcpy(slot.sid, sid, size);
+        slot.sid_size = static_cast<BYTE>(size);
+        return slot.text;
+    }
+
+}
@@ -335,7 +335,7 @@ namespace std
     }
 
     template<>
-    struct std::hash<krabs::guid>
+    struct hash<krabs::guid>
     {
         size_t operator()(const krabs::guid& guid) const
         {
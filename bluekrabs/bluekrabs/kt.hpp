@@ -88,6 +88,16 @@ namespace krabs { namespace details {
             const EVENT_RECORD &record,
             const krabs::trace<krabs::details::kt> &trace);
 
+        /**
+         * <summary>
+         *   Returns the provider in the trace that an event belongs to, or
+         *   nullptr when there is none.
+         * </summary>
+         */
+        static const provider_type *find_provider(
+            const EVENT_RECORD &record,
+            const krabs::trace<krabs::details::kt> &trace);
+
         /**
          * <summary>
          *   Sets the ETW trace log file mode.
@@ -197,15 +207,14 @@ namespace krabs { namespace details {
         const EVENT_RECORD &record,
         const krabs::trace<krabs::details::kt> &trace)
     {
-        for (auto &provider : trace.enabled_providers_) {
-            if (provider.get().id() == record.EventHeader.ProviderId) {
-                provider.get().on_event(record, trace.context_);
-                return;
-            }
-        }
+        trace.deliver(find_provider(record, trace), record);
+    }
 
-        if (trace.default_callback_ != nullptr)
-            trace.default_callback_(record, trace.context_);
+    inline const kt::provider_type *kt::find_provider(
+        const EVENT_RECORD &record,
+        const krabs::trace<krabs::details::kt> &trace)
+    {
+        return trace.dispatcher_.find(record.EventHeader.ProviderId);
     }
 
     inline unsigned long kt::augment_file_mode()
@@ -0,0 +1,115 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+#include "compiler_check.hpp"
+
+namespace krabs {
+
+    /**
+     * <summary>
+     *   Where krabs gets memory from for the schema cache and the parser.
+     *   Mirrors std::pmr::memory_resource, which is not available to code
+     *   built as C++14, so a resource can be handed to krabs and to pmr
+     *   containers with a thin adapter.
+     * </summary>
+     * <example>
+     *   class arena_resource : public krabs::memory_resource {
+     *       void *do_allocate(size_t bytes, size_t alignment) override;
+     *       void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+     *   };
+     *
+     *   arena_resource arena;
+     *   krabs::schema_locator locator(arena);
+     * </example>
+     * <remarks>
+     *   A resource must outlive everything that got memory from it.
+     * </remarks>
+     */
+    class memory_resource {
+    public:
+        virtual ~memory_resource() {}
+
+        void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+        void deallocate(void *p, size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+    protected:
+        virtual void *do_allocate(size_t bytes, size_t alignment) = 0;
+        virtual void do_deallocate(void *p, size_t bytes, size_t alignment) = 0;
+    };
+
+    /**
+     * <summary>
+     *   Returns the resource that krabs uses unless told otherwise, which
+     *   allocates with operator new.
+     * </summary>
+     */
+    memory_resource &new_delete_resource();
+
+    namespace details {
+
+        /**
+         * <summary>
+         *   Deleter for a unique_ptr to a byte buffer that came from a
+         *   memory_resource.
+         * </summary>
+         */
+        struct resource_deleter {
+            memory_resource *resource;
+            size_t size;
+
+            void operator()(char *p) const;
+        };
+
+        class new_delete_memory_resource : public memory_resource {
+        protected:
+            void *do_allocate(size_t bytes, size_t alignment) override;
+            void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+        };
+
+    } /* namespace details */
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline void *memory_resource::allocate(size_t bytes, size_t alignment)
+    {
+        return do_allocate(bytes, alignment);
+    }
+
+    inline void memory_resource::deallocate(void *p, size_t bytes, size_t alignment)
+    {
+        do_deallocate(p, bytes, alignment);
+    }
+
+    inline memory_resource &new_delete_resource()
+    {
+        static details::new_delete_memory_resource resource;
+        return resource;
+    }
+
+    namespace details {
+
+        inline void resource_deleter::operator()(char *p) const
+        {
+            resource->deallocate(p, size);
+        }
+
+        inline void *new_delete_memory_resource::do_allocate(size_t bytes, size_t)
+        {
+            // operator new is aligned for anything up to max_align_t, which
+            // is all krabs asks for.
+            return ::operator new(bytes);
+        }
+
+        inline void new_delete_memory_resource::do_deallocate(void *p, size_t, size_t)
+        {
+            ::operator delete(p);
+        }
+
+    } /* namespace details */
+}
@@ -0,0 +1,490 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntcons.h>
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "compiler_check.hpp"
+
+namespace krabs { namespace details {
+    struct record_block;
+    class record_pool;
+} /* namespace details */ } /* namespace krabs */
+
+namespace krabs {
+
+    class record_arena;
+
+    /**
+     * <summary>
+     *   A copy of an event that stays valid after the callback returns. The
+     *   header, the extended data items and the user data are copied into
+     *   one block of memory and the record points into it.
+     * </summary>
+     * <example>
+     *   krabs::record_arena arena;
+     *   std::deque&lt;krabs::owned_record&gt; queue;
+     *   provider.add_on_event_callback([&](const EVENT_RECORD &record, const krabs::trace_context &) {
+     *       queue.push_back(arena.copy(record));
+     *   });
+     * </example>
+     * <remarks>
+     *   Copies of an owned_record share the same immutable block, so they
+     *   are cheap to pass around and can be released on any thread.
+     * </remarks>
+     */
+    class owned_record {
+    public:
+
+        /**
+         * <summary>Constructs an empty owned_record.</summary>
+         */
+        owned_record();
+
+        /**
+         * <summary>
+         *   Copies the record into a block of its own. Use a record_arena
+         *   to copy many records without allocating for each one.
+         * </summary>
+         */
+        explicit owned_record(const EVENT_RECORD &record);
+
+        owned_record(const owned_record &other);
+        owned_record(owned_record &&other);
+        owned_record &operator=(owned_record other);
+        ~owned_record();
+
+        /**
+         * <summary>Returns whether the object holds no record.</summary>
+         */
+        bool empty() const;
+
+        /**
+         * <summary>Returns the copied record. Must not be empty.</summary>
+         */
+        const EVENT_RECORD &record() const;
+
+        operator const EVENT_RECORD &() const;
+
+    private:
+        owned_record(details::record_block *block, const EVENT_RECORD *record);
+
+        details::record_block *block_;
+        const EVENT_RECORD *record_;
+
+        friend class record_arena;
+    };
+
+    /**
+     * <summary>
+     *   Hands out owned_records from large blocks that are bump allocated
+     *   and recycled once every record in them is released, so a steady
+     *   stream of copies does not touch the heap.
+     * </summary>
+     * <remarks>
+     *   copy() is meant to be called from one thread, typically the one
+     *   processing the trace. The records it returns can be released on any
+     *   thread and may outlive the arena. Records that do not fit in a block
+     *   get a block of their own.
+     * </remarks>
+     */
+    class record_arena {
+    public:
+
+        /**
+         * <summary>
+         *   Constructs an arena with blocks of the given size, keeping at most
+         *   max_free_blocks released blocks around for reuse.
+         * </summary>
+         */
+        explicit record_arena(size_t block_size = 64 * 1024, size_t max_free_blocks = 16);
+
+        record_arena(const record_arena &) = delete;
+        record_arena &operator=(const record_arena &) = delete;
+
+        ~record_arena();
+
+        /**
+         * <summary>Copies the record into the current block.</summary>
+         */
+        owned_record copy(const EVENT_RECORD &record);
+
+        /**
+         * <summary>
+         *   Returns the number of blocks the arena had to allocate so far.
+         * </summary>
+         */
+        size_t blocks_allocated() const;
+
+    private:
+        std::shared_ptr<details::record_pool> pool_;
+        details::record_block *current_;
+    };
+
+    namespace details {
+
+        /**
+         * <summary>
+         *   Returns the number of bytes copy_record needs for the record.
+         * </summary>
+         */
+        size_t copied_record_size(const EVENT_RECORD &record);
+
+        /**
+         * <summary>
+         *   Copies the record, its extended data and its user data to the
+         *   destination, which must be 8 byte aligned and copied_record_size
+         *   bytes long, and returns the copy.
+         * </summary>
+         */
+        const EVENT_RECORD *copy_record(const EVENT_RECORD &record, BYTE *destination);
+
+        /**
+         * <summary>
+         *   A reference counted block of memory that owned_records live in.
+         *   The data follows the header in the same allocation.
+         * </summary>
+         */
+        struct record_block {
+            std::atomic<size_t> references;
+            size_t capacity;
+            size_t used;
+
+            // The pool the block goes back to, or null for blocks that are
+            // freed once released.
+            std::shared_ptr<record_pool> pool;
+
+            static record_block *create(size_t capacity);
+            static void destroy(record_block *block);
+
+            BYTE *data();
+            void acquire();
+            void release();
+        };
+
+        /**
+         * <summary>
+         *   The blocks of a record_arena that are free for reuse. Shared
+         *   between the arena and its blocks so that released blocks always
+         *   have somewhere to go.
+         * </summary>
+         */
+        class record_pool {
+        public:
+            record_pool(size_t block_size, size_t max_free_blocks);
+            ~record_pool();
+
+            record_pool(const record_pool &) = delete;
+            record_pool &operator=(const record_pool &) = delete;
+
+            /**
+             * <summary>
+             *   Returns an empty block with one reference, reusing a free one
+             *   when there is one.
+             * </summary>
+             */
+            record_block *take(const std::shared_ptr<record_pool> &self);
+
+            /**
+             * <summary>Keeps a released block for reuse or frees it.</summary>
+             */
+            void recycle(record_block *block);
+
+            size_t block_size() const;
+            size_t allocated() const;
+
+        private:
+            const size_t blockSize_;
+            const size_t maxFreeBlocks_;
+            std::atomic<size_t> allocated_;
+            std::mutex mutex_;
+            std::vector<record_block *> free_;
+        };
+
+        inline size_t align_record_size(size_t size)
+        {
+            return (size + 7) & ~size_t(7);
+        }
+
+    } /* namespace details */
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline owned_record::owned_record()
+        : block_(nullptr)
+        , record_(nullptr)
+    {}
+
+    inline owned_record::owned_record(const EVENT_RECORD &record)
+        : block_(details::record_block::create(details::copied_record_size(record)))
+        , record_(nullptr)
+    {
+        record_ = details::copy_record(record, block_->data());
+    }
+
+    inline owned_record::owned_record(details::record_block *block, const EVENT_RECORD *record)
+        : block_(block)
+        , record_(record)
+    {}
+
+    inline owned_record::owned_record(const owned_record &other)
+        : block_(other.block_)
+        , record_(other.record_)
+    {
+        if (block_ != nullptr) {
+            block_->acquire();
+        }
+    }
+
+    inline owned_record::owned_record(owned_record &&other)
+        : block_(other.block_)
+        , record_(other.record_)
+    {
+        other.block_ = nullptr;
+        other.record_ = nullptr;
+    }
+
+    inline owned_record &owned_record::operator=(owned_record other)
+    {
+        std::swap(block_, other.block_);
+        std::swap(record_, other.record_);
+        return *this;
+    }
+
+    inline owned_record::~owned_record()
+    {
+        if (block_ != nullptr) {
+            block_->release();
+        }
+    }
+
+    inline bool owned_record::empty() const
+    {
+        return record_ == nullptr;
+    }
+
+    inline const EVENT_RECORD &owned_record::record() const
+    {
+        return *record_;
+    }
+
+    inline owned_record::operator const EVENT_RECORD &() const
+    {
+        return *record_;
+    }
+
+    // ------------------------------------------------------------------------
+
+    inline record_arena::record_arena(size_t block_size, size_t max_free_blocks)
+        : pool_(std::make_shared<details::record_pool>(block_size, max_free_blocks))
+        , current_(nullptr)
+    {}
+
+    inline record_arena::~record_arena()
+    {
+        if (current_ != nullptr) {
+            current_->release();
+        }
+    }
+
+    inline owned_record record_arena::copy(const EVENT_RECORD &record)
+    {
+        auto size = details::copied_record_size(record);
+
+        if (size > pool_->block_size()) {
+            return owned_record(record);
+        }
+
+        if (current_ == nullptr || current_->capacity - current_->used < size) {
+            if (current_ != nullptr) {
+                current_->release();
+            }
+            current_ = pool_->take(pool_);
+        }
+
+        auto destination = current_->data() + current_->used;
+        current_->used += size;
+        current_->acquire();
+
+        return owned_record(current_, details::copy_record(record, destination));
+    }
+
+    inline size_t record_arena::blocks_allocated() const
+    {
+        return pool_->allocated();
+    }
+
+    // ------------------------------------------------------------------------
+
+    namespace details {
+
+        inline size_t copied_record_size(const EVENT_RECORD &record)
+        {
+            auto size = align_record_size(sizeof(EVENT_RECORD));
+            size += align_record_size(record.ExtendedDataCount * sizeof(EVENT_HEADER_EXTENDED_DATA_ITEM));
+
+            for (USHORT i = 0; i < record.ExtendedDataCount; ++i) {
+                size += align_record_size(record.ExtendedData[i].DataSize);
+            }
+
+            return size + align_record_size(record.UserDataLength);
+        }
+
+        inline const EVENT_RECORD *copy_record(const EVENT_RECORD &record, BYTE *destination)
+        {
+            auto copy = new (destination) EVENT_RECORD(record);
+            auto next = destination + align_record_size(sizeof(EVENT_RECORD));
+
+            if (record.ExtendedDataCount == 0) {
+                copy->ExtendedData = nullptr;
+            }
+            else {
+                auto itemsSize = record.ExtendedDataCount * sizeof(EVENT_HEADER_EXTENDED_DATA_ITEM);
+                copy->ExtendedData = reinterpret_cast<EVENT_HEADER_EXTENDED_DATA_ITEM*>(next);
+                memcpy(next, record.ExtendedData, itemsSize);
+                next += align_record_size(itemsSize);
+
+                for (USHORT i = 0; i < record.ExtendedDataCount; ++i) {
+                    auto &item = copy->ExtendedData[i];
+                    if (item.DataSize != 0) {
+                        memcpy(next, reinterpret_cast<const void*>(static_cast<ULONG_PTR>(item.DataPtr)), item.DataSize);
+                    }
+                    item.DataPtr = static_cast<ULONGLONG>(reinterpret_cast<ULONG_PTR>(next));
+                    next += align_record_size(item.DataSize);
+                }
+            }
+
+            if (record.UserDataLength != 0) {
+                memcpy(next, record.UserData, record.UserDataLength);
+            }
+            copy->UserData = next;
+
+            return copy;
+        }
+
+        // ------------------------------------------------------------------------
+
+        inline record_block *record_block::create(size_t capacity)
+        {
+            auto header = align_record_size(sizeof(record_block));
+            auto memory = ::operator new(header + capacity);
+
+            auto block = new (memory) record_block();
+            block->references.store(1, std::memory_order_relaxed);
+            block->capacity = capacity;
+            block->used = 0;
+            return block;
+        }
+
+        inline void record_block::destroy(record_block *block)
+        {
+            block->~record_block();
+            ::operator delete(block);
+        }
+
+        inline BYTE *record_block::data()
+        {
+            return reinterpret_cast<BYTE*>(this) + align_record_size(sizeof(record_block));
+        }
+
+        inline void record_block::acquire()
+        {
+            references.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        inline void record_block::release()
+        {
+            if (references.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+                return;
+            }
+
+            // The block's reference may be the last one to the pool, so keep
+            // the pool alive until it is done with the block.
+            auto owner = std::move(pool);
+            if (owner) {
+                owner->recycle(this);
+            }
+            else {
+                destroy(this);
+            }
+        }
+
+        // ------------------------------------------------------------------------
+
+        inline record_pool::record_pool(size_t block_size, size_t max_free_blocks)
+            : blockSize_(block_size)
+            , maxFreeBlocks_(max_free_blocks)
+            , allocated_(0)
+        {}
+
+        inline record_pool::~record_pool()
+        {
+            for (auto block : free_) {
+                record_block::destroy(block);
+            }
+        }
+
+        inline record_block *record_pool::take(const std::shared_ptr<record_pool> &self)
+        {
+            record_block *block = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!free_.empty()) {
+                    block = free_.back();
+                    free_.pop_back();
+                }
+            }
+
+            if (block == nullptr) {
+                block = record_block::create(blockSize_);
+                allocated_.fetch_add(1, std::memory_order_relaxed);
+            }
+            else {
+                block->references.store(1, std::memory_order_relaxed);
+                block->used = 0;
+            }
+
+            block->pool = self;
+            return block;
+        }
+
+        inline void record_pool::recycle(record_block *block)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (free_.size() < maxFreeBlocks_) {
+                    free_.push_back(block);
+                    return;
+                }
+            }
+
+            record_block::destroy(block);
+        }
+
+        inline size_t record_pool::block_size() const
+        {
+            return blockSize_;
+        }
+
+        inline size_t record_pool::allocated() const
+        {
+            return allocated_.load(std::memory_order_relaxed);
+        }
+
+    } /* namespace details */
+}
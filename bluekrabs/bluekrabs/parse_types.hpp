@@ -16,6 +16,7 @@
 #include <type_traits>
 
 #include "compiler_check.hpp"
+#include "formatting.hpp"
 
 namespace krabs {
 
@@ -135,6 +136,66 @@ namespace krabs {
         return binary(start, n);
     }
 
+    /**
+     * <summary>
+     * The bytes of an ETW field, borrowed from the event record rather than
+     * copied like binary does. Only valid while the record is, which for a
+     * live trace is until the event callback returns.
+     * </summary>
+     */
+    struct byte_span {
+    public:
+        byte_span() : data_(nullptr), size_(0) { }
+
+        byte_span(const BYTE* start, size_t n)
+        : data_(start)
+        , size_(n)
+        { }
+
+        const BYTE* data() const { return data_; }
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+
+        const BYTE* begin() const { return data_; }
+        const BYTE* end() const { return data_ + size_; }
+
+        BYTE operator[](size_t index) const { return data_[index]; }
+
+    private:
+        const BYTE* data_;
+        size_t size_;
+    };
+
+    /**
+     * <summary>
+     * The elements of an ETW array of fixed size values, borrowed from the
+     * event record like byte_span. Returned by parser::parse_array.
+     * </summary>
+     */
+    template <typename T>
+    struct array_span {
+    public:
+        array_span() : data_(nullptr), size_(0) { }
+
+        array_span(const T* start, size_t n)
+        : data_(start)
+        , size_(n)
+        { }
+
+        const T* data() const { return data_; }
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+
+        const T* begin() const { return data_; }
+        const T* end() const { return data_ + size_; }
+
+        const T& operator[](size_t index) const { return data_[index]; }
+
+    private:
+        const T* data_;
+        size_t size_;
+    };
+
     /**
      * <summary>
      * Used to handle parsing of IPv4 and IPv6 fields in an ETW record.
@@ -165,6 +226,20 @@ namespace krabs {
         }
 
         ip_address() {}
+
+        /**
+         * <summary>
+         * Writes the address to the buffer without allocating and returns
+         * its length, zero when the buffer is too small. A buffer of
+         * ipv6_string_size always fits.
+         * </summary>
+         */
+        size_t format(char* buffer, size_t size) const
+        {
+            return is_ipv6
+                ? format_ipv6(v6, buffer, size)
+                : format_ipv4(reinterpret_cast<const BYTE*>(&v4), buffer, size);
+        }
      };
 
     /**
@@ -191,6 +266,43 @@ namespace krabs {
             sa.size = size_in_bytes;
             return sa;
         }
+
+        /**
+         * <summary>
+         * Writes the address and port, "10.0.0.1:443" or "[::1]:443", to
+         * the buffer without allocating and returns its length. Returns
+         * zero when the buffer is too small or the family is neither IPv4
+         * nor IPv6. A buffer of socket_address_string_size always fits.
+         * </summary>
+         */
+        size_t format(char* buffer, size_t buffer_size) const
+        {
+            char scratch[socket_address_string_size];
+            const BYTE* port = nullptr;
+            size_t length = 0;
+
+            // Event data holds the Windows address family values, whatever
+            // the platform reading it.
+            if (sa_stor.ss_family == details::windows_af_inet) {
+                length = format_ipv4(reinterpret_cast<const BYTE*>(&sa_in.sin_addr), scratch, sizeof(scratch));
+                port = reinterpret_cast<const BYTE*>(&sa_in.sin_port);
+            }
+            else if (sa_stor.ss_family == details::windows_af_inet6) {
+                scratch[0] = '[';
+                length = format_ipv6(reinterpret_cast<const BYTE*>(&sa_in6.sin6_addr), scratch + 1, sizeof(scratch) - 1);
+                scratch[++length] = ']';
+                ++length;
+                port = reinterpret_cast<const BYTE*>(&sa_in6.sin6_port);
+            }
+            else {
+                return 0;
+            }
+
+            // The port is in network order.
+            scratch[length++] = ':';
+            auto end = details::write_decimal(scratch + length, (static_cast<uint32_t>(port[0]) << 8) | port[1]);
+            return details::copy_out(scratch, end, buffer, buffer_size);
+        }
     };
 
     /**
@@ -240,21 +352,46 @@ namespace krabs {
         static sid from_bytes(const BYTE* bytes, size_t size_in_bytes)
         {
             sid ws;
-            LPSTR temp_sid_string;
-            UNREFERENCED_PARAMETER(size_in_bytes);
+            char buffer[sid_string_size];
+            auto length = format_sid(bytes, size_in_bytes, buffer, sizeof(buffer));
 
-            if (!ConvertSidToStringSidA((PSID)bytes, &temp_sid_string)) {
+            if (length == 0) {
                 throw std::runtime_error(
                     "Failed to get a SID from a property");
             }
-            ws.sid_string = temp_sid_string;
-            LocalFree(temp_sid_string);
+            ws.sid_string.assign(buffer, length);
             return ws;
         }
 
     private:
     };
 
+    /**
+    * <summary>
+    * The bytes of the SID in a SID or WBEMSID property, borrowed from the
+    * event record. Unlike sid, parsing one neither allocates nor formats,
+    * format it into a stack buffer or through a sid_cache when the string
+    * is needed.
+    * </summary>
+    */
+    struct sid_view : byte_span {
+        sid_view() { }
+
+        sid_view(const BYTE* start, size_t n)
+        : byte_span(start, n)
+        { }
+
+        size_t format(char* buffer, size_t buffer_size) const
+        {
+            return format_sid(data(), size(), buffer, buffer_size);
+        }
+
+        const char* format(sid_cache& cache) const
+        {
+            return cache.format(data(), size());
+        }
+    };
+
     /**
     * <summary>
     * Used to handle parsing of Pointer Address types.
@@ -4,7 +4,9 @@
 #pragma once
 
 #include <cassert>
-#include <deque>
+#include <cstring>
+#include <cwchar>
+#include <type_traits>
 #include <utility>
 #include <stdexcept>
 
@@ -13,6 +15,8 @@
 #include "compiler_check.hpp"
 #include "collection_view.hpp"
 #include "property.hpp"
+#include "property_key.hpp"
+#include "memory_resource.hpp"
 #include "parse_types.hpp"
 #include "size_provider.hpp"
 #include "tdh_helpers.hpp"
@@ -20,6 +24,58 @@
 namespace krabs {
 
     class schema;
+    class struct_cursor;
+
+    namespace details {
+
+        /**
+         * <summary>
+         * The properties a parser has walked past, in schema order. The
+         * first few live inside the object, so parsing an event with a
+         * short variable length tail does not allocate at all. Larger
+         * events take one buffer from the memory_resource, sized for all of
+         * the properties of the schema.
+         * </summary>
+         */
+        class property_cache {
+        public:
+            struct value_type {
+                const wchar_t *first;
+                property_info second;
+            };
+
+            static const size_t inline_capacity = 16;
+
+            /**
+             * <summary>
+             * Constructs an empty cache that expects up to capacity entries.
+             * </summary>
+             */
+            property_cache(size_t capacity, memory_resource &resource);
+            property_cache(const property_cache &other);
+            property_cache &operator=(const property_cache &) = delete;
+            ~property_cache();
+
+            void push_back(const wchar_t *name, const property_info &info);
+
+            size_t size() const;
+            const value_type &operator[](size_t index) const;
+
+        private:
+            void grow();
+
+            memory_resource &resource_;
+            size_t expected_;
+            size_t size_;
+            size_t capacity_;
+            value_type *data_;
+            typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type inline_[inline_capacity];
+        };
+
+        static_assert(std::is_trivially_copyable<property_cache::value_type>::value,
+            "property_cache copies its entries with memcpy");
+
+    } /* namespace details */
 
     /**
      * <summary>
@@ -49,6 +105,14 @@ namespace krabs {
          */
         parser(const schema &);
 
+        /**
+         * <summary>
+         * Constructs an event parser that takes any memory it needs from
+         * the given resource, which must outlive it.
+         * </summary>
+         */
+        parser(const schema &, memory_resource &resource);
+
         /**
          * <summary>
          * Returns an iterator that returns each property in the event.
@@ -67,6 +131,26 @@ namespace krabs {
          */
         property_iterator properties() const;
 
+        /**
+         * <summary>
+         * Returns the properties of the event as lightweight references
+         * that borrow their names from the schema and locate their values
+         * only when asked, walking the event at most once.
+         * </summary>
+         * <example>
+         *    void on_event(const EVENT_RECORD &record, const krabs::trace_context &trace_context)
+         *    {
+         *        krabs::schema schema(record, trace_context.schema_locator);
+         *        krabs::parser parser(schema);
+         *        for (const krabs::property_ref &property : parser.property_refs())
+         *        {
+         *            auto value = parser.parse<krabs::byte_span>(property);
+         *        }
+         *    }
+         * </example>
+         */
+        property_ref_range property_refs();
+
         /**
          * <summary>
          * Attempts to retrieve the given property by name and type.
@@ -77,17 +161,114 @@ namespace krabs {
          * </remarks>
          */
         template <typename T>
+        bool try_parse(const std::wstring &name, T &out);
+
+        /**
+         * <summary>
+         * Attempts to retrieve the given property by key and type.
+         * </summary>
+         */
+        template <typename T>
+        bool try_parse(const property_key &key, T &out);
+
+        /**
+         * <summary>
+         * Attempts to retrieve the given property by type, using the
+         * property at the given index in the schema unless index is npos.
+         * </summary>
+         */
+        template <typename T>
         bool try_parse(const std::wstring &name, T &out, ULONG& index);
 
+        /**
+         * <summary>
+         * Attempts to retrieve the given property of this event by type.
+         * </summary>
+         */
+        template <typename T>
+        bool try_parse(const property_ref &property, T &out);
+
         /**
          * <summary>
          * Attempts to parse the given property by name and type. If the
          * property does not exist, an exception is thrown.
          * </summary>
+         * <remarks>
+         * std::wstring_view, std::string_view (C++17) and byte_span results
+         * point into the event record instead of copying the property, so
+         * they must not be kept past the event callback.
+         * </remarks>
+         */
+        template <typename T>
+        T parse(const std::wstring &name);
+
+        /**
+         * <summary>
+         * Attempts to parse the given property by key and type. If the
+         * property does not exist, an exception is thrown.
+         * </summary>
+         * <example>
+         *     static const krabs::property_key context_info(L"ContextInfo");
+         *     auto context = parser.parse<std::wstring>(context_info);
+         * </example>
+         */
+        template <typename T>
+        T parse(const property_key &key);
+
+        /**
+         * <summary>
+         * Attempts to parse the given property by type, using the property
+         * at the given index in the schema unless index is npos. If the
+         * property does not exist, an exception is thrown.
+         * </summary>
          */
         template <typename T>
         T parse(const std::wstring &name, ULONG& index);
 
+        /**
+         * <summary>
+         * Attempts to parse the given property of this event by type.
+         * </summary>
+         */
+        template <typename T>
+        T parse(const property_ref &property);
+
+        /**
+         * <summary>
+         * Parses the given array property, whose elements must be of type
+         * T. The span points into the event record. The number of elements
+         * may come from another property of the event, as may their
+         * length. If the property does not exist, an exception is thrown.
+         * </summary>
+         * <example>
+         *     auto ports = parser.parse_array<uint16_t>(L"Ports");
+         *     for (auto port : ports) {
+         *         // ...
+         *     }
+         * </example>
+         */
+        template <typename T>
+        array_span<T> parse_array(const std::wstring &name);
+
+        template <typename T>
+        array_span<T> parse_array(const property_key &key);
+
+        /**
+         * <summary>
+         * Returns a cursor over the elements of the given structure
+         * property, a single structure or an array of them. If the property
+         * does not exist or is not a structure, an exception is thrown.
+         * </summary>
+         * <example>
+         *     auto entries = parser.parse_struct(L"Entries");
+         *     while (entries.next()) {
+         *         auto key = entries.parse<std::wstring>(L"KeyName");
+         *     }
+         * </example>
+         */
+        struct_cursor parse_struct(const std::wstring &name);
+        struct_cursor parse_struct(const property_key &key);
+
         /**
         * todo
         */
@@ -101,8 +282,34 @@ namespace krabs {
         template <typename Adapter>
         auto view_of(const std::wstring &name, Adapter &adapter) -> collection_view<typename Adapter::const_iterator>;
 
+        template <typename Adapter>
+        auto view_of(const property_key &key, Adapter &adapter) -> collection_view<typename Adapter::const_iterator>;
+
+        /**
+         * <summary>
+         * Views the given property, named by length characters that need
+         * not be null terminated or held in a std::wstring, so that the
+         * lookup doesn't allocate.
+         * </summary>
+         */
+        template <typename Adapter>
+        auto view_of(const wchar_t *name, size_t length, Adapter &adapter) -> collection_view<typename Adapter::const_iterator>;
+
     private:
+        template <typename T>
+        T parse_property(const wchar_t *name, const property_info &propInfo);
+
+        template <typename T>
+        array_span<T> parse_array_property(const wchar_t *name, const property_info &propInfo);
+
+        struct_cursor parse_struct_property(const property_info &propInfo);
+
+        template <typename T, typename Parse>
+        static bool try_parse_with(T &out, Parse &&parse);
+
         property_info find_property(const std::wstring &name);
+        property_info find_property(const wchar_t *name, size_t length);
+        property_info find_property(const property_key &key);
         property_info find_property_at(ULONG index);
 
         inline property_info resolve_property(const std::wstring& name, ULONG index)
@@ -110,6 +317,35 @@ namespace krabs {
             return (index != npos) ? find_property_at(index) : find_property(name);
         }
 
+        property_info find_fixed_property(ULONG index) const;
+        void skip_fixed_properties();
+
+        // Sizing of the properties by the rules of the schema layout,
+        // counts and lengths being read from the properties before them
+        // through lookup. unknown_size means that Tdh has to be asked.
+        static constexpr ULONG unknown_size = size_provider::unknown_size;
+
+        ULONG property_size(ULONG index, const wchar_t *name);
+
+        template <typename Lookup>
+        ULONG size_of(ULONG index, const BYTE *start, Lookup &&lookup) const;
+
+        template <typename Lookup>
+        ULONG count_of(const EVENT_PROPERTY_INFO &info, Lookup &&lookup) const;
+
+        template <typename Lookup>
+        ULONG length_from(size_rule kind, ULONG index, Lookup &&lookup) const;
+
+        ULONG walk_members(
+            const EVENT_PROPERTY_INFO &structInfo,
+            const BYTE *element,
+            ULONG stopIndex,
+            property_info *found) const;
+
+        property_info find_member(const EVENT_PROPERTY_INFO &structInfo, const BYTE *element, ULONG index) const;
+
+        static ULONG read_count(const property_info &info);
+
         void cache_property(const wchar_t *name, property_info info);
 
     private:
@@ -117,19 +353,101 @@ namespace krabs {
         const BYTE *pEndBuffer_;
         BYTE *pBufferIndex_;
         ULONG lastPropertyIndex_;
+        const bool is32Bit_;
+
+        friend class property_ref;
+        friend class struct_cursor;
+
+        // Maintain a mapping from property name to blob data index. The
+        // properties at fixed offsets come from the schema layout, so only
+        // the variable length tail ends up here.
+        details::property_cache propertyCache_;
+    };
+
+    /**
+     * <summary>
+     * Walks the elements of a structure property, one at a time, and parses
+     * the members of the current element. Returned by parser::parse_struct.
+     * </summary>
+     * <remarks>
+     * The cursor starts before the first element. Members are located by
+     * walking the element from its start, which for the handful of members
+     * structures have is cheaper than remembering them. Only valid as long
+     * as the parser it came from.
+     * </remarks>
+     */
+    class struct_cursor {
+    public:
 
-        // Maintain a mapping from property name to blob data index.
-        std::deque<std::pair<const wchar_t *, property_info>> propertyCache_;
+        /**
+         * <summary>
+         * Returns the number of elements, 1 unless the structure is an
+         * array.
+         * </summary>
+         */
+        size_t count() const;
+
+        /**
+         * <summary>
+         * Moves to the next element. Returns false once past the last one.
+         * </summary>
+         */
+        bool next();
+
+        /**
+         * <summary>
+         * Returns the bytes of the current element.
+         * </summary>
+         */
+        byte_span bytes() const;
+
+        /**
+         * <summary>
+         * Parses the given member of the current element, like the parser
+         * does for properties of the event.
+         * </summary>
+         */
+        template <typename T>
+        T parse(const std::wstring &member) const;
+
+        template <typename T>
+        bool try_parse(const std::wstring &member, T &out) const;
+
+        template <typename T>
+        array_span<T> parse_array(const std::wstring &member) const;
+
+        struct_cursor parse_struct(const std::wstring &member) const;
+
+    private:
+        struct_cursor(parser &p, const EVENT_PROPERTY_INFO &info, const BYTE *start, ULONG length, ULONG count);
+
+        property_info find(const std::wstring &member) const;
+
+        parser *parser_;
+        const EVENT_PROPERTY_INFO *pStructInfo_;
+        const BYTE *pElement_;
+        const BYTE *pEnd_;
+        ULONG elementLength_;
+        ULONG count_;
+        ULONG position_;
+
+        friend class parser;
     };
 
     // Implementation
     // ------------------------------------------------------------------------
 
     inline parser::parser(const schema &s)
+    : parser(s, new_delete_resource())
+    {}
+
+    inline parser::parser(const schema &s, memory_resource &resource)
     : schema_(s)
     , pEndBuffer_((BYTE*)s.record_.UserData + s.record_.UserDataLength)
     , pBufferIndex_((BYTE*)s.record_.UserData)
     , lastPropertyIndex_(0)
+    , is32Bit_((s.record_.EventHeader.Flags & EVENT_HEADER_FLAG_32_BIT_HEADER) != 0)
+    , propertyCache_(s.pSchema_->TopLevelPropertyCount - s.pLayout_->fixed_count(), resource)
     {}
 
     inline property_iterator parser::properties() const
@@ -137,8 +455,28 @@ namespace krabs {
         return property_iterator(schema_);
     }
 
+    inline property_ref_range parser::property_refs()
+    {
+        return property_ref_range(*this, schema_);
+    }
+
+    inline property_info property_ref::info() const
+    {
+        return parser_->find_property_at(index_);
+    }
+
     inline property_info parser::find_property(const std::wstring &name)
     {
+        return find_property(name.c_str(), name.size());
+    }
+
+    inline property_info parser::find_property(const wchar_t *name, size_t length)
+    {
+        // Compares the name against a null terminated name in the schema.
+        auto matches = [name, length](const wchar_t *other) {
+            return wcsncmp(name, other, length) == 0 && other[length] == L'\0';
+        };
+
         // A schema contains a collection of properties that are keyed by name.
         // These properties are stored in a blob of bytes that needs to be
         // interpreted according to information that is packaged up in the
@@ -147,15 +485,34 @@ namespace krabs {
         // the contents within it. This is janky, so our strategy is to
         // minimize this as much as possible via caching.
 
-        // The first step is to use our cache for the property to see if we've
-        // discovered it already.
-        for (auto &item : propertyCache_) {
-            if (name == item.first) {
+        // The leading properties whose sizes are fixed by the schema sit at
+        // the same offsets in every event, so those are loaded directly.
+        const ULONG fixedCount = schema_.pLayout_->fixed_count();
+        for (ULONG i = 0; i < fixedCount; ++i) {
+            auto &currentPropInfo = schema_.pSchema_->EventPropertyInfoArray[i];
+            const wchar_t *pName = reinterpret_cast<const wchar_t*>(
+                                        reinterpret_cast<BYTE*>(schema_.pSchema_) +
+                                        currentPropInfo.NameOffset);
+
+            if (matches(pName)) {
+                return find_fixed_property(i);
+            }
+        }
+
+        // Otherwise use our cache for the property to see if we've
+        // discovered it already, latest first.
+        for (auto i = propertyCache_.size(); i > 0; --i) {
+            auto &item = propertyCache_[i - 1];
+            if (matches(item.first)) {
                 return item.second;
             }
         }
 
-        const ULONG totalPropCount = schema_.pSchema_->PropertyCount;
+        // The members of structures follow the top level properties in the
+        // schema, they are found through parse_struct.
+        const ULONG totalPropCount = schema_.pSchema_->TopLevelPropertyCount;
+
+        skip_fixed_properties();
 
         assert((pBufferIndex_ <= pEndBuffer_ && pBufferIndex_ >= schema_.record_.UserData) &&
                "invariant: we should've already thrown for falling off the edge");
@@ -185,11 +542,7 @@ namespace krabs {
                                         reinterpret_cast<BYTE*>(schema_.pSchema_) +
                                         currentPropInfo.NameOffset);
 
-            ULONG propertyLength = size_provider::get_property_size(
-                                        pBufferIndex_,
-                                        pName,
-                                        schema_.record_,
-                                        currentPropInfo);
+            ULONG propertyLength = property_size(i, pName);
 
             // verify that the length of the property doesn't exceed the buffer
             if (pBufferIndex_ + propertyLength > pEndBuffer_) {
@@ -203,7 +556,7 @@ namespace krabs {
             pBufferIndex_ += propertyLength;
 
             // The property was found, return it
-            if (name == pName) {
+            if (matches(pName)) {
                 // advance the index since we've already processed this property
                 ++i;
                 return propInfo;
@@ -214,17 +567,34 @@ namespace krabs {
         return property_info();
     }
 
+    inline property_info parser::find_property(const property_key &key)
+    {
+        // The schema knows the interned ids of its property names, so the
+        // key resolves to an index without looking at any strings.
+        auto index = schema_.pLayout_->index_of(key);
+        if (index == details::schema_layout::npos) {
+            return property_info();
+        }
+
+        return find_property_at(index);
+    }
+
     inline property_info parser::find_property_at(ULONG index)
     {
-        const ULONG totalPropCount = schema_.pSchema_->PropertyCount;
+        const ULONG totalPropCount = schema_.pSchema_->TopLevelPropertyCount;
         if (index >= totalPropCount)
             return property_info();
 
-        // Already advanced past this index — check cache by index position
+        if (index < schema_.pLayout_->fixed_count())
+            return find_fixed_property(index);
+
+        skip_fixed_properties();
+
+        // Already advanced past this index, the cache holds the variable
+        // length tail in schema order.
         if (index < lastPropertyIndex_)
         {
-            // Cache is push_front, so index 0 is at back, etc.
-            auto cacheIdx = lastPropertyIndex_ - 1 - index;
+            auto cacheIdx = index - schema_.pLayout_->fixed_count();
             if (cacheIdx < propertyCache_.size())
                 return propertyCache_[cacheIdx].second;
         }
@@ -237,8 +607,7 @@ namespace krabs {
                 reinterpret_cast<BYTE*>(schema_.pSchema_) +
                 currentPropInfo.NameOffset);
 
-            ULONG propertyLength = size_provider::get_property_size(
-                pBufferIndex_, pName, schema_.record_, currentPropInfo);
+            ULONG propertyLength = property_size(i, pName);
 
             if (pBufferIndex_ + propertyLength > pEndBuffer_)
                 throw std::out_of_range("Property length past end of property buffer");
@@ -258,11 +627,298 @@ namespace krabs {
         return property_info();
     }
 
+    inline property_info parser::find_fixed_property(ULONG index) const
+    {
+        auto offset = schema_.pLayout_->offset(index, is32Bit_);
+        auto length = schema_.pLayout_->length(index, is32Bit_);
+
+        // verify that the property doesn't exceed the buffer
+        if (offset + length > schema_.record_.UserDataLength) {
+            throw std::out_of_range("Property length past end of property buffer");
+        }
+
+        return property_info(
+            (BYTE*)schema_.record_.UserData + offset,
+            schema_.pSchema_->EventPropertyInfoArray[index],
+            length);
+    }
+
+    inline void parser::skip_fixed_properties()
+    {
+        // The walk over the variable length tail starts where the fixed
+        // properties end, without having to size each of them.
+        const ULONG fixedCount = schema_.pLayout_->fixed_count();
+        if (lastPropertyIndex_ >= fixedCount) {
+            return;
+        }
+
+        auto offset = schema_.pLayout_->offset(fixedCount, is32Bit_);
+        if (offset > schema_.record_.UserDataLength) {
+            throw std::out_of_range("Property length past end of property buffer");
+        }
+
+        pBufferIndex_ = (BYTE*)schema_.record_.UserData + offset;
+        lastPropertyIndex_ = fixedCount;
+    }
+
     inline void parser::cache_property(const wchar_t *name, property_info propInfo)
     {
-        propertyCache_.push_front(std::make_pair(name, propInfo));
+        propertyCache_.push_back(name, propInfo);
+    }
+
+    inline ULONG parser::property_size(ULONG index, const wchar_t *name)
+    {
+        // A count or length refers to a property before this one, which
+        // the walk has already passed and cached.
+        auto size = size_of(index, pBufferIndex_, [this, index](ULONG other) {
+            return other < index ? find_property_at(other) : property_info();
+        });
+
+        if (size != unknown_size) {
+            return size;
+        }
+
+        schema_.pLayout_->count_tdh_size_lookup();
+        return size_provider::get_tdh_size(name, schema_.record_);
+    }
+
+    template <typename Lookup>
+    ULONG parser::count_of(const EVENT_PROPERTY_INFO &info, Lookup &&lookup) const
+    {
+        if ((info.Flags & PropertyParamCount) != 0) {
+            return read_count(lookup(info.countPropertyIndex));
+        }
+
+        return size_provider::get_fixed_count(info);
+    }
+
+    template <typename Lookup>
+    ULONG parser::size_of(ULONG index, const BYTE *start, Lookup &&lookup) const
+    {
+        const auto &info = schema_.pSchema_->EventPropertyInfoArray[index];
+        const auto &rule = schema_.pLayout_->size_rule_at(index);
+
+        switch (rule.kind) {
+        case size_rule::length_from_property:
+        case size_rule::length_from_property_utf16:
+            return length_from(rule.kind, rule.value, lookup);
+
+        case size_rule::array:
+        case size_rule::structure:
+            break;
+
+        default:
+            return size_provider::apply_size_rule(rule.kind, rule.value, start, pEndBuffer_, is32Bit_);
+        }
+
+        const auto count = count_of(info, lookup);
+        if (count == unknown_size) {
+            return unknown_size;
+        }
+
+        const auto available = static_cast<uint64_t>(pEndBuffer_ - start);
+        uint64_t size = 0;
+
+        // Elements that all have the same size are sized at once.
+        if (rule.kind == size_rule::array && (
+            rule.element == size_rule::fixed ||
+            rule.element == size_rule::pointer ||
+            rule.element == size_rule::length_from_property ||
+            rule.element == size_rule::length_from_property_utf16)) {
+            const auto element = rule.element == size_rule::fixed || rule.element == size_rule::pointer
+                ? size_provider::apply_size_rule(rule.element, rule.value, start, pEndBuffer_, is32Bit_)
+                : length_from(rule.element, rule.value, lookup);
+            if (element == unknown_size) {
+                return unknown_size;
+            }
+
+            size = static_cast<uint64_t>(element) * count;
+            if (size > available) {
+                throw std::out_of_range("Property length past end of property buffer");
+            }
+
+            return static_cast<ULONG>(size);
+        }
+
+        // The others are sized one by one. An element only sizes to 0 once
+        // the data has run out, which is left to Tdh rather than spinning
+        // through whatever count the event claims.
+        for (ULONG i = 0; i < count; ++i) {
+            const auto element = rule.kind == size_rule::structure
+                ? walk_members(info, start + size, ULONG(-1), nullptr)
+                : size_provider::apply_size_rule(rule.element, rule.value, start + size, pEndBuffer_, is32Bit_);
+
+            if (element == unknown_size || element == 0) {
+                return unknown_size;
+            }
+
+            size += element;
+            if (size > available) {
+                throw std::out_of_range("Property length past end of property buffer");
+            }
+        }
+
+        return static_cast<ULONG>(size);
+    }
+
+    inline ULONG parser::walk_members(
+        const EVENT_PROPERTY_INFO &structInfo,
+        const BYTE *element,
+        ULONG stopIndex,
+        property_info *found) const
+    {
+        const ULONG first = structInfo.structType.StructStartIndex;
+        const ULONG last = first + structInfo.structType.NumOfStructMembers;
+
+        // Members refer to earlier members of the same element for their
+        // counts and lengths, which are found by walking again.
+        uint64_t offset = 0;
+        for (ULONG i = first; i < last; ++i) {
+            const auto &member = schema_.pSchema_->EventPropertyInfoArray[i];
+            const auto at = element + offset;
+            auto size = size_of(i, at, [&](ULONG other) {
+                return other >= first && other < i ? find_member(structInfo, element, other) : property_info();
+            });
+
+            if (size == unknown_size) {
+                return unknown_size;
+            }
+
+            if (at + size > pEndBuffer_) {
+                throw std::out_of_range("Property length past end of property buffer");
+            }
+
+            if (i == stopIndex) {
+                *found = property_info(at, member, size);
+                return static_cast<ULONG>(offset);
+            }
+
+            offset += size;
+        }
+
+        return static_cast<ULONG>(offset);
+    }
+
+    inline property_info parser::find_member(const EVENT_PROPERTY_INFO &structInfo, const BYTE *element, ULONG index) const
+    {
+        property_info found;
+        walk_members(structInfo, element, index, &found);
+        return found;
+    }
+
+    template <typename Lookup>
+    ULONG parser::length_from(size_rule kind, ULONG index, Lookup &&lookup) const
+    {
+        const auto length = read_count(lookup(index));
+        if (length == unknown_size || kind != size_rule::length_from_property_utf16) {
+            return length;
+        }
+
+        // Wide strings give their length in characters.
+        const auto size = static_cast<uint64_t>(length) * sizeof(wchar_t);
+        return size < unknown_size ? static_cast<ULONG>(size) : unknown_size;
+    }
+
+    inline ULONG parser::read_count(const property_info &info)
+    {
+        if (!info.found()) {
+            return unknown_size;
+        }
+
+        switch (info.length_) {
+        case sizeof(uint8_t):
+            return *info.pPropertyIndex_;
+        case sizeof(uint16_t):
+            return *reinterpret_cast<const uint16_t*>(info.pPropertyIndex_);
+        case sizeof(uint32_t):
+            return *reinterpret_cast<const uint32_t*>(info.pPropertyIndex_);
+        case sizeof(uint64_t): {
+            auto value = *reinterpret_cast<const uint64_t*>(info.pPropertyIndex_);
+            return value < unknown_size ? static_cast<ULONG>(value) : unknown_size;
+        }
+        default:
+            return unknown_size;
+        }
     }
 
+    // ------------------------------------------------------------------------
+
+    namespace details {
+
+        inline property_cache::property_cache(size_t capacity, memory_resource &resource)
+            : resource_(resource)
+            , expected_(capacity)
+            , size_(0)
+            , capacity_(inline_capacity)
+            , data_(reinterpret_cast<value_type *>(inline_))
+        {}
+
+        inline property_cache::property_cache(const property_cache &other)
+            : resource_(other.resource_)
+            , expected_(other.expected_)
+            , size_(other.size_)
+            , capacity_(inline_capacity)
+            , data_(reinterpret_cast<value_type *>(inline_))
+        {
+            if (other.size_ > inline_capacity) {
+                capacity_ = other.capacity_;
+                data_ = static_cast<value_type *>(
+                    resource_.allocate(capacity_ * sizeof(value_type), alignof(value_type)));
+            }
+
+            if (size_ != 0) {
+                memcpy(data_, other.data_, size_ * sizeof(value_type));
+            }
+        }
+
+        inline property_cache::~property_cache()
+        {
+            if (data_ != reinterpret_cast<value_type *>(inline_)) {
+                resource_.deallocate(data_, capacity_ * sizeof(value_type), alignof(value_type));
+            }
+        }
+
+        inline void property_cache::push_back(const wchar_t *name, const property_info &info)
+        {
+            if (size_ == capacity_) {
+                grow();
+            }
+
+            auto &entry = data_[size_++];
+            entry.first = name;
+            entry.second = info;
+        }
+
+        inline size_t property_cache::size() const
+        {
+            return size_;
+        }
+
+        inline const property_cache::value_type &property_cache::operator[](size_t index) const
+        {
+            return data_[index];
+        }
+
+        inline void property_cache::grow()
+        {
+            // The first spill goes straight to the size of the schema, so it
+            // is the only one.
+            auto capacity = expected_ > capacity_ ? expected_ : capacity_ * 2;
+            auto data = static_cast<value_type *>(
+                resource_.allocate(capacity * sizeof(value_type), alignof(value_type)));
+
+            memcpy(data, data_, size_ * sizeof(value_type));
+
+            if (data_ != reinterpret_cast<value_type *>(inline_)) {
+                resource_.deallocate(data_, capacity_ * sizeof(value_type), alignof(value_type));
+            }
+
+            data_ = data;
+            capacity_ = capacity;
+        }
+
+    } /* namespace details */
+
     inline void throw_if_property_not_found(const property_info &propInfo)
     {
         if (!propInfo.found()) {
@@ -288,11 +944,11 @@ namespace krabs {
     // try_parse
     // ------------------------------------------------------------------------
 
-    template <typename T>
-    bool parser::try_parse(const std::wstring &name, T &out, ULONG& index)
+    template <typename T, typename Parse>
+    bool parser::try_parse_with(T &out, Parse &&parse)
     {
         try {
-            out = parse<T>(name);
+            out = parse();
             return true;
         }
 
@@ -310,13 +966,60 @@ namespace krabs {
         }
     }
 
+    template <typename T>
+    bool parser::try_parse(const std::wstring &name, T &out)
+    {
+        return try_parse_with(out, [&]() { return parse<T>(name); });
+    }
+
+    template <typename T>
+    bool parser::try_parse(const property_key &key, T &out)
+    {
+        return try_parse_with(out, [&]() { return parse<T>(key); });
+    }
+
+    template <typename T>
+    bool parser::try_parse(const std::wstring &name, T &out, ULONG& index)
+    {
+        return try_parse_with(out, [&]() { return parse<T>(name, index); });
+    }
+
+    template <typename T>
+    bool parser::try_parse(const property_ref &property, T &out)
+    {
+        return try_parse_with(out, [&]() { return parse<T>(property); });
+    }
+
     // parse
     // ------------------------------------------------------------------------
 
+    template <typename T>
+    T parser::parse(const std::wstring &name)
+    {
+        return parse_property<T>(name.c_str(), find_property(name));
+    }
+
+    template <typename T>
+    T parser::parse(const property_key &key)
+    {
+        return parse_property<T>(key.name().c_str(), find_property(key));
+    }
+
     template <typename T>
     T parser::parse(const std::wstring &name, ULONG& index)
     {
-        auto propInfo = resolve_property(name, index);
+        return parse_property<T>(name.c_str(), resolve_property(name, index));
+    }
+
+    template <typename T>
+    T parser::parse(const property_ref &property)
+    {
+        return parse_property<T>(property.name(), find_property_at(property.index()));
+    }
+
+    template <typename T>
+    T parser::parse_property(const wchar_t *name, const property_info &propInfo)
+    {
         throw_if_property_not_found(propInfo);
 
         krabs::debug::assert_valid_assignment<T>(name, propInfo);
@@ -330,9 +1033,9 @@ namespace krabs {
     }
 
     template<>
-    inline bool parser::parse<bool>(const std::wstring& name, ULONG& index)
+    inline bool parser::parse_property<bool>(
+        const wchar_t *name, const property_info &propInfo)
     {
-        auto propInfo = resolve_property(name, index);
         throw_if_property_not_found(propInfo);
 
         krabs::debug::assert_valid_assignment<bool>(name, propInfo);
@@ -342,9 +1045,9 @@ namespace krabs {
     }
 
     template <>
-    inline std::wstring parser::parse<std::wstring>(const std::wstring &name, ULONG& index)
+    inline std::wstring parser::parse_property<std::wstring>(
+        const wchar_t *name, const property_info &propInfo)
     {
-        auto propInfo = resolve_property(name, index);
         throw_if_property_not_found(propInfo);
 
         krabs::debug::assert_valid_assignment<std::wstring>(name, propInfo);
@@ -356,9 +1059,9 @@ namespace krabs {
     }
 
     template <>
-    inline std::string parser::parse<std::string>(const std::wstring &name, ULONG& index)
+    inline std::string parser::parse_property<std::string>(
+        const wchar_t *name, const property_info &propInfo)
     {
-        auto propInfo = resolve_property(name, index);
         throw_if_property_not_found(propInfo);
 
         krabs::debug::assert_valid_assignment<std::string>(name, propInfo);
@@ -369,10 +1072,45 @@ namespace krabs {
         return std::string(string, length);
     }
 
+#ifdef KRABS_HAS_STRING_VIEW
+
+    // The views point into the event record and are only valid as long as
+    // the record is, they are not null terminated.
+
+    template <>
+    inline std::wstring_view parser::parse_property<std::wstring_view>(
+        const wchar_t *name, const property_info &propInfo)
+    {
+        throw_if_property_not_found(propInfo);
+
+        krabs::debug::assert_valid_assignment<std::wstring_view>(name, propInfo);
+
+        auto string = reinterpret_cast<const wchar_t*>(propInfo.pPropertyIndex_);
+        auto length = get_string_content_length(string, propInfo.length_);
+
+        return std::wstring_view(string, length);
+    }
+
+    template <>
+    inline std::string_view parser::parse_property<std::string_view>(
+        const wchar_t *name, const property_info &propInfo)
+    {
+        throw_if_property_not_found(propInfo);
+
+        krabs::debug::assert_valid_assignment<std::string_view>(name, propInfo);
+
+        auto string = reinterpret_cast<const char*>(propInfo.pPropertyIndex_);
+        auto length = get_string_content_length(string, propInfo.length_);
+
+        return std::string_view(string, length);
+    }
+
+#endif // KRABS_HAS_STRING_VIEW
+
     template<>
-    inline const counted_string* parser::parse<const counted_string*>(const std::wstring &name, ULONG& index)
+    inline const counted_string* parser::parse_property<const counted_string*>(
+        const wchar_t *name, const property_info &propInfo)
     {
-        auto propInfo = resolve_property(name, index);
         throw_if_property_not_found(propInfo);
 
         krabs::debug::assert_valid_assignment<const counted_string*>(name, propInfo);
@@ -381,9 +1119,9 @@ namespace krabs {
     }
 
     template<>
-    inline binary parser::parse<binary>(const std::wstring &name, ULONG& index)
+    inline binary parser::parse_property<binary>(
+        const wchar_t * /*name*/, const property_info &propInfo)
     {
-        auto propInfo = resolve_property(name, index);
         throw_if_property_not_found(propInfo);
 
         // no type asserts for binary - anything can be read as binary
@@ -392,10 +1130,20 @@ namespace krabs {
     }
 
     template<>
-    inline ip_address parser::parse<ip_address>(
-        const std::wstring &name, ULONG& index)
+    inline byte_span parser::parse_property<byte_span>(
+        const wchar_t * /*name*/, const property_info &propInfo)
+    {
+        throw_if_property_not_found(propInfo);
+
+        // like binary, anything can be borrowed as bytes
+
+        return byte_span(propInfo.pPropertyIndex_, propInfo.length_);
+    }
+
+    template<>
+    inline ip_address parser::parse_property<ip_address>(
+        const wchar_t *name, const property_info &propInfo)
     {
-        auto propInfo = resolve_property(name, index);
         throw_if_property_not_found(propInfo);
 
         krabs::debug::assert_valid_assignment<ip_address>(name, propInfo);
@@ -415,10 +1163,9 @@ namespace krabs {
     }
 
     template<>
-    inline socket_address parser::parse<socket_address>(
-        const std::wstring &name, ULONG& index)
+    inline socket_address parser::parse_property<socket_address>(
+        const wchar_t *name, const property_info &propInfo)
     {
-        auto propInfo = resolve_property(name, index);
         throw_if_property_not_found(propInfo);
 
         krabs::debug::assert_valid_assignment<socket_address>(name, propInfo);
@@ -427,13 +1174,12 @@ namespace krabs {
     }
 
     template<>
-    inline sid parser::parse<sid>(
-        const std::wstring& name, ULONG& index)
+    inline sid_view parser::parse_property<sid_view>(
+        const wchar_t *name, const property_info &propInfo)
     {
-        auto propInfo = resolve_property(name, index);
         throw_if_property_not_found(propInfo);
 
-        krabs::debug::assert_valid_assignment<sid>(name, propInfo);
+        krabs::debug::assert_valid_assignment<sid_view>(name, propInfo);
         auto InType = propInfo.pEventPropertyInfo_->nonStructType.InType;
 
         // A WBEMSID is actually a TOKEN_USER structure followed by the SID.
@@ -451,14 +1197,14 @@ namespace krabs {
         }
         switch (InType) {
         case TDH_INTYPE_SID:
-            return sid::from_bytes(propInfo.pPropertyIndex_, propInfo.length_);
+            return sid_view(propInfo.pPropertyIndex_, propInfo.length_);
         case TDH_INTYPE_WBEMSID:
             // Safety measure to make sure we don't overflow
             if (propInfo.length_ <= sid_start) {
                 throw std::runtime_error(
                     "Requested a WBEMSID property but data is too small");
             }
-            return sid::from_bytes(propInfo.pPropertyIndex_ + sid_start, propInfo.length_ - sid_start);
+            return sid_view(propInfo.pPropertyIndex_ + sid_start, propInfo.length_ - sid_start);
 
         default:
             throw std::runtime_error("SID was not a SID or WBEMSID");
@@ -466,9 +1212,17 @@ namespace krabs {
     }
 
     template<>
-    inline pointer parser::parse<pointer>(const std::wstring& name, ULONG& index)
+    inline sid parser::parse_property<sid>(
+        const wchar_t *name, const property_info &propInfo)
+    {
+        auto view = parse_property<sid_view>(name, propInfo);
+        return sid::from_bytes(view.data(), view.size());
+    }
+
+    template<>
+    inline pointer parser::parse_property<pointer>(
+        const wchar_t *name, const property_info &propInfo)
     {
-        auto propInfo = resolve_property(name, index);
         throw_if_property_not_found(propInfo);
 
         krabs::debug::assert_valid_assignment<pointer>(name, propInfo);
@@ -476,6 +1230,213 @@ namespace krabs {
         return pointer::from_bytes(propInfo.pPropertyIndex_, propInfo.length_);
     }
 
+    // parse_array, parse_struct
+    // ------------------------------------------------------------------------
+
+    template <typename T>
+    array_span<T> parser::parse_array(const std::wstring &name)
+    {
+        return parse_array_property<T>(name.c_str(), find_property(name));
+    }
+
+    template <typename T>
+    array_span<T> parser::parse_array(const property_key &key)
+    {
+        return parse_array_property<T>(key.name().c_str(), find_property(key));
+    }
+
+    template <typename T>
+    array_span<T> parser::parse_array_property(const wchar_t *name, const property_info &propInfo)
+    {
+        throw_if_property_not_found(propInfo);
+
+        const auto &info = *propInfo.pEventPropertyInfo_;
+        if ((info.Flags & PropertyStruct) != 0) {
+            throw std::runtime_error("Requested an array of a structure, use parse_struct");
+        }
+
+        // The in type is the type of each element.
+        krabs::debug::assert_valid_assignment<T>(name, propInfo);
+
+        // Elements whose length comes from another property are checked
+        // against the whole array only.
+        if ((info.Flags & PropertyParamLength) == 0) {
+            if (info.length == 0) {
+                throw std::runtime_error("Array elements are not of a fixed size");
+            }
+
+            auto elementSize = info.nonStructType.InType == TDH_INTYPE_POINTER
+                ? (is32Bit_ ? 4u : 8u)
+                : info.length;
+
+            if (sizeof(T) != elementSize)
+                throw std::runtime_error("Property size doesn't match requested size");
+        }
+
+        if (propInfo.length_ % sizeof(T) != 0)
+            throw std::runtime_error("Property size doesn't match requested size");
+
+        return array_span<T>(
+            reinterpret_cast<const T*>(propInfo.pPropertyIndex_),
+            propInfo.length_ / sizeof(T));
+    }
+
+    inline struct_cursor parser::parse_struct(const std::wstring &name)
+    {
+        return parse_struct_property(find_property(name));
+    }
+
+    inline struct_cursor parser::parse_struct(const property_key &key)
+    {
+        return parse_struct_property(find_property(key));
+    }
+
+    inline struct_cursor parser::parse_struct_property(const property_info &propInfo)
+    {
+        throw_if_property_not_found(propInfo);
+
+        const auto &info = *propInfo.pEventPropertyInfo_;
+        if ((info.Flags & PropertyStruct) == 0) {
+            throw std::runtime_error("Property is not a structure");
+        }
+
+        // The count was read once already while sizing the property, the
+        // properties it can come from are cached by now.
+        const auto index = static_cast<ULONG>(&info - schema_.pSchema_->EventPropertyInfoArray);
+        auto count = count_of(info, [this, index](ULONG other) {
+            return other < index ? find_property_at(other) : property_info();
+        });
+
+        if (count == unknown_size) {
+            throw std::runtime_error("Could not find the number of elements of the structure");
+        }
+
+        return struct_cursor(*this, info, propInfo.pPropertyIndex_, propInfo.length_, count);
+    }
+
+    // ------------------------------------------------------------------------
+
+    inline struct_cursor::struct_cursor(
+        parser &p,
+        const EVENT_PROPERTY_INFO &info,
+        const BYTE *start,
+        ULONG length,
+        ULONG count)
+    : parser_(&p)
+    , pStructInfo_(&info)
+    , pElement_(start)
+    , pEnd_(start + length)
+    , elementLength_(0)
+    , count_(count)
+    , position_(ULONG(-1))
+    {}
+
+    inline size_t struct_cursor::count() const
+    {
+        return count_;
+    }
+
+    inline bool struct_cursor::next()
+    {
+        if (position_ != ULONG(-1) && position_ >= count_) {
+            return false;
+        }
+
+        pElement_ += elementLength_;
+        ++position_;
+
+        if (position_ >= count_) {
+            elementLength_ = 0;
+            return false;
+        }
+
+        elementLength_ = parser_->walk_members(*pStructInfo_, pElement_, ULONG(-1), nullptr);
+        if (elementLength_ == parser::unknown_size) {
+            throw std::runtime_error("Could not find the size of a member of the structure");
+        }
+
+        if (pElement_ + elementLength_ > pEnd_) {
+            throw std::out_of_range("Property length past end of property buffer");
+        }
+
+        return true;
+    }
+
+    inline byte_span struct_cursor::bytes() const
+    {
+        if (position_ >= count_) {
+            throw std::out_of_range("The cursor is not on an element of the structure");
+        }
+
+        return byte_span(pElement_, elementLength_);
+    }
+
+    inline property_info struct_cursor::find(const std::wstring &member) const
+    {
+        if (position_ >= count_) {
+            throw std::out_of_range("The cursor is not on an element of the structure");
+        }
+
+        const auto &schema = parser_->schema_;
+        const ULONG first = pStructInfo_->structType.StructStartIndex;
+        const ULONG last = first + pStructInfo_->structType.NumOfStructMembers;
+
+        for (ULONG i = first; i < last; ++i) {
+            const wchar_t *pName = reinterpret_cast<const wchar_t*>(
+                reinterpret_cast<BYTE*>(schema.pSchema_) +
+                schema.pSchema_->EventPropertyInfoArray[i].NameOffset);
+
+            if (member == pName) {
+                return parser_->find_member(*pStructInfo_, pElement_, i);
+            }
+        }
+
+        return property_info();
+    }
+
+    template <typename T>
+    T struct_cursor::parse(const std::wstring &member) const
+    {
+        return parser_->parse_property<T>(member.c_str(), find(member));
+    }
+
+    template <typename T>
+    bool struct_cursor::try_parse(const std::wstring &member, T &out) const
+    {
+        return parser::try_parse_with(out, [&]() { return parse<T>(member); });
+    }
+
+    template <typename T>
+    array_span<T> struct_cursor::parse_array(const std::wstring &member) const
+    {
+        return parser_->parse_array_property<T>(member.c_str(), find(member));
+    }
+
+    inline struct_cursor struct_cursor::parse_struct(const std::wstring &member) const
+    {
+        auto propInfo = find(member);
+        throw_if_property_not_found(propInfo);
+
+        const auto &info = *propInfo.pEventPropertyInfo_;
+        if ((info.Flags & PropertyStruct) == 0) {
+            throw std::runtime_error("Property is not a structure");
+        }
+
+        const ULONG first = pStructInfo_->structType.StructStartIndex;
+        const auto index = static_cast<ULONG>(&info - parser_->schema_.pSchema_->EventPropertyInfoArray);
+        auto count = parser_->count_of(info, [&](ULONG other) {
+            return other >= first && other < index
+                ? parser_->find_member(*pStructInfo_, pElement_, other)
+                : property_info();
+        });
+
+        if (count == parser::unknown_size) {
+            throw std::runtime_error("Could not find the number of elements of the structure");
+        }
+
+        return struct_cursor(*parser_, info, propInfo.pPropertyIndex_, propInfo.length_, count);
+    }
+
     // pars_type
     // ------------------------------------------------------------------------
 
@@ -516,4 +1477,24 @@ namespace krabs {
 
         return adapter(propInfo);
     }
+
+    template <typename Adapter>
+    auto parser::view_of(const property_key &key, Adapter &adapter)
+        -> collection_view<typename Adapter::const_iterator>
+    {
+        auto propInfo = find_property(key);
+        throw_if_property_not_found(propInfo);
+
+        return adapter(propInfo);
+    }
+
+    template <typename Adapter>
+    auto parser::view_of(const wchar_t *name, size_t length, Adapter &adapter)
+        -> collection_view<typename Adapter::const_iterator>
+    {
+        auto propInfo = find_property(name, length);
+        throw_if_property_not_found(propInfo);
+
+        return adapter(propInfo);
+    }
 }
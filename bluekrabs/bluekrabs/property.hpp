@@ -9,12 +9,14 @@
 
 #define INITGUID
 
+#include <iterator>
 #include <memory>
 #include <vector>
 
 #include "compiler_check.hpp"
 #include "schema.hpp"
 #include "errors.hpp"
+#include "parse_types.hpp"
 
 #include <windows.h>
 #include <tdh.h>
@@ -24,6 +26,8 @@
 
 namespace krabs {
 
+    class parser;
+
     /**
      * <summary>
      * Represents a single property of the record schema.
@@ -82,14 +86,19 @@ namespace krabs {
      * <summary>
      * Iterates the properties in a given event record.
      * </summary>
+     * <remarks>
+     *   Every property is copied out of the schema, name included, before
+     *   the first one is returned. Use parser::property_refs to walk the
+     *   properties of every event.
+     * </remarks>
      */
     class property_iterator {
     public:
 
         /**
          * <summary>
-         *   Constructs a new iterator that lazily retrieves the properties of
-         *   the given event record.
+         *   Constructs a new iterator over the properties of the given event
+         *   record.
          * </summary>
          * <remarks>
          *   Don't construct this yourself. Let the `parser` class do it for you.
@@ -143,6 +152,130 @@ namespace krabs {
         std::vector<property>::iterator curr_;
     };
 
+    /**
+     * <summary>
+     * A property of the event being parsed, as yielded by
+     * parser::property_refs. It borrows its name from the schema and finds
+     * its value through the parser, so it is cheap to copy but must not
+     * outlive either.
+     * </summary>
+     */
+    class property_ref {
+    public:
+
+        /**
+         * <summary>
+         * Retrieves the null terminated name of the property.
+         * </summary>
+         */
+        const wchar_t *name() const;
+
+        /**
+         * <summary>
+         * Retrieves the length of the name, in characters.
+         * </summary>
+         */
+        size_t name_length() const;
+
+        /**
+         * <summary>
+         * Retrieves the Tdh in and out types of the property.
+         * </summary>
+         */
+        _TDH_IN_TYPE type() const;
+        _TDH_OUT_TYPE out_type() const;
+
+        /**
+         * <summary>
+         * Retrieves the index of the property in the schema.
+         * </summary>
+         */
+        ULONG index() const;
+
+        /**
+         * <summary>
+         * Locates the value of the property in the event.
+         * </summary>
+         * <remarks>
+         *   The parser walks the event up to this property the first time
+         *   and remembers what it found, so properties visited in order are
+         *   each sized once. Throws when the event is too short to hold the
+         *   property.
+         * </remarks>
+         */
+        property_info info() const;
+
+        /**
+         * <summary>
+         * Retrieves the bytes of the value of the property in the event.
+         * </summary>
+         */
+        const BYTE *data() const;
+        ULONG length() const;
+
+    private:
+        property_ref(parser &p, const schema &s, ULONG index);
+
+        parser *parser_;
+        const EVENT_PROPERTY_INFO *pPropertyInfo_;
+        const wchar_t *name_;
+        ULONG nameLength_;
+        ULONG index_;
+
+        friend class property_ref_iterator;
+    };
+
+    /**
+     * <summary>
+     * Forward iterator over the properties of the event being parsed. Moving
+     * to the next property looks at the schema only, the values are located
+     * when they are asked for.
+     * </summary>
+     */
+    class property_ref_iterator {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef property_ref value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const property_ref *pointer;
+        typedef const property_ref &reference;
+
+        property_ref_iterator(parser &p, const schema &s, ULONG index);
+
+        reference operator*() const;
+        pointer operator->() const;
+        property_ref_iterator &operator++();
+        property_ref_iterator operator++(int);
+
+        bool operator==(const property_ref_iterator &other) const;
+        bool operator!=(const property_ref_iterator &other) const;
+
+    private:
+        const schema *schema_;
+        property_ref current_;
+    };
+
+    /**
+     * <summary>
+     * The top level properties of the event being parsed, in schema order.
+     * </summary>
+     * <remarks>
+     *   Don't construct this yourself. Let the `parser` class do it for you.
+     * </remarks>
+     */
+    class property_ref_range {
+    public:
+        property_ref_range(parser &p, const schema &s);
+
+        property_ref_iterator begin() const;
+        property_ref_iterator end() const;
+        size_t size() const;
+
+    private:
+        parser &parser_;
+        const schema &schema_;
+    };
+
     // Implementation
     // ------------------------------------------------------------------------
 
@@ -212,5 +345,123 @@ namespace krabs {
         return props;
     }
 
+    // ------------------------------------------------------------------------
+
+    inline property_ref::property_ref(parser &p, const schema &s, ULONG index)
+    : parser_(&p)
+    , pPropertyInfo_(nullptr)
+    , name_(nullptr)
+    , nameLength_(0)
+    , index_(index)
+    {
+        if (index < s.pSchema_->TopLevelPropertyCount) {
+            pPropertyInfo_ = &s.pSchema_->EventPropertyInfoArray[index];
+            name_ = reinterpret_cast<const wchar_t*>(
+                reinterpret_cast<const BYTE*>(s.pSchema_) +
+                pPropertyInfo_->NameOffset);
+            nameLength_ = s.pLayout_->name_length(index);
+        }
+    }
+
+    inline const wchar_t *property_ref::name() const
+    {
+        return name_;
+    }
+
+    inline size_t property_ref::name_length() const
+    {
+        return nameLength_;
+    }
+
+    inline _TDH_IN_TYPE property_ref::type() const
+    {
+        return (_TDH_IN_TYPE)pPropertyInfo_->nonStructType.InType;
+    }
+
+    inline _TDH_OUT_TYPE property_ref::out_type() const
+    {
+        return (_TDH_OUT_TYPE)pPropertyInfo_->nonStructType.OutType;
+    }
+
+    inline ULONG property_ref::index() const
+    {
+        return index_;
+    }
+
+    inline const BYTE *property_ref::data() const
+    {
+        return info().pPropertyIndex_;
+    }
+
+    inline ULONG property_ref::length() const
+    {
+        return info().length_;
+    }
+
+    // property_ref::info is implemented in parser.hpp, where the parser is
+    // complete.
+
+    // ------------------------------------------------------------------------
+
+    inline property_ref_iterator::property_ref_iterator(parser &p, const schema &s, ULONG index)
+    : schema_(&s)
+    , current_(p, s, index)
+    {}
+
+    inline property_ref_iterator::reference property_ref_iterator::operator*() const
+    {
+        return current_;
+    }
+
+    inline property_ref_iterator::pointer property_ref_iterator::operator->() const
+    {
+        return &current_;
+    }
+
+    inline property_ref_iterator &property_ref_iterator::operator++()
+    {
+        current_ = property_ref(*current_.parser_, *schema_, current_.index_ + 1);
+        return *this;
+    }
+
+    inline property_ref_iterator property_ref_iterator::operator++(int)
+    {
+        auto previous = *this;
+        ++*this;
+        return previous;
+    }
+
+    inline bool property_ref_iterator::operator==(const property_ref_iterator &other) const
+    {
+        return current_.index_ == other.current_.index_;
+    }
+
+    inline bool property_ref_iterator::operator!=(const property_ref_iterator &other) const
+    {
+        return !(*this == other);
+    }
+
+    // ------------------------------------------------------------------------
+
+    inline property_ref_range::property_ref_range(parser &p, const schema &s)
+    : parser_(p)
+    , schema_(s)
+    {}
+
+    inline property_ref_iterator property_ref_range::begin() const
+    {
+        return property_ref_iterator(parser_, schema_, 0);
+    }
+
+    inline property_ref_iterator property_ref_range::end() const
+    {
+        return property_ref_iterator(parser_, schema_, static_cast<ULONG>(size()));
+    }
+
+    inline size_t property_ref_range::size() const
+    {
+        return schema_.pSchema_->TopLevelPropertyCount;
+    }
+
 
 } /* namespace krabs */
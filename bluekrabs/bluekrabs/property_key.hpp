@@ -0,0 +1,132 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "compiler_check.hpp"
+
+namespace krabs {
+
+    namespace details {
+
+        /**
+         * <summary>
+         *   Hands out a process wide id for each distinct property name, so
+         *   that names can be compared as integers.
+         * </summary>
+         * <remarks>
+         *   Names are interned when a property_key is created and once for
+         *   each property of a schema when it is first cached, never per
+         *   event. Ids start at one.
+         * </remarks>
+         */
+        class property_name_table {
+        public:
+            static uint32_t intern(const wchar_t *name, size_t length);
+
+        private:
+            static std::mutex &mutex();
+            static std::unordered_map<std::wstring, uint32_t> &ids();
+        };
+
+    } /* namespace details */
+
+    /**
+     * <summary>
+     *   A property name that has been interned once up front, for callbacks
+     *   and filters that look up the same properties on every event.
+     * </summary>
+     * <example>
+     *   static const krabs::property_key context_info(L"ContextInfo");
+     *
+     *   void on_event(const EVENT_RECORD &record, const krabs::trace_context &trace_context)
+     *   {
+     *       krabs::schema schema(record, trace_context.schema_locator);
+     *       krabs::parser parser(schema);
+     *       auto context = parser.parse<std::wstring>(context_info);
+     *   }
+     * </example>
+     * <remarks>
+     *   Looking a key up in a schema compares integer ids against the ids of
+     *   the schema's properties, which are computed when the schema is
+     *   cached, instead of comparing wide strings.
+     * </remarks>
+     */
+    class property_key {
+    public:
+        property_key(const std::wstring &name);
+
+        /**
+         * <summary>
+         *   Returns the name this key was created from.
+         * </summary>
+         */
+        const std::wstring &name() const;
+
+        /**
+         * <summary>
+         *   Returns the interned id of the name.
+         * </summary>
+         */
+        uint32_t id() const;
+
+    private:
+        std::wstring name_;
+        uint32_t id_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    namespace details {
+
+        inline uint32_t property_name_table::intern(const wchar_t *name, size_t length)
+        {
+            std::wstring key(name, length);
+
+            std::lock_guard<std::mutex> lock(mutex());
+            auto &table = ids();
+            auto it = table.find(key);
+            if (it != table.end()) {
+                return it->second;
+            }
+
+            auto id = static_cast<uint32_t>(table.size() + 1);
+            table.emplace(std::move(key), id);
+            return id;
+        }
+
+        inline std::mutex &property_name_table::mutex()
+        {
+            static std::mutex mutex;
+            return mutex;
+        }
+
+        inline std::unordered_map<std::wstring, uint32_t> &property_name_table::ids()
+        {
+            static std::unordered_map<std::wstring, uint32_t> ids;
+            return ids;
+        }
+
+    } /* namespace details */
+
+    inline property_key::property_key(const std::wstring &name)
+        : name_(name)
+        , id_(details::property_name_table::intern(name.c_str(), name.size()))
+    {}
+
+    inline const std::wstring &property_key::name() const
+    {
+        return name_;
+    }
+
+    inline uint32_t property_key::id() const
+    {
+        return id_;
+    }
+}
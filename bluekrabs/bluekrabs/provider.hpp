@@ -9,9 +9,11 @@
 #include <functional>
 
 #include "compiler_check.hpp"
+#include "event_batch.hpp"
 #include "filtering/event_filter.hpp"
 #include "filtering/pre_event_filter.hpp"
 #include "perfinfo_groupmask.hpp"
+#include "provider_dispatch.hpp"
 #include "trace_context.hpp"
 #include "wstring_convert.hpp"
 
@@ -113,6 +115,44 @@ namespace krabs {
             void add_filter(const event_filter &f);
 
             void add_filter(const pre_event_filter& f);
+
+            /**
+             * <summary>
+             * Adds a function to call with batches of this provider's events
+             * instead of one event at a time. Events are copied as they arrive
+             * and delivered when ETW is done with the buffer they came in, or
+             * sooner if a batch size is set.
+             * </summary>
+             * <example>
+             *    krabs::guid id(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+             *    provider<> powershell(id);
+             *    powershell.add_on_batch_callback([&](const krabs::event_span &events, const krabs::trace_context &trace_context) {
+             *        for (auto &event : events) {
+             *            krabs::schema schema(event.record(), trace_context.schema_locator);
+             *        }
+             *    });
+             * </example>
+             * <remarks>
+             * Batch callbacks are called in addition to the event callbacks
+             * and filters. The copies are only valid during the call.
+             * </remarks>
+             */
+            void add_on_batch_callback(c_provider_batch_callback callback);
+
+            template <typename U>
+            void add_on_batch_callback(U &callback);
+
+            template <typename U>
+            void add_on_batch_callback(const U &callback);
+
+            /**
+             * <summary>
+             * Delivers a batch as soon as it holds the given number of events,
+             * without waiting for the end of the buffer. Zero, the default,
+             * only delivers at the end of each buffer.
+             * </summary>
+             */
+            void set_batch_size(size_t events);
         protected:
 
             /**
@@ -122,11 +162,25 @@ namespace krabs {
              */
             void on_event(const EVENT_RECORD &record, const krabs::trace_context &context) const;
 
+            /**
+             * <summary>
+             *   Called when ETW is done with a buffer, delivers the batched
+             *   events if there are any.
+             * </summary>
+             */
+            void flush_batch(const krabs::trace_context &context) const;
+
         protected:
             std::deque<provider_callback> callbacks_;
             std::deque<provider_error_callback> error_callbacks_;
             std::deque<event_filter> filters_;
+            event_id_dispatch_table filter_dispatch_;
             filter_descriptor pre_filter_;
+            std::deque<provider_batch_callback> batch_callbacks_;
+            size_t batch_size_ = 0;
+
+            // Only touched by the thread that processes the trace.
+            mutable event_batch batch_;
         private:
             template <typename T>
             friend class details::trace_manager;
@@ -494,6 +548,7 @@ namespace krabs {
         void base_provider<T>::add_filter(const event_filter &f)
         {
             filters_.push_back(f);
+            filter_dispatch_.add(f.provider_filter_event_ids());
         }
 
         template <typename T>
@@ -502,9 +557,80 @@ namespace krabs {
             pre_filter_ = f();
         }
 
+        template <typename T>
+        void base_provider<T>::add_on_batch_callback(c_provider_batch_callback callback)
+        {
+            batch_callbacks_.push_back(callback);
+        }
+
+        template <typename T>
+        template <typename U>
+        void base_provider<T>::add_on_batch_callback(U &callback)
+        {
+            batch_callbacks_.push_back(std::ref(callback));
+        }
+
+        template <typename T>
+        template <typename U>
+        void base_provider<T>::add_on_batch_callback(const U &callback)
+        {
+            batch_callbacks_.push_back(callback);
+        }
+
+        template <typename T>
+        void base_provider<T>::set_batch_size(size_t events)
+        {
+            batch_size_ = events;
+        }
+
+        template <typename T>
+        void base_provider<T>::flush_batch(const krabs::trace_context &trace_context) const
+        {
+            if (batch_.size() == 0) {
+                return;
+            }
+
+            auto events = batch_.seal();
+
+            try
+            {
+                try
+                {
+                    for (auto& callback : batch_callbacks_)
+                    {
+                        callback(events, trace_context);
+                    }
+                }
+                catch (krabs::could_not_find_schema& ex)
+                {
+                    // Reported like it is for event callbacks. The batch
+                    // doesn't tell which of its events failed, so the error
+                    // is reported for the last one.
+                    for (auto& error_callback : error_callbacks_)
+                    {
+                        error_callback(events[events.size() - 1].record(), ex.what());
+                    }
+                }
+            }
+            catch (...)
+            {
+                batch_.clear();
+                throw;
+            }
+
+            batch_.clear();
+        }
+
         template <typename T>
         void base_provider<T>::on_event(const EVENT_RECORD &record, const krabs::trace_context &trace_context) const
         {
+            if (!batch_callbacks_.empty()) {
+                batch_.add(record);
+                if (batch_.size() == batch_size_) {
+                    flush_batch(trace_context);
+                }
+            }
+
             try
             {
                 for (auto& callback : callbacks_) 
@@ -512,8 +638,9 @@ namespace krabs {
                     callback(record, trace_context);
                 }
 
-                for (auto& filter : filters_) {
-                    filter.on_event(record, trace_context);
+                // Only the filters that asked for this event id see it.
+                for (auto index : filter_dispatch_.find(record.EventHeader.EventDescriptor.Id)) {
+                    filters_[index].on_event(record, trace_context);
                 }
             }
             catch (krabs::could_not_find_schema& ex)
@@ -678,6 +805,8 @@ namespace krabs {
         tmp.level_          = static_cast<UCHAR>(level_);
         tmp.enable_property_ = static_cast<ULONG>(enable_property_);
         tmp.callbacks_      = this->callbacks_;
+        tmp.batch_callbacks_ = this->batch_callbacks_;
+        tmp.batch_size_     = this->batch_size_;
 
         return tmp;
     }
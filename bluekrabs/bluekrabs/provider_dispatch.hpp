@@ -0,0 +1,395 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <evntcons.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "compiler_check.hpp"
+#include "guid.hpp"
+
+namespace krabs { namespace details {
+
+    /**
+     * <summary>
+     *   An immutable GUID to provider index used to route events to the
+     *   provider that was enabled for them. A table is built once per
+     *   change to the set of enabled providers and is then only read from
+     *   the event callback, so lookups never take a lock.
+     * </summary>
+     * <remarks>
+     *   trace::enable replaces a provider already enabled for the same
+     *   GUID, so the most recently enabled provider receives the events.
+     *   Should the list still hold two providers for a GUID, the first one
+     *   in it does, as when the trace used to scan its list.
+     * </remarks>
+     */
+    template <typename Provider>
+    class provider_dispatch_table {
+    public:
+
+        /**
+         * <summary>
+         *   Builds a table from the list of providers enabled on a trace.
+         * </summary>
+         */
+        explicit provider_dispatch_table(
+            const std::deque<std::reference_wrapper<const Provider>> &providers);
+
+        /**
+         * <summary>
+         *   Returns the provider that should receive events for the given
+         *   GUID or nullptr when no such provider is enabled.
+         * </summary>
+         */
+        const Provider *find(const GUID &guid) const;
+
+        /**
+         * <summary>
+         *   Calls the function with every provider that receives events.
+         * </summary>
+         */
+        template <typename Function>
+        void for_each(Function &&function) const;
+
+        /**
+         * <summary>
+         *   Returns the number of distinct GUIDs in the table.
+         * </summary>
+         */
+        size_t size() const;
+
+    private:
+        std::unordered_map<krabs::guid, const Provider *> providers_;
+    };
+
+    /**
+     * <summary>
+     *   Owns the dispatch tables of a trace and publishes the current one to
+     *   the event callback.
+     * </summary>
+     * <remarks>
+     *   Replaced tables are retired rather than freed because the thread
+     *   that processes events may still be reading from one. That thread
+     *   calls quiesce() between buffers, when it holds no table, and the
+     *   next rebuild frees every table retired before then.
+     * </remarks>
+     */
+    template <typename Provider>
+    class provider_dispatcher {
+    public:
+        provider_dispatcher();
+
+        provider_dispatcher(const provider_dispatcher &) = delete;
+        provider_dispatcher &operator=(const provider_dispatcher &) = delete;
+
+        /**
+         * <summary>
+         *   Builds a new table for the given providers and makes it the
+         *   current one. Callers serialize rebuilds among themselves.
+         * </summary>
+         */
+        void rebuild(const std::deque<std::reference_wrapper<const Provider>> &providers);
+
+        /**
+         * <summary>
+         *   Called by the thread that processes events at a point where it
+         *   holds no table, such as the end of a buffer. Tables replaced
+         *   before this call may be freed afterwards.
+         * </summary>
+         */
+        void quiesce();
+
+        /**
+         * <summary>
+         *   Returns the provider that should receive events for the given
+         *   GUID or nullptr when no such provider is enabled.
+         * </summary>
+         */
+        const Provider *find(const GUID &guid) const;
+
+        /**
+         * <summary>
+         *   Calls the function with every provider of the current table.
+         * </summary>
+         */
+        template <typename Function>
+        void for_each(Function &&function) const;
+
+        /**
+         * <summary>
+         *   Returns the number of replaced tables not freed yet.
+         * </summary>
+         */
+        size_t retired_count() const;
+
+    private:
+        typedef provider_dispatch_table<Provider> table_type;
+
+        struct retired_table {
+            uint64_t generation;
+            std::unique_ptr<const table_type> table;
+        };
+
+        std::atomic<const table_type *> current_;
+        std::unique_ptr<const table_type> owned_;
+        std::vector<retired_table> retired_;
+
+        // Bumped by every rebuild; quiescent_ is the last generation the
+        // event thread has seen while holding no table.
+        std::atomic<uint64_t> generation_;
+        std::atomic<uint64_t> quiescent_;
+    };
+
+    /**
+     * <summary>
+     *   Remembers which provider a classic (MOF) event belongs to. Those
+     *   events carry the GUID of their event class in the header instead of
+     *   the provider GUID, and resolving it requires a schema lookup.
+     * </summary>
+     * <remarks>
+     *   The mapping from an event class to its provider does not depend on
+     *   which providers are enabled, so it survives dispatch table rebuilds.
+     *   It is only touched by the thread that processes the trace.
+     * </remarks>
+     */
+    class legacy_provider_map {
+    public:
+
+        /**
+         * <summary>
+         *   Returns the provider GUID for the given event class GUID, calling
+         *   into resolve(record) the first time the class is seen. A GUID of
+         *   all zeros is cached and returned for classes that TDH can not
+         *   resolve.
+         * </summary>
+         */
+        template <typename Resolver>
+        const krabs::guid &lookup(const EVENT_RECORD &record, Resolver &&resolve);
+
+    private:
+        std::unordered_map<krabs::guid, krabs::guid> providers_;
+    };
+
+    /**
+     * <summary>
+     *   Maps an event id to the event filters of a provider that want to see
+     *   it. Filters constructed with event ids only get those events, filters
+     *   without ids get every event. Events that no filter asked for are
+     *   dropped with a single bit test.
+     * </summary>
+     * <remarks>
+     *   Filters are identified by their position in the provider's list, so
+     *   the table stays valid when the provider is copied. The list for an
+     *   id keeps the filters in the order they were added.
+     * </remarks>
+     */
+    class event_id_dispatch_table {
+    public:
+        event_id_dispatch_table();
+
+        /**
+         * <summary>
+         *   Registers the next filter of the provider with the event ids it
+         *   wants. An empty list means all events.
+         * </summary>
+         */
+        void add(const std::vector<unsigned short> &event_ids);
+
+        /**
+         * <summary>
+         *   Returns the positions of the filters that want the given event id.
+         * </summary>
+         */
+        const std::vector<size_t> &find(unsigned short event_id) const;
+
+    private:
+        size_t count_;
+        std::bitset<65536> ids_;
+        std::unordered_map<unsigned short, std::vector<size_t>> filtersById_;
+        std::vector<size_t> allEvents_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    template <typename Provider>
+    provider_dispatch_table<Provider>::provider_dispatch_table(
+        const std::deque<std::reference_wrapper<const Provider>> &providers)
+    {
+        providers_.reserve(providers.size());
+        for (auto &provider : providers) {
+            providers_.emplace(provider.get().guid(), &provider.get());
+        }
+    }
+
+    template <typename Provider>
+    const Provider *provider_dispatch_table<Provider>::find(const GUID &guid) const
+    {
+        auto it = providers_.find(krabs::guid(guid));
+        if (it == providers_.end()) {
+            return nullptr;
+        }
+
+        return it->second;
+    }
+
+    template <typename Provider>
+    template <typename Function>
+    void provider_dispatch_table<Provider>::for_each(Function &&function) const
+    {
+        for (auto &entry : providers_) {
+            function(*entry.second);
+        }
+    }
+
+    template <typename Provider>
+    size_t provider_dispatch_table<Provider>::size() const
+    {
+        return providers_.size();
+    }
+
+    // ------------------------------------------------------------------------
+
+    template <typename Provider>
+    provider_dispatcher<Provider>::provider_dispatcher()
+    : current_(nullptr)
+    , generation_(0)
+    , quiescent_(0)
+    {}
+
+    template <typename Provider>
+    void provider_dispatcher<Provider>::rebuild(
+        const std::deque<std::reference_wrapper<const Provider>> &providers)
+    {
+        // Tables retired at or before the generation the event thread last
+        // passed quietly can no longer be in use.
+        auto quiescent = quiescent_.load(std::memory_order_acquire);
+        retired_.erase(
+            std::remove_if(retired_.begin(), retired_.end(), [quiescent](const retired_table &retired) {
+                return retired.generation <= quiescent;
+            }),
+            retired_.end());
+
+        std::unique_ptr<const table_type> table(new table_type(providers));
+        current_.store(table.get(), std::memory_order_release);
+
+        // The event thread sees the new table once it has seen the new
+        // generation, which it only records between buffers.
+        auto generation = generation_.fetch_add(1, std::memory_order_acq_rel) + 1;
+        if (owned_) {
+            retired_.push_back(retired_table{ generation, std::move(owned_) });
+        }
+
+        owned_ = std::move(table);
+    }
+
+    template <typename Provider>
+    void provider_dispatcher<Provider>::quiesce()
+    {
+        quiescent_.store(generation_.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    template <typename Provider>
+    size_t provider_dispatcher<Provider>::retired_count() const
+    {
+        return retired_.size();
+    }
+
+    template <typename Provider>
+    const Provider *provider_dispatcher<Provider>::find(const GUID &guid) const
+    {
+        auto table = current_.load(std::memory_order_acquire);
+        if (table == nullptr) {
+            return nullptr;
+        }
+
+        return table->find(guid);
+    }
+
+    template <typename Provider>
+    template <typename Function>
+    void provider_dispatcher<Provider>::for_each(Function &&function) const
+    {
+        auto table = current_.load(std::memory_order_acquire);
+        if (table != nullptr) {
+            table->for_each(std::forward<Function>(function));
+        }
+    }
+
+    // ------------------------------------------------------------------------
+
+    template <typename Resolver>
+    const krabs::guid &legacy_provider_map::lookup(
+        const EVENT_RECORD &record,
+        Resolver &&resolve)
+    {
+        auto it = providers_.find(krabs::guid(record.EventHeader.ProviderId));
+        if (it != providers_.end()) {
+            return it->second;
+        }
+
+        return providers_.emplace(
+            krabs::guid(record.EventHeader.ProviderId),
+            resolve(record)).first->second;
+    }
+
+    // ------------------------------------------------------------------------
+
+    inline event_id_dispatch_table::event_id_dispatch_table()
+    : count_(0)
+    {}
+
+    inline void event_id_dispatch_table::add(const std::vector<unsigned short> &event_ids)
+    {
+        auto index = count_++;
+
+        if (event_ids.empty()) {
+            allEvents_.push_back(index);
+            for (auto &entry : filtersById_) {
+                entry.second.push_back(index);
+            }
+
+            return;
+        }
+
+        for (auto id : event_ids) {
+            if (!ids_[id]) {
+                // Filters that want all events and were added before this
+                // one come first for this id as well.
+                ids_[id] = true;
+                filtersById_[id] = allEvents_;
+            }
+
+            auto &filters = filtersById_[id];
+            if (filters.empty() || filters.back() != index) {
+                filters.push_back(index);
+            }
+        }
+    }
+
+    inline const std::vector<size_t> &event_id_dispatch_table::find(unsigned short event_id) const
+    {
+        if (!ids_[event_id]) {
+            return allEvents_;
+        }
+
+        return filtersById_.find(event_id)->second;
+    }
+
+} /* namespace details */ } /* namespace krabs */
@@ -262,9 +262,13 @@ namespace krabs {
         */
         std::vector<ULONG_PTR> stack_trace() const;
 
+    private:
+        schema(const EVENT_RECORD &, const details::schema_cache_entry &);
+
     private:
         const EVENT_RECORD &record_;
         TRACE_EVENT_INFO *pSchema_;
+        const details::schema_layout *pLayout_;
 
     private:
         friend std::wstring event_name(const schema &);
@@ -282,6 +286,9 @@ namespace krabs {
 
         friend class parser;
         friend class property_iterator;
+        friend class property_ref;
+        friend class property_ref_range;
+        friend class struct_cursor;
         friend class record_builder;
     };
 
@@ -290,8 +297,13 @@ namespace krabs {
     // ------------------------------------------------------------------------
 
     inline schema::schema(const EVENT_RECORD &record, const krabs::schema_locator &schema_locator)
+        : schema(record, *schema_locator.find_entry(record))
+    { }
+
+    inline schema::schema(const EVENT_RECORD &record, const details::schema_cache_entry &entry)
         : record_(record)
-        , pSchema_(schema_locator.get_event_schema(record))
+        , pSchema_((TRACE_EVENT_INFO *)entry.buffer.get())
+        , pLayout_(&entry.layout)
     { }
 
     inline bool schema::operator==(const schema &other) const
@@ -383,9 +395,18 @@ namespace krabs {
 
     inline const wchar_t *schema::provider_name() const
     {
-       return reinterpret_cast<const wchar_t*>(
-           reinterpret_cast<const char*>(pSchema_) +
-           pSchema_->ProviderNameOffset);
+        /*
+        ProviderNameOffset is 0 for schemas that were built without a
+        provider name, like those decoded from a manifest resource alone.
+        */
+        if (pSchema_->ProviderNameOffset != 0) {
+            return reinterpret_cast<const wchar_t*>(
+                reinterpret_cast<const char*>(pSchema_) +
+                pSchema_->ProviderNameOffset);
+        }
+        else {
+            return L"";
+        }
     }
 
     inline unsigned int schema::process_id() const
@@ -0,0 +1,463 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <tdh.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <cwchar>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "compiler_check.hpp"
+#include "schema_locator.hpp"
+
+#pragma comment(lib, "advapi32.lib")
+
+namespace krabs {
+
+    /**
+     * <summary>
+     * Writes every schema the locator holds to a file that
+     * load_schema_cache can read back on the next start, and returns how
+     * many were written. The file is replaced atomically.
+     * </summary>
+     * <example>
+     *    // on shutdown
+     *    krabs::save_schema_cache(trace_context.schema_locator, L"C:\\ProgramData\\agent\\schemas.bin");
+     * </example>
+     */
+    size_t save_schema_cache(const schema_locator &locator, const std::wstring &path);
+
+    /**
+     * <summary>
+     * Adds the schemas stored in a file written by save_schema_cache to
+     * the locator, so lookups for them never call into TDH, and returns
+     * how many were added.
+     * </summary>
+     * <remarks>
+     * A missing file, a file from another version of Windows and a file
+     * that is not a schema cache all load nothing. Schemas that fail
+     * their checksum or do not match their key are skipped and looked up
+     * through TDH when their events show up.
+     *
+     * Manifests installed with Windows only change with the OS build, and
+     * a provider that changes the layout of an event bumps its version,
+     * which is part of the key. A file is tied to the build and update
+     * revision it was written on.
+     * </remarks>
+     */
+    size_t load_schema_cache(const schema_locator &locator, const std::wstring &path);
+
+    namespace details {
+
+        /**
+         * <summary>
+         * The start of a schema cache file. It is followed by entry_count
+         * entries, each an entry header and the TRACE_EVENT_INFO as TDH
+         * returned it, padded to 8 bytes. The file is meant to be mapped
+         * and read in place.
+         * </summary>
+         */
+        struct schema_cache_file_header {
+            static const uint32_t expected_magic = 0x4353524B; // "KRSC"
+            static const uint32_t current_format = 1;
+
+            uint32_t magic;
+            uint32_t format;
+            uint32_t os_build;
+            uint32_t os_revision;
+            uint64_t entry_count;
+            uint64_t size;
+        };
+
+        struct schema_cache_file_entry {
+            GUID provider;
+            uint16_t id;
+            uint8_t opcode;
+            uint8_t version;
+            uint8_t level;
+            uint8_t reserved[3];
+            uint32_t size;
+            uint64_t checksum;
+        };
+
+        /**
+         * <summary>
+         * Turns the contents of a schema_locator into the file format and
+         * back. Works on memory so that the file handling stays out of it.
+         * </summary>
+         */
+        class schema_cache_file {
+        public:
+
+            /**
+             * <summary>
+             * Returns the file contents for the schemas of the locator.
+             * </summary>
+             */
+            static std::vector<BYTE> serialize(
+                const schema_locator &locator,
+                uint32_t os_build,
+                uint32_t os_revision);
+
+            /**
+             * <summary>
+             * Adds the valid schemas found in the file contents to the
+             * locator and returns how many there were. Nothing is added
+             * unless the header matches the given OS version.
+             * </summary>
+             */
+            static size_t deserialize(
+                const schema_locator &locator,
+                const BYTE *data,
+                size_t size,
+                uint32_t os_build,
+                uint32_t os_revision);
+        };
+
+        /**
+         * <summary>
+         * Returns whether a TRACE_EVENT_INFO read from a file fits in its
+         * buffer and describes the event of the key.
+         * </summary>
+         */
+        bool is_valid_schema(const schema_key &key, const BYTE *data, size_t size);
+
+        /**
+         * <summary>
+         * FNV-1a over the bytes, used to notice entries that were damaged.
+         * </summary>
+         */
+        uint64_t schema_checksum(const BYTE *data, size_t size);
+
+        /**
+         * <summary>
+         * Reads the build number and update revision of Windows.
+         * </summary>
+         */
+        void current_os_version(uint32_t &build, uint32_t &revision);
+
+        inline size_t align_schema_size(size_t size)
+        {
+            return (size + 7) & ~size_t(7);
+        }
+
+        /**
+         * <summary>Closes a Win32 handle when it goes out of scope.</summary>
+         */
+        class scoped_handle {
+        public:
+            explicit scoped_handle(HANDLE handle) : handle_(handle) {}
+            ~scoped_handle()
+            {
+                if (valid()) {
+                    CloseHandle(handle_);
+                }
+            }
+
+            scoped_handle(const scoped_handle &) = delete;
+            scoped_handle &operator=(const scoped_handle &) = delete;
+
+            HANDLE get() const { return handle_; }
+            bool valid() const { return handle_ != nullptr && handle_ != INVALID_HANDLE_VALUE; }
+
+        private:
+            HANDLE handle_;
+        };
+
+    } /* namespace details */
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline size_t save_schema_cache(const schema_locator &locator, const std::wstring &path)
+    {
+        uint32_t build, revision;
+        details::current_os_version(build, revision);
+
+        auto contents = details::schema_cache_file::serialize(locator, build, revision);
+        auto header = reinterpret_cast<const details::schema_cache_file_header *>(contents.data());
+
+        // Write next to the destination and move it over, so a crash while
+        // writing never leaves a torn file behind.
+        auto temporary = path + L".tmp";
+        {
+            details::scoped_handle file(CreateFileW(
+                temporary.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+
+            if (!file.valid()) {
+                throw std::runtime_error("Could not create the schema cache file");
+            }
+
+            DWORD written = 0;
+            if (!WriteFile(file.get(), contents.data(), static_cast<DWORD>(contents.size()), &written, nullptr) ||
+                written != contents.size()) {
+                throw std::runtime_error("Could not write the schema cache file");
+            }
+        }
+
+        if (!MoveFileExW(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+            DeleteFileW(temporary.c_str());
+            throw std::runtime_error("Could not replace the schema cache file");
+        }
+
+        return static_cast<size_t>(header->entry_count);
+    }
+
+    inline size_t load_schema_cache(const schema_locator &locator, const std::wstring &path)
+    {
+        details::scoped_handle file(CreateFileW(
+            path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+
+        if (!file.valid()) {
+            return 0;
+        }
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file.get(), &size) ||
+            size.QuadPart < static_cast<LONGLONG>(sizeof(details::schema_cache_file_header))) {
+            return 0;
+        }
+
+        details::scoped_handle mapping(CreateFileMappingW(file.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+        if (!mapping.valid()) {
+            return 0;
+        }
+
+        auto view = static_cast<const BYTE *>(MapViewOfFile(mapping.get(), FILE_MAP_READ, 0, 0, 0));
+        if (view == nullptr) {
+            return 0;
+        }
+
+        uint32_t build, revision;
+        details::current_os_version(build, revision);
+
+        size_t loaded = 0;
+        try {
+            loaded = details::schema_cache_file::deserialize(
+                locator, view, static_cast<size_t>(size.QuadPart), build, revision);
+        }
+        catch (...) {
+            UnmapViewOfFile(view);
+            throw;
+        }
+
+        UnmapViewOfFile(view);
+        return loaded;
+    }
+
+    namespace details {
+
+        inline std::vector<BYTE> schema_cache_file::serialize(
+            const schema_locator &locator,
+            uint32_t os_build,
+            uint32_t os_revision)
+        {
+            std::vector<BYTE> contents(sizeof(schema_cache_file_header));
+            uint64_t count = 0;
+
+            {
+                std::lock_guard<std::mutex> lock(locator.cache_mutex_);
+
+                for (auto &entry : locator.entries_) {
+                    auto blob = reinterpret_cast<const BYTE *>(entry->buffer.get());
+                    auto blobSize = entry->buffer.get_deleter().size;
+
+                    schema_cache_file_entry header = {};
+                    header.provider = entry->key.provider;
+                    header.id = entry->key.id;
+                    header.opcode = entry->key.opcode;
+                    header.version = entry->key.version;
+                    header.level = entry->key.level;
+                    header.size = static_cast<uint32_t>(blobSize);
+                    header.checksum = schema_checksum(blob, blobSize);
+
+                    auto offset = contents.size();
+                    contents.resize(offset + sizeof(header) + align_schema_size(blobSize));
+                    memcpy(contents.data() + offset, &header, sizeof(header));
+                    memcpy(contents.data() + offset + sizeof(header), blob, blobSize);
+                    ++count;
+                }
+            }
+
+            schema_cache_file_header header = {};
+            header.magic = schema_cache_file_header::expected_magic;
+            header.format = schema_cache_file_header::current_format;
+            header.os_build = os_build;
+            header.os_revision = os_revision;
+            header.entry_count = count;
+            header.size = contents.size();
+            memcpy(contents.data(), &header, sizeof(header));
+
+            return contents;
+        }
+
+        inline size_t schema_cache_file::deserialize(
+            const schema_locator &locator,
+            const BYTE *data,
+            size_t size,
+            uint32_t os_build,
+            uint32_t os_revision)
+        {
+            if (size < sizeof(schema_cache_file_header)) {
+                return 0;
+            }
+
+            schema_cache_file_header header;
+            memcpy(&header, data, sizeof(header));
+
+            if (header.magic != schema_cache_file_header::expected_magic ||
+                header.format != schema_cache_file_header::current_format ||
+                header.os_build != os_build ||
+                header.os_revision != os_revision ||
+                header.size != size) {
+                return 0;
+            }
+
+            size_t loaded = 0;
+            size_t offset = sizeof(header);
+
+            for (uint64_t i = 0; i < header.entry_count; ++i) {
+                if (size - offset < sizeof(schema_cache_file_entry)) {
+                    break;
+                }
+
+                schema_cache_file_entry entry;
+                memcpy(&entry, data + offset, sizeof(entry));
+                offset += sizeof(entry);
+
+                if (entry.size > size - offset) {
+                    break;
+                }
+
+                auto blob = data + offset;
+                offset += (std::min)(align_schema_size(entry.size), size - offset);
+
+                // The key is rebuilt through a record, the only way a
+                // schema_key is made.
+                EVENT_RECORD record = {};
+                record.EventHeader.ProviderId = entry.provider;
+                record.EventHeader.EventDescriptor.Id = entry.id;
+                record.EventHeader.EventDescriptor.Opcode = entry.opcode;
+                record.EventHeader.EventDescriptor.Version = entry.version;
+                record.EventHeader.EventDescriptor.Level = entry.level;
+                schema_key key(record);
+
+                if (schema_checksum(blob, entry.size) != entry.checksum ||
+                    !is_valid_schema(key, blob, entry.size)) {
+                    continue;
+                }
+
+                auto &resource = locator.resource_;
+                auto copy = static_cast<char *>(resource.allocate(entry.size));
+                memcpy(copy, blob, entry.size);
+
+                auto inserted = locator.insert(
+                    key,
+                    std::hash<schema_key>()(key),
+                    std::unique_ptr<char[], resource_deleter>(copy, resource_deleter{ &resource, entry.size }));
+
+                // A schema the locator already had is kept and the copy dropped.
+                if (inserted->buffer.get() == copy) {
+                    ++loaded;
+                }
+            }
+
+            return loaded;
+        }
+
+        inline bool is_valid_schema(const schema_key &key, const BYTE *data, size_t size)
+        {
+            const size_t fixedSize = offsetof(TRACE_EVENT_INFO, EventPropertyInfoArray);
+            if (size < fixedSize) {
+                return false;
+            }
+
+            TRACE_EVENT_INFO info;
+            memcpy(&info, data, fixedSize);
+
+            if (info.PropertyCount > (size - fixedSize) / sizeof(EVENT_PROPERTY_INFO)) {
+                return false;
+            }
+
+            // Manifest events are looked up by provider, classic events by
+            // the GUID of their event class.
+            if (!IsEqualGUID(info.ProviderGuid, key.provider) &&
+                !IsEqualGUID(info.EventGuid, key.provider)) {
+                return false;
+            }
+
+            if (info.DecodingSource == DecodingSourceXMLFile &&
+                (info.EventDescriptor.Id != key.id || info.EventDescriptor.Version != key.version)) {
+                return false;
+            }
+
+            const ULONG offsets[] = {
+                info.ProviderNameOffset,
+                info.TaskNameOffset,
+                info.OpcodeNameOffset,
+                info.EventNameOffset,
+            };
+
+            for (auto offset : offsets) {
+                if (offset >= size) {
+                    return false;
+                }
+            }
+
+            auto properties = reinterpret_cast<const EVENT_PROPERTY_INFO *>(data + fixedSize);
+            for (ULONG i = 0; i < info.PropertyCount; ++i) {
+                EVENT_PROPERTY_INFO property;
+                memcpy(&property, properties + i, sizeof(property));
+
+                if (property.NameOffset >= size) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        inline uint64_t schema_checksum(const BYTE *data, size_t size)
+        {
+            uint64_t hash = 14695981039346656037ull;
+            for (size_t i = 0; i < size; ++i) {
+                hash ^= data[i];
+                hash *= 1099511628211ull;
+            }
+
+            return hash;
+        }
+
+        inline void current_os_version(uint32_t &build, uint32_t &revision)
+        {
+            const wchar_t *key = L"SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion";
+
+            wchar_t buildNumber[16] = {};
+            DWORD size = sizeof(buildNumber);
+            build = 0;
+            if (RegGetValueW(HKEY_LOCAL_MACHINE, key, L"CurrentBuildNumber", RRF_RT_REG_SZ, nullptr, buildNumber, &size) == ERROR_SUCCESS) {
+                build = static_cast<uint32_t>(wcstoul(buildNumber, nullptr, 10));
+            }
+
+            DWORD ubr = 0;
+            size = sizeof(ubr);
+            revision = 0;
+            if (RegGetValueW(HKEY_LOCAL_MACHINE, key, L"UBR", RRF_RT_REG_DWORD, nullptr, &ubr, &size) == ERROR_SUCCESS) {
+                revision = ubr;
+            }
+        }
+
+    } /* namespace details */
+}
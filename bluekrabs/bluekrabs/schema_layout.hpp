@@ -0,0 +1,214 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <tdh.h>
+#include <evntrace.h>
+
+#include <atomic>
+#include <vector>
+
+#include "compiler_check.hpp"
+#include "property_key.hpp"
+#include "size_provider.hpp"
+
+namespace krabs { namespace details {
+
+    /**
+     * <summary>
+     * The precomputed positions of the properties of an event schema.
+     * </summary>
+     * <remarks>
+     * Properties are packed back to back in the user data of an event, so
+     * the offset of a property is only known once the sizes of all the
+     * properties before it are. For the leading run of properties whose
+     * size comes from the schema alone, the offsets are the same for every
+     * event and are computed once here, which lets the parser load them
+     * directly and only walk the variable length tail.
+     *
+     * Pointer sized properties depend on the bitness of the process that
+     * logged the event, so the offsets are kept for both pointer sizes.
+     *
+     * The interned ids and lengths of the property names are kept as well,
+     * so that a property_key is found without comparing strings and a
+     * property_ref hands out names without measuring them.
+     *
+     * Every property, structure members included, gets the rule its size
+     * is found by, so that sizing the tail is a switch on the rule. The
+     * properties whose size only Tdh knows are counted each time Tdh is
+     * asked.
+     * </remarks>
+     */
+    class schema_layout {
+    public:
+        explicit schema_layout(const TRACE_EVENT_INFO &info);
+
+        /**
+         * <summary>
+         * Returns the number of leading properties whose offset and size
+         * are fixed.
+         * </summary>
+         */
+        ULONG fixed_count() const;
+
+        /**
+         * <summary>
+         * Returns the offset in the user data of the property at the given
+         * index, for any index up to and including fixed_count(). The
+         * offset at fixed_count() is where the variable length tail starts.
+         * </summary>
+         */
+        ULONG offset(ULONG index, bool is32Bit) const;
+
+        /**
+         * <summary>
+         * Returns the size of the property at the given index, for any
+         * index below fixed_count().
+         * </summary>
+         */
+        ULONG length(ULONG index, bool is32Bit) const;
+
+        /**
+         * <summary>
+         * Returns the index of the top level property with the given name
+         * or npos when the schema has no such property.
+         * </summary>
+         */
+        ULONG index_of(const property_key &key) const;
+
+        /**
+         * <summary>
+         * Returns the length, in characters, of the name of the property at
+         * the given index.
+         * </summary>
+         */
+        ULONG name_length(ULONG index) const;
+
+        /**
+         * <summary>
+         * Returns how the size of the property at the given index is found.
+         * </summary>
+         */
+        const property_size_rule &size_rule_at(ULONG index) const;
+
+        /**
+         * <summary>
+         * Counts a property of this schema that had to be sized by asking Tdh.
+         * </summary>
+         */
+        void count_tdh_size_lookup() const;
+
+        /**
+         * <summary>
+         * Returns how many properties of this schema were sized by asking Tdh.
+         * </summary>
+         */
+        uint64_t tdh_size_lookups() const;
+
+        static constexpr ULONG npos = ULONG(-1);
+
+    private:
+        ULONG fixedCount_;
+        ULONG topLevelCount_;
+        std::vector<uint32_t> nameIds_;
+        std::vector<ULONG> nameLengths_;
+        std::vector<property_size_rule> sizeRules_;
+        mutable std::atomic<uint64_t> tdhSizeLookups_;
+
+        // fixedCount_ + 1 entries each, the last one being the tail offset.
+        std::vector<ULONG> offsets32_;
+        std::vector<ULONG> offsets64_;
+    };
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline schema_layout::schema_layout(const TRACE_EVENT_INFO &info)
+        : fixedCount_(0)
+        , topLevelCount_(info.TopLevelPropertyCount)
+        , tdhSizeLookups_(0)
+    {
+        nameIds_.reserve(info.PropertyCount);
+        nameLengths_.reserve(info.PropertyCount);
+        sizeRules_.reserve(info.PropertyCount);
+        for (ULONG i = 0; i < info.PropertyCount; ++i) {
+            auto name = reinterpret_cast<const wchar_t*>(
+                reinterpret_cast<const BYTE*>(&info) +
+                info.EventPropertyInfoArray[i].NameOffset);
+
+            auto length = wcslen(name);
+            nameIds_.push_back(property_name_table::intern(name, length));
+            nameLengths_.push_back(static_cast<ULONG>(length));
+            sizeRules_.push_back(size_provider::get_size_rule(info.EventPropertyInfoArray[i]));
+        }
+
+        offsets32_.push_back(0);
+        offsets64_.push_back(0);
+
+        // Members of structures follow the top level properties, they are
+        // not part of the run.
+        for (ULONG i = 0; i < info.TopLevelPropertyCount; ++i) {
+            auto &property = info.EventPropertyInfoArray[i];
+            if (!size_provider::has_fixed_size(property)) {
+                break;
+            }
+
+            offsets32_.push_back(offsets32_.back() + size_provider::get_fixed_size(property, true));
+            offsets64_.push_back(offsets64_.back() + size_provider::get_fixed_size(property, false));
+            ++fixedCount_;
+        }
+    }
+
+    inline ULONG schema_layout::fixed_count() const
+    {
+        return fixedCount_;
+    }
+
+    inline ULONG schema_layout::offset(ULONG index, bool is32Bit) const
+    {
+        return is32Bit ? offsets32_[index] : offsets64_[index];
+    }
+
+    inline ULONG schema_layout::length(ULONG index, bool is32Bit) const
+    {
+        return offset(index + 1, is32Bit) - offset(index, is32Bit);
+    }
+
+    inline ULONG schema_layout::index_of(const property_key &key) const
+    {
+        for (ULONG i = 0; i < topLevelCount_; ++i) {
+            if (nameIds_[i] == key.id()) {
+                return i;
+            }
+        }
+
+        return npos;
+    }
+
+    inline ULONG schema_layout::name_length(ULONG index) const
+    {
+        return nameLengths_[index];
+    }
+
+    inline const property_size_rule &schema_layout::size_rule_at(ULONG index) const
+    {
+        return sizeRules_[index];
+    }
+
+    inline void schema_layout::count_tdh_size_lookup() const
+    {
+        tdhSizeLookups_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    inline uint64_t schema_layout::tdh_size_lookups() const
+    {
+        return tdhSizeLookups_.load(std::memory_order_relaxed);
+    }
+
+} /* namespace details */ } /* namespace krabs */
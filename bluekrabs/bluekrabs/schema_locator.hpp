@@ -12,14 +12,21 @@
 #include <windows.h>
 #include <tdh.h>
 #include <evntrace.h>
-#include <mutex>
 
+#include <atomic>
+#include <cassert>
+#include <cstring>
 #include <memory>
-#include <unordered_map>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
 
 #include "compiler_check.hpp"
 #include "errors.hpp"
 #include "guid.hpp"
+#include "memory_resource.hpp"
+#include "schema_layout.hpp"
 
 #pragma comment(lib, "tdh.lib")
 
@@ -66,7 +73,7 @@ namespace std {
      * </summary>
      */
     template<>
-    struct std::hash<krabs::schema_key>
+    struct hash<krabs::schema_key>
     {
         size_t operator()(const krabs::schema_key &key) const
         {
@@ -93,15 +100,420 @@ namespace krabs {
      */
     std::unique_ptr<char[]> get_event_schema_from_tdh(const EVENT_RECORD &);
 
+    /**
+     * <summary>
+     * Get event schema from TDH into a buffer from the given resource.
+     * </summary>
+     */
+    std::unique_ptr<char[], details::resource_deleter> get_event_schema_from_tdh(
+        const EVENT_RECORD &, memory_resource &);
+
+    /**
+     * <summary>
+     * Something other than TDH that knows the schemas of some events, for
+     * example a decoded provider manifest. A schema_locator asks its source
+     * before it falls back to TDH.
+     * </summary>
+     */
+    class schema_source {
+    public:
+        virtual ~schema_source() {}
+
+        /**
+         * <summary>
+         * Returns the size of the TRACE_EVENT_INFO for the record, or zero
+         * when the source does not know the event, and copies it to the
+         * buffer when it is large enough. Called from any thread.
+         * </summary>
+         */
+        virtual size_t get_event_schema(const EVENT_RECORD &record, void *buffer, size_t size) const = 0;
+    };
+
+    /**
+     * <summary>
+     * Counters describing how a schema_locator served its lookups.
+     * </summary>
+     */
+    struct schema_cache_stats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t tdh_lookups;
+        uint64_t tdh_size_lookups;   // properties only Tdh could size
+    };
+}
+
+namespace krabs { namespace details {
+
+    class schema_cache_file;
+
+    /**
+     * <summary>
+     * A counter that many threads can bump without fighting over a single
+     * cache line. Each thread increments the stripe picked by its id and
+     * readers sum all stripes.
+     * </summary>
+     */
+    class striped_counter {
+    public:
+        striped_counter();
+
+        void increment();
+        uint64_t value() const;
+
+    private:
+        static const size_t stripe_count = 16;
+
+        struct stripe {
+            std::atomic<uint64_t> value;
+            char padding[64 - sizeof(std::atomic<uint64_t>)];
+        };
+
+        stripe stripes_[stripe_count];
+    };
+
+    /**
+     * <summary>
+     * A counter that only one thread writes and any thread may read. With
+     * a single writer, incrementing it is a plain load and store instead of
+     * an interlocked add.
+     * </summary>
+     */
+    class thread_counter {
+    public:
+        thread_counter();
+
+        void increment();
+        uint64_t value() const;
+
+    private:
+        std::atomic<uint64_t> value_;
+    };
+
+    /**
+     * <summary>
+     * A schema owned by a schema_locator. Entries are never modified or
+     * freed once published, which is what lets readers use them without
+     * holding a lock.
+     * </summary>
+     */
+    struct schema_cache_entry
+    {
+        schema_key key;
+        size_t hash;
+        std::unique_ptr<char[], resource_deleter> buffer;
+        schema_layout layout;
+
+        schema_cache_entry(const schema_key &key, size_t hash, std::unique_ptr<char[], resource_deleter> buffer)
+            : key(key)
+            , hash(hash)
+            , buffer(std::move(buffer))
+            , layout(*(const TRACE_EVENT_INFO *)this->buffer.get()) { }
+    };
+
+    /**
+     * <summary>
+     * Fixed size, insert only, open addressing table of cache entries.
+     * Slots are written once under the locator's lock and read without it.
+     * </summary>
+     */
+    class schema_cache_table {
+    public:
+        explicit schema_cache_table(size_t capacity);
+
+        const schema_cache_entry *find(const schema_key &key, size_t hash) const;
+        void insert(const schema_cache_entry *entry);
+
+        size_t size() const { return size_; }
+        size_t capacity() const { return mask_ + 1; }
+
+    private:
+        const size_t mask_;
+        size_t size_;
+        std::unique_ptr<std::atomic<const schema_cache_entry *>[]> slots_;
+    };
+
+    /**
+     * <summary>
+     * The last few schemas looked up by a thread, most recent first. Event
+     * streams are bursty, so comparing the raw header bytes of a record with
+     * these usually finds its schema without hashing anything.
+     * </summary>
+     * <remarks>
+     * Slots are tagged with the id of the locator that filled them, ids are
+     * never reused so a slot left behind by a destroyed locator can not be
+     * mistaken for a live one. The same goes for the thread's hit counters
+     * of the locators it used last, which the locators own.
+     * </remarks>
+     */
+    struct schema_mru
+    {
+        static const size_t slot_count = 4;
+
+        struct slot {
+            uint64_t locator;
+            uint64_t descriptor;
+            GUID provider;
+            const schema_cache_entry *entry;
+            thread_counter *hits;
+        };
+
+        struct counter_slot {
+            uint64_t locator;
+            thread_counter *counter;
+        };
+
+        slot slots[slot_count];
+        counter_slot counters[slot_count];
+
+        schema_mru();
+
+        /**
+         * <summary>
+         * Returns the schema of the record if it is one of the last few,
+         * counting the hit on the counter it was inserted with.
+         * </summary>
+         */
+        const schema_cache_entry *find(uint64_t locator, const EVENT_RECORD &record);
+        void insert(uint64_t locator, const EVENT_RECORD &record, const schema_cache_entry *entry, thread_counter *hits);
+
+        thread_counter *find_counter(uint64_t locator) const;
+        void insert_counter(uint64_t locator, thread_counter *counter);
+
+        /**
+         * <summary>
+         * Returns the bytes of the event descriptor that make up a
+         * schema_key: Id, Version, Level and Opcode. Channel and Task are
+         * masked out because the cache does not key on them.
+         * </summary>
+         */
+        static uint64_t descriptor_bits(const EVENT_RECORD &record);
+    };
+
+#if !defined(_M_CEE)
+    /**
+     * <summary>
+     * Returns the calling thread's schema_mru.
+     * </summary>
+     */
+    schema_mru &thread_schema_mru();
+#endif
+
+    /**
+     * <summary>
+     * Hands out a process wide unique id for each schema_locator.
+     * </summary>
+     */
+    uint64_t next_schema_locator_id();
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline striped_counter::striped_counter()
+    {
+        for (auto &stripe : stripes_) {
+            stripe.value.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    inline void striped_counter::increment()
+    {
+        // Thread ids are multiples of four on Windows.
+        auto index = (GetCurrentThreadId() >> 2) & (stripe_count - 1);
+        stripes_[index].value.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    inline uint64_t striped_counter::value() const
+    {
+        uint64_t total = 0;
+        for (auto &stripe : stripes_) {
+            total += stripe.value.load(std::memory_order_relaxed);
+        }
+
+        return total;
+    }
+
+    // ------------------------------------------------------------------------
+
+    inline thread_counter::thread_counter()
+        : value_(0)
+    {}
+
+    inline void thread_counter::increment()
+    {
+        value_.store(value_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    inline uint64_t thread_counter::value() const
+    {
+        return value_.load(std::memory_order_relaxed);
+    }
+
+    // ------------------------------------------------------------------------
+
+    inline schema_cache_table::schema_cache_table(size_t capacity)
+        : mask_(capacity - 1)
+        , size_(0)
+        , slots_(new std::atomic<const schema_cache_entry *>[capacity])
+    {
+        assert((capacity & mask_) == 0 && "capacity must be a power of two");
+
+        for (size_t i = 0; i < capacity; ++i) {
+            slots_[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    inline const schema_cache_entry *schema_cache_table::find(
+        const schema_key &key, size_t hash) const
+    {
+        for (size_t i = hash & mask_; ; i = (i + 1) & mask_) {
+            auto entry = slots_[i].load(std::memory_order_acquire);
+            if (entry == nullptr) {
+                return nullptr;
+            }
+
+            if (entry->hash == hash && entry->key == key) {
+                return entry;
+            }
+        }
+    }
+
+    inline void schema_cache_table::insert(const schema_cache_entry *entry)
+    {
+        for (size_t i = entry->hash & mask_; ; i = (i + 1) & mask_) {
+            if (slots_[i].load(std::memory_order_relaxed) == nullptr) {
+                slots_[i].store(entry, std::memory_order_release);
+                ++size_;
+                return;
+            }
+        }
+    }
+
+    // ------------------------------------------------------------------------
+
+    inline schema_mru::schema_mru()
+    {
+        // Locator ids start at one, so zeroed slots never match.
+        ZeroMemory(slots, sizeof(slots));
+        ZeroMemory(counters, sizeof(counters));
+    }
+
+    inline uint64_t schema_mru::descriptor_bits(const EVENT_RECORD &record)
+    {
+        // Id (2 bytes), Version, Channel, Level, Opcode, Task (2 bytes)
+        static_assert(sizeof(EVENT_DESCRIPTOR) >= sizeof(uint64_t), "unexpected EVENT_DESCRIPTOR layout");
+        const uint64_t mask = 0x0000FFFF00FFFFFFull;
+
+        uint64_t bits;
+        memcpy(&bits, &record.EventHeader.EventDescriptor, sizeof(bits));
+        return bits & mask;
+    }
+
+    inline const schema_cache_entry *schema_mru::find(uint64_t locator, const EVENT_RECORD &record)
+    {
+        auto descriptor = descriptor_bits(record);
+
+        for (size_t i = 0; i < slot_count; ++i) {
+            if (slots[i].locator == locator &&
+                slots[i].descriptor == descriptor &&
+                IsEqualGUID(slots[i].provider, record.EventHeader.ProviderId)) {
+
+                // Move the hit to the front so a burst is found on the
+                // first compare.
+                if (i != 0) {
+                    auto hit = slots[i];
+                    memmove(&slots[1], &slots[0], i * sizeof(slot));
+                    slots[0] = hit;
+                }
+
+                slots[0].hits->increment();
+                return slots[0].entry;
+            }
+        }
+
+        return nullptr;
+    }
+
+    inline void schema_mru::insert(uint64_t locator, const EVENT_RECORD &record, const schema_cache_entry *entry, thread_counter *hits)
+    {
+        memmove(&slots[1], &slots[0], (slot_count - 1) * sizeof(slot));
+
+        slots[0].locator = locator;
+        slots[0].descriptor = descriptor_bits(record);
+        slots[0].provider = record.EventHeader.ProviderId;
+        slots[0].entry = entry;
+        slots[0].hits = hits;
+    }
+
+    inline thread_counter *schema_mru::find_counter(uint64_t locator) const
+    {
+        for (auto &slot : counters) {
+            if (slot.locator == locator) {
+                return slot.counter;
+            }
+        }
+
+        return nullptr;
+    }
+
+    inline void schema_mru::insert_counter(uint64_t locator, thread_counter *counter)
+    {
+        memmove(&counters[1], &counters[0], (slot_count - 1) * sizeof(counter_slot));
+
+        counters[0].locator = locator;
+        counters[0].counter = counter;
+    }
+
+#if !defined(_M_CEE)
+    inline schema_mru &thread_schema_mru()
+    {
+        static thread_local schema_mru mru;
+        return mru;
+    }
+#endif
+
+    inline uint64_t next_schema_locator_id()
+    {
+        static std::atomic<uint64_t> next_id(1);
+        return next_id.fetch_add(1, std::memory_order_relaxed);
+    }
+
+} /* namespace details */ } /* namespace krabs */
+
+namespace krabs {
+
     /**
      * <summary>
      * Fetches and caches schemas from TDH.
      * NOTE: this cache also reduces the number of managed to native transitions
      * when krabs is compiled into a managed assembly.
      * </summary>
+     * <remarks>
+     * After warm-up the cache is effectively read only, so lookups are lock
+     * free: they probe an immutable snapshot of the table. Only a miss takes
+     * the lock, to publish the new schema and, when the table gets too full,
+     * a larger copy of it. Replaced tables are kept alive with the locator
+     * because readers may still be probing them.
+     *
+     * In front of the table each thread keeps its last few schemas, found
+     * by comparing the provider and event descriptor of the record. Those
+     * hits are counted by each thread on its own, and added up when stats
+     * are read. This is skipped when compiling with /clr, which does not
+     * support thread_local.
+     *
+     * The schemas themselves are copied into buffers from a memory_resource,
+     * operator new unless one is given. The resource must outlive the
+     * locator, and so must the schema_source when one is given.
+     * </remarks>
      */
     class schema_locator {
     public:
+        schema_locator();
+        explicit schema_locator(memory_resource &resource);
+        explicit schema_locator(const schema_source &source, memory_resource &resource = new_delete_resource());
+
+        schema_locator(const schema_locator &) = delete;
+        schema_locator &operator=(const schema_locator &) = delete;
 
         /**
          * <summary>
@@ -111,58 +523,279 @@ namespace krabs {
          */
         const PTRACE_EVENT_INFO get_event_schema(const EVENT_RECORD &record) const;
 
+        /**
+         * <summary>
+         * Returns the lookup counters of this locator, along with how often
+         * parsers of its schemas had to ask Tdh for the size of a property.
+         * </summary>
+         */
+        schema_cache_stats stats() const;
+
+    private:
+        const details::schema_cache_entry *find_entry(const EVENT_RECORD &record) const;
+#if !defined(_M_CEE)
+        details::thread_counter *thread_hits() const;
+#endif
+
+        const details::schema_cache_entry *insert(
+            const schema_key &key,
+            size_t hash,
+            std::unique_ptr<char[], details::resource_deleter> buffer) const;
+
     private:
-        mutable std::unordered_map<schema_key, std::unique_ptr<char[]>> cache_;
+        static const size_t initial_capacity = 64;
+
+        const uint64_t id_;
+        memory_resource &resource_;
+        const schema_source *source_;
+
+        mutable std::atomic<const details::schema_cache_table *> table_;
+        mutable std::vector<std::unique_ptr<details::schema_cache_table>> tables_;
+        mutable std::vector<std::unique_ptr<details::schema_cache_entry>> entries_;
         mutable std::mutex cache_mutex_;
+
+        mutable details::striped_counter hits_;
+        mutable details::striped_counter misses_;
+        mutable details::striped_counter tdh_lookups_;
+
+        // Hits on the threads' most recent schemas, one counter per thread
+        // id. Guarded by cache_mutex_.
+        mutable std::vector<std::pair<DWORD, std::unique_ptr<details::thread_counter>>> thread_hits_;
+
+        friend class schema;
+        friend class details::schema_cache_file;
     };
 
     // Implementation
     // ------------------------------------------------------------------------
 
+    inline schema_locator::schema_locator()
+        : schema_locator(new_delete_resource())
+    {}
+
+    inline schema_locator::schema_locator(const schema_source &source, memory_resource &resource)
+        : schema_locator(resource)
+    {
+        source_ = &source;
+    }
+
+    inline schema_locator::schema_locator(memory_resource &resource)
+        : id_(details::next_schema_locator_id())
+        , resource_(resource)
+        , source_(nullptr)
+        , table_(nullptr)
+    {
+        tables_.emplace_back(new details::schema_cache_table(initial_capacity));
+        table_.store(tables_.back().get(), std::memory_order_release);
+    }
+
     inline const PTRACE_EVENT_INFO schema_locator::get_event_schema(const EVENT_RECORD &record) const
     {
-        std::lock_guard<std::mutex> lock(cache_mutex_);
+        return (PTRACE_EVENT_INFO)(find_entry(record)->buffer.get());
+    }
+
+    inline const details::schema_cache_entry *schema_locator::find_entry(const EVENT_RECORD &record) const
+    {
+#if !defined(_M_CEE)
+        // check this thread's most recent schemas
+        auto &mru = details::thread_schema_mru();
+        auto entry = mru.find(id_, record);
+        if (entry != nullptr) {
+            return entry;
+        }
+#else
+        const details::schema_cache_entry *entry = nullptr;
+#endif
+
         // check the cache
         auto key = schema_key(record);
-        auto& buffer = cache_[key];
+        auto hash = std::hash<schema_key>()(key);
+
+        entry = table_.load(std::memory_order_acquire)->find(key, hash);
+        if (entry != nullptr) {
+            hits_.increment();
+#if !defined(_M_CEE)
+            mru.insert(id_, record, entry, thread_hits());
+#endif
+            return entry;
+        }
+
+        misses_.increment();
+
+        if (source_ != nullptr) {
+            auto size = source_->get_event_schema(record, nullptr, 0);
+            if (size != 0) {
+                auto buffer = static_cast<char*>(resource_.allocate(size));
+                std::unique_ptr<char[], details::resource_deleter> schema(buffer, details::resource_deleter{ &resource_, size });
+
+                // The source may have changed between the two calls, in which
+                // case the buffer was not filled and TDH is asked instead.
+                if (source_->get_event_schema(record, buffer, size) == size) {
+                    entry = insert(key, hash, std::move(schema));
+#if !defined(_M_CEE)
+                    mru.insert(id_, record, entry, thread_hits());
+#endif
+                    return entry;
+                }
+            }
+        }
+
+        // TDH is called without holding the lock, if another thread raced
+        // us to the same schema its copy wins and ours is dropped.
+        tdh_lookups_.increment();
+        entry = insert(key, hash, get_event_schema_from_tdh(record, resource_));
+#if !defined(_M_CEE)
+        mru.insert(id_, record, entry, thread_hits());
+#endif
+
+        return entry;
+    }
+
+#if !defined(_M_CEE)
+    inline details::thread_counter *schema_locator::thread_hits() const
+    {
+        auto &mru = details::thread_schema_mru();
+        auto counter = mru.find_counter(id_);
+        if (counter != nullptr) {
+            return counter;
+        }
+
+        // Only the first lookup on a thread, or one after it used several
+        // other locators, gets here. The counter of a thread that exited is
+        // taken over by the next thread given its id, so there are never
+        // more counters than thread ids.
+        auto threadId = GetCurrentThreadId();
+        {
+            std::lock_guard<std::mutex> guard(cache_mutex_);
+            for (const auto &hits : thread_hits_) {
+                if (hits.first == threadId) {
+                    counter = hits.second.get();
+                    break;
+                }
+            }
+
+            if (counter == nullptr) {
+                thread_hits_.emplace_back(threadId, std::unique_ptr<details::thread_counter>(new details::thread_counter()));
+                counter = thread_hits_.back().second.get();
+            }
+        }
+
+        mru.insert_counter(id_, counter);
+        return counter;
+    }
+#endif
 
-        if (!buffer) {
-            auto temp = get_event_schema_from_tdh(record);
-            buffer.swap(temp);
+    inline schema_cache_stats schema_locator::stats() const
+    {
+        uint64_t hits = hits_.value();
+        uint64_t tdhSizeLookups = 0;
+        {
+            std::lock_guard<std::mutex> guard(cache_mutex_);
+            for (const auto &entry : entries_) {
+                tdhSizeLookups += entry->layout.tdh_size_lookups();
+            }
+
+            for (const auto &threadHits : thread_hits_) {
+                hits += threadHits.second->value();
+            }
         }
 
-        return (PTRACE_EVENT_INFO)(buffer.get());
+        return { hits, misses_.value(), tdh_lookups_.value(), tdhSizeLookups };
     }
 
+    inline const details::schema_cache_entry *schema_locator::insert(
+        const schema_key &key,
+        size_t hash,
+        std::unique_ptr<char[], details::resource_deleter> buffer) const
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+
+        // The newest table is the published one, only it is written to.
+        auto table = tables_.back().get();
+        auto existing = table->find(key, hash);
+        if (existing != nullptr) {
+            return existing;
+        }
+
+        entries_.emplace_back(new details::schema_cache_entry(key, hash, std::move(buffer)));
+        auto entry = entries_.back().get();
+
+        // Keep the load factor at or below one half so probes stay short.
+        if ((table->size() + 1) * 2 > table->capacity()) {
+            auto grown = new details::schema_cache_table(table->capacity() * 2);
+            tables_.emplace_back(grown);
+            for (auto &e : entries_) {
+                grown->insert(e.get());
+            }
+
+            table_.store(grown, std::memory_order_release);
+        }
+        else {
+            table->insert(entry);
+        }
+
+        return entry;
+    }
+
+    namespace details {
+
+        /**
+         * <summary>
+         * Asks TDH for the schema of the record, into a buffer returned by
+         * allocate(size).
+         * </summary>
+         */
+        template <typename Buffer, typename Allocate>
+        Buffer get_event_schema_from_tdh(const EVENT_RECORD &record, Allocate &&allocate)
+        {
+            // get required size
+            ULONG bufferSize = 0;
+            ULONG status = TdhGetEventInformation(
+                (PEVENT_RECORD)&record,
+                0,
+                NULL,
+                NULL,
+                &bufferSize);
+
+            if (status != ERROR_INSUFFICIENT_BUFFER) {
+                error_check_common_conditions(status, record);
+            }
+
+            // allocate and fill the schema from TDH
+            Buffer buffer = allocate(bufferSize);
+
+            status = TdhGetEventInformation(
+                (PEVENT_RECORD)&record,
+                0,
+                NULL,
+                (PTRACE_EVENT_INFO)buffer.get(),
+                &bufferSize);
+
+            if (status != ERROR_SUCCESS) {
+                error_check_common_conditions(status, record);
+            }
+
+            return buffer;
+        }
+
+    } /* namespace details */
+
     inline std::unique_ptr<char[]> get_event_schema_from_tdh(const EVENT_RECORD &record)
     {
-        // get required size
-        ULONG bufferSize = 0;
-        ULONG status = TdhGetEventInformation(
-            (PEVENT_RECORD)&record,
-            0,
-            NULL,
-            NULL,
-            &bufferSize);
-
-        if (status != ERROR_INSUFFICIENT_BUFFER) {
-            error_check_common_conditions(status, record);
-        }
-
-        // allocate and fill the schema from TDH
-        auto buffer = std::unique_ptr<char[]>(new char[bufferSize]);
-
-        status = TdhGetEventInformation(
-            (PEVENT_RECORD)&record,
-            0,
-            NULL,
-            (PTRACE_EVENT_INFO)buffer.get(),
-            &bufferSize);
-        
-        if (status != ERROR_SUCCESS) {
-            error_check_common_conditions(status, record);
-        }
-       
-        return buffer;
+        return details::get_event_schema_from_tdh<std::unique_ptr<char[]>>(record, [](ULONG size) {
+            return std::unique_ptr<char[]>(new char[size]);
+        });
+    }
+
+    inline std::unique_ptr<char[], details::resource_deleter> get_event_schema_from_tdh(
+        const EVENT_RECORD &record,
+        memory_resource &resource)
+    {
+        typedef std::unique_ptr<char[], details::resource_deleter> buffer_type;
+
+        return details::get_event_schema_from_tdh<buffer_type>(record, [&](ULONG size) {
+            auto p = static_cast<char*>(resource.allocate(size));
+            return buffer_type(p, details::resource_deleter{ &resource, size });
+        });
     }
 }
@@ -1,310 +1,623 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
 #pragma once
-#include <string>
-#include <vector>
-#include <map>
 
-//Exclude rarely-used stuff from Windows headers
-#define WIN32_LEAN_AND_MEA
+#ifndef  WIN32_LEAN_AND_MEAN
+#define  WIN32_LEAN_AND_MEAN
+#endif
+
 #include <windows.h>
-#include <combaseapi.h>
 #include <tdh.h>
-#pragma comment(lib, "tdh")
-
-#include "helping/file_mapping.hpp"
-//#include "common.hpp"
-//#include "output_cache.hpp"
-
-namespace krabs { namespace details {
-	class wevt {
-
-	};
-
-}	/* namespace details */ } /* namespace krabs */
-
 
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
 
+#include "../compiler_check.hpp"
+#include "../errors.hpp"
+#include "../guid.hpp"
+#include "../schema_locator.hpp"
 
 namespace krabs {
-	struct resource_metadata {
-		std::wstring name;
-		DWORD size{ NULL };
-		BYTE* address{ nullptr };
-		DWORD rva{ NULL };
-	};
-
-	class wevt : file_mapping {
-	public:
-		wevt(
-			const std::wstring& path,
-			utility::binary_memory_mapping_c& binary_mem_map,
-			utility::output_cache_c& output_cache);
-
-		~wevt();
-
-		open(const std::wstring& path);
-		
-
-		bool signatur_found();
-		bool push_to_cache(const bool& is_dump = false);
-
-	protected:
-
-	private:
-		bool enum_events();
-		bool find_resource(const std::wstring& path);
-		TDHSTATUS record_at(const int& at, common::record_s& record);
-
-		//file_mapping file_mapping_;
-
-		utility::binary_memory_mapping& binary_mem_map_;
-		utility::output_cache_c& output_cache_;
-
-		HMODULE module_handle_{ NULL };
-		HRSRC wevt_resource_handle_{ NULL };
-		resource_metadata resource_;
 
-		std::wstring path_;
-		bool resource_found_{ false };
-		bool provider_info_found_{ false };
-
-		GUID* guid_{ nullptr };
-		std::wstring guid_wstr_;
-		std::wstring provider_name_;
-		PROVIDER_EVENT_INFO* event_info_{ nullptr };
-		std::vector<BYTE> event_info_buffer_;
-		ULONG event_info_size_{ 0 };
-	};
-
-
-	// Implementation
-	// ------------------------------------------------------------------------
-
-	wevt::wevt(
-		const std::wstring& path,
-		utility::binary_memory_mapping_c& binary_mem_map,
-		utility::output_cache_c& output_cache)
-		: path_(path)
-		, binary_mem_map_(binary_mem_map)
-		, output_cache_(output_cache)
-	{
-
-		if (path.empty())
-			throw std::exception("wevt_metadata_c::wevt_metadata_c: path empty");
-
-		if (resource_found_ = find_resource()) {
-			provider_info_found_ = init_provider_info();
-		}
-
-	}
-
-	wevt::~wevt() 
-	{
-		if (!m_module_handle_) {
-			::FreeLibrary(m_module_handle_);
-		}
-	}
-
-	bool wevt::open(const std::wstring& path)
-	{
-		bool status = false;
-
-		if ((status = this->create_mapping(path)) == 0) {
-			return status;
-		}
-
-		if ((status = find_resource(path)) == 0) {
-			return status;
-		}
-
-		if ((status = enum_events()) == 0) {
-			return status;
-		}
-
-		return status;
-	}
-
-	bool wevt::find_resource(const std::wstring& path)
-	{
-		bool status{ false };
-
-		if (module_handle_ == NULL)
-			module_handle_ = ::LoadLibraryEx(path.c_str(), nullptr, LOAD_LIBRARY_AS_IMAGE_RESOURCE | LOAD_LIBRARY_AS_DATAFILE);
-
-		if (module_handle_ != NULL) {
-			const std::wstring resource_name{ L"WEVT_TEMPLATE" };
-			resource_handle_ = ::FindResource(module_handle_, MAKEINTRESOURCE(1), resource_name.c_str());
-
-			if (resource_handle_) {
-				resource_.name = resource_name;
-				resource_.size = ::SizeofResource(module_handle_, resource_handle_);
-				resource_.address = (BYTE*)::LockResource(::LoadResource(module_handle_, resource_handle_));
-				resource_.rva = static_cast<DWORD>(DWORD_PTR(resource_.address) - (DWORD_PTR(module_handle_) & ~0xf));
-
-				status = true;
-			}
-		}
-
-		return status;
-	}
-
-	bool wevt::enum_events() 
-	{
-		TDHSTATUS status{ (ULONG)-1 };
-		wchar_t guid_wstr[64];
-
-		if (resource_found_) {
-			guid_ = resource_.address == nullptr ? nullptr : (GUID*)(((PBYTE)resource_.address) + 16);
-
-			if (guid_ != nullptr) {
-				::StringFromGUID2(*guid_, guid_wstr, _countof(guid_wstr));
-				guid_wstr_ = guid_wstr;
-
-				status = ::TdhLoadManifestFromBinary((PWSTR)path_.c_str());
-				if (status != ERROR_SUCCESS) { goto exit; }
-
-				do {
-					if (status == ERROR_INSUFFICIENT_BUFFER) {
-						try {
-							event_info_buffer_.resize(event_info_size_);
-							event_info_ = (PROVIDER_EVENT_INFO*)&event_info_buffer_.at(0);
-							status = ERROR_SUCCESS;
-						}
-						catch (std::bad_alloc) {
-							status = ERROR_OUTOFMEMORY;
-						}
-					}
-
-					status = ::TdhEnumerateManifestProviderEvents(guid_, event_info_, &event_info_size_);
-				} while (status == ERROR_INSUFFICIENT_BUFFER);
-			}
-		}
-
-	exit:
-		return status == ERROR_SUCCESS;
-	}
-
-	bool wevt::push_to_cache(const bool& is_dump /* = false */) 
-	{
-		if (event_info_ == nullptr) {
-			throw std::exception("wevt_metadata_c::push_to_cache: mp_provider_info_ nullptr");
-		}
-
-		TDHSTATUS status{ (ULONG)-1 };
-
-		if (resource_found_ && provider_info_found_) {
-			if (event_info_->NumberOfEvents != 0) {
-				std::map<common::provider_type_e, common::provider_s> buffer;
-				common::provider_s provider;
-				provider.type = common::provider_type_e::wevt;
-
-				if (!is_dump) {
-					common::record_s record;
-					status = record_at(0, record);
-
-					if (status == ERROR_SUCCESS) {
-						auto pair = std::make_pair(provider_name_, guid_wstr_);
-						provider.m_identifiers.emplace(pair);
-						buffer.emplace(common::provider_type_e::wevt, provider);
-						output_cache_.push(path_, buffer);
-					}
-
-				}
-				else {
-					for (unsigned int at = 0; at < event_info_->NumberOfEvents; at++) {
-						common::record_s record;
-						status = record_at(at, record);
-
-						if (status == ERROR_SUCCESS) {
-							provider.records.push_back(record);
-						}
-					}
-
-					auto pair = std::make_pair(provider_name_, guid_wstr_);
-					provider.identifiers.emplace(pair);
-					buffer.emplace(common::provider_type_e::wevt, provider);
-					output_cache_.push(path_, buffer);
-				}
-			}
-		}
-
-		return status == ERROR_SUCCESS;
-	}
-
-	TDHSTATUS wevt::record_at(const int& at, common::record_s& record) 
-	{
-		if (event_info_ == nullptr) {
-			throw std::exception("wevt_metadata_c::record_at: mp_provider_info_ nullptr");
-		}
-
-		if (guid_ == nullptr) {
-			throw std::exception("wevt_metadata_c::record_at: mp_provider_guid_ nullptr");
-		}
-
-		TDHSTATUS status{ (ULONG)-1 };
-		auto& event_descriptor = event_info_->EventDescriptorsArray[at];
-
-		ULONG trace_info_size{ 0 };
-		TRACE_EVENT_INFO* trace_info{ nullptr };
-		std::vector<BYTE> trace_info_buffer;
-
-		do {
-			if (status == ERROR_INSUFFICIENT_BUFFER) {
-				try {
-					trace_info_buffer.resize(trace_info_size);
-					trace_info = (TRACE_EVENT_INFO*)&trace_info_buffer.at(0);
-					status = ERROR_SUCCESS;
-				}
-				catch (std::bad_alloc) {
-					status = ERROR_OUTOFMEMORY;
-				}
-			}
-
-			status = ::TdhGetManifestEventInformation(
-				guid_,
-				(EVENT_DESCRIPTOR*)&event_descriptor,
-				trace_info,
-				&trace_info_size);
-
-		} while (status == ERROR_INSUFFICIENT_BUFFER);
-
-		if (status == ERROR_SUCCESS) {
-
-			//ProviderName
-			if (trace_info->ProviderNameOffset) {
-				if (provider_name_.empty()) {
-					provider_name_.assign((PCWSTR)(&trace_info_buffer.at(0) + trace_info->ProviderNameOffset));
-				}
-			}
-
-			//EventName
-			if (trace_info->EventNameOffset) {
-				record.m_record_name = (PCWSTR)(&trace_info_buffer.at(0) + trace_info->EventNameOffset);
-			}
-
-			record.channel = event_descriptor.Channel;
-			record.evel = event_descriptor.Level;
-			record.opcode = event_descriptor.Opcode;
-			record.keyword = event_descriptor.Keyword;
-			record.version = event_descriptor.Version;
-			record.id = event_descriptor.Id;
-
-			for (ULONG count = 0; count < trace_info->TopLevelPropertyCount; count++) {
-				auto& event_property = trace_info->EventPropertyInfoArray[count];
-				common::record_specific_metadata_s field;
-
-				//FieldName
-				if (event_property.NameOffset) {
-					field.field_name = (PCWSTR)(&trace_info_buffer.at(0) + event_property.NameOffset);
-				}
-
-				if ((event_property.Flags & PropertyStruct) == 0) {
-					field.out_type = event_property.nonStructType.OutType;
-					field.in_type = event_property.nonStructType.InType;
-				}
-				record.fields.push_back(field);
-			}
-		}
-
-		return status;
-	}
+    /**
+     * <summary>
+     *   The event schemas of a provider manifest, decoded from the binary
+     *   WEVT_TEMPLATE resource that the message compiler embeds in the
+     *   provider's image, without calling into TDH.
+     * </summary>
+     * <example>
+     *   auto manifest = krabs::wevt_manifest::from_module(L"C:\\Windows\\System32\\wevtsvc.dll");
+     *   krabs::schema_locator locator(manifest);
+     *   krabs::schema schema(record, locator);
+     * </example>
+     * <remarks>
+     *   The schemas are laid out the way TdhGetEventInformation lays them
+     *   out, so krabs::schema and krabs::parser read them the same way.
+     *   A resource does not hold event or provider names, so EventNameOffset
+     *   is zero and the provider name is the one given, if any. Task, opcode
+     *   and level names come from the manifest.
+     *
+     *   Events whose templates use structures are not decoded and are left
+     *   to the locator's next source, TDH. Value maps are not decoded
+     *   either, MapNameOffset is always zero.
+     *
+     *   The layout follows the libfwevt documentation of the format. The
+     *   decoder has only been tested against resources written to that
+     *   same layout, not yet against resources extracted from images
+     *   built by mc.exe, so treat its schemas with care until it has been.
+     * </remarks>
+     */
+    class wevt_manifest : public schema_source {
+    public:
+
+        /**
+         * <summary>
+         *   Decodes the contents of a WEVT_TEMPLATE resource. Throws
+         *   invalid_manifest when the data is not a well formed resource.
+         * </summary>
+         */
+        wevt_manifest(const BYTE *data, size_t size, const std::wstring &provider_name = std::wstring());
+
+#if defined(_WIN32)
+        /**
+         * <summary>
+         *   Loads the WEVT_TEMPLATE resource of an image and decodes it.
+         * </summary>
+         */
+        static wevt_manifest from_module(const std::wstring &path, const std::wstring &provider_name = std::wstring());
+#endif
+
+        /**
+         * <summary>Returns the number of events that were decoded.</summary>
+         */
+        size_t event_count() const;
+
+        /**
+         * <summary>
+         *   Returns the number of events that were left out because their
+         *   template could not be decoded.
+         * </summary>
+         */
+        size_t skipped_count() const;
+
+        /**
+         * <summary>
+         *   Returns the schema of a manifest event, or nullptr when the
+         *   manifest does not define it.
+         * </summary>
+         */
+        const TRACE_EVENT_INFO *find(const GUID &provider, USHORT id, UCHAR version) const;
+
+        size_t get_event_schema(const EVENT_RECORD &record, void *buffer, size_t size) const override;
+
+    private:
+        struct event_key {
+            krabs::guid provider;
+            USHORT id;
+            UCHAR version;
+
+            bool operator<(const event_key &rhs) const;
+        };
+
+        void decode(const BYTE *data, size_t size, const std::wstring &provider_name);
+
+        std::map<event_key, std::vector<BYTE>> schemas_;
+        size_t skipped_;
+    };
+
+    namespace details {
+
+        /**
+         * <summary>
+         *   Bounds checked reads from a WEVT_TEMPLATE resource. Offsets in
+         *   the resource are relative to its start.
+         * </summary>
+         */
+        class wevt_reader {
+        public:
+            wevt_reader(const BYTE *data, size_t size);
+
+            template <typename T>
+            T read(size_t offset) const;
+
+            bool has_signature(size_t offset, const char *signature) const;
+
+            /**
+             * <summary>
+             *   Reads a string stored as its size in bytes, the size field
+             *   included, followed by the UTF-16 characters.
+             * </summary>
+             */
+            std::wstring read_string(size_t offset) const;
+
+            void check(size_t offset, size_t length) const;
+
+        private:
+            const BYTE *data_;
+            size_t size_;
+        };
+
+        /**
+         * <summary>
+         *   A template item, one property of an event. A structure, flagged
+         *   PropertyStruct, gives the index and number of its members, which
+         *   follow the top level properties.
+         * </summary>
+         */
+        struct wevt_property {
+            std::wstring name;
+            ULONG flags;
+            USHORT in_type;
+            USHORT out_type;
+            USHORT count;
+            USHORT length;
+            USHORT struct_start;
+            USHORT struct_members;
+        };
+
+        /**
+         * <summary>
+         *   Returns the size TDH reports for a fixed size input type, or zero
+         *   for types whose size depends on the data.
+         * </summary>
+         */
+        USHORT wevt_fixed_size(USHORT in_type);
+
+        /**
+         * <summary>
+         *   Returns the output type TDH reports for an input type when the
+         *   manifest does not name one.
+         * </summary>
+         */
+        USHORT wevt_default_out_type(USHORT in_type);
+
+        /**
+         * <summary>
+         *   Lays out a TRACE_EVENT_INFO with the names following the
+         *   property array, like TDH does.
+         * </summary>
+         */
+        std::vector<BYTE> build_trace_event_info(
+            const GUID &provider,
+            const EVENT_DESCRIPTOR &descriptor,
+            const std::wstring &provider_name,
+            const std::wstring &task_name,
+            const std::wstring &opcode_name,
+            const std::wstring &level_name,
+            const std::vector<wevt_property> &properties);
+
+        // The layout of the resource, as documented by the libfwevt
+        // project. The template item flags are the PROPERTY_FLAGS that
+        // TDH reports for the property.
+        namespace wevt_layout {
+            const size_t crim_header_size = 16;
+            const size_t crim_provider_size = 20;
+            const size_t wevt_header_size = 20;
+            const size_t wevt_descriptor_size = 8;
+            const size_t evnt_header_size = 16;
+            const size_t evnt_definition_size = 48;
+            const size_t temp_header_size = 40;
+            const size_t temp_item_size = 20;
+            const size_t task_name_offset = 24;
+            const size_t opcode_name_offset = 8;
+            const size_t level_name_offset = 8;
+        }
+
+    } /* namespace details */
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline wevt_manifest::wevt_manifest(const BYTE *data, size_t size, const std::wstring &provider_name)
+        : skipped_(0)
+    {
+        decode(data, size, provider_name);
+    }
+
+#if defined(_WIN32)
+    inline wevt_manifest wevt_manifest::from_module(const std::wstring &path, const std::wstring &provider_name)
+    {
+        auto module = LoadLibraryExW(path.c_str(), nullptr, LOAD_LIBRARY_AS_IMAGE_RESOURCE | LOAD_LIBRARY_AS_DATAFILE);
+        if (module == nullptr) {
+            throw invalid_manifest("could not load the image");
+        }
+
+        auto resource = FindResourceW(module, MAKEINTRESOURCEW(1), L"WEVT_TEMPLATE");
+        auto loaded = resource == nullptr ? nullptr : LoadResource(module, resource);
+        auto data = loaded == nullptr ? nullptr : static_cast<const BYTE *>(LockResource(loaded));
+
+        if (data == nullptr) {
+            FreeLibrary(module);
+            throw invalid_manifest("the image has no WEVT_TEMPLATE resource");
+        }
+
+        try {
+            wevt_manifest manifest(data, SizeofResource(module, resource), provider_name);
+            FreeLibrary(module);
+            return manifest;
+        }
+        catch (...) {
+            FreeLibrary(module);
+            throw;
+        }
+    }
+#endif
+
+    inline size_t wevt_manifest::event_count() const
+    {
+        return schemas_.size();
+    }
+
+    inline size_t wevt_manifest::skipped_count() const
+    {
+        return skipped_;
+    }
+
+    inline const TRACE_EVENT_INFO *wevt_manifest::find(const GUID &provider, USHORT id, UCHAR version) const
+    {
+        auto it = schemas_.find(event_key{ krabs::guid(provider), id, version });
+        if (it == schemas_.end()) {
+            return nullptr;
+        }
+
+        return reinterpret_cast<const TRACE_EVENT_INFO *>(it->second.data());
+    }
+
+    inline size_t wevt_manifest::get_event_schema(const EVENT_RECORD &record, void *buffer, size_t size) const
+    {
+        auto &descriptor = record.EventHeader.EventDescriptor;
+        auto it = schemas_.find(event_key{
+            krabs::guid(record.EventHeader.ProviderId), descriptor.Id, descriptor.Version });
+
+        if (it == schemas_.end()) {
+            return 0;
+        }
+
+        auto &schema = it->second;
+        if (buffer != nullptr && size >= schema.size()) {
+            memcpy(buffer, schema.data(), schema.size());
+        }
+
+        return schema.size();
+    }
+
+    inline bool wevt_manifest::event_key::operator<(const event_key &rhs) const
+    {
+        if (!(provider == rhs.provider)) {
+            return provider < rhs.provider;
+        }
+
+        if (id != rhs.id) {
+            return id < rhs.id;
+        }
+
+        return version < rhs.version;
+    }
+
+    inline void wevt_manifest::decode(const BYTE *data, size_t size, const std::wstring &provider_name)
+    {
+        using namespace details::wevt_layout;
+
+        details::wevt_reader reader(data, size);
+
+        if (!reader.has_signature(0, "CRIM")) {
+            throw invalid_manifest("missing CRIM signature");
+        }
+
+        auto providerCount = reader.read<uint32_t>(12);
+
+        for (uint32_t p = 0; p < providerCount; ++p) {
+            auto providerEntry = crim_header_size + p * crim_provider_size;
+            auto providerGuid = reader.read<GUID>(providerEntry);
+            auto providerOffset = reader.read<uint32_t>(providerEntry + 16);
+
+            if (!reader.has_signature(providerOffset, "WEVT")) {
+                throw invalid_manifest("missing WEVT signature");
+            }
+
+            auto descriptorCount = reader.read<uint32_t>(providerOffset + 12);
+
+            for (uint32_t d = 0; d < descriptorCount; ++d) {
+                auto elementOffset = reader.read<uint32_t>(
+                    providerOffset + wevt_header_size + d * wevt_descriptor_size);
+
+                if (!reader.has_signature(elementOffset, "EVNT")) {
+                    continue;
+                }
+
+                auto eventCount = reader.read<uint32_t>(elementOffset + 8);
+
+                for (uint32_t e = 0; e < eventCount; ++e) {
+                    auto definition = elementOffset + evnt_header_size + e * evnt_definition_size;
+                    reader.check(definition, evnt_definition_size);
+
+                    EVENT_DESCRIPTOR descriptor;
+                    descriptor.Id = reader.read<USHORT>(definition);
+                    descriptor.Version = reader.read<UCHAR>(definition + 2);
+                    descriptor.Channel = reader.read<UCHAR>(definition + 3);
+                    descriptor.Level = reader.read<UCHAR>(definition + 4);
+                    descriptor.Opcode = reader.read<UCHAR>(definition + 5);
+                    descriptor.Task = reader.read<USHORT>(definition + 6);
+                    descriptor.Keyword = reader.read<ULONGLONG>(definition + 8);
+
+                    auto templateOffset = reader.read<uint32_t>(definition + 20);
+                    auto opcodeOffset = reader.read<uint32_t>(definition + 24);
+                    auto levelOffset = reader.read<uint32_t>(definition + 28);
+                    auto taskOffset = reader.read<uint32_t>(definition + 32);
+
+                    std::vector<details::wevt_property> properties;
+                    bool supported = true;
+
+                    if (templateOffset != 0) {
+                        if (!reader.has_signature(templateOffset, "TEMP")) {
+                            throw invalid_manifest("missing TEMP signature");
+                        }
+
+                        auto itemCount = reader.read<uint32_t>(templateOffset + 8);
+                        auto itemsOffset = reader.read<uint32_t>(templateOffset + 16);
+
+                        for (uint32_t i = 0; i < itemCount && supported; ++i) {
+                            auto item = itemsOffset + i * temp_item_size;
+                            reader.check(item, temp_item_size);
+
+                            details::wevt_property property;
+                            property.flags = reader.read<uint32_t>(item);
+                            property.in_type = reader.read<UCHAR>(item + 4);
+                            property.out_type = reader.read<UCHAR>(item + 5);
+                            property.count = reader.read<USHORT>(item + 12);
+                            property.length = reader.read<USHORT>(item + 14);
+                            property.name = reader.read_string(reader.read<uint32_t>(item + 16));
+                            property.struct_start = 0;
+                            property.struct_members = 0;
+
+                            if ((property.flags & PropertyStruct) != 0 || property.in_type == TDH_INTYPE_NULL) {
+                                supported = false;
+                            }
+
+                            properties.push_back(std::move(property));
+                        }
+                    }
+
+                    if (!supported) {
+                        ++skipped_;
+                        continue;
+                    }
+
+                    auto name_at = [&](uint32_t entry, size_t nameOffset) {
+                        if (entry == 0) {
+                            return std::wstring();
+                        }
+
+                        auto offset = reader.read<uint32_t>(entry + nameOffset);
+                        return offset == 0 ? std::wstring() : reader.read_string(offset);
+                    };
+
+                    schemas_[event_key{ krabs::guid(providerGuid), descriptor.Id, descriptor.Version }] =
+                        details::build_trace_event_info(
+                            providerGuid,
+                            descriptor,
+                            provider_name,
+                            name_at(taskOffset, task_name_offset),
+                            name_at(opcodeOffset, opcode_name_offset),
+                            name_at(levelOffset, level_name_offset),
+                            properties);
+                }
+            }
+        }
+    }
+
+    // ------------------------------------------------------------------------
+
+    namespace details {
+
+        inline wevt_reader::wevt_reader(const BYTE *data, size_t size)
+            : data_(data)
+            , size_(size)
+        {}
+
+        template <typename T>
+        T wevt_reader::read(size_t offset) const
+        {
+            check(offset, sizeof(T));
+
+            T value;
+            memcpy(&value, data_ + offset, sizeof(T));
+            return value;
+        }
+
+        inline bool wevt_reader::has_signature(size_t offset, const char *signature) const
+        {
+            check(offset, 4);
+            return memcmp(data_ + offset, signature, 4) == 0;
+        }
+
+        inline std::wstring wevt_reader::read_string(size_t offset) const
+        {
+            auto size = read<uint32_t>(offset);
+            if (size < sizeof(uint32_t)) {
+                throw invalid_manifest("string size out of range");
+            }
+
+            check(offset, size);
+
+            // The characters are UTF-16 whatever the width of wchar_t, and
+            // include the terminator.
+            std::wstring value;
+            for (size_t at = offset + sizeof(uint32_t); at + sizeof(uint16_t) <= offset + size; at += sizeof(uint16_t)) {
+                auto c = read<uint16_t>(at);
+                if (c == 0) {
+                    break;
+                }
+
+                value.push_back(static_cast<wchar_t>(c));
+            }
+
+            return value;
+        }
+
+        inline void wevt_reader::check(size_t offset, size_t length) const
+        {
+            if (offset > size_ || length > size_ - offset) {
+                throw invalid_manifest("offset out of range");
+            }
+        }
+
+        inline USHORT wevt_fixed_size(USHORT in_type)
+        {
+            switch (in_type) {
+            case TDH_INTYPE_INT8:
+            case TDH_INTYPE_UINT8:
+            case TDH_INTYPE_ANSICHAR:
+                return 1;
+            case TDH_INTYPE_INT16:
+            case TDH_INTYPE_UINT16:
+            case TDH_INTYPE_UNICODECHAR:
+                return 2;
+            case TDH_INTYPE_INT32:
+            case TDH_INTYPE_UINT32:
+            case TDH_INTYPE_HEXINT32:
+            case TDH_INTYPE_FLOAT:
+            case TDH_INTYPE_BOOLEAN:
+                return 4;
+            case TDH_INTYPE_INT64:
+            case TDH_INTYPE_UINT64:
+            case TDH_INTYPE_HEXINT64:
+            case TDH_INTYPE_DOUBLE:
+            case TDH_INTYPE_FILETIME:
+            case TDH_INTYPE_POINTER:
+                return 8;
+            case TDH_INTYPE_GUID:
+            case TDH_INTYPE_SYSTEMTIME:
+                return 16;
+            default:
+                return 0;
+            }
+        }
+
+        inline USHORT wevt_default_out_type(USHORT in_type)
+        {
+            switch (in_type) {
+            case TDH_INTYPE_UNICODESTRING:
+            case TDH_INTYPE_ANSISTRING:
+            case TDH_INTYPE_UNICODECHAR:
+            case TDH_INTYPE_ANSICHAR:
+            case TDH_INTYPE_SID:
+                return TDH_OUTTYPE_STRING;
+            case TDH_INTYPE_INT8: return TDH_OUTTYPE_BYTE;
+            case TDH_INTYPE_UINT8: return TDH_OUTTYPE_UNSIGNEDBYTE;
+            case TDH_INTYPE_INT16: return TDH_OUTTYPE_SHORT;
+            case TDH_INTYPE_UINT16: return TDH_OUTTYPE_UNSIGNEDSHORT;
+            case TDH_INTYPE_INT32: return TDH_OUTTYPE_INT;
+            case TDH_INTYPE_UINT32: return TDH_OUTTYPE_UNSIGNEDINT;
+            case TDH_INTYPE_INT64: return TDH_OUTTYPE_LONG;
+            case TDH_INTYPE_UINT64: return TDH_OUTTYPE_UNSIGNEDLONG;
+            case TDH_INTYPE_FLOAT: return TDH_OUTTYPE_FLOAT;
+            case TDH_INTYPE_DOUBLE: return TDH_OUTTYPE_DOUBLE;
+            case TDH_INTYPE_BOOLEAN: return TDH_OUTTYPE_BOOLEAN;
+            case TDH_INTYPE_BINARY: return TDH_OUTTYPE_HEXBINARY;
+            case TDH_INTYPE_GUID: return TDH_OUTTYPE_GUID;
+            case TDH_INTYPE_POINTER: return TDH_OUTTYPE_HEXINT64;
+            case TDH_INTYPE_FILETIME:
+            case TDH_INTYPE_SYSTEMTIME:
+                return TDH_OUTTYPE_DATETIME;
+            case TDH_INTYPE_HEXINT32: return TDH_OUTTYPE_HEXINT32;
+            case TDH_INTYPE_HEXINT64: return TDH_OUTTYPE_HEXINT64;
+            default: return TDH_OUTTYPE_NULL;
+            }
+        }
+
+        inline std::vector<BYTE> build_trace_event_info(
+            const GUID &provider,
+            const EVENT_DESCRIPTOR &descriptor,
+            const std::wstring &provider_name,
+            const std::wstring &task_name,
+            const std::wstring &opcode_name,
+            const std::wstring &level_name,
+            const std::vector<wevt_property> &properties)
+        {
+            const auto propertyCount = static_cast<ULONG>(properties.size());
+            const auto headerSize = (std::max)(
+                offsetof(TRACE_EVENT_INFO, EventPropertyInfoArray) + propertyCount * sizeof(EVENT_PROPERTY_INFO),
+                sizeof(TRACE_EVENT_INFO));
+
+            std::vector<BYTE> buffer(headerSize);
+
+            auto append = [&](const std::wstring &value) -> ULONG {
+                if (value.empty()) {
+                    return 0;
+                }
+
+                auto offset = buffer.size();
+                auto bytes = (value.size() + 1) * sizeof(wchar_t);
+                buffer.resize(offset + bytes);
+                memcpy(buffer.data() + offset, value.c_str(), bytes);
+                return static_cast<ULONG>(offset);
+            };
+
+            TRACE_EVENT_INFO info;
+            memset(&info, 0, sizeof(info));
+            info.ProviderGuid = provider;
+            info.EventDescriptor = descriptor;
+            info.DecodingSource = DecodingSourceXMLFile;
+            info.ProviderNameOffset = append(provider_name);
+            info.TaskNameOffset = append(task_name);
+            info.OpcodeNameOffset = append(opcode_name);
+            info.LevelNameOffset = append(level_name);
+            info.PropertyCount = propertyCount;
+
+            // Members of structures come after the top level properties.
+            info.TopLevelPropertyCount = propertyCount;
+            for (auto &property : properties) {
+                if ((property.flags & PropertyStruct) != 0) {
+                    info.TopLevelPropertyCount = (std::min)(info.TopLevelPropertyCount, static_cast<ULONG>(property.struct_start));
+                }
+            }
+
+            info.Flags = TEMPLATE_EVENT_DATA;
+
+            std::vector<EVENT_PROPERTY_INFO> infos(propertyCount);
+            for (ULONG i = 0; i < propertyCount; ++i) {
+                auto &property = properties[i];
+                auto &propertyInfo = infos[i];
+                memset(&propertyInfo, 0, sizeof(propertyInfo));
+
+                propertyInfo.Flags = static_cast<PROPERTY_FLAGS>(property.flags & (PropertyStruct | PropertyParamLength | PropertyParamCount));
+                propertyInfo.NameOffset = append(property.name);
+
+                if ((property.flags & PropertyStruct) != 0) {
+                    propertyInfo.structType.StructStartIndex = property.struct_start;
+                    propertyInfo.structType.NumOfStructMembers = property.struct_members;
+                }
+                else {
+                    propertyInfo.nonStructType.InType = property.in_type;
+                    propertyInfo.nonStructType.OutType = property.out_type != 0
+                        ? property.out_type
+                        : wevt_default_out_type(property.in_type);
+                }
+
+                // A scalar has a count of one, a count or length taken from
+                // another property is that property's index. The manifest
+                // leaves the length of fixed size types out, TDH fills it in.
+                propertyInfo.count = (property.flags & PropertyParamCount) || property.count != 0 ? property.count : 1;
+                propertyInfo.length = (property.flags & PropertyParamLength) || property.length != 0
+                    ? property.length
+                    : wevt_fixed_size(property.in_type);
+            }
+
+            memcpy(buffer.data(), &info, offsetof(TRACE_EVENT_INFO, EventPropertyInfoArray));
+            if (propertyCount != 0) {
+                memcpy(buffer.data() + offsetof(TRACE_EVENT_INFO, EventPropertyInfoArray),
+                       infos.data(),
+                       propertyCount * sizeof(EVENT_PROPERTY_INFO));
+            }
+
+            return buffer;
+        }
+
+    } /* namespace details */
 }
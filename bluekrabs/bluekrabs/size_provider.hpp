@@ -11,10 +11,47 @@
 #include <tdh.h>
 #include <evntrace.h>
 
+#include <cstdint>
+#include <limits>
+
 #include "compiler_check.hpp"
+#include "string_kernels.hpp"
 
 namespace krabs {
 
+    /**
+     * <summary>
+     * How the size of a property is found, decided once per schema.
+     * </summary>
+     */
+    enum class size_rule : uint8_t {
+        fixed,                       // value bytes
+        pointer,                     // value pointers of the bitness of the event
+        length_from_property,        // value is the index of the property holding the length
+        length_from_property_utf16,  // the same, with the length in wide characters
+        null_terminated_utf16,
+        null_terminated_ansi,
+        counted,                     // a 16 bit byte count, then the bytes
+        reversed_counted,            // the same with a big endian count
+        sid,
+        remaining_bytes,             // up to the end of the event
+        array,                       // count elements, each sized by the element rule
+        structure,                   // count elements, each sized by its members
+        tdh                          // only Tdh knows
+    };
+
+    /**
+     * <summary>
+     * The size rule of a property. For arrays, element and value describe
+     * each element.
+     * </summary>
+     */
+    struct property_size_rule {
+        size_rule kind;
+        size_rule element;
+        ULONG value;
+    };
+
     // TODO: I don't like this interface - it's too tightly
     // coupled to parser.hpp mainly because the code was
     // lifted directly out of parser::find_property.
@@ -36,15 +73,80 @@ namespace krabs {
             const EVENT_RECORD&,
             const EVENT_PROPERTY_INFO&);
 
+        /**
+         * <summary>
+         * Returns whether the size of the specified property is known from
+         * the schema alone, i.e. is the same for every event.
+         * </summary>
+         */
+        static bool has_fixed_size(const EVENT_PROPERTY_INFO&);
+
+        /**
+         * <summary>
+         * Get the size of a property for which has_fixed_size is true. For
+         * an array with a count in the schema, that is the size of all of
+         * its elements.
+         * </summary>
+         * EVENT_PROPERTY_INFO& property info for the property to query
+         * bool whether the event was logged with 32 bit pointers
+         */
+        static ULONG get_fixed_size(const EVENT_PROPERTY_INFO&, bool);
+
+        /**
+         * <summary>
+         * Get the number of elements of a property whose count is given by
+         * the schema, 1 for anything that isn't an array.
+         * </summary>
+         */
+        static ULONG get_fixed_count(const EVENT_PROPERTY_INFO&);
+
+        /**
+         * <summary>
+         * Decides how the size of the specified property is found. Done
+         * once per schema, the schema layout keeps the result.
+         * </summary>
+         */
+        static property_size_rule get_size_rule(const EVENT_PROPERTY_INFO&);
+
+        /**
+         * <summary>
+         * Get the size of a property or array element from its rule and
+         * the data, for every rule that doesn't refer to other properties.
+         * Returns unknown_size when only Tdh can tell.
+         * </summary>
+         * size_rule how to size the property
+         * ULONG the value of the rule
+         * BYTE* offset into the user data buffer where the property starts
+         * BYTE* end of the user data buffer
+         * bool whether the event was logged with 32 bit pointers
+         */
+        static ULONG apply_size_rule(size_rule, ULONG, const BYTE*, const BYTE*, bool);
+
+        /**
+         * <summary>
+         * Asks Tdh for the size of the specified top level property.
+         * </summary>
+         * wchar_t* name of the property to query
+         * EVENT_RECORD& record to query
+         */
+        static ULONG get_tdh_size(
+            const wchar_t*,
+            const EVENT_RECORD&);
+
+        static constexpr ULONG unknown_size = ULONG(-1);
+
     private:
         static ULONG get_heuristic_size(
             const BYTE*,
             const EVENT_PROPERTY_INFO&,
             const EVENT_RECORD&);
 
-        static ULONG get_tdh_size(
-            const wchar_t*,
-            const EVENT_RECORD&);
+        static size_rule get_element_rule(const EVENT_PROPERTY_INFO&);
+
+        template <typename T>
+        static ULONG get_null_terminated_size(
+            const BYTE*,
+            const BYTE*);
     };
 
     // Implementation
@@ -64,22 +166,11 @@ namespace krabs {
         // property. For others, the size is immediately accessible in
         // the schema structure.
 
-        if ((propertyInfo.Flags & PropertyParamLength) == 0 &&
-            propertyInfo.length > 0)
+        if (has_fixed_size(propertyInfo))
         {
-            // length is a union that may refer to another field for a length
-            // value. In that case, defer to TDH for the value otherwise
-            // use the length value directly.
-
-            // For pointers check header instead of size, see PointerSize at
-            // https://docs.microsoft.com/en-us/windows/win32/api/tdh/nf-tdh-tdhformatproperty
-            // for details
-            if (propertyInfo.nonStructType.InType == TDH_INTYPE_POINTER)
-            {
-                return record.EventHeader.Flags & EVENT_HEADER_FLAG_32_BIT_HEADER ? 4 : 8;
-            }
-
-            return propertyInfo.length;
+            return get_fixed_size(
+                propertyInfo,
+                (record.EventHeader.Flags & EVENT_HEADER_FLAG_32_BIT_HEADER) != 0);
         }
 
         ULONG propertyLength = 0;
@@ -102,6 +193,188 @@ namespace krabs {
         return propertyLength;
     }
 
+    inline bool size_provider::has_fixed_size(const EVENT_PROPERTY_INFO& propertyInfo)
+    {
+        // length is a union that may refer to another field for a length
+        // value, as count may for the number of elements. Structures are
+        // sized by their members.
+        return (propertyInfo.Flags & (PropertyStruct | PropertyParamLength | PropertyParamCount)) == 0 &&
+               propertyInfo.length > 0;
+    }
+
+    inline ULONG size_provider::get_fixed_size(
+        const EVENT_PROPERTY_INFO& propertyInfo,
+        bool is32Bit)
+    {
+        // For pointers check header instead of size, see PointerSize at
+        // https://docs.microsoft.com/en-us/windows/win32/api/tdh/nf-tdh-tdhformatproperty
+        // for details
+        ULONG elementSize = propertyInfo.length;
+        if (propertyInfo.nonStructType.InType == TDH_INTYPE_POINTER)
+        {
+            elementSize = is32Bit ? 4 : 8;
+        }
+
+        // Arrays with a count in the schema are fixed as well.
+        return elementSize * get_fixed_count(propertyInfo);
+    }
+
+    inline ULONG size_provider::get_fixed_count(const EVENT_PROPERTY_INFO& propertyInfo)
+    {
+        // Scalars have a count of 1. Older schemas describe fixed size
+        // arrays by a count above 1 alone, newer ones flag them as well,
+        // which allows a count of 0.
+        if ((propertyInfo.Flags & PropertyParamFixedCount) != 0 || propertyInfo.count > 1)
+        {
+            return propertyInfo.count;
+        }
+
+        return 1;
+    }
+
+    inline property_size_rule size_provider::get_size_rule(const EVENT_PROPERTY_INFO& propertyInfo)
+    {
+        if ((propertyInfo.Flags & PropertyStruct) != 0)
+        {
+            return { size_rule::structure, size_rule::tdh, 0 };
+        }
+
+        if (has_fixed_size(propertyInfo))
+        {
+            if (propertyInfo.nonStructType.InType == TDH_INTYPE_POINTER)
+            {
+                return { size_rule::pointer, size_rule::tdh, get_fixed_count(propertyInfo) };
+            }
+
+            return { size_rule::fixed, size_rule::tdh, propertyInfo.length * get_fixed_count(propertyInfo) };
+        }
+
+        // Each element of an array is sized like a single property would be.
+        auto element = get_element_rule(propertyInfo);
+        ULONG value = 0;
+        if (element == size_rule::length_from_property ||
+            element == size_rule::length_from_property_utf16)
+        {
+            value = propertyInfo.lengthPropertyIndex;
+        }
+        else if (element == size_rule::fixed)
+        {
+            value = propertyInfo.length;
+        }
+        else if (element == size_rule::pointer)
+        {
+            // One pointer, whose size comes from the event header.
+            value = 1;
+        }
+
+        if ((propertyInfo.Flags & PropertyParamCount) != 0 || get_fixed_count(propertyInfo) != 1)
+        {
+            return { size_rule::array, element, value };
+        }
+
+        return { element, size_rule::tdh, value };
+    }
+
+    inline size_rule size_provider::get_element_rule(const EVENT_PROPERTY_INFO& propertyInfo)
+    {
+        // Tdh reads a length from another property as characters for wide
+        // strings and as bytes for everything else, ANSI strings included.
+        if ((propertyInfo.Flags & PropertyParamLength) != 0)
+        {
+            return propertyInfo.nonStructType.InType == TDH_INTYPE_UNICODESTRING
+                ? size_rule::length_from_property_utf16
+                : size_rule::length_from_property;
+        }
+
+        if (propertyInfo.length > 0)
+        {
+            return propertyInfo.nonStructType.InType == TDH_INTYPE_POINTER
+                ? size_rule::pointer
+                : size_rule::fixed;
+        }
+
+        switch (propertyInfo.nonStructType.InType)
+        {
+        case TDH_INTYPE_UNICODESTRING:
+            return size_rule::null_terminated_utf16;
+
+        case TDH_INTYPE_ANSISTRING:
+            return size_rule::null_terminated_ansi;
+
+        case TDH_INTYPE_COUNTEDSTRING:
+        case TDH_INTYPE_COUNTEDANSISTRING:
+        case TDH_INTYPE_MANIFEST_COUNTEDSTRING:
+        case TDH_INTYPE_MANIFEST_COUNTEDANSISTRING:
+        case TDH_INTYPE_MANIFEST_COUNTEDBINARY:
+            return size_rule::counted;
+
+        case TDH_INTYPE_REVERSEDCOUNTEDSTRING:
+        case TDH_INTYPE_REVERSEDCOUNTEDANSISTRING:
+            return size_rule::reversed_counted;
+
+        case TDH_INTYPE_SID:
+            return size_rule::sid;
+
+        case TDH_INTYPE_NONNULLTERMINATEDSTRING:
+        case TDH_INTYPE_NONNULLTERMINATEDANSISTRING:
+            return size_rule::remaining_bytes;
+
+        default:
+            return size_rule::tdh;
+        }
+    }
+
+    inline ULONG size_provider::apply_size_rule(
+        size_rule rule,
+        ULONG value,
+        const BYTE* propertyStart,
+        const BYTE* pRecordEnd,
+        bool is32Bit)
+    {
+        const auto available = propertyStart < pRecordEnd
+            ? static_cast<size_t>(pRecordEnd - propertyStart)
+            : 0;
+
+        switch (rule)
+        {
+        case size_rule::fixed:
+            return value;
+
+        case size_rule::pointer:
+            return value * (is32Bit ? 4 : 8);
+
+        // A string left empty at the end of an event may be left out
+        // altogether, so running out of data means a size of 0.
+        case size_rule::null_terminated_utf16:
+            return get_null_terminated_size<wchar_t>(propertyStart, pRecordEnd);
+
+        case size_rule::null_terminated_ansi:
+            return get_null_terminated_size<char>(propertyStart, pRecordEnd);
+
+        case size_rule::counted:
+            if (available < sizeof(USHORT)) break;
+            return static_cast<ULONG>(sizeof(USHORT) + (propertyStart[0] | (propertyStart[1] << 8)));
+
+        case size_rule::reversed_counted:
+            if (available < sizeof(USHORT)) break;
+            return static_cast<ULONG>(sizeof(USHORT) + ((propertyStart[0] << 8) | propertyStart[1]));
+
+        // The revision and sub authority count, then a 6 byte authority and
+        // 4 bytes per sub authority.
+        case size_rule::sid:
+            if (available < 2) break;
+            return static_cast<ULONG>(8 + propertyStart[1] * sizeof(DWORD));
+
+        case size_rule::remaining_bytes:
+            return static_cast<ULONG>(available);
+
+        default:
+            break;
+        }
+
+        return unknown_size;
+    }
+
     inline ULONG size_provider::get_heuristic_size(
         const BYTE* propertyStart,
         const EVENT_PROPERTY_INFO& propertyInfo,
@@ -126,32 +399,38 @@ namespace krabs {
         {
             if (propertyInfo.nonStructType.InType == TDH_INTYPE_UNICODESTRING)
             {
-                auto p = (const wchar_t*)propertyStart;
-                auto pEnd = (const wchar_t*)pRecordEnd;
-                while (p < pEnd) {
-                    if (!*p++) {
-                        break;
-                    }
-                }
-                propertyLength = static_cast<ULONG>(((PBYTE)p) - propertyStart);
+                propertyLength = get_null_terminated_size<wchar_t>(propertyStart, pRecordEnd);
             }
             else if (propertyInfo.nonStructType.InType == TDH_INTYPE_ANSISTRING)
             {
-                auto p = (const char*)propertyStart;
-                auto pEnd = (const char*)pRecordEnd;
-                while (p < pEnd) {
-                    if (!*p++) {
-                        break;
-                    }
-
-                }
-                propertyLength = static_cast<ULONG>(((PBYTE)p) - propertyStart);
+                propertyLength = get_null_terminated_size<char>(propertyStart, pRecordEnd);
             }
         }
 
         return propertyLength;
     }
 
+    template <typename T>
+    ULONG size_provider::get_null_terminated_size(
+        const BYTE* propertyStart,
+        const BYTE* pRecordEnd)
+    {
+        if (propertyStart >= pRecordEnd) {
+            return 0;
+        }
+
+        // Includes the null character when there is one, otherwise every
+        // whole character up to the end of the record.
+        auto maxLength = static_cast<size_t>(pRecordEnd - propertyStart) / sizeof(T);
+        auto length = details::string_kernels::find_null(
+            reinterpret_cast<const T*>(propertyStart), maxLength);
+        if (length < maxLength) {
+            ++length;
+        }
+
+        return static_cast<ULONG>(length * sizeof(T));
+    }
+
     inline ULONG size_provider::get_tdh_size(
         const wchar_t* propertyName,
         const EVENT_RECORD& record)
@@ -160,7 +439,7 @@ namespace krabs {
 
         PROPERTY_DATA_DESCRIPTOR desc;
         desc.PropertyName = (ULONGLONG)propertyName;
-        desc.ArrayIndex = ULONG_MAX;
+        desc.ArrayIndex = (std::numeric_limits<ULONG>::max)();
 
         TdhGetPropertySize((PEVENT_RECORD)&record, 0, NULL, 1, &desc, &propertyLength);
 
@@ -0,0 +1,675 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+#include "compiler_check.hpp"
+
+// The vector kernels are only built for native x86 and x64 code. Managed
+// (/clr) builds and other architectures use the scalar kernels. GCC and
+// Clang only allow an instruction set in functions marked for it, MSVC
+// allows all of them everywhere.
+#if !defined(_M_CEE) && (defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__))
+#define KRABS_VECTOR_STRING_KERNELS
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define KRABS_TARGET_SSE2
+#define KRABS_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define KRABS_TARGET_SSE2 __attribute__((target("sse2")))
+#define KRABS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#include <immintrin.h>
+#endif
+
+namespace krabs { namespace details { namespace string_kernels {
+
+    static const size_t npos = static_cast<size_t>(-1);
+
+    /**
+     * <summary>
+     * The widest instruction set the string kernels may use on this machine.
+     * </summary>
+     */
+    enum class simd_level {
+        scalar,
+        sse2,
+        avx2
+    };
+
+    /**
+     * <summary>
+     * Returns the instruction set used by the string kernels. The processor
+     * is queried once per process.
+     * </summary>
+     */
+    simd_level current_level();
+
+    /**
+     * <summary>
+     * Makes the string kernels use at most the given instruction set, so
+     * that every level the processor supports can be tested on it. Not
+     * safe to call while other threads use the kernels.
+     * </summary>
+     */
+    void limit_level(simd_level level);
+
+    /**
+     * <summary>
+     * Returns the index of the first null character in the string or length
+     * when there is none.
+     * </summary>
+     */
+    template <typename T>
+    size_t find_null(const T *string, size_t length);
+
+    /**
+     * <summary>
+     * Returns whether the first length characters of both strings are equal.
+     * </summary>
+     */
+    template <typename T>
+    bool equal(const T *first, const T *second, size_t length);
+
+    /**
+     * <summary>
+     * Returns whether the first length characters of both strings are equal
+     * under the given case insensitive character comparison.
+     * </summary>
+     * <remarks>
+     * ASCII letters are folded sixteen or thirty-two characters at a time.
+     * Whenever a block differs after folding, that block is compared again
+     * with the given comparison. The result is the same as comparing every
+     * character with it, as long as it agrees with ASCII case folding on
+     * ASCII letters, which towupper and toupper do outside of Turkic
+     * locales.
+     * </remarks>
+     */
+    template <typename T, typename Equal>
+    bool iequal(const T *first, const T *second, size_t length, Equal equal);
+
+    /**
+     * <summary>
+     * Returns the index of the first occurrence of the needle in the
+     * haystack or npos. An empty needle is found at index zero.
+     * </summary>
+     */
+    template <typename T>
+    size_t find(const T *haystack, size_t length, const T *needle, size_t count);
+
+    /**
+     * <summary>
+     * Returns the index of the first occurrence of the needle in the
+     * haystack under the given case insensitive character comparison, or
+     * npos. An empty needle is found at index zero.
+     * </summary>
+     */
+    template <typename T, typename Equal>
+    size_t ifind(const T *haystack, size_t length, const T *needle, size_t count, Equal equal);
+
+    // Scalar kernels
+    // ------------------------------------------------------------------------
+
+    namespace scalar {
+
+        template <typename T>
+        size_t find_null(const T *string, size_t length)
+        {
+            for (size_t i = 0; i < length; ++i) {
+                if (string[i] == T(0)) {
+                    return i;
+                }
+            }
+
+            return length;
+        }
+
+        template <typename T, typename Equal>
+        bool equal(const T *first, const T *second, size_t length, Equal equal)
+        {
+            for (size_t i = 0; i < length; ++i) {
+                if (!equal(first[i], second[i])) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        template <typename T, typename Equal>
+        size_t find(const T *haystack, size_t length, const T *needle, size_t count, Equal equal)
+        {
+            auto it = std::search(haystack, haystack + length, needle, needle + count, equal);
+            if (it == haystack + length) {
+                return count == 0 ? 0 : npos;
+            }
+
+            return static_cast<size_t>(it - haystack);
+        }
+
+    } /* namespace scalar */
+
+    inline bool is_ascii(char c)
+    {
+        return (static_cast<unsigned char>(c) & 0x80) == 0;
+    }
+
+    inline bool is_ascii(wchar_t c)
+    {
+        // wchar_t is 32 bits outside of Windows, all of it is compared.
+        return static_cast<uint32_t>(c) < 0x80;
+    }
+
+    template <typename T>
+    T ascii_fold(T c)
+    {
+        return (c >= T('a') && c <= T('z')) ? static_cast<T>(c - T('a') + T('A')) : c;
+    }
+
+#ifdef KRABS_VECTOR_STRING_KERNELS
+
+    // Vector kernels
+    // ------------------------------------------------------------------------
+
+    inline unsigned long lowest_bit(uint32_t mask)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return index;
+#else
+        return static_cast<unsigned long>(__builtin_ctz(mask));
+#endif
+    }
+
+    /**
+     * <summary>
+     * The operations the vector kernels need from an instruction set, for
+     * one character width. Masks have one bit per byte of the vector, as
+     * produced by movemask, so a wide character owns two adjacent bits, or
+     * four where wchar_t is 32 bits.
+     * </summary>
+     */
+    template <typename T, size_t Size = sizeof(T)>
+    struct sse2_lanes;
+
+    template <>
+    struct sse2_lanes<char> {
+        typedef char char_type;
+        typedef __m128i vector;
+        static const size_t width = 16;
+        static const uint32_t all = 0xFFFF;
+
+        KRABS_TARGET_SSE2
+        static vector load(const char *p)
+        {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        }
+
+        KRABS_TARGET_SSE2
+        static vector splat(char c)
+        {
+            return _mm_set1_epi8(c);
+        }
+
+        KRABS_TARGET_SSE2
+        static uint32_t equal_mask(vector a, vector b)
+        {
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)));
+        }
+
+        KRABS_TARGET_SSE2
+        static uint32_t non_ascii_mask(vector v)
+        {
+            return static_cast<uint32_t>(_mm_movemask_epi8(v));
+        }
+
+        // Signed compares leave bytes above 0x7F alone, they are negative.
+        KRABS_TARGET_SSE2
+        static vector fold(vector v)
+        {
+            auto lower = _mm_and_si128(
+                _mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)),
+                _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1)));
+
+            return _mm_sub_epi8(v, _mm_and_si128(lower, _mm_set1_epi8(0x20)));
+        }
+    };
+
+    template <>
+    struct sse2_lanes<wchar_t, 2> {
+        typedef wchar_t char_type;
+        typedef __m128i vector;
+        static const size_t width = 8;
+        static const uint32_t all = 0xFFFF;
+
+        KRABS_TARGET_SSE2
+        static vector load(const wchar_t *p)
+        {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        }
+
+        KRABS_TARGET_SSE2
+        static vector splat(wchar_t c)
+        {
+            return _mm_set1_epi16(static_cast<short>(c));
+        }
+
+        KRABS_TARGET_SSE2
+        static uint32_t equal_mask(vector a, vector b)
+        {
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi16(a, b)));
+        }
+
+        KRABS_TARGET_SSE2
+        static uint32_t non_ascii_mask(vector v)
+        {
+            auto high = _mm_and_si128(v, _mm_set1_epi16(static_cast<short>(0xFF80)));
+            return all & ~static_cast<uint32_t>(
+                _mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())));
+        }
+
+        // Signed compares leave characters above 0x7FFF alone, they are negative.
+        KRABS_TARGET_SSE2
+        static vector fold(vector v)
+        {
+            auto lower = _mm_and_si128(
+                _mm_cmpgt_epi16(v, _mm_set1_epi16('a' - 1)),
+                _mm_cmplt_epi16(v, _mm_set1_epi16('z' + 1)));
+
+            return _mm_sub_epi16(v, _mm_and_si128(lower, _mm_set1_epi16(0x20)));
+        }
+    };
+
+    template <>
+    struct sse2_lanes<wchar_t, 4> {
+        typedef wchar_t char_type;
+        typedef __m128i vector;
+        static const size_t width = 4;
+        static const uint32_t all = 0xFFFF;
+
+        KRABS_TARGET_SSE2
+        static vector load(const wchar_t *p)
+        {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        }
+
+        KRABS_TARGET_SSE2
+        static vector splat(wchar_t c)
+        {
+            return _mm_set1_epi32(static_cast<int>(c));
+        }
+
+        KRABS_TARGET_SSE2
+        static uint32_t equal_mask(vector a, vector b)
+        {
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi32(a, b)));
+        }
+
+        KRABS_TARGET_SSE2
+        static uint32_t non_ascii_mask(vector v)
+        {
+            auto high = _mm_and_si128(v, _mm_set1_epi32(static_cast<int>(0xFFFFFF80)));
+            return all & ~static_cast<uint32_t>(
+                _mm_movemask_epi8(_mm_cmpeq_epi32(high, _mm_setzero_si128())));
+        }
+
+        // Signed compares leave characters above 0x7FFFFFFF alone, they are negative.
+        KRABS_TARGET_SSE2
+        static vector fold(vector v)
+        {
+            auto lower = _mm_and_si128(
+                _mm_cmpgt_epi32(v, _mm_set1_epi32('a' - 1)),
+                _mm_cmplt_epi32(v, _mm_set1_epi32('z' + 1)));
+
+            return _mm_sub_epi32(v, _mm_and_si128(lower, _mm_set1_epi32(0x20)));
+        }
+    };
+
+    template <typename T, size_t Size = sizeof(T)>
+    struct avx2_lanes;
+
+    template <>
+    struct avx2_lanes<char> {
+        typedef char char_type;
+        typedef __m256i vector;
+        static const size_t width = 32;
+        static const uint32_t all = 0xFFFFFFFF;
+
+        KRABS_TARGET_AVX2
+        static vector load(const char *p)
+        {
+            return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        }
+
+        KRABS_TARGET_AVX2
+        static vector splat(char c)
+        {
+            return _mm256_set1_epi8(c);
+        }
+
+        KRABS_TARGET_AVX2
+        static uint32_t equal_mask(vector a, vector b)
+        {
+            return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)));
+        }
+
+        KRABS_TARGET_AVX2
+        static uint32_t non_ascii_mask(vector v)
+        {
+            return static_cast<uint32_t>(_mm256_movemask_epi8(v));
+        }
+
+        KRABS_TARGET_AVX2
+        static vector fold(vector v)
+        {
+            auto lower = _mm256_and_si256(
+                _mm256_cmpgt_epi8(v, _mm256_set1_epi8('a' - 1)),
+                _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), v));
+
+            return _mm256_sub_epi8(v, _mm256_and_si256(lower, _mm256_set1_epi8(0x20)));
+        }
+    };
+
+    template <>
+    struct avx2_lanes<wchar_t, 2> {
+        typedef wchar_t char_type;
+        typedef __m256i vector;
+        static const size_t width = 16;
+        static const uint32_t all = 0xFFFFFFFF;
+
+        KRABS_TARGET_AVX2
+        static vector load(const wchar_t *p)
+        {
+            return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        }
+
+        KRABS_TARGET_AVX2
+        static vector splat(wchar_t c)
+        {
+            return _mm256_set1_epi16(static_cast<short>(c));
+        }
+
+        KRABS_TARGET_AVX2
+        static uint32_t equal_mask(vector a, vector b)
+        {
+            return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(a, b)));
+        }
+
+        KRABS_TARGET_AVX2
+        static uint32_t non_ascii_mask(vector v)
+        {
+            auto high = _mm256_and_si256(v, _mm256_set1_epi16(static_cast<short>(0xFF80)));
+            return ~static_cast<uint32_t>(
+                _mm256_movemask_epi8(_mm256_cmpeq_epi16(high, _mm256_setzero_si256())));
+        }
+
+        KRABS_TARGET_AVX2
+        static vector fold(vector v)
+        {
+            auto lower = _mm256_and_si256(
+                _mm256_cmpgt_epi16(v, _mm256_set1_epi16('a' - 1)),
+                _mm256_cmpgt_epi16(_mm256_set1_epi16('z' + 1), v));
+
+            return _mm256_sub_epi16(v, _mm256_and_si256(lower, _mm256_set1_epi16(0x20)));
+        }
+    };
+
+    template <>
+    struct avx2_lanes<wchar_t, 4> {
+        typedef wchar_t char_type;
+        typedef __m256i vector;
+        static const size_t width = 8;
+        static const uint32_t all = 0xFFFFFFFF;
+
+        KRABS_TARGET_AVX2
+        static vector load(const wchar_t *p)
+        {
+            return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        }
+
+        KRABS_TARGET_AVX2
+        static vector splat(wchar_t c)
+        {
+            return _mm256_set1_epi32(static_cast<int>(c));
+        }
+
+        KRABS_TARGET_AVX2
+        static uint32_t equal_mask(vector a, vector b)
+        {
+            return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi32(a, b)));
+        }
+
+        KRABS_TARGET_AVX2
+        static uint32_t non_ascii_mask(vector v)
+        {
+            auto high = _mm256_and_si256(v, _mm256_set1_epi32(static_cast<int>(0xFFFFFF80)));
+            return ~static_cast<uint32_t>(
+                _mm256_movemask_epi8(_mm256_cmpeq_epi32(high, _mm256_setzero_si256())));
+        }
+
+        KRABS_TARGET_AVX2
+        static vector fold(vector v)
+        {
+            auto lower = _mm256_and_si256(
+                _mm256_cmpgt_epi32(v, _mm256_set1_epi32('a' - 1)),
+                _mm256_cmpgt_epi32(_mm256_set1_epi32('z' + 1), v));
+
+            return _mm256_sub_epi32(v, _mm256_and_si256(lower, _mm256_set1_epi32(0x20)));
+        }
+    };
+
+} /* namespace string_kernels */ } /* namespace details */ } /* namespace krabs */
+
+#define KRABS_VECTOR_KERNELS sse2_kernels
+#define KRABS_VECTOR_TARGET KRABS_TARGET_SSE2
+#include "string_kernels_vector.hpp"
+#undef KRABS_VECTOR_KERNELS
+#undef KRABS_VECTOR_TARGET
+
+#define KRABS_VECTOR_KERNELS avx2_kernels
+#define KRABS_VECTOR_TARGET KRABS_TARGET_AVX2
+#include "string_kernels_vector.hpp"
+#undef KRABS_VECTOR_KERNELS
+#undef KRABS_VECTOR_TARGET
+
+namespace krabs { namespace details { namespace string_kernels {
+
+    inline void cpuid(int leaf, int info[4])
+    {
+#if defined(_MSC_VER)
+        __cpuidex(info, leaf, 0);
+#else
+        unsigned int registers[4];
+        __cpuid_count(leaf, 0, registers[0], registers[1], registers[2], registers[3]);
+        for (int i = 0; i < 4; ++i) {
+            info[i] = static_cast<int>(registers[i]);
+        }
+#endif
+    }
+
+    inline uint64_t xgetbv()
+    {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#else
+        uint32_t low, high;
+        __asm__ __volatile__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+        return (static_cast<uint64_t>(high) << 32) | low;
+#endif
+    }
+
+    inline simd_level detect_level()
+    {
+        int info[4];
+
+        cpuid(0, info);
+        const int maxLeaf = info[0];
+
+        // Every x64 processor has SSE2, only 32 bit ones may lack it.
+        cpuid(1, info);
+        if ((info[3] & (1 << 26)) == 0) {
+            return simd_level::scalar;
+        }
+
+        if (maxLeaf < 7) {
+            return simd_level::sse2;
+        }
+
+        // AVX2 needs the OS to save the upper halves of the ymm registers.
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (xgetbv() & 0x6) != 0x6) {
+            return simd_level::sse2;
+        }
+
+        cpuid(7, info);
+        return (info[1] & (1 << 5)) != 0 ? simd_level::avx2 : simd_level::sse2;
+    }
+
+    inline simd_level supported_level()
+    {
+        static const simd_level level = detect_level();
+        return level;
+    }
+
+    inline simd_level &active_level()
+    {
+        static simd_level level = supported_level();
+        return level;
+    }
+
+#endif
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline simd_level current_level()
+    {
+#ifdef KRABS_VECTOR_STRING_KERNELS
+        return active_level();
+#else
+        return simd_level::scalar;
+#endif
+    }
+
+    inline void limit_level(simd_level level)
+    {
+#ifdef KRABS_VECTOR_STRING_KERNELS
+        active_level() = (std::min)(level, supported_level());
+#else
+        (void)level;
+#endif
+    }
+
+    template <typename T>
+    size_t find_null(const T *string, size_t length)
+    {
+#ifdef KRABS_VECTOR_STRING_KERNELS
+        switch (current_level()) {
+        case simd_level::avx2:
+            return avx2_kernels<avx2_lanes<T>>::find_null(string, length);
+        case simd_level::sse2:
+            return sse2_kernels<sse2_lanes<T>>::find_null(string, length);
+        default:
+            break;
+        }
+#endif
+        return scalar::find_null(string, length);
+    }
+
+    template <typename T>
+    bool equal(const T *first, const T *second, size_t length)
+    {
+        // memcmp is already vectorized by the C runtime.
+        return length == 0 || memcmp(first, second, length * sizeof(T)) == 0;
+    }
+
+    template <typename T, typename Equal>
+    bool iequal(const T *first, const T *second, size_t length, Equal equal)
+    {
+#ifdef KRABS_VECTOR_STRING_KERNELS
+        switch (current_level()) {
+        case simd_level::avx2:
+            return avx2_kernels<avx2_lanes<T>>::iequal(first, second, length, equal);
+        case simd_level::sse2:
+            return sse2_kernels<sse2_lanes<T>>::iequal(first, second, length, equal);
+        default:
+            break;
+        }
+#endif
+        return scalar::equal(first, second, length, equal);
+    }
+
+    template <typename T>
+    size_t find(const T *haystack, size_t length, const T *needle, size_t count)
+    {
+        if (count == 0) {
+            return 0;
+        }
+
+        if (count > length) {
+            return npos;
+        }
+
+#ifdef KRABS_VECTOR_STRING_KERNELS
+        auto verify = [](const T *candidate, const T *expected, size_t size) {
+            return equal(candidate, expected, size);
+        };
+
+        switch (current_level()) {
+        case simd_level::avx2:
+            return avx2_kernels<avx2_lanes<T>>::template find<false>(
+                haystack, length, needle, count, verify);
+        case simd_level::sse2:
+            return sse2_kernels<sse2_lanes<T>>::template find<false>(
+                haystack, length, needle, count, verify);
+        default:
+            break;
+        }
+#endif
+        return scalar::find(haystack, length, needle, count, std::equal_to<T>());
+    }
+
+    template <typename T, typename Equal>
+    size_t ifind(const T *haystack, size_t length, const T *needle, size_t count, Equal equal)
+    {
+        if (count == 0) {
+            return 0;
+        }
+
+        if (count > length) {
+            return npos;
+        }
+
+#ifdef KRABS_VECTOR_STRING_KERNELS
+        // A non-ASCII character at either end of the needle may match
+        // characters that ASCII folding does not know about, so those
+        // needles are searched one position at a time.
+        if (is_ascii(needle[0]) && is_ascii(needle[count - 1])) {
+            auto verify = [&equal](const T *candidate, const T *expected, size_t size) {
+                return scalar::equal(candidate, expected, size, equal);
+            };
+
+            switch (current_level()) {
+            case simd_level::avx2:
+                return avx2_kernels<avx2_lanes<T>>::template find<true>(
+                    haystack, length, needle, count, verify);
+            case simd_level::sse2:
+                return sse2_kernels<sse2_lanes<T>>::template find<true>(
+                    haystack, length, needle, count, verify);
+            default:
+                break;
+            }
+        }
+#endif
+        return scalar::find(haystack, length, needle, count, equal);
+    }
+
+} /* namespace string_kernels */ } /* namespace details */ } /* namespace krabs */
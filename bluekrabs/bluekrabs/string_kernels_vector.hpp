@@ -0,0 +1,108 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// The vector kernels, written once and included by string_kernels.hpp once
+// per instruction set. KRABS_VECTOR_KERNELS names the template and
+// KRABS_VECTOR_TARGET is the attribute that lets GCC and Clang use the
+// instruction set in it, so there is no include guard.
+
+namespace krabs { namespace details { namespace string_kernels {
+
+    template <typename Lanes>
+    struct KRABS_VECTOR_KERNELS {
+        typedef typename Lanes::char_type char_type;
+
+        // The bits of a mask that belong to the lowest character.
+        static const uint32_t char_bits = (1u << sizeof(char_type)) - 1;
+
+        KRABS_VECTOR_TARGET
+        static size_t find_null(const char_type *string, size_t length)
+        {
+            const auto zero = Lanes::splat(char_type(0));
+
+            size_t i = 0;
+            for (; i + Lanes::width <= length; i += Lanes::width) {
+                auto mask = Lanes::equal_mask(Lanes::load(string + i), zero);
+                if (mask != 0) {
+                    return i + lowest_bit(mask) / sizeof(char_type);
+                }
+            }
+
+            return i + scalar::find_null(string + i, length - i);
+        }
+
+        template <typename Equal>
+        KRABS_VECTOR_TARGET
+        static bool iequal(const char_type *first, const char_type *second, size_t length, Equal equal)
+        {
+            size_t i = 0;
+            for (; i + Lanes::width <= length; i += Lanes::width) {
+                auto mask = Lanes::equal_mask(
+                    Lanes::fold(Lanes::load(first + i)),
+                    Lanes::fold(Lanes::load(second + i)));
+
+                if (mask != Lanes::all && !scalar::equal(first + i, second + i, Lanes::width, equal)) {
+                    return false;
+                }
+            }
+
+            return scalar::equal(first + i, second + i, length - i, equal);
+        }
+
+        // The positions of a block that may hold the expected character.
+        // Exact matches compare the characters as they are, case insensitive
+        // matches compare them ASCII folded and treat every non-ASCII
+        // character as a possible match, leaving the decision to verify.
+        template <bool Folded>
+        KRABS_VECTOR_TARGET
+        static uint32_t candidates(typename Lanes::vector block, typename Lanes::vector expected)
+        {
+            if (Folded) {
+                return Lanes::equal_mask(Lanes::fold(block), expected) | Lanes::non_ascii_mask(block);
+            }
+
+            return Lanes::equal_mask(block, expected);
+        }
+
+        // Compares the first and last characters of the needle against a
+        // block of starting positions at once and only verifies the
+        // positions where both match. Requires 0 < count <= length.
+        template <bool Folded, typename Verify>
+        KRABS_VECTOR_TARGET
+        static size_t find(
+            const char_type *haystack,
+            size_t length,
+            const char_type *needle,
+            size_t count,
+            Verify verify)
+        {
+            const auto first = Lanes::splat(Folded ? ascii_fold(needle[0]) : needle[0]);
+            const auto last = Lanes::splat(Folded ? ascii_fold(needle[count - 1]) : needle[count - 1]);
+
+            size_t i = 0;
+            for (; i + count - 1 + Lanes::width <= length; i += Lanes::width) {
+                auto mask =
+                    candidates<Folded>(Lanes::load(haystack + i), first) &
+                    candidates<Folded>(Lanes::load(haystack + i + count - 1), last);
+
+                while (mask != 0) {
+                    auto lane = lowest_bit(mask) / sizeof(char_type);
+                    if (verify(haystack + i + lane, needle, count)) {
+                        return i + lane;
+                    }
+
+                    mask &= ~(char_bits << (lane * sizeof(char_type)));
+                }
+            }
+
+            for (; i + count <= length; ++i) {
+                if (verify(haystack + i, needle, count)) {
+                    return i;
+                }
+            }
+
+            return npos;
+        }
+    };
+
+} /* namespace string_kernels */ } /* namespace details */ } /* namespace krabs */
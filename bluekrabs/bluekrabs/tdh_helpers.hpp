@@ -6,10 +6,15 @@
 #define INITGUID
 
 #include <tdh.h>
+#include <cwchar>
 #include <string>
 #include <stdexcept>
 
 #include "compiler_check.hpp"
+
+#ifdef KRABS_HAS_STRING_VIEW
+#include <string_view>
+#endif
 #include "parse_types.hpp"
 
 namespace krabs {
@@ -127,7 +132,7 @@ namespace krabs {
         // type that does not have any assignment validation. This compiles
         // to a no-op in release.
         template <typename T>
-        inline void assert_valid_assignment(const std::wstring&, const property_info&)
+        inline void assert_valid_assignment(const wchar_t*, const property_info&)
         {
 #ifndef NDEBUG
 
@@ -146,7 +151,7 @@ namespace krabs {
         // will fall back to the unspecialized version which is a no-op in release.
 
         inline void throw_if_invalid(
-            const std::wstring& name,
+            const wchar_t* name,
             const property_info& info,
             _TDH_IN_TYPE requested)
         {
@@ -156,7 +161,7 @@ namespace krabs {
 
 #pragma warning(push)
 #pragma warning(disable: 4244) // narrowing property name wchar_t to char for this error message
-            std::string ansiName(name.begin(), name.end());
+            std::string ansiName(name, name + wcslen(name));
 #pragma warning(pop)
 
             throw type_mismatch_assert(
@@ -173,7 +178,7 @@ namespace krabs {
 #define BUILD_ASSERT(type, tdh_type) \
         template <> \
         inline void assert_valid_assignment<type>(               \
-            const std::wstring& name, const property_info& info) \
+            const wchar_t* name, const property_info& info) \
         {                                                        \
             throw_if_invalid(name, info, tdh_type);              \
         }
@@ -189,6 +194,10 @@ namespace krabs {
         BUILD_ASSERT(std::wstring, TDH_INTYPE_UNICODESTRING);
         BUILD_ASSERT(std::string, TDH_INTYPE_ANSISTRING);
         BUILD_ASSERT(const counted_string*, TDH_INTYPE_COUNTEDSTRING);
+#ifdef KRABS_HAS_STRING_VIEW
+        BUILD_ASSERT(std::wstring_view, TDH_INTYPE_UNICODESTRING);
+        BUILD_ASSERT(std::string_view, TDH_INTYPE_ANSISTRING);
+#endif
 
         // integers
         BUILD_ASSERT(int8_t, TDH_INTYPE_INT8);
@@ -212,7 +221,7 @@ namespace krabs {
 
         template <>
         inline void assert_valid_assignment<ip_address>(
-            const std::wstring&, const property_info& info)
+            const wchar_t*, const property_info& info)
         {
             auto outType = info.pEventPropertyInfo_->nonStructType.OutType;
 
@@ -225,7 +234,7 @@ namespace krabs {
 
         template <>
         inline void assert_valid_assignment<socket_address>(
-            const std::wstring&, const property_info& info)
+            const wchar_t*, const property_info& info)
         {
             auto outType = info.pEventPropertyInfo_->nonStructType.OutType;
 
@@ -237,7 +246,7 @@ namespace krabs {
 
         template <>
         inline void assert_valid_assignment<sid>(
-            const std::wstring&, const property_info& info)
+            const wchar_t*, const property_info& info)
         {
             auto inType = info.pEventPropertyInfo_->nonStructType.InType;
 
@@ -247,9 +256,16 @@ namespace krabs {
             }
         }
 
+        template <>
+        inline void assert_valid_assignment<sid_view>(
+            const wchar_t* name, const property_info& info)
+        {
+            assert_valid_assignment<sid>(name, info);
+        }
+
         template <>
         inline void assert_valid_assignment<pointer>(
-            const std::wstring&, const property_info& info)
+            const wchar_t*, const property_info& info)
         {
             auto inType = info.pEventPropertyInfo_->nonStructType.InType;
 
@@ -261,7 +277,7 @@ namespace krabs {
 
         template <>
         inline void assert_valid_assignment<bool>(
-            const std::wstring&, const property_info& info)
+            const wchar_t*, const property_info& info)
         {
             auto inType = info.pEventPropertyInfo_->nonStructType.InType;
 
@@ -54,6 +54,13 @@ namespace krabs { namespace testing {
          */
         void push_event(const synth_record &record);
 
+        /**
+         * <summary>
+         * Returns the trace context that events are pushed with.
+         * </summary>
+         */
+        const krabs::trace_context &trace_context() const;
+
     private:
         krabs::event_filter &event_filter_;
         krabs::trace_context trace_context_;
@@ -72,4 +79,9 @@ namespace krabs { namespace testing {
         event_filter_.on_event(record, trace_context_);
     }
 
+    inline const krabs::trace_context &event_filter_proxy::trace_context() const
+    {
+        return trace_context_;
+    }
+
 } /* namespace testing */ } /* namespace krabs */
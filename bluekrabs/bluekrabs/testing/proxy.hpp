@@ -44,9 +44,21 @@ namespace krabs { namespace testing {
          *     krabs::testing::trace_proxy proxy(trace);
          *     proxy.start(); // do not call trace.start()
          * </example>
+         * <remarks>
+         *   Starts the worker pool of the trace, if it has one.
+         * </remarks>
          */
         void start();
 
+        /**
+         * <summary>
+         * Mocks the underlying trace running out of events. Waits for the
+         * worker pool of the trace, if it has one, to deliver every event
+         * that was pushed.
+         * </summary>
+         */
+        void stop();
+
         /**
          * <summary>
          * Pushes an event through to the proxied trace instance.
@@ -75,6 +87,14 @@ namespace krabs { namespace testing {
          */
         void push_event(const synth_record &record);
 
+        /**
+         * <summary>
+         * Mocks ETW finishing a buffer, which delivers the events that
+         * providers have batched up to their batch callbacks.
+         * </summary>
+         */
+        void end_buffer();
+
     private:
         T &trace_;
     };
@@ -101,6 +121,13 @@ namespace krabs { namespace testing {
     template <typename T>
     void trace_proxy<T>::start()
     {
+        trace_.start_workers();
+    }
+
+    template <typename T>
+    void trace_proxy<T>::stop()
+    {
+        trace_.stop_workers();
     }
 
     template <typename T>
@@ -109,4 +136,10 @@ namespace krabs { namespace testing {
         trace_.on_event(record);
     }
 
+    template <typename T>
+    void trace_proxy<T>::end_buffer()
+    {
+        trace_.on_buffer_processed();
+    }
+
 } /* namespace testing */ } /* namespace krabs */
@@ -5,12 +5,16 @@
 
 #include <deque>
 #include <map>
+#include <memory>
 #include <mutex>
 
 #include "compiler_check.hpp"
+#include "event_pipeline.hpp"
 #include "guid.hpp"
 #include "provider.hpp"
+#include "schema_cache_file.hpp"
 #include "trace_context.hpp"
+#include "provider_dispatch.hpp"
 #include "etw.hpp"
 
 
@@ -52,8 +56,14 @@ namespace krabs {
 		const std::wstring log_file_name;
 		const std::wstring logger_name;
 		const uint32_t flush_threshold;
-
-		trace_stats(uint64_t eventsHandled, const details::trace_info& props)
+		const uint64_t events_queued;
+		const uint64_t events_dropped;
+		const uint64_t events_blocked;
+
+		trace_stats(
+			uint64_t eventsHandled,
+			const details::trace_info& props,
+			const details::pipeline_stats& pipeline = details::pipeline_stats())
 			: buffers_count(props.properties.NumberOfBuffers)
 			, buffers_free(props.properties.FreeBuffers)
 			, buffers_written(props.properties.BuffersWritten)
@@ -71,6 +81,9 @@ namespace krabs {
 			, flush_threshold(props.properties.FlushThreshold)
 			, logger_name(props.traceName)
 			, log_file_name(props.logfileName)
+			, events_queued(pipeline.events_queued)
+			, events_dropped(pipeline.events_dropped)
+			, events_blocked(pipeline.events_blocked)
 		{ }
 	};
 
@@ -357,6 +370,33 @@ namespace krabs {
 		 */
 		size_t buffers_processed() const;
 
+		/**
+		 * <summary>
+		 * Loads schemas saved by an earlier run, so their events are decoded
+		 * without asking TDH. Returns how many schemas were loaded.
+		 * </summary>
+		 * <example>
+		 *    krabs::user_trace trace;
+		 *    trace.load_schema_cache(L"C:\\ProgramData\\agent\\schemas.bin");
+		 *    trace.start();
+		 *    // ...
+		 *    trace.stop();
+		 *    trace.save_schema_cache(L"C:\\ProgramData\\agent\\schemas.bin");
+		 * </example>
+		 * <remarks>
+		 * See krabs::load_schema_cache for when a file is not used.
+		 * </remarks>
+		 */
+		size_t load_schema_cache(const std::wstring &path);
+
+		/**
+		 * <summary>
+		 * Saves the schemas the trace has looked up so far for the next run
+		 * to load. Returns how many schemas were saved.
+		 * </summary>
+		 */
+		size_t save_schema_cache(const std::wstring &path) const;
+
 		/**
 		 * <summary>
 		 * Adds a function to call when an event is fired which has no corresponding provider.
@@ -378,6 +418,34 @@ namespace krabs {
 		 */
 		void set_default_event_callback(c_provider_callback callback);
 
+#if !defined(_M_CEE)
+		/**
+		 * <summary>
+		 * Runs the provider callbacks on a pool of worker threads instead of
+		 * the thread that processes the trace. Events are copied into a queue
+		 * per worker and the trace thread goes back to ETW right away, so slow
+		 * callbacks no longer cause buffers to be lost.
+		 * </summary>
+		 * <example>
+		 *    krabs::worker_pool_options options;
+		 *    options.worker_count = 4;
+		 *    options.sharding = krabs::worker_sharding::by_process;
+		 *    options.backpressure = krabs::backpressure_policy::drop_oldest;
+		 *
+		 *    krabs::user_trace trace;
+		 *    trace.set_worker_pool(options);
+		 *    trace.start();
+		 * </example>
+		 * <remarks>
+		 * Must be called before the trace is started. The queued, dropped and
+		 * blocked counts show up in query_stats(). Batch callbacks need the
+		 * events of a provider on one worker, so they can not be combined
+		 * with worker_sharding::by_process.
+		 * </remarks>
+		 */
+		void set_worker_pool(const worker_pool_options &options);
+#endif
+
 	private:
 
 		/**
@@ -387,6 +455,37 @@ namespace krabs {
 		 */
 		void on_event(const EVENT_RECORD &);
 
+		/**
+		 * <summary>
+		 *   Invoked when ETW is done with a buffer, delivers the events the
+		 *   providers have batched up.
+		 * </summary>
+		 */
+		void on_buffer_processed();
+
+		/**
+		 * <summary>
+		 *   Hands an event to its provider or to the default callback.
+		 * </summary>
+		 */
+		void deliver(const typename T::provider_type *provider, const EVENT_RECORD &record) const;
+
+		/**
+		 * <summary>
+		 *   Starts the worker pool, if there is one, before events flow and
+		 *   drains it once they stop.
+		 * </summary>
+		 */
+		void start_workers();
+		void stop_workers();
+
+		/**
+		 * <summary>
+		 *   Returns the counters of the worker pool.
+		 * </summary>
+		 */
+		details::pipeline_stats pipeline_stats() const;
+
 		/////**
 		//// * <summary>
 		//// * Updates a trace session.
@@ -408,6 +507,10 @@ namespace krabs {
 		// TODO: Only forward the calls that are requested to each provider.
 		typename T::provider_enable_info provider_enable_info_;
 		std::mutex providers_mutex_;
+		// Read by T::forward_events for every event, rebuilt whenever
+		// enabled_providers_ changes.
+		details::provider_dispatcher<typename T::provider_type> dispatcher_;
+		details::legacy_provider_map legacy_providers_;
 		LPFILETIME start_time_;
 		LPFILETIME end_time_;
 
@@ -424,6 +527,10 @@ namespace krabs {
 
 		provider_callback default_callback_ = nullptr;
 
+#if !defined(_M_CEE)
+		std::unique_ptr<details::event_pipeline<typename T::provider_type>> pipeline_;
+#endif
+
 	private:
 		template <typename T>
 		friend class details::trace_manager;
@@ -510,9 +617,101 @@ namespace krabs {
 	{
 		++eventsHandled_;
 		//std::lock_guard<std::mutex> lock(providers_mutex_);
+#if !defined(_M_CEE)
+		if (pipeline_ && pipeline_->running()) {
+			pipeline_->push(record, T::find_provider(record, *this));
+			return;
+		}
+#endif
 		T::forward_events(record, *this);
 	}
 
+	template <typename T>
+	void trace<T>::on_buffer_processed()
+	{
+#if !defined(_M_CEE)
+		if (pipeline_ && pipeline_->running()) {
+			pipeline_->end_buffer();
+			dispatcher_.quiesce();
+			return;
+		}
+#endif
+		dispatcher_.for_each([&](const typename T::provider_type &provider) {
+			provider.flush_batch(context_);
+		});
+		dispatcher_.quiesce();
+	}
+
+	template <typename T>
+	void trace<T>::deliver(const typename T::provider_type *provider, const EVENT_RECORD &record) const
+	{
+		if (provider != nullptr) {
+			provider->on_event(record, context_);
+			return;
+		}
+
+		if (default_callback_ != nullptr)
+			default_callback_(record, context_);
+	}
+
+#if !defined(_M_CEE)
+	template <typename T>
+	void trace<T>::set_worker_pool(const worker_pool_options &options)
+	{
+		pipeline_.reset(new details::event_pipeline<typename T::provider_type>(
+			options,
+			[this](const typename T::provider_type *provider, const EVENT_RECORD &record) {
+				deliver(provider, record);
+			},
+			[this](const typename T::provider_type &provider) {
+				provider.flush_batch(context_);
+			}));
+	}
+#endif
+
+	template <typename T>
+	void trace<T>::start_workers()
+	{
+#if !defined(_M_CEE)
+		if (!pipeline_) {
+			return;
+		}
+
+		if (pipeline_->options().sharding == worker_sharding::by_process &&
+			pipeline_->options().worker_count > 1) {
+			std::lock_guard<std::mutex> lock(providers_mutex_);
+			for (auto &provider : enabled_providers_) {
+				if (!provider.get().batch_callbacks_.empty()) {
+					throw krabs::unsupported_worker_pool();
+				}
+			}
+		}
+
+		pipeline_->start();
+#endif
+	}
+
+	template <typename T>
+	void trace<T>::stop_workers()
+	{
+#if !defined(_M_CEE)
+		if (pipeline_) {
+			pipeline_->stop();
+		}
+#endif
+	}
+
+	template <typename T>
+	details::pipeline_stats trace<T>::pipeline_stats() const
+	{
+#if !defined(_M_CEE)
+		if (pipeline_) {
+			return pipeline_->stats();
+		}
+#endif
+		return details::pipeline_stats();
+	}
+
 	template <typename T>
 	void trace<T>::enable(const typename T::provider_type& p)
 	{                    
@@ -529,13 +728,16 @@ namespace krabs {
 		};
 
 		if (registrationHandle_ == INVALID_PROCESSTRACE_HANDLE && sessionHandle_ == INVALID_PROCESSTRACE_HANDLE) {
+			std::lock_guard<std::mutex> lock(providers_mutex_);
 			insert_unique(p);
+			dispatcher_.rebuild(enabled_providers_);
 		}
 		else {        
 			std::lock_guard<std::mutex> lock(providers_mutex_);
 			details::trace_manager<trace> manager(*this);
 			manager.enable(p);
 			insert_unique(p);
+			dispatcher_.rebuild(enabled_providers_);
 		}                                                                         
 	}
 
@@ -552,6 +754,7 @@ namespace krabs {
 				details::trace_manager<trace> manager(*this);
 				manager.disable(p);
 				enabled_providers_.erase(it);
+				dispatcher_.rebuild(enabled_providers_);
 			}
 		}
 	}
@@ -640,7 +843,7 @@ namespace krabs {
 	trace_stats trace<T>::query_stats()
 	{
 		details::trace_manager<trace> manager(*this);
-		return { eventsHandled_, manager.query() };
+		return { eventsHandled_, manager.query(), pipeline_stats() };
 	}
 
 	template <typename T>
@@ -649,6 +852,18 @@ namespace krabs {
 		return buffersRead_;
 	}
 
+	template <typename T>
+	size_t trace<T>::load_schema_cache(const std::wstring &path)
+	{
+		return krabs::load_schema_cache(context_.schema_locator, path);
+	}
+
+	template <typename T>
+	size_t trace<T>::save_schema_cache(const std::wstring &path) const
+	{
+		return krabs::save_schema_cache(context_.schema_locator, path);
+	}
+
 	template <typename T>
 	void trace<T>::set_default_event_callback(c_provider_callback callback)
 	{
@@ -15,8 +15,19 @@ namespace krabs {
      */
     struct trace_context
     {
-        const schema_locator schema_locator;
+        const krabs::schema_locator schema_locator;
         /* Add additional trace context here. */
+
+        /**
+         * <summary>
+         * Returns how many schema lookups were served from the cache,
+         * how many missed it and how many of those went to TDH.
+         * </summary>
+         */
+        schema_cache_stats schema_stats() const
+        {
+            return schema_locator.stats();
+        }
     };
 
 }
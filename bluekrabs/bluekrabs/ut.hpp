@@ -10,6 +10,7 @@
 #include "compiler_check.hpp"
 #include "trace.hpp"
 #include "provider.hpp"
+#include "schema_locator.hpp"
 
 #include "property.hpp"
 
@@ -105,6 +106,16 @@ namespace krabs { namespace details {
             const EVENT_RECORD &record,
             krabs::trace<krabs::details::ut> &trace);
 
+        /**
+         * <summary>
+         *   Returns the provider in the trace that an event belongs to, or
+         *   nullptr when there is none.
+         * </summary>
+         */
+        static const provider_type *find_provider(
+            const EVENT_RECORD &record,
+            krabs::trace<krabs::details::ut> &trace);
+
         /**
          * <summary>
          *   Sets the ETW trace log file mode.
@@ -254,31 +265,38 @@ namespace krabs { namespace details {
     inline void ut::forward_events(
         const EVENT_RECORD &record,
         krabs::trace<krabs::details::ut> &trace)
+    {
+        trace.deliver(find_provider(record, trace), record);
+    }
+
+    inline const ut::provider_type *ut::find_provider(
+        const EVENT_RECORD &record,
+        krabs::trace<krabs::details::ut> &trace)
     {
         // for manifest providers, EventHeader.ProviderId is the Provider GUID
-        for (auto& provider : trace.enabled_providers_) {
-            if (record.EventHeader.ProviderId == provider.get().guid_) {
-                provider.get().on_event(record, trace.context_);
-                return;
-            }
+        auto provider = trace.dispatcher_.find(record.EventHeader.ProviderId);
+        if (provider != nullptr) {
+            return provider;
         }
 
         // for MOF providers, EventHeader.Provider is the *Message* GUID
         // we need to ask TDH for event information in order to determine the
-        // correct provider to pass this event to
-        if ((record.EventHeader.EventProperty & EVENT_HEADER_PROPERTY_LEGACY_EVENTLOG) == 1) {
-            auto schema = get_event_schema_from_tdh(record);
-            auto eventInfo = reinterpret_cast<PTRACE_EVENT_INFO>(schema.get());
-            for (auto& provider : trace.enabled_providers_) {
-                if (eventInfo->ProviderGuid == provider.get().guid_) {
-                    provider.get().on_event(record, trace.context_);
-                    return;
+        // correct provider to pass this event to. The answer only depends on
+        // the message GUID, so TDH is asked once per event class.
+        if ((record.EventHeader.Flags & EVENT_HEADER_FLAG_CLASSIC_HEADER) != 0) {
+            auto &providerGuid = trace.legacy_providers_.lookup(record, [&](const EVENT_RECORD &r) {
+                try {
+                    return krabs::guid(trace.context_.schema_locator.get_event_schema(r)->ProviderGuid);
                 }
-            }
+                catch (const krabs::could_not_find_schema &) {
+                    return krabs::guid(GUID());
+                }
+            });
+
+            return trace.dispatcher_.find(providerGuid);
         }
-        
-        if (trace.default_callback_ != nullptr)
-            trace.default_callback_(record, trace.context_);
+
+        return nullptr;
     }
 
     inline unsigned long ut::augment_file_mode()
@@ -27,26 +27,43 @@
 #pragma warning(disable: 4635) // DocXml comment warnings in native C++
 
 #include "bluekrabs/compiler_check.hpp"
-#include "bluekrabs/ut.hpp"
-#include "bluekrabs/kt.hpp"
+#include "bluekrabs/owned_record.hpp"
 #include "bluekrabs/guid.hpp"
-#include "bluekrabs/trace.hpp"
 #include "bluekrabs/trace_context.hpp"
-#include "bluekrabs/client.hpp"
 #include "bluekrabs/errors.hpp"
+#include "bluekrabs/event_batch.hpp"
+#include "bluekrabs/event_context.hpp"
+#include "bluekrabs/event_pipeline.hpp"
 #include "bluekrabs/schema.hpp"
+#include "bluekrabs/schema_layout.hpp"
+#include "bluekrabs/memory_resource.hpp"
 #include "bluekrabs/schema_locator.hpp"
 #include "bluekrabs/parse_types.hpp"
+#include "bluekrabs/formatting.hpp"
 #include "bluekrabs/collection_view.hpp"
 #include "bluekrabs/size_provider.hpp"
+#include "bluekrabs/string_kernels.hpp"
 #include "bluekrabs/parser.hpp"
 #include "bluekrabs/property.hpp"
+#include "bluekrabs/property_key.hpp"
+#include "bluekrabs/provider_dispatch.hpp"
+#include "bluekrabs/tdh_helpers.hpp"
+
+// Traces, providers and the schema cache file need ETW itself. Elsewhere only
+// the headers that read events and schemas are available, built against the
+// stand-ins for the Windows SDK in portability/.
+#if defined(_WIN32)
+#include "bluekrabs/ut.hpp"
+#include "bluekrabs/kt.hpp"
+#include "bluekrabs/trace.hpp"
+#include "bluekrabs/client.hpp"
+#include "bluekrabs/schema_cache_file.hpp"
 #include "bluekrabs/provider.hpp"
 #include "bluekrabs/etw.hpp"
-#include "bluekrabs/tdh_helpers.hpp"
 #include "bluekrabs/kernel_providers.hpp"
-
 #include "bluekrabs/testing/proxy.hpp"
+#endif
+
 #include "bluekrabs/testing/filler.hpp"
 #include "bluekrabs/testing/synth_record.hpp"
 #include "bluekrabs/testing/record_builder.hpp"
@@ -55,7 +72,13 @@
 
 #include "bluekrabs/filtering/view_adapters.hpp"
 #include "bluekrabs/filtering/comparers.hpp"
+#include "bluekrabs/filtering/pattern_set.hpp"
 #include "bluekrabs/filtering/predicates.hpp"
 #include "bluekrabs/filtering/event_filter.hpp"
+#include "bluekrabs/filtering/static_event_filter.hpp"
+
+// The WEVT_TEMPLATE decoder in bluekrabs/searching/wevt.hpp is left out
+// until it has been checked against resources from mc.exe built images.
+// Include it on its own to use krabs::wevt_manifest.
 
 #pragma warning(pop)
\ No newline at end of file
@@ -0,0 +1,346 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Summary
+// ----------------------------------------------------------------------------
+// The schema types from tdh.h, laid out as in the Windows SDK, and a stand-in
+// for the TDH functions krabs calls. See krabs_win_types.h.
+//
+// There is no event manifest store to ask outside of Windows, so the
+// stand-in gets schemas from a source the application plugs in:
+//
+//   #include <bluekrabs/searching/wevt.hpp>
+//
+//   auto manifest = krabs::wevt_manifest(resource.data(), resource.size());
+//   krabs::portability::set_schema_source(manifest);
+//
+// Any object with krabs::schema_source's get_event_schema member will do.
+
+#pragma once
+
+#include "krabs_etw_types.h"
+
+typedef enum _TDH_IN_TYPE {
+    TDH_INTYPE_NULL,
+    TDH_INTYPE_UNICODESTRING,
+    TDH_INTYPE_ANSISTRING,
+    TDH_INTYPE_INT8,
+    TDH_INTYPE_UINT8,
+    TDH_INTYPE_INT16,
+    TDH_INTYPE_UINT16,
+    TDH_INTYPE_INT32,
+    TDH_INTYPE_UINT32,
+    TDH_INTYPE_INT64,
+    TDH_INTYPE_UINT64,
+    TDH_INTYPE_FLOAT,
+    TDH_INTYPE_DOUBLE,
+    TDH_INTYPE_BOOLEAN,
+    TDH_INTYPE_BINARY,
+    TDH_INTYPE_GUID,
+    TDH_INTYPE_POINTER,
+    TDH_INTYPE_FILETIME,
+    TDH_INTYPE_SYSTEMTIME,
+    TDH_INTYPE_SID,
+    TDH_INTYPE_HEXINT32,
+    TDH_INTYPE_HEXINT64,
+    TDH_INTYPE_MANIFEST_COUNTEDSTRING,
+    TDH_INTYPE_MANIFEST_COUNTEDANSISTRING,
+    TDH_INTYPE_RESERVED24,
+    TDH_INTYPE_MANIFEST_COUNTEDBINARY,
+
+    TDH_INTYPE_COUNTEDSTRING = 300,
+    TDH_INTYPE_COUNTEDANSISTRING,
+    TDH_INTYPE_REVERSEDCOUNTEDSTRING,
+    TDH_INTYPE_REVERSEDCOUNTEDANSISTRING,
+    TDH_INTYPE_NONNULLTERMINATEDSTRING,
+    TDH_INTYPE_NONNULLTERMINATEDANSISTRING,
+    TDH_INTYPE_UNICODECHAR,
+    TDH_INTYPE_ANSICHAR,
+    TDH_INTYPE_SIZET,
+    TDH_INTYPE_HEXDUMP,
+    TDH_INTYPE_WBEMSID
+} TDH_IN_TYPE;
+
+typedef enum _TDH_OUT_TYPE {
+    TDH_OUTTYPE_NULL,
+    TDH_OUTTYPE_STRING,
+    TDH_OUTTYPE_DATETIME,
+    TDH_OUTTYPE_BYTE,
+    TDH_OUTTYPE_UNSIGNEDBYTE,
+    TDH_OUTTYPE_SHORT,
+    TDH_OUTTYPE_UNSIGNEDSHORT,
+    TDH_OUTTYPE_INT,
+    TDH_OUTTYPE_UNSIGNEDINT,
+    TDH_OUTTYPE_LONG,
+    TDH_OUTTYPE_UNSIGNEDLONG,
+    TDH_OUTTYPE_FLOAT,
+    TDH_OUTTYPE_DOUBLE,
+    TDH_OUTTYPE_BOOLEAN,
+    TDH_OUTTYPE_GUID,
+    TDH_OUTTYPE_HEXBINARY,
+    TDH_OUTTYPE_HEXINT8,
+    TDH_OUTTYPE_HEXINT16,
+    TDH_OUTTYPE_HEXINT32,
+    TDH_OUTTYPE_HEXINT64,
+    TDH_OUTTYPE_PID,
+    TDH_OUTTYPE_TID,
+    TDH_OUTTYPE_PORT,
+    TDH_OUTTYPE_IPV4,
+    TDH_OUTTYPE_IPV6,
+    TDH_OUTTYPE_SOCKETADDRESS,
+    TDH_OUTTYPE_CIMDATETIME,
+    TDH_OUTTYPE_ETWTIME,
+    TDH_OUTTYPE_XML,
+    TDH_OUTTYPE_ERRORCODE,
+    TDH_OUTTYPE_WIN32ERROR,
+    TDH_OUTTYPE_NTSTATUS,
+    TDH_OUTTYPE_HRESULT,
+    TDH_OUTTYPE_CULTURE_INSENSITIVE_DATETIME,
+    TDH_OUTTYPE_JSON,
+    TDH_OUTTYPE_UTF8,
+    TDH_OUTTYPE_PKCS7_WITH_TYPE_INFO,
+    TDH_OUTTYPE_CODE_POINTER,
+    TDH_OUTTYPE_DATETIME_UTC,
+
+    TDH_OUTTYPE_REDUCEDSTRING = 300,
+    TDH_OUTTYPE_NOPRINT
+} TDH_OUT_TYPE;
+
+typedef enum _PROPERTY_FLAGS {
+    PropertyStruct = 0x1,
+    PropertyParamLength = 0x2,
+    PropertyParamCount = 0x4,
+    PropertyWBEMXmlFragment = 0x8,
+    PropertyParamFixedLength = 0x10,
+    PropertyParamFixedCount = 0x20,
+    PropertyHasTags = 0x40,
+    PropertyHasCustomSchema = 0x80
+} PROPERTY_FLAGS;
+
+typedef struct _EVENT_PROPERTY_INFO {
+    PROPERTY_FLAGS Flags;
+    ULONG NameOffset;
+    union {
+        struct {
+            USHORT InType;
+            USHORT OutType;
+            ULONG MapNameOffset;
+        } nonStructType;
+        struct {
+            USHORT StructStartIndex;
+            USHORT NumOfStructMembers;
+            ULONG padding;
+        } structType;
+        struct {
+            USHORT InType;
+            USHORT OutType;
+            ULONG CustomSchemaOffset;
+        } customSchemaType;
+    };
+    union {
+        USHORT count;
+        USHORT countPropertyIndex;
+    };
+    union {
+        USHORT length;
+        USHORT lengthPropertyIndex;
+    };
+    union {
+        ULONG Reserved;
+        struct {
+            ULONG Tags : 28;
+        };
+    };
+} EVENT_PROPERTY_INFO, *PEVENT_PROPERTY_INFO;
+
+typedef enum _DECODING_SOURCE {
+    DecodingSourceXMLFile,
+    DecodingSourceWbem,
+    DecodingSourceWPP,
+    DecodingSourceTlg,
+    DecodingSourceMax
+} DECODING_SOURCE;
+
+typedef enum _TEMPLATE_FLAGS {
+    TEMPLATE_EVENT_DATA = 1,
+    TEMPLATE_USER_DATA = 2,
+    TEMPLATE_CONTROL_GUID = 4
+} TEMPLATE_FLAGS;
+
+typedef struct _TRACE_EVENT_INFO {
+    GUID ProviderGuid;
+    GUID EventGuid;
+    EVENT_DESCRIPTOR EventDescriptor;
+    DECODING_SOURCE DecodingSource;
+    ULONG ProviderNameOffset;
+    ULONG LevelNameOffset;
+    ULONG ChannelNameOffset;
+    ULONG KeywordsNameOffset;
+    ULONG TaskNameOffset;
+    ULONG OpcodeNameOffset;
+    ULONG EventMessageOffset;
+    ULONG ProviderMessageOffset;
+    ULONG BinaryXMLOffset;
+    ULONG BinaryXMLSize;
+    union {
+        ULONG EventNameOffset;
+        ULONG ActivityIDNameOffset;
+    };
+    union {
+        ULONG EventAttributesOffset;
+        ULONG RelatedActivityIDNameOffset;
+    };
+    ULONG PropertyCount;
+    ULONG TopLevelPropertyCount;
+    union {
+        TEMPLATE_FLAGS Flags;
+        struct {
+            ULONG Reserved : 4;
+            ULONG Tags : 28;
+        };
+    };
+    EVENT_PROPERTY_INFO EventPropertyInfoArray[ANYSIZE_ARRAY];
+} TRACE_EVENT_INFO, *PTRACE_EVENT_INFO;
+
+typedef struct _PROPERTY_DATA_DESCRIPTOR {
+    ULONGLONG PropertyName;
+    ULONG ArrayIndex;
+    ULONG Reserved;
+} PROPERTY_DATA_DESCRIPTOR, *PPROPERTY_DATA_DESCRIPTOR;
+
+typedef struct _TDH_CONTEXT {
+    ULONGLONG ParameterValue;
+    ULONG ParameterType;
+    ULONG ParameterSize;
+} TDH_CONTEXT, *PTDH_CONTEXT;
+
+namespace krabs { namespace portability {
+
+    /**
+     * <summary>
+     *   Copies the schema of the record to the buffer when it is at least
+     *   size bytes long and returns the size of the schema, or zero when the
+     *   event is unknown.
+     * </summary>
+     */
+    typedef size_t (*schema_callback)(const void *context, const EVENT_RECORD &record, void *buffer, size_t size);
+
+    /**
+     * <summary>
+     *   Makes the TDH stand-in read schemas from the source, which must
+     *   outlive its use. Not synchronized with lookups, set it before events
+     *   are parsed.
+     * </summary>
+     */
+    template <typename Source>
+    void set_schema_source(const Source &source);
+
+    /**
+     * <summary>
+     *   Makes the TDH stand-in call the function for schemas.
+     * </summary>
+     */
+    void set_schema_callback(schema_callback callback, const void *context);
+
+    /**
+     * <summary>
+     *   Removes the schema source, after which no event has a schema.
+     * </summary>
+     */
+    void clear_schema_source();
+
+    namespace details {
+
+        struct schema_hook {
+            schema_callback callback;
+            const void *context;
+        };
+
+        inline schema_hook &current_schema_hook()
+        {
+            static schema_hook hook = { nullptr, nullptr };
+            return hook;
+        }
+
+    } /* namespace details */
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    template <typename Source>
+    void set_schema_source(const Source &source)
+    {
+        set_schema_callback([](const void *context, const EVENT_RECORD &record, void *buffer, size_t size) {
+            return static_cast<const Source *>(context)->get_event_schema(record, buffer, size);
+        }, &source);
+    }
+
+    inline void set_schema_callback(schema_callback callback, const void *context)
+    {
+        details::current_schema_hook() = details::schema_hook{ callback, context };
+    }
+
+    inline void clear_schema_source()
+    {
+        set_schema_callback(nullptr, nullptr);
+    }
+
+} /* namespace portability */ } /* namespace krabs */
+
+/**
+ * Returns the schema of the record from the source set with
+ * krabs::portability::set_schema_source, ERROR_NOT_FOUND when it has none.
+ */
+inline ULONG TdhGetEventInformation(
+    PEVENT_RECORD Event,
+    ULONG TdhContextCount,
+    PTDH_CONTEXT TdhContext,
+    PTRACE_EVENT_INFO Buffer,
+    PULONG BufferSize)
+{
+    UNREFERENCED_PARAMETER(TdhContextCount);
+    UNREFERENCED_PARAMETER(TdhContext);
+
+    auto &hook = krabs::portability::details::current_schema_hook();
+    if (Event == nullptr || BufferSize == nullptr) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    if (hook.callback == nullptr) {
+        return ERROR_NOT_FOUND;
+    }
+
+    auto available = Buffer == nullptr ? 0 : *BufferSize;
+    auto size = hook.callback(hook.context, *Event, Buffer, available);
+    if (size == 0) {
+        return ERROR_NOT_FOUND;
+    }
+
+    *BufferSize = static_cast<ULONG>(size);
+    return size > available ? ERROR_INSUFFICIENT_BUFFER : ERROR_SUCCESS;
+}
+
+/**
+ * Sizes of properties that depend on the values of other properties are not
+ * worked out, the call always fails and the size is left at zero.
+ */
+inline ULONG TdhGetPropertySize(
+    PEVENT_RECORD pEvent,
+    ULONG TdhContextCount,
+    PTDH_CONTEXT pTdhContext,
+    ULONG PropertyDataCount,
+    PPROPERTY_DATA_DESCRIPTOR pPropertyData,
+    ULONG *pPropertySize)
+{
+    UNREFERENCED_PARAMETER(pEvent);
+    UNREFERENCED_PARAMETER(TdhContextCount);
+    UNREFERENCED_PARAMETER(pTdhContext);
+    UNREFERENCED_PARAMETER(PropertyDataCount);
+    UNREFERENCED_PARAMETER(pPropertyData);
+
+    if (pPropertySize != nullptr) {
+        *pPropertySize = 0;
+    }
+
+    return ERROR_NOT_SUPPORTED;
+}
@@ -0,0 +1,344 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Summary
+// ----------------------------------------------------------------------------
+// The Windows SDK types and helpers that the parsing core of krabs uses, for
+// building it on platforms other than Windows. The headers in this directory
+// are named after the SDK headers they stand in for, so the krabs headers
+// include them unchanged; put this directory on the include path only when
+// not building for Windows.
+//
+// Only what reading EVENT_RECORDs and schemas needs is provided. Starting
+// and consuming traces is not.
+//
+// wchar_t is 32 bits wide outside of Windows. Wide strings in schemas and
+// in event data are read as wchar_t, so records and schemas used with these
+// headers must hold strings of the platform's wchar_t, as the ones built by
+// krabs::testing::record_builder and krabs::wevt_manifest do.
+
+#pragma once
+
+#if defined(_WIN32)
+#error "The krabs portability headers stand in for the Windows SDK and must not be used on Windows."
+#endif
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <random>
+#include <string>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Annotations and calling conventions
+// ----------------------------------------------------------------------------
+
+#define WINAPI
+#define NTAPI
+#define CONST const
+
+#define _In_
+#define _In_opt_
+#define _Out_
+#define _Out_opt_
+#define _Inout_
+#define _Inout_opt_
+
+// MSVC's name of the current function, only used in static_assert messages
+// where a string literal is required.
+#ifndef __FUNCSIG__
+#define __FUNCSIG__ "see the instantiation context"
+#endif
+
+#define UNREFERENCED_PARAMETER(p) (void)(p)
+#define FIELD_OFFSET(type, field) ((LONG)offsetof(type, field))
+#define ANYSIZE_ARRAY 1
+
+template <typename T, size_t N>
+char (&krabs_countof_helper(T (&)[N]))[N];
+#define _countof(array) (sizeof(krabs_countof_helper(array)))
+
+#define TRUE 1
+#define FALSE 0
+
+// Integer and string types
+// ----------------------------------------------------------------------------
+
+typedef void VOID, *PVOID, *LPVOID, *HANDLE, *HLOCAL;
+typedef uint8_t UCHAR, BYTE, BOOLEAN, *PUCHAR, *PBYTE, *LPBYTE;
+typedef char CHAR, *PCHAR, *LPSTR, *PSTR;
+typedef const char *LPCSTR, *PCSTR;
+typedef int16_t SHORT;
+typedef uint16_t USHORT, WORD, *PUSHORT;
+typedef int32_t LONG, INT, BOOL, HRESULT;
+typedef uint32_t ULONG, DWORD, UINT, *PULONG, *LPDWORD;
+typedef int64_t LONGLONG, LONG64, INT64;
+typedef uint64_t ULONGLONG, ULONG64, DWORD64, UINT64, *PULONG64;
+typedef intptr_t LONG_PTR;
+typedef uintptr_t ULONG_PTR, UINT_PTR, SIZE_T;
+typedef wchar_t WCHAR, *PWCHAR, *LPWSTR, *PWSTR;
+typedef const wchar_t *LPCWSTR, *PCWSTR;
+
+#define S_OK ((HRESULT)0)
+#define E_INVALIDARG ((HRESULT)0x80070057)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000E)
+#define CO_E_CLASSSTRING ((HRESULT)0x800401F3)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+
+#define ERROR_SUCCESS 0
+#define ERROR_FILE_NOT_FOUND 2
+#define ERROR_ACCESS_DENIED 5
+#define ERROR_INVALID_HANDLE 6
+#define ERROR_NOT_ENOUGH_MEMORY 8
+#define ERROR_OUTOFMEMORY 14
+#define ERROR_NOT_SUPPORTED 50
+#define ERROR_INVALID_PARAMETER 87
+#define ERROR_INSUFFICIENT_BUFFER 122
+#define ERROR_ALREADY_EXISTS 183
+#define ERROR_MORE_DATA 234
+#define ERROR_NOT_FOUND 1168
+#define ERROR_NO_SYSTEM_RESOURCES 1450
+#define ERROR_WMI_GUID_NOT_FOUND 4200
+#define ERROR_WMI_INSTANCE_NOT_FOUND 4201
+
+typedef union _LARGE_INTEGER {
+    struct {
+        ULONG LowPart;
+        LONG HighPart;
+    };
+    LONGLONG QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER;
+
+typedef struct _FILETIME {
+    DWORD dwLowDateTime;
+    DWORD dwHighDateTime;
+} FILETIME, *PFILETIME, *LPFILETIME;
+
+typedef struct _SYSTEMTIME {
+    WORD wYear;
+    WORD wMonth;
+    WORD wDayOfWeek;
+    WORD wDay;
+    WORD wHour;
+    WORD wMinute;
+    WORD wSecond;
+    WORD wMilliseconds;
+} SYSTEMTIME, *PSYSTEMTIME;
+
+inline void ZeroMemory(void *destination, size_t length)
+{
+    memset(destination, 0, length);
+}
+
+inline int memcpy_s(void *destination, size_t size, const void *source, size_t count)
+{
+    if (count > size) {
+        memset(destination, 0, size);
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    memcpy(destination, source, count);
+    return 0;
+}
+
+inline DWORD GetCurrentThreadId()
+{
+    static thread_local DWORD id = static_cast<DWORD>(syscall(SYS_gettid));
+    return id;
+}
+
+inline DWORD GetCurrentProcessId()
+{
+    return static_cast<DWORD>(getpid());
+}
+
+inline HLOCAL LocalFree(HLOCAL memory)
+{
+    free(memory);
+    return nullptr;
+}
+
+inline void CoTaskMemFree(LPVOID memory)
+{
+    free(memory);
+}
+
+// GUIDs
+// ----------------------------------------------------------------------------
+
+typedef struct _GUID {
+    uint32_t Data1;
+    uint16_t Data2;
+    uint16_t Data3;
+    uint8_t Data4[8];
+} GUID, CLSID, IID, *LPGUID;
+
+typedef const GUID *LPCGUID;
+typedef const GUID &REFGUID;
+typedef const GUID &REFCLSID;
+
+#define DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) \
+    static const GUID name = { l, w1, w2, { b1, b2, b3, b4, b5, b6, b7, b8 } }
+
+static const GUID GUID_NULL = { 0, 0, 0, { 0, 0, 0, 0, 0, 0, 0, 0 } };
+
+inline bool operator==(const GUID &lhs, const GUID &rhs)
+{
+    return memcmp(&lhs, &rhs, sizeof(GUID)) == 0;
+}
+
+inline bool operator!=(const GUID &lhs, const GUID &rhs)
+{
+    return !(lhs == rhs);
+}
+
+inline int IsEqualGUID(const GUID &lhs, const GUID &rhs)
+{
+    return lhs == rhs;
+}
+
+/** Parses a GUID in the registry format, {xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx}. */
+inline HRESULT CLSIDFromString(LPCWSTR string, LPGUID guid)
+{
+    if (string == nullptr || guid == nullptr || wcslen(string) != 38 ||
+        string[0] != L'{' || string[37] != L'}') {
+        return CO_E_CLASSSTRING;
+    }
+
+    // Positions of the 32 hex digits in the string.
+    static const int digits[32] = {
+        1, 2, 3, 4, 5, 6, 7, 8, 10, 11, 12, 13, 15, 16, 17, 18,
+        20, 21, 22, 23, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36 };
+
+    if (string[9] != L'-' || string[14] != L'-' || string[19] != L'-' || string[24] != L'-') {
+        return CO_E_CLASSSTRING;
+    }
+
+    uint8_t nibbles[32];
+    for (int i = 0; i < 32; ++i) {
+        auto c = string[digits[i]];
+        if (c >= L'0' && c <= L'9') nibbles[i] = static_cast<uint8_t>(c - L'0');
+        else if (c >= L'a' && c <= L'f') nibbles[i] = static_cast<uint8_t>(c - L'a' + 10);
+        else if (c >= L'A' && c <= L'F') nibbles[i] = static_cast<uint8_t>(c - L'A' + 10);
+        else return CO_E_CLASSSTRING;
+    }
+
+    auto value = [&](int first, int count) {
+        uint64_t result = 0;
+        for (int i = first; i < first + count; ++i) {
+            result = (result << 4) | nibbles[i];
+        }
+        return result;
+    };
+
+    guid->Data1 = static_cast<uint32_t>(value(0, 8));
+    guid->Data2 = static_cast<uint16_t>(value(8, 4));
+    guid->Data3 = static_cast<uint16_t>(value(12, 4));
+    for (int i = 0; i < 8; ++i) {
+        guid->Data4[i] = static_cast<uint8_t>(value(16 + i * 2, 2));
+    }
+
+    return S_OK;
+}
+
+/** Formats a GUID in the registry format, returns the characters written including the null. */
+inline int StringFromGUID2(REFGUID guid, LPWSTR buffer, int length)
+{
+    if (buffer == nullptr || length < 39) {
+        return 0;
+    }
+
+    swprintf(buffer, static_cast<size_t>(length),
+        L"{%08X-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X}",
+        guid.Data1, guid.Data2, guid.Data3,
+        guid.Data4[0], guid.Data4[1], guid.Data4[2], guid.Data4[3],
+        guid.Data4[4], guid.Data4[5], guid.Data4[6], guid.Data4[7]);
+
+    return 39;
+}
+
+/** Formats a GUID into a string that is released with CoTaskMemFree. */
+inline HRESULT StringFromCLSID(REFCLSID guid, LPWSTR *string)
+{
+    auto buffer = static_cast<LPWSTR>(malloc(39 * sizeof(WCHAR)));
+    if (buffer == nullptr) {
+        return E_OUTOFMEMORY;
+    }
+
+    StringFromGUID2(guid, buffer, 39);
+    *string = buffer;
+    return S_OK;
+}
+
+/** Makes a random (version 4) GUID. */
+inline HRESULT CoCreateGuid(LPGUID guid)
+{
+    static thread_local std::mt19937_64 generator{ std::random_device{}() };
+
+    uint64_t halves[2] = { generator(), generator() };
+    memcpy(guid, halves, sizeof(GUID));
+    guid->Data3 = static_cast<uint16_t>((guid->Data3 & 0x0FFF) | 0x4000);
+    guid->Data4[0] = static_cast<uint8_t>((guid->Data4[0] & 0x3F) | 0x80);
+    return S_OK;
+}
+
+// SIDs
+// ----------------------------------------------------------------------------
+
+typedef struct _SID_IDENTIFIER_AUTHORITY {
+    BYTE Value[6];
+} SID_IDENTIFIER_AUTHORITY;
+
+typedef struct _SID {
+    BYTE Revision;
+    BYTE SubAuthorityCount;
+    SID_IDENTIFIER_AUTHORITY IdentifierAuthority;
+    DWORD SubAuthority[ANYSIZE_ARRAY];
+} SID;
+
+typedef PVOID PSID;
+
+#define SID_REVISION 1
+#define SID_MAX_SUB_AUTHORITIES 15
+
+inline BOOL IsValidSid(PSID sid)
+{
+    auto value = static_cast<const SID *>(sid);
+    return value != nullptr &&
+           value->Revision == SID_REVISION &&
+           value->SubAuthorityCount <= SID_MAX_SUB_AUTHORITIES;
+}
+
+inline DWORD GetLengthSid(PSID sid)
+{
+    auto value = static_cast<const SID *>(sid);
+    return static_cast<DWORD>(offsetof(SID, SubAuthority) + value->SubAuthorityCount * sizeof(DWORD));
+}
+
+// Networking
+// ----------------------------------------------------------------------------
+
+#ifndef INET_ADDRSTRLEN
+#define INET_ADDRSTRLEN 22
+#endif
+
+#ifndef INET6_ADDRSTRLEN
+#define INET6_ADDRSTRLEN 65
+#endif
+
+typedef struct in_addr IN_ADDR;
+typedef struct in6_addr IN6_ADDR;
+typedef struct sockaddr SOCKADDR;
+typedef struct sockaddr_in SOCKADDR_IN;
+typedef struct sockaddr_in6 SOCKADDR_IN6;
+typedef struct sockaddr_storage SOCKADDR_STORAGE;
@@ -0,0 +1,8 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Stands in for the Windows SDK header of the same name, see krabs_win_types.h.
+
+#pragma once
+
+#include "krabs_tdh.h"
@@ -2,6 +2,7 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 using System;
+using System.Runtime.InteropServices;
 using System.Text;
 using Microsoft.VisualStudio.TestTools.UnitTesting;
 
@@ -78,6 +79,109 @@ namespace EtwTestsCS
                     data, String.Empty, String.Empty));
             }
 
+            [TestMethod]
+            public void it_should_copy_unicode_strings_into_a_buffer()
+            {
+                var data = "This is some user data";
+                var prop = PowerShellEvent.UserData;
+
+                var provider = new Provider(PowerShellEvent.ProviderId);
+                provider.OnEvent += e =>
+                {
+                    var buffer = new char[64];
+                    int length;
+                    Assert.IsTrue(e.TryGetUnicodeString(prop, buffer, 4, out length));
+                    Assert.AreEqual(data, new string(buffer, 4, length));
+
+                    var small = new char[4];
+                    Assert.IsFalse(e.TryGetUnicodeString(prop, small, 0, out length));
+                    Assert.AreEqual(data.Length, length);
+
+                    Assert.IsFalse(e.TryGetUnicodeString("Not a property", buffer, 0, out length));
+                };
+
+                trace.Enable(provider);
+                proxy.PushEvent(PowerShellEvent.CreateRecord(
+                    data, String.Empty, String.Empty));
+            }
+
+            [TestMethod]
+            public void it_should_expose_raw_unicode_strings()
+            {
+                var data = "This is some user data";
+                var prop = PowerShellEvent.UserData;
+
+                var provider = new Provider(PowerShellEvent.ProviderId);
+                provider.OnEvent += e =>
+                {
+                    int length;
+                    var raw = e.GetUnicodeStringRaw(prop, out length);
+                    Assert.AreEqual(data, Marshal.PtrToStringUni(raw, length));
+
+                    IntPtr ptr;
+                    Assert.IsTrue(e.TryGetUnicodeStringRaw(prop, out ptr, out length));
+                    Assert.AreEqual(raw, ptr);
+                    Assert.IsFalse(e.TryGetUnicodeStringRaw("Not a property", out ptr, out length));
+                };
+
+                trace.Enable(provider);
+                proxy.PushEvent(PowerShellEvent.CreateRecord(
+                    data, String.Empty, String.Empty));
+            }
+
+            [TestMethod]
+            public void it_should_reuse_records_when_asked_to()
+            {
+                var provider = new Provider(PowerShellEvent.ProviderId);
+                provider.ReuseEventRecords = true;
+
+                var records = new System.Collections.Generic.List<IEventRecord>();
+                var values = new System.Collections.Generic.List<string>();
+                provider.OnEvent += e =>
+                {
+                    records.Add(e);
+                    values.Add(e.GetUnicodeString(PowerShellEvent.UserData));
+                };
+
+                trace.Enable(provider);
+                proxy.PushEvent(PowerShellEvent.CreateRecord(
+                    "first", String.Empty, String.Empty));
+                proxy.PushEvent(PowerShellEvent.CreateRecord(
+                    "second", String.Empty, String.Empty));
+
+                Assert.AreEqual(2, records.Count);
+                Assert.AreSame(records[0], records[1]);
+                CollectionAssert.AreEqual(new[] { "first", "second" }, values);
+            }
+
+            [TestMethod]
+            public void it_should_intern_repeated_strings()
+            {
+                var prop = PowerShellEvent.UserData;
+
+                var provider = new Provider(PowerShellEvent.ProviderId);
+                var values = new System.Collections.Generic.List<string>();
+                var names = new System.Collections.Generic.List<string>();
+                provider.OnEvent += e =>
+                {
+                    values.Add(e.GetInternedUnicodeString(prop));
+                    names.Add(e.ProviderName);
+                };
+
+                trace.Enable(provider);
+                var hits = StringCache.Hits;
+                proxy.PushEvent(PowerShellEvent.CreateRecord(
+                    "powershell.exe", String.Empty, String.Empty));
+                proxy.PushEvent(PowerShellEvent.CreateRecord(
+                    "powershell.exe", String.Empty, String.Empty));
+
+                Assert.AreEqual(2, values.Count);
+                Assert.AreEqual("powershell.exe", values[0]);
+                Assert.AreSame(values[0], values[1]);
+                Assert.AreSame(names[0], names[1]);
+                Assert.IsTrue(StringCache.Hits >= hits + 2);
+            }
+
             [TestMethod]
             public void it_should_parse_ansi_strings()
             {
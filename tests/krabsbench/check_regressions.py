@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+# Copyright (c) Microsoft. All rights reserved.
+# Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+"""Compares two krabsbench JSON results and fails when a benchmark slowed down.
+
+The median CPU time of every benchmark in both files is compared. One that
+is more than the threshold slower than in the baseline, and by more than
+twice the spread of the repetitions, is a regression. Benchmarks that are
+only in one of the files are listed but never fail the check.
+
+usage: check_regressions.py BASELINE CONTENDER [--threshold PERCENT]
+"""
+
+import argparse
+import json
+import sys
+
+
+def median_times(path):
+    with open(path) as f:
+        report = json.load(f)
+
+    # With repetitions the median and standard deviation aggregates are
+    # used, without them the single run is, with no spread.
+    times = {}
+    spreads = {}
+    for benchmark in report["benchmarks"]:
+        name = benchmark.get("run_name", benchmark["name"])
+        if benchmark.get("run_type") == "aggregate":
+            if benchmark.get("aggregate_name") == "median":
+                times[name] = benchmark["cpu_time"]
+            elif benchmark.get("aggregate_name") == "stddev":
+                spreads[name] = benchmark["cpu_time"]
+        else:
+            times.setdefault(name, benchmark["cpu_time"])
+
+    return {name: (time, spreads.get(name, 0.0)) for name, time in times.items()}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("contender")
+    parser.add_argument("--threshold", type=float, default=20.0,
+                        help="percentage slowdown that counts as a regression")
+    args = parser.parse_args()
+
+    baseline = median_times(args.baseline)
+    contender = median_times(args.contender)
+
+    regressions = []
+    for name in sorted(baseline.keys() & contender.keys()):
+        (before, before_spread), (after, after_spread) = baseline[name], contender[name]
+        change = (after - before) / before * 100.0 if before > 0 else 0.0
+        marker = ""
+        if change > args.threshold and after - before > 2 * (before_spread + after_spread):
+            regressions.append(name)
+            marker = "  REGRESSION"
+        print(f"{name:<60} {before:>12.1f} {after:>12.1f} {change:>+8.1f}%{marker}")
+
+    for name in sorted(baseline.keys() - contender.keys()):
+        print(f"{name:<60} removed")
+    for name in sorted(contender.keys() - baseline.keys()):
+        print(f"{name:<60} new")
+
+    if regressions:
+        print(f"\n{len(regressions)} benchmark(s) more than {args.threshold:g}% slower than the baseline")
+        return 1
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,950 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Summary
+// ----------------------------------------------------------------------------
+// Benchmarks of the per event work krabs does: finding the schema, parsing
+// properties, formatting SIDs and addresses, enumerating properties,
+// keeping copies of events, comparing strings, evaluating predicates and
+// handing events to filters and providers. Every benchmark taking a
+// workload argument runs once per event kind in workloads.hpp.
+//
+// Results are written as JSON with the usual Google Benchmark flags, e.g.
+//
+//   krabsbench --benchmark_out=krabsbench.json --benchmark_out_format=json
+//
+// and two such files are compared with compare.py from Google Benchmark.
+
+#include "workloads.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <cwctype>
+#include <deque>
+#include <new>
+
+// Every allocation of the process is counted, so benchmarks can report how
+// many the code they time makes per event.
+namespace {
+    std::atomic<size_t> allocations(0);
+}
+
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace krabsbench {
+
+    namespace {
+
+        workload workload_of(const benchmark::State &state)
+        {
+            return static_cast<workload>(state.range(0));
+        }
+
+        // A number and a string property of each workload, TCP sends carry
+        // no string.
+        const wchar_t *number_property(workload kind)
+        {
+            switch (kind) {
+            case workload::process_start: return L"ParentProcessID";
+            case workload::image_load: return L"TimeDateStamp";
+            case workload::tcp_send: return L"sport";
+            default: return L"MessageTotal";
+            }
+        }
+
+        const wchar_t *string_property(workload kind)
+        {
+            switch (kind) {
+            case workload::process_start:
+            case workload::image_load: return L"ImageName";
+            case workload::tcp_send: return nullptr;
+            default: return L"ScriptBlockText";
+            }
+        }
+
+        // Reports the allocations made since the benchmark started, per
+        // iteration.
+        class allocation_counter {
+        public:
+            allocation_counter()
+                : start_(allocations.load(std::memory_order_relaxed))
+            {}
+
+            void report(benchmark::State &state) const
+            {
+                auto made = allocations.load(std::memory_order_relaxed) - start_;
+                state.counters["allocs_per_event"] = benchmark::Counter(
+                    static_cast<double>(made), benchmark::Counter::kAvgIterations);
+            }
+
+        private:
+            size_t start_;
+        };
+
+        // Reads the number property of the workload with its own type, by
+        // name, key or name and index.
+        template <typename... Where>
+        uint32_t parse_number(krabs::parser &parser, workload kind, Where &&... where)
+        {
+            switch (kind) {
+            case workload::tcp_send:
+                return parser.parse<uint16_t>(where...);
+            case workload::script_block:
+                return static_cast<uint32_t>(parser.parse<int32_t>(where...));
+            default:
+                return parser.parse<uint32_t>(where...);
+            }
+        }
+
+    }
+
+    // Schema lookup
+    // ------------------------------------------------------------------------
+
+    void schema_lookup(benchmark::State &state)
+    {
+        auto record = make_record(workload_of(state));
+        krabs::schema_locator locator;
+
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(locator.get_event_schema(record));
+        }
+
+        state.SetLabel(name_of(workload_of(state)));
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(schema_lookup)->DenseRange(0, 3);
+
+    // The schemas of an interleaved stream, which defeats the last lookup
+    // memo and goes to the shared table.
+    void schema_lookup_mixed(benchmark::State &state)
+    {
+        auto records = make_mix(64);
+        krabs::schema_locator locator;
+        size_t next = 0;
+
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(locator.get_event_schema(records[next]));
+            next = (next + 1) % records.size();
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(schema_lookup_mixed);
+
+    // Schemas of a stream where each event repeats for a burst before the
+    // next one arrives, like real traces do.
+    void schema_lookup_by_burst_length(benchmark::State &state)
+    {
+        auto records = make_mix(64);
+        const auto burst = static_cast<size_t>(state.range(0));
+        krabs::schema_locator locator;
+        for (auto &record : records) {
+            locator.get_event_schema(record);
+        }
+
+        size_t next = 0;
+        for (auto _ : state) {
+            krabs::schema schema(records[(next / burst) % records.size()], locator);
+            benchmark::DoNotOptimize(schema.event_id());
+            ++next;
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(schema_lookup_by_burst_length)->Arg(1)->Arg(4)->Arg(64)->Arg(1024);
+
+    void schema_construction(benchmark::State &state)
+    {
+        auto record = make_record(workload_of(state));
+        krabs::schema_locator locator;
+
+        for (auto _ : state) {
+            krabs::schema schema(record, locator);
+            benchmark::DoNotOptimize(&schema);
+        }
+
+        state.SetLabel(name_of(workload_of(state)));
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(schema_construction)->DenseRange(0, 3);
+
+    // Parsing
+    // ------------------------------------------------------------------------
+
+    void parse_number_by_name(benchmark::State &state)
+    {
+        auto kind = workload_of(state);
+        auto record = make_record(kind);
+        krabs::schema_locator locator;
+        krabs::schema schema(record, locator);
+
+        for (auto _ : state) {
+            krabs::parser parser(schema);
+            benchmark::DoNotOptimize(parse_number(parser, kind, number_property(kind)));
+        }
+
+        state.SetLabel(name_of(kind));
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(parse_number_by_name)->DenseRange(0, 3);
+
+    void parse_number_by_key(benchmark::State &state)
+    {
+        auto kind = workload_of(state);
+        auto record = make_record(kind);
+        krabs::schema_locator locator;
+        krabs::schema schema(record, locator);
+        const krabs::property_key key(number_property(kind));
+
+        for (auto _ : state) {
+            krabs::parser parser(schema);
+            benchmark::DoNotOptimize(parse_number(parser, kind, key));
+        }
+
+        state.SetLabel(name_of(kind));
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(parse_number_by_key)->DenseRange(0, 3);
+
+    // Resolves the index of the property on the first event and reuses it
+    // afterwards, like a callback that keeps it between events.
+    void parse_number_by_index(benchmark::State &state)
+    {
+        auto kind = workload_of(state);
+        auto record = make_record(kind);
+        krabs::schema_locator locator;
+        krabs::schema schema(record, locator);
+        const std::wstring name(number_property(kind));
+        ULONG index = krabs::parser::npos;
+
+        for (auto _ : state) {
+            krabs::parser parser(schema);
+            benchmark::DoNotOptimize(parse_number(parser, kind, name, index));
+        }
+
+        state.SetLabel(name_of(kind));
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(parse_number_by_index)->DenseRange(0, 3);
+
+    void parse_string_by_name(benchmark::State &state)
+    {
+        auto kind = workload_of(state);
+        auto record = make_record(kind);
+        krabs::schema_locator locator;
+        krabs::schema schema(record, locator);
+        const std::wstring property(string_property(kind));
+
+        allocation_counter counter;
+        for (auto _ : state) {
+            krabs::parser parser(schema);
+            benchmark::DoNotOptimize(parser.parse<std::wstring>(property));
+        }
+
+        counter.report(state);
+        state.SetLabel(name_of(kind));
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(parse_string_by_name)
+        ->Arg(static_cast<int>(workload::process_start))
+        ->Arg(static_cast<int>(workload::image_load))
+        ->Arg(static_cast<int>(workload::script_block));
+
+    // The same strings borrowed from the record, which should not allocate.
+    void parse_string_view_by_name(benchmark::State &state)
+    {
+        auto kind = workload_of(state);
+        auto record = make_record(kind);
+        krabs::schema_locator locator;
+        krabs::schema schema(record, locator);
+        const std::wstring property(string_property(kind));
+
+        allocation_counter counter;
+        for (auto _ : state) {
+            krabs::parser parser(schema);
+            benchmark::DoNotOptimize(parser.parse<std::wstring_view>(property));
+        }
+
+        counter.report(state);
+        state.SetLabel(name_of(kind));
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(parse_string_view_by_name)
+        ->Arg(static_cast<int>(workload::process_start))
+        ->Arg(static_cast<int>(workload::image_load))
+        ->Arg(static_cast<int>(workload::script_block));
+
+    template <typename Bytes>
+    void parse_bytes(benchmark::State &state)
+    {
+        auto record = make_record(workload::script_block);
+        krabs::schema_locator locator;
+        krabs::schema schema(record, locator);
+        const std::wstring property(L"ScriptBlockText");
+
+        allocation_counter counter;
+        for (auto _ : state) {
+            krabs::parser parser(schema);
+            auto bytes = parser.parse<Bytes>(property);
+            benchmark::DoNotOptimize(&bytes);
+        }
+
+        counter.report(state);
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK_TEMPLATE(parse_bytes, krabs::binary);
+    BENCHMARK_TEMPLATE(parse_bytes, krabs::byte_span);
+
+    // Everything a callback does for a process start: look the schema up,
+    // then read the fields a sensor keeps.
+    void process_start_callback(benchmark::State &state)
+    {
+        auto record = make_record(workload::process_start);
+        krabs::schema_locator locator;
+
+        for (auto _ : state) {
+            krabs::schema schema(record, locator);
+            krabs::parser parser(schema);
+            benchmark::DoNotOptimize(parser.parse<uint32_t>(L"ProcessID"));
+            benchmark::DoNotOptimize(parser.parse<uint32_t>(L"ParentProcessID"));
+            benchmark::DoNotOptimize(parser.parse<std::wstring>(L"ImageName"));
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(process_start_callback);
+
+    // SID and address formatting
+    // ------------------------------------------------------------------------
+
+    namespace {
+
+        // S-1-5-21-1004336348-1177238915-682003330-1001, a domain user.
+        std::vector<BYTE> user_sid()
+        {
+            const BYTE header[] = { 1, 5, 0, 0, 0, 0, 0, 5 };
+            const DWORD subAuthorities[] = { 21, 1004336348, 1177238915, 682003330, 1001 };
+
+            std::vector<BYTE> bytes(sizeof(header) + sizeof(subAuthorities));
+            memcpy(bytes.data(), header, sizeof(header));
+            memcpy(bytes.data() + sizeof(header), subAuthorities, sizeof(subAuthorities));
+            return bytes;
+        }
+
+    }
+
+    void sid_to_string(benchmark::State &state)
+    {
+        auto bytes = user_sid();
+
+        allocation_counter counter;
+        for (auto _ : state) {
+            auto sid = krabs::sid::from_bytes(bytes.data(), bytes.size());
+            benchmark::DoNotOptimize(sid.sid_string.data());
+        }
+
+        counter.report(state);
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(sid_to_string);
+
+    void sid_format_to_buffer(benchmark::State &state)
+    {
+        auto bytes = user_sid();
+
+        allocation_counter counter;
+        for (auto _ : state) {
+            char buffer[krabs::sid_string_size];
+            benchmark::DoNotOptimize(krabs::format_sid(bytes.data(), bytes.size(), buffer, sizeof(buffer)));
+            benchmark::ClobberMemory();
+        }
+
+        counter.report(state);
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(sid_format_to_buffer);
+
+    void sid_format_cached(benchmark::State &state)
+    {
+        auto bytes = user_sid();
+        krabs::sid_cache cache;
+
+        allocation_counter counter;
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(cache.format(bytes.data(), bytes.size()));
+        }
+
+        counter.report(state);
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(sid_format_cached);
+
+    void ipv6_format_to_buffer(benchmark::State &state)
+    {
+        const BYTE address[16] = { 0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0x1c, 0, 0, 0, 0, 0x4a, 0x01 };
+
+        allocation_counter counter;
+        for (auto _ : state) {
+            char buffer[krabs::ipv6_string_size];
+            benchmark::DoNotOptimize(krabs::format_ipv6(address, buffer, sizeof(buffer)));
+            benchmark::ClobberMemory();
+        }
+
+        counter.report(state);
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(ipv6_format_to_buffer);
+
+    void ipv4_format_to_buffer(benchmark::State &state)
+    {
+        const BYTE address[4] = { 192, 168, 100, 254 };
+
+        allocation_counter counter;
+        for (auto _ : state) {
+            char buffer[krabs::ipv4_string_size];
+            benchmark::DoNotOptimize(krabs::format_ipv4(address, buffer, sizeof(buffer)));
+            benchmark::ClobberMemory();
+        }
+
+        counter.report(state);
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(ipv4_format_to_buffer);
+
+    // Enumeration
+    // ------------------------------------------------------------------------
+
+    void property_enumeration(benchmark::State &state)
+    {
+        auto kind = workload_of(state);
+        auto record = make_record(kind);
+        krabs::schema_locator locator;
+        krabs::schema schema(record, locator);
+
+        allocation_counter counter;
+        for (auto _ : state) {
+            krabs::parser parser(schema);
+            size_t count = 0;
+            for (auto &property : parser.properties()) {
+                benchmark::DoNotOptimize(property.name().data());
+                ++count;
+            }
+            benchmark::DoNotOptimize(count);
+        }
+
+        counter.report(state);
+        state.SetLabel(name_of(kind));
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(property_enumeration)->DenseRange(0, 3);
+
+    // What a generic exporter does with every event: visit each property
+    // and read its bytes.
+    void property_ref_enumeration(benchmark::State &state)
+    {
+        auto kind = workload_of(state);
+        auto record = make_record(kind);
+        krabs::schema_locator locator;
+        krabs::schema schema(record, locator);
+
+        allocation_counter counter;
+        for (auto _ : state) {
+            krabs::parser parser(schema);
+            size_t bytes = 0;
+            for (const auto &property : parser.property_refs()) {
+                benchmark::DoNotOptimize(property.name());
+                bytes += property.length();
+            }
+            benchmark::DoNotOptimize(bytes);
+        }
+
+        counter.report(state);
+        state.SetLabel(name_of(kind));
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(property_ref_enumeration)->DenseRange(0, 3);
+
+    // Keeping events
+    // ------------------------------------------------------------------------
+
+    // Copies of the last 1024 events kept as synth_records...
+    void keep_as_synth_record(benchmark::State &state)
+    {
+        auto record = make_record(workload::process_start);
+        const EVENT_RECORD &source = record;
+        std::vector<BYTE> userData(
+            static_cast<const BYTE *>(source.UserData),
+            static_cast<const BYTE *>(source.UserData) + source.UserDataLength);
+
+        const size_t window = 1024;
+        std::vector<krabs::testing::synth_record> kept;
+        kept.reserve(window);
+
+        allocation_counter counter;
+        for (auto _ : state) {
+            if (kept.size() == window) {
+                kept.clear();
+            }
+            kept.emplace_back(source, userData);
+        }
+
+        counter.report(state);
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(keep_as_synth_record);
+
+    // ...and as owned_records taken from an arena.
+    void keep_as_owned_record(benchmark::State &state)
+    {
+        auto record = make_record(workload::process_start);
+        const EVENT_RECORD &source = record;
+
+        const size_t window = 1024;
+        krabs::record_arena arena;
+        std::vector<krabs::owned_record> kept;
+        kept.reserve(window);
+
+        allocation_counter counter;
+        for (auto _ : state) {
+            if (kept.size() == window) {
+                kept.clear();
+            }
+            kept.push_back(arena.copy(source));
+        }
+
+        counter.report(state);
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(keep_as_owned_record);
+
+    // Predicates
+    // ------------------------------------------------------------------------
+
+    template <typename Predicate>
+    void evaluate_over_mix(benchmark::State &state, const Predicate &predicate)
+    {
+        auto records = make_mix(64);
+        krabs::trace_context context;
+        size_t next = 0;
+        size_t matched = 0;
+
+        for (auto _ : state) {
+            matched += predicate(records[next], context) ? 1 : 0;
+            next = (next + 1) % records.size();
+        }
+
+        benchmark::DoNotOptimize(matched);
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    void predicate_id(benchmark::State &state)
+    {
+        evaluate_over_mix(state, krabs::predicates::id_is(4104));
+    }
+    BENCHMARK(predicate_id);
+
+    void predicate_property_is(benchmark::State &state)
+    {
+        evaluate_over_mix(state, krabs::predicates::and_filter(
+            krabs::predicates::id_is(1),
+            krabs::predicates::property_is(L"ParentProcessID", (unsigned int)4)));
+    }
+    BENCHMARK(predicate_property_is);
+
+    void predicate_property_icontains(benchmark::State &state)
+    {
+        evaluate_over_mix(state, krabs::predicates::and_filter(
+            krabs::predicates::id_is(4104),
+            krabs::predicates::property_icontains(L"ScriptBlockText", std::wstring(L"downloadstring"))));
+    }
+    BENCHMARK(predicate_property_icontains);
+
+    namespace {
+
+        // Patterns that never occur in a script block.
+        std::vector<std::wstring> make_patterns(size_t count)
+        {
+            std::vector<std::wstring> patterns;
+            for (size_t i = 0; i < count; ++i) {
+                patterns.push_back(L"pattern-" + std::to_wstring(i));
+            }
+
+            return patterns;
+        }
+
+    }
+
+    // Matching a script block against many patterns with an any_of over one
+    // property_icontains per pattern...
+    void predicate_icontains_any_of(benchmark::State &state)
+    {
+        auto record = make_record(workload::script_block);
+        auto patterns = make_patterns(static_cast<size_t>(state.range(0)));
+        krabs::trace_context context;
+
+        typedef decltype(krabs::predicates::property_icontains(L"ScriptBlockText", patterns[0])) predicate_type;
+        std::vector<predicate_type> owned;
+        owned.reserve(patterns.size());
+        std::vector<krabs::predicates::details::predicate_base *> chain;
+        for (auto &pattern : patterns) {
+            owned.push_back(krabs::predicates::property_icontains(L"ScriptBlockText", pattern));
+            chain.push_back(&owned.back());
+        }
+
+        krabs::predicates::any_of any(chain);
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(any(record, context));
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(predicate_icontains_any_of)->Arg(1)->Arg(16)->Arg(256);
+
+    // ...and with a single property_contains_any.
+    void predicate_contains_any(benchmark::State &state)
+    {
+        auto record = make_record(workload::script_block);
+        auto patterns = make_patterns(static_cast<size_t>(state.range(0)));
+        krabs::trace_context context;
+
+        auto any = krabs::predicates::property_contains_any(L"ScriptBlockText", patterns, true);
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(any(record, context));
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(predicate_contains_any)->Arg(1)->Arg(16)->Arg(256);
+
+    // String comparisons
+    // ------------------------------------------------------------------------
+
+    namespace {
+
+        const std::wstring image_needle(L"POWERSHELL.EXE");
+
+        // An image path of the given length ending in the needle, which the
+        // search only finds at the very end.
+        std::wstring image_path(size_t length)
+        {
+            std::wstring path(length - image_needle.size(), L'a');
+            path += L"powershell.exe";
+            return path;
+        }
+
+        const char *level_name()
+        {
+            static const char *levels[] = { "scalar", "sse2", "avx2" };
+            return levels[static_cast<int>(krabs::details::string_kernels::current_level())];
+        }
+
+    }
+
+    // The iterator based comparison the string kernels replace.
+    void icontains_iterator(benchmark::State &state)
+    {
+        auto path = image_path(static_cast<size_t>(state.range(0)));
+        krabs::predicates::comparers::iequal_to<wchar_t> iequal;
+
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(std::search(
+                path.begin(), path.end(), image_needle.begin(), image_needle.end(), iequal));
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(icontains_iterator)->Arg(16)->Arg(64)->Arg(260)->Arg(1024);
+
+    void icontains_kernel(benchmark::State &state)
+    {
+        using namespace krabs::predicates::comparers;
+
+        auto path = image_path(static_cast<size_t>(state.range(0)));
+        const wchar_t *first = path.data();
+        const wchar_t *last = path.data() + path.size();
+
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(contains<iequal_to<wchar_t>>()(
+                first, last, image_needle.begin(), image_needle.end()));
+        }
+
+        state.SetLabel(level_name());
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(icontains_kernel)->Arg(16)->Arg(64)->Arg(260)->Arg(1024);
+
+    void iequals_iterator(benchmark::State &state)
+    {
+        auto path = image_path(static_cast<size_t>(state.range(0)));
+        std::wstring upper(path);
+        std::transform(upper.begin(), upper.end(), upper.begin(), [](wchar_t c) {
+            return static_cast<wchar_t>(towupper(c));
+        });
+        krabs::predicates::comparers::iequal_to<wchar_t> iequal;
+
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(std::equal(path.begin(), path.end(), upper.begin(), upper.end(), iequal));
+        }
+
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(iequals_iterator)->Arg(16)->Arg(64)->Arg(260)->Arg(1024);
+
+    void iequals_kernel(benchmark::State &state)
+    {
+        using namespace krabs::predicates::comparers;
+
+        auto path = image_path(static_cast<size_t>(state.range(0)));
+        std::wstring upper(path);
+        std::transform(upper.begin(), upper.end(), upper.begin(), [](wchar_t c) {
+            return static_cast<wchar_t>(towupper(c));
+        });
+
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(equals<iequal_to<wchar_t>>()(
+                path.begin(), path.end(), upper.begin(), upper.end()));
+        }
+
+        state.SetLabel(level_name());
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(iequals_kernel)->Arg(16)->Arg(64)->Arg(260)->Arg(1024);
+
+    // Dispatch
+    // ------------------------------------------------------------------------
+
+    // A filter as a provider holds it, behind an id check and a predicate.
+    void filter_dispatch(benchmark::State &state)
+    {
+        auto records = make_mix(64);
+        size_t delivered = 0;
+
+        krabs::event_filter filter(krabs::predicates::property_icontains(
+            L"ScriptBlockText", std::wstring(L"invoke-expression")));
+        filter.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) {
+            ++delivered;
+        });
+
+        krabs::testing::event_filter_proxy proxy(filter);
+        size_t next = 0;
+
+        for (auto _ : state) {
+            proxy.push_event(records[next]);
+            next = (next + 1) % records.size();
+        }
+
+        benchmark::DoNotOptimize(delivered);
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(filter_dispatch);
+
+#if defined(_WIN32)
+
+    // From the trace callback to the provider of each event and its filters.
+    void provider_dispatch(benchmark::State &state)
+    {
+        auto records = make_mix(64);
+        size_t delivered = 0;
+        auto count = [&](const EVENT_RECORD &, const krabs::trace_context &) { ++delivered; };
+
+        krabs::user_trace trace;
+        krabs::provider<> process(kernel_process);
+        krabs::provider<> network(kernel_network);
+        krabs::provider<> script(powershell);
+
+        krabs::event_filter starts(krabs::predicates::id_is(1));
+        starts.add_on_event_callback(count);
+        process.add_filter(starts);
+        network.add_on_event_callback(count);
+
+        krabs::event_filter blocks(krabs::predicates::property_icontains(
+            L"ScriptBlockText", std::wstring(L"invoke-expression")));
+        blocks.add_on_event_callback(count);
+        script.add_filter(blocks);
+
+        trace.enable(process);
+        trace.enable(network);
+        trace.enable(script);
+
+        krabs::testing::user_trace_proxy proxy(trace);
+        proxy.start();
+        size_t next = 0;
+
+        for (auto _ : state) {
+            proxy.push_event(records[next]);
+            next = (next + 1) % records.size();
+        }
+
+        benchmark::DoNotOptimize(delivered);
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(provider_dispatch);
+
+    // Reaching one provider among count enabled ones, which should cost
+    // the same whatever the count.
+    void provider_dispatch_by_provider_count(benchmark::State &state)
+    {
+        auto record = make_record(workload::script_block);
+        const auto count = static_cast<size_t>(state.range(0));
+        size_t delivered = 0;
+
+        krabs::user_trace trace;
+        std::deque<krabs::provider<>> others;
+        for (size_t i = 1; i < count; ++i) {
+            others.emplace_back(krabs::guid::random_guid());
+            trace.enable(others.back());
+        }
+
+        krabs::provider<> script(powershell);
+        script.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) {
+            ++delivered;
+        });
+        trace.enable(script);
+
+        krabs::testing::user_trace_proxy proxy(trace);
+        proxy.start();
+
+        for (auto _ : state) {
+            proxy.push_event(record);
+        }
+
+        benchmark::DoNotOptimize(delivered);
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(provider_dispatch_by_provider_count)->Arg(1)->Arg(8)->Arg(64)->Arg(256);
+
+    // Getting past count filters of a provider when none of them asked for
+    // the event.
+    void filter_dispatch_by_filter_count(benchmark::State &state)
+    {
+        auto record = make_record(workload::script_block);
+        const auto count = static_cast<size_t>(state.range(0));
+        size_t delivered = 0;
+
+        krabs::user_trace trace;
+        krabs::provider<> script(powershell);
+        for (size_t i = 0; i < count; ++i) {
+            krabs::event_filter filter(static_cast<unsigned short>(i + 1));
+            filter.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) {
+                ++delivered;
+            });
+            script.add_filter(filter);
+        }
+        trace.enable(script);
+
+        krabs::testing::user_trace_proxy proxy(trace);
+        proxy.start();
+
+        for (auto _ : state) {
+            proxy.push_event(record);
+        }
+
+        benchmark::DoNotOptimize(delivered);
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(filter_dispatch_by_filter_count)->Arg(1)->Arg(8)->Arg(64);
+
+    // Delivering the events of full buffers one at a time...
+    void event_delivery_single(benchmark::State &state)
+    {
+        auto record = make_record(workload::script_block);
+        const size_t events_per_buffer = 256;
+        size_t seen = 0;
+
+        krabs::user_trace trace;
+        krabs::provider<> script(powershell);
+        script.add_on_event_callback([&](const EVENT_RECORD &event, const krabs::trace_context &) {
+            seen += event.UserDataLength;
+        });
+        trace.enable(script);
+
+        krabs::testing::user_trace_proxy proxy(trace);
+        size_t pushed = 0;
+
+        for (auto _ : state) {
+            proxy.push_event(record);
+            if (++pushed % events_per_buffer == 0) {
+                proxy.end_buffer();
+            }
+        }
+
+        benchmark::DoNotOptimize(seen);
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(event_delivery_single);
+
+    // ...and in a batch per buffer.
+    void event_delivery_batched(benchmark::State &state)
+    {
+        auto record = make_record(workload::script_block);
+        const size_t events_per_buffer = 256;
+        size_t seen = 0;
+
+        krabs::user_trace trace;
+        krabs::provider<> script(powershell);
+        script.add_on_batch_callback([&](const krabs::event_span &events, const krabs::trace_context &) {
+            for (auto &event : events) {
+                seen += event.record().UserDataLength;
+            }
+        });
+        trace.enable(script);
+
+        krabs::testing::user_trace_proxy proxy(trace);
+        size_t pushed = 0;
+
+        for (auto _ : state) {
+            proxy.push_event(record);
+            if (++pushed % events_per_buffer == 0) {
+                proxy.end_buffer();
+            }
+        }
+        proxy.end_buffer();
+
+        benchmark::DoNotOptimize(seen);
+        state.SetItemsProcessed(state.iterations());
+    }
+    BENCHMARK(event_delivery_batched);
+
+#endif
+
+}
+
+int main(int argc, char **argv)
+{
+#if !defined(_WIN32)
+    static krabsbench::workload_schemas schemas;
+    krabs::portability::set_schema_source(schemas);
+#endif
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
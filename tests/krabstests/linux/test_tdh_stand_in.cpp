@@ -0,0 +1,178 @@
+﻿// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+#include <bluekrabs/searching/wevt.hpp>
+
+#include <iterator>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    // Serves a single schema, as a manifest read from disk would.
+    struct single_schema_source {
+        single_schema_source(const krabs::guid &provider, std::vector<BYTE> schema)
+            : provider(provider)
+            , schema(std::move(schema))
+        {}
+
+        krabs::guid provider;
+        std::vector<BYTE> schema;
+
+        size_t get_event_schema(const EVENT_RECORD &record, void *buffer, size_t size) const
+        {
+            if (record.EventHeader.ProviderId != provider ||
+                record.EventHeader.EventDescriptor.Id != 1) {
+                return 0;
+            }
+
+            if (size >= schema.size()) {
+                memcpy(buffer, schema.data(), schema.size());
+            }
+
+            return schema.size();
+        }
+    };
+
+    TEST_CLASS(test_tdh_stand_in)
+    {
+        const krabs::guid provider;
+        const single_schema_source source;
+
+        static std::vector<BYTE> make_schema(const krabs::guid &provider)
+        {
+            EVENT_DESCRIPTOR descriptor;
+            memset(&descriptor, 0, sizeof(descriptor));
+            descriptor.Id = 1;
+
+            return krabs::details::build_trace_event_info(
+                provider, descriptor, L"Krabs-Test-Provider", L"", L"", L"", {
+                    { L"ProcessId", 0, TDH_INTYPE_UINT32, TDH_OUTTYPE_NULL, 1, 4 },
+                    { L"ImageName", 0, TDH_INTYPE_UNICODESTRING, TDH_OUTTYPE_STRING, 1, 0 },
+                });
+        }
+
+    public:
+
+        test_tdh_stand_in()
+            : provider(L"{6A4C8D1E-0B5F-4C3A-9E27-1D8F5B6C7A90}")
+            , source(provider, make_schema(provider))
+        {
+            krabs::portability::set_schema_source(source);
+        }
+
+        ~test_tdh_stand_in()
+        {
+            krabs::portability::clear_schema_source();
+        }
+
+        TEST_METHOD(should_report_unknown_events)
+        {
+            krabs::testing::record_builder builder(provider, krabs::id(2), krabs::version(0));
+
+            Assert::ExpectException<krabs::could_not_find_schema>([&] {
+                builder.pack_incomplete();
+            });
+        }
+
+        TEST_METHOD(should_ask_for_a_larger_buffer)
+        {
+            EVENT_RECORD record;
+            memset(&record, 0, sizeof(record));
+            record.EventHeader.ProviderId = provider;
+            record.EventHeader.EventDescriptor.Id = 1;
+
+            ULONG size = 0;
+            Assert::AreEqual((ULONG)ERROR_INSUFFICIENT_BUFFER, TdhGetEventInformation(&record, 0, nullptr, nullptr, &size));
+            Assert::AreEqual((ULONG)source.schema.size(), size);
+
+            std::vector<BYTE> buffer(size);
+            auto info = reinterpret_cast<PTRACE_EVENT_INFO>(buffer.data());
+            Assert::AreEqual((ULONG)ERROR_SUCCESS, TdhGetEventInformation(&record, 0, nullptr, info, &size));
+            Assert::AreEqual((ULONG)2, info->TopLevelPropertyCount);
+        }
+
+        TEST_METHOD(should_build_parse_and_filter_records)
+        {
+            krabs::testing::record_builder builder(provider, krabs::id(1), krabs::version(0));
+            builder.add_properties()
+                (L"ProcessId", (uint32_t)42)
+                (L"ImageName", L"krabs.exe");
+
+            auto record = builder.pack();
+            krabs::trace_context context;
+            krabs::schema schema(record, context.schema_locator);
+            krabs::parser parser(schema);
+
+            Assert::AreEqual(L"Krabs-Test-Provider", schema.provider_name());
+            Assert::AreEqual((uint32_t)42, parser.parse<uint32_t>(L"ProcessId"));
+            Assert::AreEqual(std::wstring(L"krabs.exe"), parser.parse<std::wstring>(L"ImageName"));
+
+            auto filter = krabs::predicates::property_icontains(L"ImageName", std::wstring(L"KRABS"));
+            Assert::IsTrue(filter(record, context));
+        }
+
+        TEST_METHOD(should_borrow_properties_from_the_record)
+        {
+            krabs::testing::record_builder builder(provider, krabs::id(1), krabs::version(0));
+            builder.add_properties()
+                (L"ProcessId", (uint32_t)42)
+                (L"ImageName", L"krabs.exe");
+
+            auto record = builder.pack();
+            krabs::schema_locator locator;
+            krabs::schema schema(record, locator);
+            krabs::parser parser(schema);
+
+            const EVENT_RECORD &raw = record;
+            auto begin = static_cast<const BYTE *>(raw.UserData);
+            auto end = begin + raw.UserDataLength;
+
+            auto image = parser.parse<std::wstring_view>(L"ImageName");
+            Assert::IsTrue(image == L"krabs.exe");
+            Assert::IsTrue(reinterpret_cast<const BYTE *>(image.data()) > begin);
+            Assert::IsTrue(reinterpret_cast<const BYTE *>(image.data() + image.size()) <= end);
+
+            krabs::byte_span pid;
+            Assert::IsTrue(parser.try_parse(L"ProcessId", pid));
+            Assert::AreEqual((size_t)4, pid.size());
+            Assert::IsTrue(pid.data() == begin);
+            Assert::AreEqual((BYTE)42, pid[0]);
+        }
+
+        TEST_METHOD(should_walk_property_refs_in_place)
+        {
+            krabs::testing::record_builder builder(provider, krabs::id(1), krabs::version(0));
+            builder.add_properties()
+                (L"ProcessId", (uint32_t)42)
+                (L"ImageName", L"krabs.exe");
+
+            auto record = builder.pack();
+            krabs::schema_locator locator;
+            krabs::schema schema(record, locator);
+            krabs::parser parser(schema);
+
+            auto refs = parser.property_refs();
+            auto it = refs.begin();
+            Assert::AreEqual(std::wstring(L"ProcessId"), std::wstring(it->name(), it->name_length()));
+            Assert::AreEqual((uint32_t)42, parser.parse<uint32_t>(*it));
+
+            ++it;
+            Assert::AreEqual((ULONG)1, it->index());
+            Assert::AreEqual((int)TDH_INTYPE_UNICODESTRING, (int)it->type());
+            Assert::AreEqual(std::wstring(L"krabs.exe"), parser.parse<std::wstring>(*it));
+
+            // Names point into the schema, every walk hands out the same ones.
+            Assert::IsTrue(it->name() == std::next(refs.begin())->name());
+
+            krabs::byte_span bytes;
+            Assert::IsTrue(parser.try_parse(*it, bytes));
+            Assert::IsTrue(bytes.data() == it->data());
+
+            ++it;
+            Assert::IsTrue(it == refs.end());
+        }
+    };
+}
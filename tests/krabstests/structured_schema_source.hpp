@@ -0,0 +1,107 @@
+﻿// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <krabs.hpp>
+#include <bluekrabs/searching/wevt.hpp>
+
+#include <cstring>
+#include <cwchar>
+#include <vector>
+
+namespace krabstests
+{
+    // Serves the schema of a registry style event made of arrays and
+    // structures, whose sizes all come from the event itself.
+    class structured_schema_source : public krabs::schema_source {
+    public:
+        explicit structured_schema_source(const krabs::guid &provider)
+            : provider_(provider)
+        {
+            EVENT_DESCRIPTOR descriptor;
+            memset(&descriptor, 0, sizeof(descriptor));
+            descriptor.Id = 1;
+
+            schema_ = krabs::details::build_trace_event_info(
+                provider, descriptor, L"Krabs-Test-Provider", L"", L"", L"", {
+                    { L"PortCount", 0, TDH_INTYPE_UINT16, 0, 1, 0, 0, 0 },
+                    { L"Ports", PropertyParamCount, TDH_INTYPE_UINT16, 0, 0, 0, 0, 0 },
+                    { L"Tags", 0, TDH_INTYPE_UINT32, 0, 3, 0, 0, 0 },
+                    { L"BlobSize", 0, TDH_INTYPE_UINT32, 0, 1, 0, 0, 0 },
+                    { L"Blob", PropertyParamLength, TDH_INTYPE_BINARY, 0, 1, 3, 0, 0 },
+                    { L"EntryCount", 0, TDH_INTYPE_UINT32, 0, 1, 0, 0, 0 },
+                    { L"Entries", PropertyStruct | PropertyParamCount, 0, 0, 5, 0, 11, 3 },
+                    { L"Names", 0, TDH_INTYPE_UNICODESTRING, 0, 2, 0, 0, 0 },
+                    { L"LabelLength", 0, TDH_INTYPE_UINT16, 0, 1, 0, 0, 0 },
+                    { L"Label", PropertyParamLength, TDH_INTYPE_UNICODESTRING, 0, 1, 8, 0, 0 },
+                    { L"Trailer", 0, TDH_INTYPE_UINT32, 0, 1, 0, 0, 0 },
+                    { L"Key", 0, TDH_INTYPE_UNICODESTRING, 0, 1, 0, 0, 0 },
+                    { L"ValueSize", 0, TDH_INTYPE_UINT16, 0, 1, 0, 0, 0 },
+                    { L"Value", PropertyParamLength, TDH_INTYPE_BINARY, 0, 1, 12, 0, 0 },
+                });
+        }
+
+        size_t get_event_schema(const EVENT_RECORD &record, void *buffer, size_t size) const override
+        {
+            if (record.EventHeader.ProviderId != provider_ ||
+                record.EventHeader.EventDescriptor.Id != 1) {
+                return 0;
+            }
+
+            if (size >= schema_.size()) {
+                memcpy(buffer, schema_.data(), schema_.size());
+            }
+
+            return schema_.size();
+        }
+
+    private:
+        krabs::guid provider_;
+        std::vector<BYTE> schema_;
+    };
+
+    // Builds an event that matches the structured_schema_source schema,
+    // with a trailer of 0xDEADBEEF after every array and structure.
+    inline krabs::testing::synth_record make_structured_record(const krabs::guid &provider)
+    {
+        EVENT_RECORD record;
+        memset(&record, 0, sizeof(record));
+        record.EventHeader.ProviderId = provider;
+        record.EventHeader.EventDescriptor.Id = 1;
+
+        std::vector<BYTE> data;
+        auto put = [&data](const void *value, size_t size) {
+            data.insert(data.end(), static_cast<const BYTE*>(value), static_cast<const BYTE*>(value) + size);
+        };
+        auto put16 = [&put](uint16_t value) { put(&value, sizeof(value)); };
+        auto put32 = [&put](uint32_t value) { put(&value, sizeof(value)); };
+        auto put_string = [&put](const wchar_t *value) { put(value, (wcslen(value) + 1) * sizeof(wchar_t)); };
+
+        put16(2);
+        put16(80);
+        put16(443);
+        put32(1);
+        put32(2);
+        put32(3);
+        put32(3);
+        data.insert(data.end(), { 'a', 'b', 'c' });
+        put32(2);
+
+        put_string(L"Run");
+        put16(2);
+        data.insert(data.end(), { 0x10, 0x20 });
+        put_string(L"RunOnce");
+        put16(0);
+
+        put_string(L"first");
+        put_string(L"second");
+
+        // The label length counts characters, and there is no terminator.
+        put16(5);
+        put(L"label", 5 * sizeof(wchar_t));
+        put32(0xDEADBEEF);
+
+        return krabs::testing::synth_record(record, data);
+    }
+}
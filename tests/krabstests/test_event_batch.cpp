@@ -0,0 +1,228 @@
+﻿// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_event_batch)
+    {
+        static krabs::testing::synth_record init()
+        {
+            krabs::testing::record_builder builder(powershell, krabs::id(7942), krabs::version(1));
+
+            builder.add_properties()
+                (L"ClassName", L"FakeETWEventForRealz")
+                (L"Message", L"This message is completely faked");
+
+            return builder.pack_incomplete();
+        }
+
+        static const krabs::guid powershell;
+
+        krabs::testing::synth_record record = init();
+
+    public:
+
+        TEST_METHOD(batch_callback_should_be_called_when_the_buffer_ends)
+        {
+            krabs::user_trace trace;
+            krabs::provider<> provider(powershell);
+
+            size_t calls = 0;
+            std::vector<std::wstring> messages;
+
+            provider.add_on_batch_callback([&](const krabs::event_span &events, const krabs::trace_context &trace_context) {
+                ++calls;
+                for (auto &event : events) {
+                    krabs::schema schema(event.record(), trace_context.schema_locator);
+                    krabs::parser parser(schema);
+                    messages.push_back(parser.parse<std::wstring>(L"Message"));
+                }
+            });
+
+            trace.enable(provider);
+
+            krabs::testing::user_trace_proxy proxy(trace);
+            proxy.start();
+            proxy.push_event(record);
+            proxy.push_event(record);
+            proxy.push_event(record);
+
+            Assert::AreEqual((size_t)0, calls);
+
+            proxy.end_buffer();
+
+            Assert::AreEqual((size_t)1, calls);
+            Assert::AreEqual((size_t)3, messages.size());
+            for (auto &message : messages) {
+                Assert::AreEqual(std::wstring(L"This message is completely faked"), message);
+            }
+
+            // Nothing is delivered for a buffer without events.
+            proxy.end_buffer();
+            Assert::AreEqual((size_t)1, calls);
+        }
+
+        TEST_METHOD(batch_size_should_deliver_every_n_events)
+        {
+            krabs::user_trace trace;
+            krabs::provider<> provider(powershell);
+
+            std::vector<size_t> sizes;
+            provider.add_on_batch_callback([&](const krabs::event_span &events, const krabs::trace_context &) {
+                sizes.push_back(events.size());
+            });
+            provider.set_batch_size(2);
+
+            trace.enable(provider);
+
+            krabs::testing::user_trace_proxy proxy(trace);
+            proxy.start();
+            for (int i = 0; i < 5; ++i) {
+                proxy.push_event(record);
+            }
+
+            Assert::AreEqual((size_t)2, sizes.size());
+
+            proxy.end_buffer();
+
+            Assert::AreEqual((size_t)3, sizes.size());
+            Assert::AreEqual((size_t)2, sizes[0]);
+            Assert::AreEqual((size_t)2, sizes[1]);
+            Assert::AreEqual((size_t)1, sizes[2]);
+        }
+
+        TEST_METHOD(event_callbacks_should_still_be_called_in_batch_mode)
+        {
+            krabs::user_trace trace;
+            krabs::provider<> provider(powershell);
+
+            size_t events = 0;
+            size_t batched = 0;
+
+            provider.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) {
+                ++events;
+            });
+            provider.add_on_batch_callback([&](const krabs::event_span &span, const krabs::trace_context &) {
+                batched += span.size();
+            });
+
+            trace.enable(provider);
+
+            krabs::testing::user_trace_proxy proxy(trace);
+            proxy.start();
+            proxy.push_event(record);
+            proxy.push_event(record);
+
+            Assert::AreEqual((size_t)2, events);
+            Assert::AreEqual((size_t)0, batched);
+
+            proxy.end_buffer();
+
+            Assert::AreEqual((size_t)2, batched);
+        }
+
+        TEST_METHOD(batch_callback_errors_should_go_to_the_error_callbacks)
+        {
+            krabs::user_trace trace;
+            krabs::provider<> provider(powershell);
+
+            std::vector<std::string> errors;
+            provider.add_on_batch_callback([](const krabs::event_span &, const krabs::trace_context &) {
+                throw krabs::could_not_find_schema();
+            });
+            provider.add_on_error_callback([&](const EVENT_RECORD &, const std::string &error) {
+                errors.push_back(error);
+            });
+            provider.set_batch_size(2);
+
+            trace.enable(provider);
+
+            krabs::testing::user_trace_proxy proxy(trace);
+            proxy.start();
+
+            // Both when the batch is full and when the buffer ends.
+            proxy.push_event(record);
+            proxy.push_event(record);
+            Assert::AreEqual((size_t)1, errors.size());
+
+            proxy.push_event(record);
+            proxy.end_buffer();
+            Assert::AreEqual((size_t)2, errors.size());
+            Assert::AreEqual(std::string("Could not find the schema"), errors[1]);
+        }
+
+        TEST_METHOD(event_batch_should_copy_user_data_and_extended_data)
+        {
+            BYTE userData[] = { 1, 2, 3, 4, 5 };
+            ULONG64 first = 0x1122334455667788;
+            BYTE second[] = { 9, 8, 7 };
+
+            EVENT_HEADER_EXTENDED_DATA_ITEM items[2] = {};
+            items[0].ExtType = EVENT_HEADER_EXT_TYPE_PROCESS_START_KEY;
+            items[0].DataSize = sizeof(first);
+            items[0].DataPtr = reinterpret_cast<ULONG_PTR>(&first);
+            items[1].ExtType = EVENT_HEADER_EXT_TYPE_SID;
+            items[1].DataSize = sizeof(second);
+            items[1].DataPtr = reinterpret_cast<ULONG_PTR>(second);
+
+            EVENT_RECORD original = {};
+            original.EventHeader.EventDescriptor.Id = 42;
+            original.UserData = userData;
+            original.UserDataLength = sizeof(userData);
+            original.ExtendedData = items;
+            original.ExtendedDataCount = 2;
+
+            krabs::details::event_batch batch;
+            batch.add(original);
+            batch.add(record);
+
+            // The source buffers may be reused once add returns.
+            std::memset(userData, 0, sizeof(userData));
+            first = 0;
+            std::memset(second, 0, sizeof(second));
+
+            auto events = batch.seal();
+            Assert::AreEqual((size_t)2, events.size());
+
+            auto &copy = events[0].record();
+            Assert::AreEqual((size_t)42, (size_t)copy.EventHeader.EventDescriptor.Id);
+            Assert::AreEqual((size_t)5, (size_t)copy.UserDataLength);
+            Assert::IsTrue(copy.UserData != userData);
+
+            const BYTE expectedUserData[] = { 1, 2, 3, 4, 5 };
+            Assert::AreEqual(0, std::memcmp(expectedUserData, copy.UserData, sizeof(expectedUserData)));
+
+            Assert::AreEqual((size_t)2, (size_t)copy.ExtendedDataCount);
+            Assert::IsTrue(copy.ExtendedData != items);
+            Assert::AreEqual((size_t)EVENT_HEADER_EXT_TYPE_PROCESS_START_KEY, (size_t)copy.ExtendedData[0].ExtType);
+            Assert::AreEqual((size_t)EVENT_HEADER_EXT_TYPE_SID, (size_t)copy.ExtendedData[1].ExtType);
+
+            auto copiedFirst = reinterpret_cast<const ULONG64*>(static_cast<ULONG_PTR>(copy.ExtendedData[0].DataPtr));
+            Assert::IsTrue(*copiedFirst == 0x1122334455667788);
+
+            const BYTE expectedSecond[] = { 9, 8, 7 };
+            auto copiedSecond = reinterpret_cast<const BYTE*>(static_cast<ULONG_PTR>(copy.ExtendedData[1].DataPtr));
+            Assert::AreEqual(0, std::memcmp(expectedSecond, copiedSecond, sizeof(expectedSecond)));
+
+            auto &synthetic = events[1].record();
+            const EVENT_RECORD &source = record;
+            Assert::AreEqual((size_t)source.UserDataLength, (size_t)synthetic.UserDataLength);
+            Assert::AreEqual(0, std::memcmp(source.UserData, synthetic.UserData, source.UserDataLength));
+            Assert::IsNull(synthetic.ExtendedData);
+
+            batch.clear();
+            Assert::AreEqual((size_t)0, batch.size());
+        }
+    };
+
+    const krabs::guid test_event_batch::powershell(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+}
@@ -0,0 +1,314 @@
+﻿// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_event_pipeline)
+    {
+        typedef krabs::details::event_pipeline<krabs::provider<>> pipeline_type;
+
+        static EVENT_RECORD make_record(USHORT id, ULONG process_id = 0)
+        {
+            EVENT_RECORD record = {};
+            record.EventHeader.EventDescriptor.Id = id;
+            record.EventHeader.ProcessId = process_id;
+            return record;
+        }
+
+        static krabs::worker_pool_options single_worker(size_t capacity, krabs::backpressure_policy backpressure)
+        {
+            krabs::worker_pool_options options;
+            options.worker_count = 1;
+            options.queue_capacity = capacity;
+            options.backpressure = backpressure;
+            return options;
+        }
+
+        // Runs a pipeline whose single worker is stuck on the first event
+        // while the rest are pushed, and returns the ids it delivered.
+        static std::vector<USHORT> run_with_stuck_worker(
+            krabs::backpressure_policy backpressure,
+            krabs::details::pipeline_stats &stats)
+        {
+            std::vector<USHORT> delivered;
+            std::atomic<bool> started(false);
+            std::atomic<bool> release(false);
+
+            pipeline_type pipeline(
+                single_worker(2, backpressure),
+                [&](const krabs::provider<> *, const EVENT_RECORD &record) {
+                    started = true;
+                    while (!release) {
+                        std::this_thread::yield();
+                    }
+                    delivered.push_back(record.EventHeader.EventDescriptor.Id);
+                },
+                [](const krabs::provider<> &) {});
+
+            pipeline.start();
+            pipeline.push(make_record(1), nullptr);
+            while (!started) {
+                std::this_thread::yield();
+            }
+
+            for (USHORT id = 2; id <= 5; ++id) {
+                pipeline.push(make_record(id), nullptr);
+            }
+
+            release = true;
+            pipeline.stop();
+            stats = pipeline.stats();
+            return delivered;
+        }
+
+    public:
+
+        TEST_METHOD(ring_should_hand_out_slots_in_order)
+        {
+            krabs::details::spsc_ring<int> ring(3);
+            Assert::AreEqual((size_t)4, ring.capacity());
+            Assert::IsTrue(ring.empty());
+
+            for (int i = 0; i < 4; ++i) {
+                auto slot = ring.try_reserve();
+                Assert::IsNotNull(slot);
+                *slot = i;
+                ring.publish();
+            }
+
+            Assert::IsNull(ring.try_reserve());
+
+            for (int i = 0; i < 4; ++i) {
+                auto slot = ring.try_acquire();
+                Assert::IsNotNull(slot);
+                Assert::AreEqual(i, *slot);
+                ring.release();
+            }
+
+            Assert::IsNull(ring.try_acquire());
+            Assert::IsTrue(ring.empty());
+        }
+
+        TEST_METHOD(ring_drop_oldest_should_free_the_oldest_unclaimed_slot)
+        {
+            krabs::details::spsc_ring<int> ring(2);
+
+            for (int i = 0; i < 2; ++i) {
+                *ring.try_reserve() = i;
+                ring.publish();
+            }
+
+            auto dropped = ring.drop_oldest();
+            Assert::IsNotNull(dropped);
+            Assert::AreEqual(0, *dropped);
+
+            auto slot = ring.try_reserve();
+            Assert::IsNotNull(slot);
+            *slot = 2;
+            ring.publish();
+
+            Assert::AreEqual(1, *ring.try_acquire());
+            ring.release();
+            Assert::AreEqual(2, *ring.try_acquire());
+
+            // The consumer holds the only full slot, nothing is left to drop.
+            Assert::IsNull(ring.drop_oldest());
+            ring.release();
+        }
+
+        TEST_METHOD(pipeline_should_deliver_every_event_in_order_when_blocking)
+        {
+            std::vector<USHORT> delivered;
+            std::thread::id worker_thread;
+
+            pipeline_type pipeline(
+                single_worker(4, krabs::backpressure_policy::block),
+                [&](const krabs::provider<> *, const EVENT_RECORD &record) {
+                    worker_thread = std::this_thread::get_id();
+                    delivered.push_back(record.EventHeader.EventDescriptor.Id);
+                },
+                [](const krabs::provider<> &) {});
+
+            pipeline.start();
+            for (USHORT id = 0; id < 1000; ++id) {
+                pipeline.push(make_record(id), nullptr);
+            }
+            pipeline.stop();
+
+            Assert::AreEqual((size_t)1000, delivered.size());
+            for (USHORT id = 0; id < 1000; ++id) {
+                Assert::AreEqual((int)id, (int)delivered[id]);
+            }
+
+            Assert::IsTrue(worker_thread != std::this_thread::get_id());
+
+            auto stats = pipeline.stats();
+            Assert::AreEqual((uint64_t)1000, stats.events_queued);
+            Assert::AreEqual((uint64_t)0, stats.events_dropped);
+        }
+
+        TEST_METHOD(pipeline_should_drop_newest_events_when_full)
+        {
+            krabs::details::pipeline_stats stats;
+            auto delivered = run_with_stuck_worker(krabs::backpressure_policy::drop_newest, stats);
+
+            Assert::AreEqual((size_t)3, delivered.size());
+            Assert::AreEqual(1, (int)delivered[0]);
+            Assert::AreEqual(2, (int)delivered[1]);
+            Assert::AreEqual(3, (int)delivered[2]);
+            Assert::AreEqual((uint64_t)3, stats.events_queued);
+            Assert::AreEqual((uint64_t)2, stats.events_dropped);
+        }
+
+        TEST_METHOD(pipeline_should_drop_oldest_events_when_full)
+        {
+            krabs::details::pipeline_stats stats;
+            auto delivered = run_with_stuck_worker(krabs::backpressure_policy::drop_oldest, stats);
+
+            Assert::AreEqual((size_t)3, delivered.size());
+            Assert::AreEqual(1, (int)delivered[0]);
+            Assert::AreEqual(4, (int)delivered[1]);
+            Assert::AreEqual(5, (int)delivered[2]);
+            Assert::AreEqual((uint64_t)3, stats.events_queued);
+            Assert::AreEqual((uint64_t)2, stats.events_dropped);
+        }
+
+        TEST_METHOD(pipeline_should_keep_the_events_of_a_process_in_order)
+        {
+            krabs::worker_pool_options options;
+            options.worker_count = 4;
+            options.queue_capacity = 16;
+            options.sharding = krabs::worker_sharding::by_process;
+
+            std::mutex mutex;
+            std::map<ULONG, std::vector<USHORT>> delivered;
+            std::map<ULONG, std::thread::id> threads;
+            bool same_thread = true;
+
+            pipeline_type pipeline(
+                options,
+                [&](const krabs::provider<> *, const EVENT_RECORD &record) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    auto pid = record.EventHeader.ProcessId;
+                    delivered[pid].push_back(record.EventHeader.EventDescriptor.Id);
+
+                    auto it = threads.find(pid);
+                    if (it == threads.end()) {
+                        threads[pid] = std::this_thread::get_id();
+                    }
+                    else if (it->second != std::this_thread::get_id()) {
+                        same_thread = false;
+                    }
+                },
+                [](const krabs::provider<> &) {});
+
+            pipeline.start();
+            for (USHORT id = 0; id < 400; ++id) {
+                pipeline.push(make_record(id, id % 7), nullptr);
+            }
+            pipeline.stop();
+
+            Assert::IsTrue(same_thread);
+            Assert::AreEqual((size_t)7, delivered.size());
+            for (auto &entry : delivered) {
+                USHORT expected = static_cast<USHORT>(entry.first);
+                for (auto id : entry.second) {
+                    Assert::AreEqual((int)expected, (int)id);
+                    expected += 7;
+                }
+            }
+        }
+
+        TEST_METHOD(pipeline_stop_should_rethrow_callback_exceptions)
+        {
+            size_t calls = 0;
+
+            pipeline_type pipeline(
+                single_worker(4, krabs::backpressure_policy::block),
+                [&](const krabs::provider<> *, const EVENT_RECORD &) {
+                    ++calls;
+                    throw std::runtime_error("callback failed");
+                },
+                [](const krabs::provider<> &) {});
+
+            pipeline.start();
+            pipeline.push(make_record(1), nullptr);
+            pipeline.push(make_record(2), nullptr);
+
+            Assert::ExpectException<std::runtime_error>([&] { pipeline.stop(); });
+            Assert::AreEqual((size_t)2, calls);
+        }
+
+        TEST_METHOD(trace_with_worker_pool_should_call_providers_on_workers)
+        {
+            krabs::guid powershell(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+
+            krabs::user_trace trace;
+            krabs::provider<> provider(powershell);
+
+            std::atomic<size_t> events(0);
+            size_t batched = 0;
+            std::thread::id callback_thread;
+
+            provider.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) {
+                callback_thread = std::this_thread::get_id();
+                ++events;
+            });
+            provider.add_on_batch_callback([&](const krabs::event_span &span, const krabs::trace_context &) {
+                batched += span.size();
+            });
+
+            krabs::worker_pool_options options;
+            options.worker_count = 2;
+            trace.set_worker_pool(options);
+            trace.enable(provider);
+
+            krabs::testing::record_builder builder(powershell, krabs::id(7942), krabs::version(1));
+            builder.add_properties()
+                (L"ClassName", L"FakeETWEventForRealz")
+                (L"Message", L"This message is completely faked");
+            auto record = builder.pack_incomplete();
+
+            krabs::testing::user_trace_proxy proxy(trace);
+            proxy.start();
+            proxy.push_event(record);
+            proxy.push_event(record);
+            proxy.end_buffer();
+            proxy.push_event(record);
+            proxy.stop();
+
+            Assert::AreEqual((size_t)3, events.load());
+            Assert::AreEqual((size_t)3, batched);
+            Assert::IsTrue(callback_thread != std::this_thread::get_id());
+        }
+
+        TEST_METHOD(trace_should_reject_batch_callbacks_with_process_sharding)
+        {
+            krabs::guid powershell(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+
+            krabs::user_trace trace;
+            krabs::provider<> provider(powershell);
+            provider.add_on_batch_callback([](const krabs::event_span &, const krabs::trace_context &) {});
+
+            krabs::worker_pool_options options;
+            options.worker_count = 2;
+            options.sharding = krabs::worker_sharding::by_process;
+            trace.set_worker_pool(options);
+            trace.enable(provider);
+
+            krabs::testing::user_trace_proxy proxy(trace);
+            Assert::ExpectException<krabs::unsupported_worker_pool>([&] { proxy.start(); });
+        }
+    };
+}
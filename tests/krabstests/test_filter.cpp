@@ -566,5 +566,59 @@ namespace krabstests
             auto filter = krabs::predicates::none_of({ &item1, &item2 });
             Assert::IsFalse(filter(record, trace_context));
         }
+
+        TEST_METHOD(should_share_one_schema_lookup_between_predicates_and_callbacks)
+        {
+            krabs::event_filter filter(krabs::predicates::and_filter(
+                krabs::predicates::property_is(L"ContextInfo", L"Foo bar baz bingo"),
+                krabs::predicates::property_contains(L"ContextInfo", std::wstring(L"bingo"))));
+
+            std::wstring context_info;
+            filter.add_on_event_callback([&](krabs::event_context &context) {
+                context_info = context.parser().parse<std::wstring>(L"ContextInfo");
+            });
+
+            krabs::testing::event_filter_proxy proxy(filter);
+            proxy.push_event(record);
+
+            Assert::AreEqual(std::wstring(L"Foo bar baz bingo"), context_info);
+
+            auto stats = proxy.trace_context().schema_stats();
+            Assert::AreEqual((uint64_t)1, stats.hits + stats.misses);
+        }
+
+        TEST_METHOD(should_call_record_callbacks_and_context_callbacks_in_order)
+        {
+            krabs::event_filter filter(krabs::predicates::any_event);
+
+            std::vector<int> calls;
+            filter.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) { calls.push_back(1); });
+            filter.add_on_event_callback([&](krabs::event_context &context) {
+                Assert::IsTrue(&context.record() == &static_cast<const EVENT_RECORD &>(record));
+                calls.push_back(2);
+            });
+
+            krabs::testing::event_filter_proxy proxy(filter);
+            proxy.push_event(record);
+
+            Assert::AreEqual((size_t)2, calls.size());
+            Assert::AreEqual(1, calls[0]);
+            Assert::AreEqual(2, calls[1]);
+        }
+
+        TEST_METHOD(should_accept_predicates_taking_an_event_context)
+        {
+            krabs::event_filter filter([](krabs::event_context &context) {
+                return context.record().EventHeader.EventDescriptor.Id == 7937;
+            });
+
+            auto was_called = false;
+            filter.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) { was_called = true; });
+
+            krabs::testing::event_filter_proxy proxy(filter);
+            proxy.push_event(record);
+
+            Assert::IsTrue(was_called);
+        }
     };
-}
\ No newline at end of file
+}
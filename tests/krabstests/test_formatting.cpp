@@ -0,0 +1,264 @@
+﻿// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+#if defined(_WIN32)
+#include <sddl.h>
+#endif
+
+#include <string>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_formatting)
+    {
+        // S-1-<authority>-<sub authorities...>, with the authority in
+        // network order and the sub authorities in machine order.
+        static std::vector<BYTE> make_sid(const BYTE (&authority)[6], std::vector<DWORD> subAuthorities)
+        {
+            std::vector<BYTE> bytes = { 1, static_cast<BYTE>(subAuthorities.size()) };
+            bytes.insert(bytes.end(), authority, authority + 6);
+            for (auto value : subAuthorities) {
+                auto at = reinterpret_cast<const BYTE*>(&value);
+                bytes.insert(bytes.end(), at, at + sizeof(value));
+            }
+
+            return bytes;
+        }
+
+        static std::vector<BYTE> nt_authority(std::vector<DWORD> subAuthorities)
+        {
+            const BYTE authority[6] = { 0, 0, 0, 0, 0, 5 };
+            return make_sid(authority, subAuthorities);
+        }
+
+        static std::string sid_string(const std::vector<BYTE> &bytes)
+        {
+            char buffer[krabs::sid_string_size];
+            auto length = krabs::format_sid(bytes.data(), bytes.size(), buffer, sizeof(buffer));
+            return std::string(buffer, length);
+        }
+
+        static std::string ipv6_string(std::vector<BYTE> bytes)
+        {
+            char buffer[krabs::ipv6_string_size];
+            auto length = krabs::format_ipv6(bytes.data(), buffer, sizeof(buffer));
+            return std::string(buffer, length);
+        }
+
+        static std::string socket_string(const std::vector<BYTE> &bytes)
+        {
+            auto address = krabs::socket_address::from_bytes(bytes.data(), bytes.size());
+            char buffer[krabs::socket_address_string_size];
+            auto length = address.format(buffer, sizeof(buffer));
+            return std::string(buffer, length);
+        }
+
+    public:
+
+        TEST_METHOD(format_sid_should_write_the_sddl_form)
+        {
+            Assert::AreEqual(std::string("S-1-5-18"), sid_string(nt_authority({ 18 })));
+            Assert::AreEqual(
+                std::string("S-1-5-21-1004336348-1177238915-682003330-512"),
+                sid_string(nt_authority({ 21, 1004336348, 1177238915, 682003330, 512 })));
+            Assert::AreEqual(std::string("S-1-5-4294967295"), sid_string(nt_authority({ 0xFFFFFFFF })));
+
+            const BYTE everyone[6] = { 0, 0, 0, 0, 0, 1 };
+            Assert::AreEqual(std::string("S-1-1-0"), sid_string(make_sid(everyone, { 0 })));
+        }
+
+        TEST_METHOD(format_sid_should_write_large_authorities_in_hex)
+        {
+            const BYTE authority[6] = { 0, 1, 2, 3, 4, 0xAB };
+            Assert::AreEqual(std::string("S-1-0x0001020304AB-7"), sid_string(make_sid(authority, { 7 })));
+        }
+
+#if defined(_WIN32)
+        TEST_METHOD(format_sid_should_match_convert_sid_to_string_sid)
+        {
+            const BYTE everyone[6] = { 0, 0, 0, 0, 0, 1 };
+            const BYTE large[6] = { 0, 1, 2, 3, 4, 0xAB };
+            const BYTE largest[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+            const std::vector<std::vector<BYTE>> sids = {
+                nt_authority({ 18 }),
+                nt_authority({ 21, 1004336348, 1177238915, 682003330, 512 }),
+                nt_authority({ 0xFFFFFFFF }),
+                make_sid(everyone, { 0 }),
+                make_sid(large, { 7 }),
+                make_sid(largest, std::vector<DWORD>(15, 0xFFFFFFFF)),
+            };
+
+            for (auto &bytes : sids) {
+                LPSTR expected = nullptr;
+                Assert::IsTrue(ConvertSidToStringSidA((PSID)bytes.data(), &expected) != FALSE);
+                std::string windows(expected);
+                LocalFree(expected);
+
+                Assert::AreEqual(windows, sid_string(bytes));
+            }
+        }
+#endif
+
+        TEST_METHOD(format_sid_should_fit_the_longest_sid)
+        {
+            const BYTE authority[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+            auto bytes = make_sid(authority, std::vector<DWORD>(15, 0xFFFFFFFF));
+            Assert::AreEqual(krabs::max_sid_size, bytes.size());
+
+            char buffer[krabs::sid_string_size];
+            auto length = krabs::format_sid(bytes.data(), bytes.size(), buffer, sizeof(buffer));
+            Assert::AreEqual(krabs::sid_string_size - 1, length);
+            Assert::AreEqual(length, strlen(buffer));
+        }
+
+        TEST_METHOD(format_sid_should_reject_invalid_sids_and_small_buffers)
+        {
+            auto bytes = nt_authority({ 21, 1004336348, 1177238915, 682003330, 512 });
+            char buffer[krabs::sid_string_size] = "untouched";
+
+            Assert::AreEqual((size_t)0, krabs::format_sid(bytes.data(), bytes.size() - 1, buffer, sizeof(buffer)));
+            Assert::AreEqual((size_t)0, krabs::format_sid(bytes.data(), bytes.size(), buffer, 10));
+            Assert::AreEqual(std::string("untouched"), std::string(buffer));
+
+            bytes[0] = 2;
+            Assert::AreEqual((size_t)0, krabs::format_sid(bytes.data(), bytes.size(), buffer, sizeof(buffer)));
+
+            Assert::ExpectException<std::runtime_error>([&] {
+                krabs::sid::from_bytes(bytes.data(), bytes.size());
+            });
+        }
+
+        TEST_METHOD(sid_from_bytes_should_match_format_sid)
+        {
+            auto bytes = nt_authority({ 21, 1004336348, 1177238915, 682003330, 512 });
+            auto sid = krabs::sid::from_bytes(bytes.data(), bytes.size());
+            Assert::AreEqual(sid_string(bytes), sid.sid_string);
+
+            krabs::sid_view view(bytes.data(), bytes.size());
+            char buffer[krabs::sid_string_size];
+            Assert::AreEqual(sid.sid_string.size(), view.format(buffer, sizeof(buffer)));
+            Assert::AreEqual(sid.sid_string, std::string(buffer));
+        }
+
+        TEST_METHOD(sid_cache_should_format_each_sid_once)
+        {
+            auto system = nt_authority({ 18 });
+            auto user = nt_authority({ 21, 1004336348, 1177238915, 682003330, 1001 });
+
+            krabs::sid_cache cache;
+            auto first = cache.format(system.data(), system.size());
+            Assert::AreEqual("S-1-5-18", first);
+            Assert::AreEqual("S-1-5-21-1004336348-1177238915-682003330-1001", cache.format(user.data(), user.size()));
+            Assert::IsTrue(first == cache.format(system.data(), system.size()));
+
+            Assert::AreEqual((uint64_t)1, cache.hits());
+            Assert::AreEqual((uint64_t)2, cache.misses());
+        }
+
+        TEST_METHOD(sid_cache_should_evict_colliding_sids)
+        {
+            auto system = nt_authority({ 18 });
+            auto service = nt_authority({ 19 });
+
+            krabs::sid_cache cache(1);
+            Assert::AreEqual("S-1-5-18", cache.format(system.data(), system.size()));
+            Assert::AreEqual("S-1-5-19", cache.format(service.data(), service.size()));
+            Assert::AreEqual("S-1-5-18", cache.format(system.data(), system.size()));
+            Assert::AreEqual((uint64_t)0, cache.hits());
+
+            // Bytes past the SID don't make it a different one.
+            system.push_back(0xCC);
+            Assert::AreEqual("S-1-5-18", cache.format(system.data(), system.size()));
+            Assert::AreEqual((uint64_t)1, cache.hits());
+
+            system[0] = 2;
+            Assert::IsNull(cache.format(system.data(), system.size()));
+        }
+
+        TEST_METHOD(format_ipv4_should_write_dotted_quads)
+        {
+            char buffer[krabs::ipv4_string_size];
+            const BYTE loopback[4] = { 127, 0, 0, 1 };
+            const BYTE broadcast[4] = { 255, 255, 255, 255 };
+
+            Assert::AreEqual((size_t)9, krabs::format_ipv4(loopback, buffer, sizeof(buffer)));
+            Assert::AreEqual(std::string("127.0.0.1"), std::string(buffer));
+            Assert::AreEqual((size_t)15, krabs::format_ipv4(broadcast, buffer, sizeof(buffer)));
+            Assert::AreEqual(std::string("255.255.255.255"), std::string(buffer));
+            Assert::AreEqual((size_t)0, krabs::format_ipv4(broadcast, buffer, 15));
+        }
+
+        TEST_METHOD(format_ipv6_should_follow_rfc_5952)
+        {
+            Assert::AreEqual(std::string("::"), ipv6_string(std::vector<BYTE>(16, 0)));
+            Assert::AreEqual(std::string("::1"),
+                ipv6_string({ 0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0,1 }));
+            Assert::AreEqual(std::string("fe80::"),
+                ipv6_string({ 0xfe,0x80, 0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0,0 }));
+            Assert::AreEqual(std::string("2001:db8::1"),
+                ipv6_string({ 0x20,0x01, 0x0d,0xb8, 0,0, 0,0, 0,0, 0,0, 0,0, 0,1 }));
+
+            // A single zero group is not shortened.
+            Assert::AreEqual(std::string("2001:db8:0:1:1:1:1:1"),
+                ipv6_string({ 0x20,0x01, 0x0d,0xb8, 0,0, 0,1, 0,1, 0,1, 0,1, 0,1 }));
+
+            // The longest run is shortened, the first of equally long ones.
+            Assert::AreEqual(std::string("2001:0:0:1::1"),
+                ipv6_string({ 0x20,0x01, 0,0, 0,0, 0,1, 0,0, 0,0, 0,0, 0,1 }));
+            Assert::AreEqual(std::string("2001:db8::1:0:0:1"),
+                ipv6_string({ 0x20,0x01, 0x0d,0xb8, 0,0, 0,0, 0,1, 0,0, 0,0, 0,1 }));
+
+            Assert::AreEqual(std::string("::ffff:192.0.2.1"),
+                ipv6_string({ 0,0, 0,0, 0,0, 0,0, 0,0, 0xff,0xff, 192,0, 2,1 }));
+        }
+
+        TEST_METHOD(format_ipv6_should_fit_the_longest_address)
+        {
+            std::vector<BYTE> bytes(16, 0xff);
+            Assert::AreEqual(std::string("ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff"), ipv6_string(bytes));
+
+            char buffer[krabs::ipv6_string_size];
+            Assert::AreEqual((size_t)0, krabs::format_ipv6(bytes.data(), buffer, 39));
+        }
+
+        TEST_METHOD(ip_address_should_format_both_families)
+        {
+            char buffer[krabs::ipv6_string_size];
+
+            const BYTE v4[4] = { 10, 1, 2, 3 };
+            DWORD value;
+            memcpy(&value, v4, sizeof(value));
+            auto address = krabs::ip_address::from_ipv4(value);
+            address.format(buffer, sizeof(buffer));
+            Assert::AreEqual(std::string("10.1.2.3"), std::string(buffer));
+
+            const BYTE v6[16] = { 0x20,0x01, 0x0d,0xb8, 0,0, 0,0, 0,0, 0,0, 0,0, 0,2 };
+            address = krabs::ip_address::from_ipv6(v6);
+            address.format(buffer, sizeof(buffer));
+            Assert::AreEqual(std::string("2001:db8::2"), std::string(buffer));
+        }
+
+        TEST_METHOD(socket_address_should_format_address_and_port)
+        {
+            // Windows sockaddr_in and sockaddr_in6 as they appear in events:
+            // the family in machine order, the port and address in network
+            // order.
+            Assert::AreEqual(std::string("192.168.1.20:443"), socket_string({
+                2, 0, 0x01, 0xbb, 192, 168, 1, 20, 0, 0, 0, 0, 0, 0, 0, 0 }));
+
+            Assert::AreEqual(std::string("[fe80::1]:8080"), socket_string({
+                23, 0, 0x1f, 0x90, 0, 0, 0, 0,
+                0xfe,0x80, 0,0, 0,0, 0,0, 0,0, 0,0, 0,0, 0,1,
+                0, 0, 0, 0 }));
+
+            Assert::AreEqual(std::string(""), socket_string({ 1, 0, 0, 0 }));
+        }
+    };
+}
@@ -0,0 +1,184 @@
+﻿// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_owned_record)
+    {
+        static krabs::testing::synth_record init()
+        {
+            krabs::guid powershell(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+            krabs::testing::record_builder builder(powershell, krabs::id(7942), krabs::version(1));
+
+            builder.add_properties()
+                (L"ClassName", L"FakeETWEventForRealz")
+                (L"Message", L"This message is completely faked");
+
+            return builder.pack_incomplete();
+        }
+
+        krabs::testing::synth_record synth = init();
+
+        static bool points_into(const krabs::owned_record &owned, const void *pointer)
+        {
+            auto first = reinterpret_cast<const BYTE*>(&owned.record());
+            auto last = first + krabs::details::copied_record_size(owned.record());
+            auto p = reinterpret_cast<const BYTE*>(pointer);
+            return p >= first && p <= last;
+        }
+
+    public:
+
+        TEST_METHOD(owned_record_should_copy_user_data_and_extended_data)
+        {
+            BYTE userData[] = { 1, 2, 3, 4, 5 };
+            ULONG64 startKey = 0x1122334455667788;
+
+            EVENT_HEADER_EXTENDED_DATA_ITEM item = {};
+            item.ExtType = EVENT_HEADER_EXT_TYPE_PROCESS_START_KEY;
+            item.DataSize = sizeof(startKey);
+            item.DataPtr = reinterpret_cast<ULONG_PTR>(&startKey);
+
+            EVENT_RECORD record = {};
+            record.EventHeader.EventDescriptor.Id = 42;
+            record.UserData = userData;
+            record.UserDataLength = sizeof(userData);
+            record.ExtendedData = &item;
+            record.ExtendedDataCount = 1;
+
+            krabs::owned_record owned(record);
+
+            std::memset(userData, 0, sizeof(userData));
+            startKey = 0;
+            item.DataSize = 0;
+
+            auto &copy = owned.record();
+            Assert::AreEqual((size_t)42, (size_t)copy.EventHeader.EventDescriptor.Id);
+
+            const BYTE expectedUserData[] = { 1, 2, 3, 4, 5 };
+            Assert::AreEqual((size_t)sizeof(expectedUserData), (size_t)copy.UserDataLength);
+            Assert::AreEqual(0, std::memcmp(expectedUserData, copy.UserData, sizeof(expectedUserData)));
+            Assert::IsTrue(points_into(owned, copy.UserData));
+
+            Assert::AreEqual((size_t)1, (size_t)copy.ExtendedDataCount);
+            Assert::AreEqual((size_t)sizeof(ULONG64), (size_t)copy.ExtendedData[0].DataSize);
+            Assert::IsTrue(points_into(owned, copy.ExtendedData));
+
+            auto copiedKey = reinterpret_cast<const ULONG64*>(static_cast<ULONG_PTR>(copy.ExtendedData[0].DataPtr));
+            Assert::IsTrue(points_into(owned, copiedKey));
+            Assert::IsTrue(*copiedKey == 0x1122334455667788);
+        }
+
+        TEST_METHOD(owned_record_should_be_parseable_after_the_source_is_gone)
+        {
+            krabs::record_arena arena;
+            krabs::owned_record owned;
+            Assert::IsTrue(owned.empty());
+
+            {
+                auto local = init();
+                owned = arena.copy(local);
+            }
+
+            Assert::IsFalse(owned.empty());
+
+            krabs::schema_locator locator;
+            krabs::schema schema(owned, locator);
+            krabs::parser parser(schema);
+
+            Assert::AreEqual(std::wstring(L"This message is completely faked"), parser.parse<std::wstring>(L"Message"));
+        }
+
+        TEST_METHOD(owned_record_copies_should_share_the_block)
+        {
+            krabs::record_arena arena;
+            auto first = arena.copy(synth);
+
+            krabs::owned_record second(first);
+            Assert::IsTrue(&first.record() == &second.record());
+
+            krabs::owned_record third(std::move(second));
+            Assert::IsTrue(second.empty());
+            Assert::IsTrue(&first.record() == &third.record());
+        }
+
+        TEST_METHOD(record_arena_should_pack_records_into_one_block)
+        {
+            krabs::record_arena arena(64 * 1024);
+
+            std::vector<krabs::owned_record> records;
+            for (int i = 0; i < 10; ++i) {
+                records.push_back(arena.copy(synth));
+            }
+
+            Assert::AreEqual((size_t)1, arena.blocks_allocated());
+
+            auto size = krabs::details::copied_record_size(synth);
+            auto first = reinterpret_cast<const BYTE*>(&records[0].record());
+            auto second = reinterpret_cast<const BYTE*>(&records[1].record());
+            Assert::IsTrue(second == first + size);
+        }
+
+        TEST_METHOD(record_arena_should_reuse_released_blocks)
+        {
+            const EVENT_RECORD &source = synth;
+            auto size = krabs::details::copied_record_size(source);
+            krabs::record_arena arena(size * 4, 16);
+
+            for (int round = 0; round < 100; ++round) {
+                std::vector<krabs::owned_record> records;
+                for (int i = 0; i < 16; ++i) {
+                    records.push_back(arena.copy(synth));
+                }
+            }
+
+            // Four blocks hold a round, one more is current when the next
+            // round starts.
+            Assert::IsTrue(arena.blocks_allocated() <= 5);
+        }
+
+        TEST_METHOD(record_arena_should_give_large_records_their_own_block)
+        {
+            krabs::record_arena arena(128);
+
+            const EVENT_RECORD &source = synth;
+            Assert::IsTrue(krabs::details::copied_record_size(source) > 128);
+
+            auto owned = arena.copy(synth);
+            Assert::AreEqual((size_t)0, arena.blocks_allocated());
+            Assert::AreEqual(0, std::memcmp(source.UserData, owned.record().UserData, source.UserDataLength));
+        }
+
+        TEST_METHOD(owned_records_should_outlive_their_arena_and_thread)
+        {
+            std::vector<krabs::owned_record> records;
+            {
+                krabs::record_arena arena;
+                for (int i = 0; i < 100; ++i) {
+                    records.push_back(arena.copy(synth));
+                }
+            }
+
+            const EVENT_RECORD &source = synth;
+            std::thread consumer([&] {
+                for (auto &owned : records) {
+                    Assert::AreEqual(0, std::memcmp(source.UserData, owned.record().UserData, source.UserDataLength));
+                }
+                records.clear();
+            });
+            consumer.join();
+
+            Assert::IsTrue(records.empty());
+        }
+    };
+}
@@ -4,10 +4,62 @@
 #include "CppUnitTest.h"
 #include <krabs.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
+// Every allocation of the test binary is counted, so tests can check that a
+// path makes none at all, not just none through a memory_resource.
+namespace {
+    std::atomic<size_t> heap_allocations(0);
+}
+
+void *operator new(size_t size)
+{
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
 namespace krabstests
 {
+    // Forwards to operator new and keeps count of what went through it.
+    class counting_resource : public krabs::memory_resource {
+    public:
+        size_t allocations = 0;
+        size_t bytes_outstanding = 0;
+
+    protected:
+        void *do_allocate(size_t bytes, size_t alignment) override
+        {
+            ++allocations;
+            bytes_outstanding += bytes;
+            return krabs::new_delete_resource().allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void *p, size_t bytes, size_t alignment) override
+        {
+            bytes_outstanding -= bytes;
+            krabs::new_delete_resource().deallocate(p, bytes, alignment);
+        }
+    };
+
     TEST_CLASS(test_parser)
     {
     public:
@@ -27,6 +79,55 @@ namespace krabstests
             Assert::AreEqual((size_t)std::distance(props.begin(), props.end()), (size_t)8);
         }
 
+        TEST_METHOD(property_refs_should_match_the_enumerated_properties)
+        {
+            krabs::guid powershell(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+            krabs::testing::record_builder builder(powershell, krabs::id(7942), krabs::version(1));
+
+            auto record = builder.pack_incomplete();
+            krabs::schema schema(record, schema_locator_);
+            krabs::parser parser(schema);
+
+            auto props = parser.properties();
+            auto refs = parser.property_refs();
+            Assert::AreEqual((size_t)8, refs.size());
+            Assert::AreEqual((size_t)std::distance(props.begin(), props.end()), (size_t)std::distance(refs.begin(), refs.end()));
+
+            auto prop = props.begin();
+            for (const krabs::property_ref &ref : refs) {
+                Assert::AreEqual(prop->name(), std::wstring(ref.name(), ref.name_length()));
+                Assert::AreEqual((int)prop->type(), (int)ref.type());
+                Assert::AreEqual((int)prop->out_type(), (int)ref.out_type());
+                ++prop;
+            }
+        }
+
+        TEST_METHOD(property_refs_should_locate_values_in_the_record)
+        {
+            krabs::guid powershell(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+            krabs::testing::record_builder builder(powershell, krabs::id(7937), krabs::version(1));
+            builder.add_properties()
+                (L"ContextInfo", std::wstring(L"context"))
+                (L"Payload", std::wstring(L"payload"));
+
+            auto record = builder.pack_incomplete();
+            krabs::schema schema(record, schema_locator_);
+            krabs::parser parser(schema);
+
+            const EVENT_RECORD &raw = record;
+            auto begin = static_cast<const BYTE*>(raw.UserData);
+            for (const auto &ref : parser.property_refs()) {
+                Assert::IsTrue(ref.data() >= begin && ref.data() + ref.length() <= begin + raw.UserDataLength);
+
+                if (wcscmp(ref.name(), L"Payload") == 0) {
+                    Assert::AreEqual(std::wstring(L"payload"), parser.parse<std::wstring>(ref));
+                }
+            }
+
+            // Values found while walking are the ones parsing by name returns.
+            Assert::AreEqual(std::wstring(L"context"), parser.parse<std::wstring>(L"ContextInfo"));
+        }
+
 #if NDEBUG
         TEST_METHOD(parse_should_not_throw_when_requesting_wrong_property_type_in_release)
         {
@@ -123,6 +224,78 @@ namespace krabstests
         }
 #endif
 
+        TEST_METHOD(parse_byte_span_should_borrow_field_bytes)
+        {
+            krabs::guid powershell(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+            krabs::testing::record_builder builder(powershell, krabs::id(7937), krabs::version(1));
+            builder.add_properties()(L"ContextInfo", L"Testing");
+
+            auto record = builder.pack_incomplete();
+            krabs::schema schema(record, schema_locator_);
+            krabs::parser parser(schema);
+
+            auto span = parser.parse<krabs::byte_span>(L"ContextInfo");
+            auto copy = parser.parse<krabs::binary>(L"ContextInfo");
+
+            const EVENT_RECORD &raw = record;
+            auto begin = static_cast<const BYTE*>(raw.UserData);
+            Assert::IsTrue(span.data() >= begin && span.end() <= begin + raw.UserDataLength);
+            Assert::AreEqual(copy.bytes().size(), span.size());
+            Assert::IsTrue(std::equal(span.begin(), span.end(), copy.bytes().begin()));
+        }
+
+#ifdef KRABS_HAS_STRING_VIEW
+        TEST_METHOD(parse_string_views_should_point_into_the_record)
+        {
+            krabs::guid powershell(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+            krabs::testing::record_builder builder(powershell, krabs::id(7937), krabs::version(1));
+            builder.add_properties()
+                (L"ContextInfo", std::wstring(L"context"))
+                (L"Payload", std::wstring(L"payload"));
+
+            auto record = builder.pack_incomplete();
+            krabs::schema schema(record, schema_locator_);
+            krabs::parser parser(schema);
+
+            auto payload = parser.parse<std::wstring_view>(L"Payload");
+            Assert::IsTrue(payload == L"payload");
+
+            std::wstring_view context;
+            Assert::IsTrue(parser.try_parse(L"ContextInfo", context));
+            Assert::IsTrue(context == L"context");
+
+            const EVENT_RECORD &raw = record;
+            auto begin = static_cast<const BYTE*>(raw.UserData);
+            auto at = reinterpret_cast<const BYTE*>(context.data());
+            Assert::IsTrue(at >= begin && at < begin + raw.UserDataLength);
+
+            std::wstring_view missing;
+            Assert::IsFalse(parser.try_parse(L"NoSuchProperty", missing));
+        }
+#endif
+
+        TEST_METHOD(view_of_should_take_names_that_are_not_null_terminated)
+        {
+            krabs::guid powershell(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+            krabs::testing::record_builder builder(powershell, krabs::id(7937), krabs::version(1));
+            builder.add_properties()
+                (L"ContextInfo", std::wstring(L"context"))
+                (L"Payload", std::wstring(L"payload"));
+
+            auto record = builder.pack_incomplete();
+            krabs::schema schema(record, schema_locator_);
+            krabs::parser parser(schema);
+            krabs::predicates::adapters::generic_string<wchar_t> adapter;
+
+            // Only the first length characters are the name.
+            const wchar_t names[] = L"PayloadContextInfo";
+            auto view = parser.view_of(names, 7, adapter);
+            Assert::AreEqual(std::wstring(L"payload"), std::wstring(view.begin(), view.end()));
+
+            Assert::ExpectException<std::runtime_error>([&] { parser.view_of(names, 5, adapter); });
+            Assert::ExpectException<std::runtime_error>([&] { parser.view_of(names, _countof(names) - 1, adapter); });
+        }
+
         TEST_METHOD(parse_unicode_string_should_work_when_unicode_string_property_is_last_and_not_null_terminated)
         {
             std::wstring expectedUrl(L"https://www.foo.com/api/v1/health/check");
@@ -163,6 +336,103 @@ namespace krabstests
             Assert::AreEqual(expectedUrl, url);
         }
 
+        TEST_METHOD(parse_should_not_allocate_from_the_resource_when_the_properties_fit_inline)
+        {
+            krabs::guid powershell(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+            krabs::testing::record_builder builder(powershell, krabs::id(7937), krabs::version(1));
+            builder.add_properties()
+                (L"ContextInfo", std::wstring(L"context"))
+                (L"UserData", std::wstring(L"user"))
+                (L"Payload", std::wstring(L"payload"));
+
+            auto record = builder.pack_incomplete();
+            krabs::schema schema(record, schema_locator_);
+
+            counting_resource resource;
+            {
+                krabs::parser parser(schema, resource);
+
+                Assert::AreEqual(std::wstring(L"payload"), parser.parse<std::wstring>(L"Payload"));
+                Assert::AreEqual(std::wstring(L"context"), parser.parse<std::wstring>(L"ContextInfo"));
+
+                krabs::parser copy(parser);
+                Assert::AreEqual(std::wstring(L"user"), copy.parse<std::wstring>(L"UserData"));
+            }
+
+            Assert::AreEqual((size_t)0, resource.allocations);
+        }
+
+        TEST_METHOD(parse_should_not_allocate_when_nothing_is_copied_out)
+        {
+            krabs::guid powershell(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+            krabs::testing::record_builder builder(powershell, krabs::id(7937), krabs::version(1));
+            builder.add_properties()
+                (L"ContextInfo", std::wstring(L"context"))
+                (L"UserData", std::wstring(L"user"))
+                (L"Payload", std::wstring(L"payload"));
+
+            auto record = builder.pack_incomplete();
+            krabs::schema warm(record, schema_locator_);
+
+            // Names are passed as keys or counted strings, a std::wstring of
+            // the name would allocate once it outgrows its inline buffer.
+            const krabs::property_key payload(L"Payload");
+            krabs::predicates::adapters::generic_string<wchar_t> adapter;
+
+            size_t payloadLength = 0;
+            size_t contextLength = 0;
+            size_t userLength = 0;
+
+            auto before = heap_allocations.load();
+            {
+                krabs::schema schema(record, schema_locator_);
+                krabs::parser parser(schema);
+
+                auto payloadView = parser.view_of(payload, adapter);
+                payloadLength = payloadView.end() - payloadView.begin();
+
+                auto contextView = parser.view_of(L"ContextInfo", 11, adapter);
+                contextLength = contextView.end() - contextView.begin();
+
+                auto userView = parser.view_of(L"UserData", 8, adapter);
+                userLength = userView.end() - userView.begin();
+            }
+            auto made = heap_allocations.load() - before;
+
+            Assert::AreEqual((size_t)0, made);
+            Assert::AreEqual((size_t)7, payloadLength);
+            Assert::AreEqual((size_t)7, contextLength);
+            Assert::AreEqual((size_t)4, userLength);
+        }
+
+        TEST_METHOD(schema_locator_should_take_schemas_from_the_given_resource)
+        {
+            krabs::guid powershell(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+            krabs::testing::record_builder builder(powershell, krabs::id(7937), krabs::version(1));
+            auto record = builder.pack_incomplete();
+
+            counting_resource resource;
+            {
+                krabs::schema_locator locator(resource);
+
+                locator.get_event_schema(record);
+                Assert::AreEqual((size_t)1, resource.allocations);
+                Assert::IsTrue(resource.bytes_outstanding >= sizeof(TRACE_EVENT_INFO));
+
+                for (int i = 0; i < 100; ++i) {
+                    krabs::schema schema(record, locator);
+                    krabs::parser parser(schema, resource);
+
+                    std::wstring context;
+                    parser.try_parse(L"ContextInfo", context);
+                }
+
+                Assert::AreEqual((size_t)1, resource.allocations);
+            }
+
+            Assert::AreEqual((size_t)0, resource.bytes_outstanding);
+        }
+
         private:
             krabs::schema_locator schema_locator_;
     };
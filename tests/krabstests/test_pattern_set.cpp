@@ -0,0 +1,276 @@
+﻿// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+#include <bluekrabs/searching/wevt.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <cwchar>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+namespace adpt = krabs::predicates::adapters;
+
+namespace krabstests
+{
+#if !defined(_WIN32)
+
+    // Outside of Windows there are no manifests, the TDH stand-in serves
+    // the PowerShell event the tests build for as long as the fixture lives.
+    class powershell_context_schema {
+    public:
+        powershell_context_schema()
+            : provider_(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}")
+        {
+            EVENT_DESCRIPTOR descriptor;
+            memset(&descriptor, 0, sizeof(descriptor));
+            descriptor.Id = 7937;
+            descriptor.Version = 1;
+
+            schema_ = krabs::details::build_trace_event_info(
+                provider_, descriptor, L"Microsoft-Windows-PowerShell", L"", L"", L"", {
+                    { L"ContextInfo", 0, TDH_INTYPE_UNICODESTRING, TDH_OUTTYPE_STRING, 1, 0, 0, 0 },
+                    { L"UserData", 0, TDH_INTYPE_UNICODESTRING, TDH_OUTTYPE_STRING, 1, 0, 0, 0 },
+                    { L"Payload", 0, TDH_INTYPE_UNICODESTRING, TDH_OUTTYPE_STRING, 1, 0, 0, 0 },
+                });
+
+            krabs::portability::set_schema_source(*this);
+        }
+
+        ~powershell_context_schema()
+        {
+            krabs::portability::clear_schema_source();
+        }
+
+        powershell_context_schema(const powershell_context_schema &) = delete;
+        powershell_context_schema &operator=(const powershell_context_schema &) = delete;
+
+        size_t get_event_schema(const EVENT_RECORD &record, void *buffer, size_t size) const
+        {
+            if (record.EventHeader.ProviderId != provider_ ||
+                record.EventHeader.EventDescriptor.Id != 7937) {
+                return 0;
+            }
+
+            if (size >= schema_.size()) {
+                memcpy(buffer, schema_.data(), schema_.size());
+            }
+
+            return schema_.size();
+        }
+
+    private:
+        krabs::guid provider_;
+        std::vector<BYTE> schema_;
+    };
+
+#endif
+
+    TEST_CLASS(test_pattern_set)
+    {
+#if !defined(_WIN32)
+        powershell_context_schema schema;
+#endif
+
+        static krabs::testing::synth_record init()
+        {
+            krabs::guid powershell(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+            krabs::testing::record_builder builder(powershell, krabs::id(7937), krabs::version(1));
+            builder.add_properties()(L"UserData", L">this counted string is 31 characters long, but the null character comes a lot after");
+            builder.add_properties()(L"ContextInfo", L"powershell.exe -NoProfile -EncodedCommand SQBFAFgA");
+            return builder.pack_incomplete();
+        }
+
+        krabs::testing::synth_record record = init();
+
+        krabs::trace_context trace_context;
+
+        std::vector<size_t> find_all(const krabs::predicates::pattern_set &patterns, const std::wstring &input) const
+        {
+            return patterns.find_all(input.begin(), input.end());
+        }
+
+        // What the automaton should report, one pattern at a time.
+        std::vector<size_t> brute_force(
+            const std::vector<std::wstring> &patterns,
+            const std::wstring &input,
+            bool case_insensitive) const
+        {
+            using namespace krabs::predicates::comparers;
+
+            std::vector<size_t> ids;
+            for (size_t id = 0; id < patterns.size(); ++id) {
+                auto &pattern = patterns[id];
+                auto found = case_insensitive
+                    ? contains<iequal_to<wchar_t>>()(input.begin(), input.end(), pattern.begin(), pattern.end())
+                    : contains<std::equal_to<wchar_t>>()(input.begin(), input.end(), pattern.begin(), pattern.end());
+
+                if (found) {
+                    ids.push_back(id);
+                }
+            }
+
+            return ids;
+        }
+
+    public:
+        TEST_METHOD(should_report_overlapping_patterns)
+        {
+            krabs::predicates::pattern_set patterns({ L"he", L"she", L"his", L"hers" });
+
+            auto ids = find_all(patterns, L"ushers");
+            Assert::IsTrue(ids == std::vector<size_t>({ 0, 1, 3 }));
+
+            ids = find_all(patterns, L"this");
+            Assert::IsTrue(ids == std::vector<size_t>({ 2 }));
+
+            const std::wstring upper(L"HERS");
+            Assert::IsFalse(patterns.contains_any(upper.begin(), upper.end()));
+        }
+
+        TEST_METHOD(should_ignore_case_when_asked_to)
+        {
+            krabs::predicates::pattern_set patterns({ L"-EncodedCommand", L"downloadstring" }, true);
+
+            auto ids = find_all(patterns, L"powershell -encodedcommand AAAA; (New-Object Net.WebClient).DownloadString(x)");
+            Assert::IsTrue(ids == std::vector<size_t>({ 0, 1 }));
+            Assert::IsTrue(patterns.case_insensitive());
+        }
+
+        TEST_METHOD(should_match_empty_pattern_everywhere)
+        {
+            krabs::predicates::pattern_set patterns({ L"abc", L"" });
+
+            std::wstring empty;
+            Assert::IsTrue(patterns.contains_any(empty.begin(), empty.end()));
+            Assert::IsTrue(find_all(patterns, L"") == std::vector<size_t>({ 1 }));
+            Assert::IsTrue(find_all(patterns, L"xabcx") == std::vector<size_t>({ 0, 1 }));
+        }
+
+        TEST_METHOD(should_match_nothing_without_patterns)
+        {
+            krabs::predicates::pattern_set patterns({});
+
+            Assert::AreEqual((size_t)0, patterns.size());
+            Assert::IsTrue(find_all(patterns, L"anything").empty());
+        }
+
+        TEST_METHOD(should_throw_for_more_distinct_characters_than_classes)
+        {
+            // Every 16 bit character takes its own class, one more than fits
+            // next to the class of characters in no pattern.
+            std::wstring pattern;
+            for (uint32_t c = 0; c <= 0xFFFF; ++c) {
+                pattern.push_back(static_cast<wchar_t>(c));
+            }
+
+            Assert::ExpectException<std::length_error>([&] {
+                krabs::predicates::pattern_set patterns({ pattern });
+            });
+        }
+
+        TEST_METHOD(should_not_mistake_characters_beyond_the_bmp_for_ascii)
+        {
+            krabs::predicates::pattern_set exact({ L"a", L"\x00e9" });
+            krabs::predicates::pattern_set folded({ L"a", L"\x00e9" }, true);
+
+            // U+10061, whose low 16 bits are 'a', in the encoding of wchar_t.
+#if WCHAR_MAX > 0xFFFF
+            const std::wstring input(1, static_cast<wchar_t>(0x10061));
+#else
+            const std::wstring input(L"\xD800\xDC61");
+#endif
+            Assert::IsTrue(find_all(exact, input).empty());
+            Assert::IsTrue(find_all(folded, input).empty());
+            Assert::IsTrue(find_all(folded, L"x" + input + L"A") == std::vector<size_t>({ 0 }));
+        }
+
+        TEST_METHOD(should_agree_with_contains_for_every_pattern)
+        {
+            std::mt19937 random(11);
+            static const wchar_t alphabet[] = L"abAB\x00e9\x00c9\x0101";
+            std::uniform_int_distribution<size_t> pick(0, _countof(alphabet) - 2);
+            std::uniform_int_distribution<size_t> length(1, 5);
+
+            auto make_string = [&](size_t size) {
+                std::wstring string;
+                for (size_t i = 0; i < size; ++i) {
+                    string.push_back(alphabet[pick(random)]);
+                }
+                return string;
+            };
+
+            for (int round = 0; round < 50; ++round) {
+                std::vector<std::wstring> list;
+                for (int i = 0; i < 20; ++i) {
+                    list.push_back(make_string(length(random)));
+                }
+
+                krabs::predicates::pattern_set exact(list, false);
+                krabs::predicates::pattern_set folded(list, true);
+
+                for (int i = 0; i < 20; ++i) {
+                    auto input = make_string(i * 3);
+                    Assert::IsTrue(brute_force(list, input, false) == find_all(exact, input));
+                    Assert::IsTrue(brute_force(list, input, true) == find_all(folded, input));
+                }
+            }
+        }
+
+        TEST_METHOD(property_contains_any_should_match_properties_with_any_pattern)
+        {
+            auto filter = krabs::predicates::property_contains_any(
+                L"ContextInfo", { L"DownloadString", L"-EncodedCommand", L"Invoke-Expression" });
+            Assert::IsTrue(filter(record, trace_context));
+        }
+
+        TEST_METHOD(property_contains_any_should_not_match_properties_without_any_pattern)
+        {
+            auto filter = krabs::predicates::property_contains_any(
+                L"ContextInfo", { L"DownloadString", L"-encodedcommand", L"Invoke-Expression" });
+            Assert::IsFalse(filter(record, trace_context));
+        }
+
+        TEST_METHOD(property_contains_any_should_ignore_case_when_asked_to)
+        {
+            auto filter = krabs::predicates::property_contains_any(
+                L"ContextInfo", { L"DownloadString", L"-encodedcommand" }, true);
+            Assert::IsTrue(filter(record, trace_context));
+        }
+
+        TEST_METHOD(property_contains_any_should_not_match_missing_properties)
+        {
+            auto filter = krabs::predicates::property_contains_any(L"NotAProperty", { L"" });
+            Assert::IsFalse(filter(record, trace_context));
+        }
+
+// Reading a string property as a counted string takes 16 bit characters.
+#if WCHAR_MAX <= 0xFFFF
+        TEST_METHOD(property_contains_any_should_stop_at_counted_string_end)
+        {
+            // Only the first 31 characters of UserData are part of the string.
+            auto past_end = krabs::predicates::property_contains_any<adpt::counted_string>(
+                L"UserData", { L"charac", L"long" });
+            Assert::IsFalse(past_end(record, trace_context));
+
+            auto at_end = krabs::predicates::property_contains_any<adpt::counted_string>(
+                L"UserData", { L"chara", L"long" });
+            Assert::IsTrue(at_end(record, trace_context));
+        }
+#endif
+
+        TEST_METHOD(property_contains_any_should_report_matched_pattern_ids)
+        {
+            auto filter = krabs::predicates::property_contains_any(
+                L"ContextInfo", { L"iex", L"-noprofile", L"powershell", L"-encodedcommand" }, true);
+
+            krabs::event_context context(record, trace_context);
+            Assert::IsTrue(filter.matched_patterns(context) == std::vector<size_t>({ 1, 2, 3 }));
+        }
+    };
+}
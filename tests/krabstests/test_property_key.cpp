@@ -0,0 +1,85 @@
+﻿// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_property_key)
+    {
+        krabs::schema_locator schema_locator_;
+
+        krabs::testing::synth_record make_record() const
+        {
+            krabs::guid powershell(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+            krabs::testing::record_builder builder(powershell, krabs::id(7942), krabs::version(1));
+
+            builder.add_properties()
+                (L"ClassName", L"FClassName")
+                (L"Message", L"Fake message");
+
+            return builder.pack_incomplete();
+        }
+
+    public:
+
+        TEST_METHOD(should_give_equal_names_the_same_id)
+        {
+            krabs::property_key first(L"ContextInfo");
+            krabs::property_key second(std::wstring(L"ContextInfo"));
+
+            Assert::AreEqual(first.id(), second.id());
+            Assert::AreEqual(std::wstring(L"ContextInfo"), second.name());
+        }
+
+        TEST_METHOD(should_give_different_names_different_ids)
+        {
+            krabs::property_key first(L"ContextInfo");
+            krabs::property_key second(L"contextinfo");
+
+            Assert::AreNotEqual(first.id(), second.id());
+        }
+
+        TEST_METHOD(parse_should_find_property_by_key)
+        {
+            auto record = make_record();
+            krabs::schema schema(record, schema_locator_);
+            krabs::parser parser(schema);
+
+            const krabs::property_key message(L"Message");
+            const krabs::property_key class_name(L"ClassName");
+
+            // Out of schema order, to go through the cached and walked paths.
+            Assert::AreEqual(std::wstring(L"Fake message"), parser.parse<std::wstring>(message));
+            Assert::AreEqual(std::wstring(L"FClassName"), parser.parse<std::wstring>(class_name));
+            Assert::AreEqual(parser.parse<std::wstring>(L"Message"), parser.parse<std::wstring>(message));
+        }
+
+        TEST_METHOD(try_parse_should_return_false_for_unknown_key)
+        {
+            auto record = make_record();
+            krabs::schema schema(record, schema_locator_);
+            krabs::parser parser(schema);
+
+            std::wstring result;
+            Assert::IsFalse(parser.try_parse(krabs::property_key(L"NotAProperty"), result));
+            Assert::IsTrue(parser.try_parse(krabs::property_key(L"ClassName"), result));
+            Assert::AreEqual(std::wstring(L"FClassName"), result);
+        }
+
+        TEST_METHOD(property_is_should_match_by_key)
+        {
+            auto record = make_record();
+            krabs::trace_context context;
+
+            auto filter = krabs::predicates::property_is(L"ClassName", std::wstring(L"FClassName"));
+            auto mismatch = krabs::predicates::property_is(L"ClassName", std::wstring(L"Other"));
+
+            Assert::IsTrue(filter(record, context));
+            Assert::IsFalse(mismatch(record, context));
+        }
+    };
+}
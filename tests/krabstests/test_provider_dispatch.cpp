@@ -0,0 +1,187 @@
+﻿// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    // The default callback of a trace is a plain function pointer.
+    static int default_count = 0;
+
+    TEST_CLASS(test_provider_dispatch)
+    {
+        // Microsoft-Windows-PowerShell, its schema is available on every box.
+        const krabs::guid powershell = krabs::guid(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+
+        krabs::testing::synth_record make_record() const
+        {
+            krabs::testing::record_builder builder(powershell, krabs::id(7942), krabs::version(1));
+            builder.add_properties()
+                (L"ClassName", L"FakeETWEventForRealz")
+                (L"Message", L"This message is completely faked");
+
+            return builder.pack_incomplete();
+        }
+
+        // Enables `count` providers with random GUIDs followed by the
+        // PowerShell provider so that it is the last one in the trace.
+        static std::deque<krabs::provider<>> make_providers(size_t count)
+        {
+            std::deque<krabs::provider<>> providers;
+            for (size_t i = 0; i < count; ++i) {
+                providers.emplace_back(krabs::guid::random_guid());
+            }
+
+            return providers;
+        }
+
+    public:
+
+        TEST_METHOD(should_route_event_to_provider_enabled_last)
+        {
+            krabs::user_trace trace;
+            auto others = make_providers(64);
+            for (auto &p : others) {
+                p.add_on_event_callback([](const EVENT_RECORD &, const krabs::trace_context &) {
+                    Assert::Fail(L"event routed to the wrong provider");
+                });
+                trace.enable(p);
+            }
+
+            int count = 0;
+            krabs::provider<> provider(powershell);
+            provider.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) {
+                ++count;
+            });
+            trace.enable(provider);
+
+            krabs::testing::user_trace_proxy proxy(trace);
+            proxy.start();
+            proxy.push_event(make_record());
+
+            Assert::AreEqual(1, count);
+        }
+
+        TEST_METHOD(should_stop_routing_after_disable)
+        {
+            krabs::user_trace trace;
+
+            int provider_count = 0;
+            krabs::provider<> provider(powershell);
+            provider.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) {
+                ++provider_count;
+            });
+
+            default_count = 0;
+            trace.set_default_event_callback([](const EVENT_RECORD &, const krabs::trace_context &) {
+                ++default_count;
+            });
+
+            trace.enable(provider);
+
+            krabs::testing::user_trace_proxy proxy(trace);
+            proxy.start();
+
+            auto record = make_record();
+            proxy.push_event(record);
+            trace.disable(provider);
+            proxy.push_event(record);
+
+            Assert::AreEqual(1, provider_count);
+            Assert::AreEqual(1, default_count);
+        }
+
+        TEST_METHOD(should_replace_provider_enabled_twice_for_same_guid)
+        {
+            krabs::user_trace trace;
+
+            int first_count = 0;
+            krabs::provider<> first(powershell);
+            first.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) {
+                ++first_count;
+            });
+
+            int second_count = 0;
+            krabs::provider<> second(powershell);
+            second.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) {
+                ++second_count;
+            });
+
+            trace.enable(first);
+            trace.enable(second);
+
+            krabs::testing::user_trace_proxy proxy(trace);
+            proxy.start();
+            proxy.push_event(make_record());
+
+            Assert::AreEqual(0, first_count);
+            Assert::AreEqual(1, second_count);
+        }
+
+        TEST_METHOD(should_only_forward_events_to_filters_that_asked_for_their_id)
+        {
+            krabs::user_trace trace;
+            krabs::provider<> provider(powershell);
+
+            std::vector<int> calls;
+            krabs::event_filter other_id((unsigned short)7937);
+            other_id.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) { calls.push_back(1); });
+
+            krabs::event_filter all_ids(krabs::predicates::any_event);
+            all_ids.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) { calls.push_back(2); });
+
+            krabs::event_filter this_id(std::vector<unsigned short>{ 7937, 7942 });
+            this_id.add_on_event_callback([&](const EVENT_RECORD &, const krabs::trace_context &) { calls.push_back(3); });
+
+            provider.add_filter(other_id);
+            provider.add_filter(all_ids);
+            provider.add_filter(this_id);
+            trace.enable(provider);
+
+            krabs::testing::user_trace_proxy proxy(trace);
+            proxy.start();
+            proxy.push_event(make_record());
+
+            Assert::AreEqual((size_t)2, calls.size());
+            Assert::AreEqual(2, calls[0]);
+            Assert::AreEqual(3, calls[1]);
+        }
+
+        TEST_METHOD(event_id_table_should_keep_filters_in_the_order_they_were_added)
+        {
+            krabs::details::event_id_dispatch_table table;
+            table.add({ 5 });
+            table.add({});
+            table.add({ 5, 6, 5 });
+            table.add({});
+
+            Assert::IsTrue(std::vector<size_t>{ 0, 1, 2, 3 } == table.find(5));
+            Assert::IsTrue(std::vector<size_t>{ 1, 2, 3 } == table.find(6));
+            Assert::IsTrue(std::vector<size_t>{ 1, 3 } == table.find(7));
+        }
+
+        TEST_METHOD(dispatcher_should_free_replaced_tables_once_the_event_thread_is_quiet)
+        {
+            krabs::provider<> provider(powershell);
+            std::deque<std::reference_wrapper<const krabs::provider<>>> enabled;
+            enabled.push_back(std::cref(provider));
+
+            krabs::details::provider_dispatcher<krabs::provider<>> dispatcher;
+            dispatcher.rebuild(enabled);
+            dispatcher.rebuild(enabled);
+            dispatcher.rebuild(enabled);
+            Assert::AreEqual((size_t)2, dispatcher.retired_count());
+
+            // Only the table replaced after the quiet point is kept.
+            dispatcher.quiesce();
+            dispatcher.rebuild(enabled);
+            Assert::AreEqual((size_t)1, dispatcher.retired_count());
+            Assert::IsTrue(dispatcher.find(powershell) == &provider);
+        }
+    };
+}
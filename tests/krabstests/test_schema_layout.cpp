@@ -0,0 +1,182 @@
+﻿// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+#include <memory>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    TEST_CLASS(test_schema_layout)
+    {
+        struct property_spec {
+            _TDH_IN_TYPE in_type;
+            USHORT length;
+            USHORT flags;
+            USHORT count = 1;
+        };
+
+        // Lays out a TRACE_EVENT_INFO with the given properties, the way
+        // TDH would hand it back. Only the fields the layout reads are set.
+        std::unique_ptr<char[]> make_schema(const std::vector<property_spec> &specs) const
+        {
+            auto size = sizeof(TRACE_EVENT_INFO) + specs.size() * sizeof(EVENT_PROPERTY_INFO);
+            std::unique_ptr<char[]> buffer(new char[size]());
+
+            auto info = (TRACE_EVENT_INFO *)buffer.get();
+            info->PropertyCount = (ULONG)specs.size();
+            info->TopLevelPropertyCount = (ULONG)specs.size();
+
+            for (size_t i = 0; i < specs.size(); ++i) {
+                auto &property = info->EventPropertyInfoArray[i];
+                property.Flags = (PROPERTY_FLAGS)specs[i].flags;
+                property.nonStructType.InType = (USHORT)specs[i].in_type;
+                property.length = specs[i].length;
+                property.count = specs[i].count;
+            }
+
+            return buffer;
+        }
+
+    public:
+
+        TEST_METHOD(should_stop_fixed_prefix_at_first_variable_length_property)
+        {
+            auto buffer = make_schema({
+                { TDH_INTYPE_UINT32, 4, 0 },
+                { TDH_INTYPE_UINT64, 8, 0 },
+                { TDH_INTYPE_UNICODESTRING, 0, 0 },
+                { TDH_INTYPE_UINT16, 2, 0 },
+            });
+
+            krabs::details::schema_layout layout(*(TRACE_EVENT_INFO *)buffer.get());
+
+            Assert::AreEqual((ULONG)2, layout.fixed_count());
+            Assert::AreEqual((ULONG)0, layout.offset(0, false));
+            Assert::AreEqual((ULONG)4, layout.offset(1, false));
+            Assert::AreEqual((ULONG)8, layout.length(1, false));
+            Assert::AreEqual((ULONG)12, layout.offset(2, false));
+        }
+
+        TEST_METHOD(should_size_pointers_by_the_bitness_of_the_event)
+        {
+            auto buffer = make_schema({
+                { TDH_INTYPE_POINTER, 8, 0 },
+                { TDH_INTYPE_UINT32, 4, 0 },
+            });
+
+            krabs::details::schema_layout layout(*(TRACE_EVENT_INFO *)buffer.get());
+
+            Assert::AreEqual((ULONG)2, layout.fixed_count());
+            Assert::AreEqual((ULONG)4, layout.offset(1, true));
+            Assert::AreEqual((ULONG)8, layout.offset(1, false));
+            Assert::AreEqual((ULONG)8, layout.offset(2, true));
+            Assert::AreEqual((ULONG)12, layout.offset(2, false));
+        }
+
+        TEST_METHOD(should_treat_length_from_another_property_as_variable)
+        {
+            auto buffer = make_schema({
+                { TDH_INTYPE_UINT32, 4, 0 },
+                { TDH_INTYPE_BINARY, 0, PropertyParamLength },
+            });
+
+            krabs::details::schema_layout layout(*(TRACE_EVENT_INFO *)buffer.get());
+
+            Assert::AreEqual((ULONG)1, layout.fixed_count());
+            Assert::AreEqual((ULONG)4, layout.offset(1, false));
+        }
+
+        TEST_METHOD(should_cover_every_property_when_all_are_fixed)
+        {
+            auto buffer = make_schema({
+                { TDH_INTYPE_UINT8, 1, 0 },
+                { TDH_INTYPE_GUID, 16, 0 },
+                { TDH_INTYPE_UINT16, 2, 0 },
+            });
+
+            krabs::details::schema_layout layout(*(TRACE_EVENT_INFO *)buffer.get());
+
+            Assert::AreEqual((ULONG)3, layout.fixed_count());
+            Assert::AreEqual((ULONG)19, layout.offset(3, false));
+        }
+
+        TEST_METHOD(should_size_fixed_count_arrays_by_all_their_elements)
+        {
+            // The length of an array property is that of one element.
+            auto buffer = make_schema({
+                { TDH_INTYPE_UINT16, 2, PropertyParamFixedCount, 4 },
+                { TDH_INTYPE_UINT32, 4, 0, 3 },
+                { TDH_INTYPE_POINTER, 8, PropertyParamFixedCount, 2 },
+                { TDH_INTYPE_UINT8, 1, PropertyParamFixedCount, 0 },
+                { TDH_INTYPE_UINT32, 4, 0 },
+            });
+
+            krabs::details::schema_layout layout(*(TRACE_EVENT_INFO *)buffer.get());
+
+            Assert::AreEqual((ULONG)5, layout.fixed_count());
+            Assert::AreEqual((ULONG)8, layout.length(0, false));
+            Assert::AreEqual((ULONG)12, layout.length(1, false));
+            Assert::AreEqual((ULONG)8, layout.length(2, true));
+            Assert::AreEqual((ULONG)16, layout.length(2, false));
+            Assert::AreEqual((ULONG)0, layout.length(3, false));
+            Assert::AreEqual((ULONG)36, layout.offset(4, false));
+        }
+
+        TEST_METHOD(should_pick_a_size_rule_for_every_property)
+        {
+            auto buffer = make_schema({
+                { TDH_INTYPE_POINTER, 8, 0 },
+                { TDH_INTYPE_UNICODESTRING, 0, 0 },
+                { TDH_INTYPE_ANSISTRING, 0, 0 },
+                { TDH_INTYPE_SID, 0, 0 },
+                { TDH_INTYPE_UINT16, 2, 0 },
+                { TDH_INTYPE_BINARY, 4, PropertyParamLength },
+                { TDH_INTYPE_UINT32, 4, PropertyParamCount },
+                { TDH_INTYPE_WBEMSID, 0, 0 },
+                { TDH_INTYPE_UNICODESTRING, 4, PropertyParamLength },
+                { TDH_INTYPE_ANSISTRING, 4, PropertyParamLength },
+            });
+
+            krabs::details::schema_layout layout(*(TRACE_EVENT_INFO *)buffer.get());
+
+            Assert::IsTrue(layout.size_rule_at(0).kind == krabs::size_rule::pointer);
+            Assert::IsTrue(layout.size_rule_at(1).kind == krabs::size_rule::null_terminated_utf16);
+            Assert::IsTrue(layout.size_rule_at(2).kind == krabs::size_rule::null_terminated_ansi);
+            Assert::IsTrue(layout.size_rule_at(3).kind == krabs::size_rule::sid);
+            Assert::IsTrue(layout.size_rule_at(4).kind == krabs::size_rule::fixed);
+            Assert::AreEqual((ULONG)2, layout.size_rule_at(4).value);
+
+            // The length is the index of the property holding it.
+            Assert::IsTrue(layout.size_rule_at(5).kind == krabs::size_rule::length_from_property);
+            Assert::AreEqual((ULONG)4, layout.size_rule_at(5).value);
+
+            Assert::IsTrue(layout.size_rule_at(6).kind == krabs::size_rule::array);
+            Assert::IsTrue(layout.size_rule_at(6).element == krabs::size_rule::fixed);
+            Assert::IsTrue(layout.size_rule_at(7).kind == krabs::size_rule::tdh);
+
+            // Wide strings count their length in characters, ANSI strings
+            // in bytes like any other property.
+            Assert::IsTrue(layout.size_rule_at(8).kind == krabs::size_rule::length_from_property_utf16);
+            Assert::AreEqual((ULONG)4, layout.size_rule_at(8).value);
+            Assert::IsTrue(layout.size_rule_at(9).kind == krabs::size_rule::length_from_property);
+            Assert::AreEqual((ULONG)4, layout.size_rule_at(9).value);
+
+            Assert::AreEqual((uint64_t)0, layout.tdh_size_lookups());
+        }
+
+        TEST_METHOD(should_have_empty_prefix_for_schema_without_properties)
+        {
+            auto buffer = make_schema({});
+
+            krabs::details::schema_layout layout(*(TRACE_EVENT_INFO *)buffer.get());
+
+            Assert::AreEqual((ULONG)0, layout.fixed_count());
+            Assert::AreEqual((ULONG)0, layout.offset(0, false));
+        }
+    };
+}
@@ -0,0 +1,325 @@
+﻿// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+#include "structured_schema_source.hpp"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    // Learns about a larger schema for the event between being asked for
+    // its size and being asked for a copy, like a manifest being reloaded.
+    class growing_schema_source : public krabs::schema_source {
+    public:
+        explicit growing_schema_source(const krabs::schema_source &source)
+            : source_(source)
+            , calls_(0)
+        {
+        }
+
+        size_t get_event_schema(const EVENT_RECORD &record, void *buffer, size_t size) const override
+        {
+            if (calls_++ == 0) {
+                return source_.get_event_schema(record, buffer, size);
+            }
+
+            return source_.get_event_schema(record, nullptr, 0) + 8;
+        }
+
+    private:
+        const krabs::schema_source &source_;
+        mutable int calls_;
+    };
+
+    TEST_CLASS(test_schema_locator)
+    {
+        // Microsoft-Windows-PowerShell, its schema is available on every box.
+        const krabs::guid powershell = krabs::guid(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+
+        // A provider TDH does not know, served by structured_schema_source.
+        const krabs::guid structured = krabs::guid(L"{3E5A7C91-2B4D-4F60-8A1C-9D7E6B5F4A32}");
+
+        // TDH resolves manifest events by id and version, so varying the
+        // level gives distinct cache keys that all have a schema.
+        krabs::testing::synth_record make_record(size_t level = 0) const
+        {
+            krabs::testing::record_builder builder(powershell, krabs::id(7942), krabs::version(1), krabs::opcode(0), level);
+            return builder.pack_incomplete();
+        }
+
+    public:
+
+        TEST_METHOD(should_count_first_lookup_as_miss_and_tdh_lookup)
+        {
+            krabs::schema_locator locator;
+            auto record = make_record();
+
+            locator.get_event_schema(record);
+
+            auto stats = locator.stats();
+            Assert::AreEqual((uint64_t)0, stats.hits);
+            Assert::AreEqual((uint64_t)1, stats.misses);
+            Assert::AreEqual((uint64_t)1, stats.tdh_lookups);
+        }
+
+        TEST_METHOD(should_serve_repeated_lookups_from_cache)
+        {
+            krabs::schema_locator locator;
+            auto record = make_record();
+
+            auto first = locator.get_event_schema(record);
+            auto second = locator.get_event_schema(record);
+
+            Assert::IsTrue(first == second);
+
+            auto stats = locator.stats();
+            Assert::AreEqual((uint64_t)1, stats.hits);
+            Assert::AreEqual((uint64_t)1, stats.misses);
+            Assert::AreEqual((uint64_t)1, stats.tdh_lookups);
+        }
+
+        TEST_METHOD(should_keep_schemas_when_the_cache_grows)
+        {
+            krabs::schema_locator locator;
+
+            std::vector<krabs::testing::synth_record> records;
+            std::vector<PTRACE_EVENT_INFO> schemas;
+            for (size_t level = 0; level < 200; ++level) {
+                records.push_back(make_record(level));
+                schemas.push_back(locator.get_event_schema(records.back()));
+            }
+
+            for (size_t level = 0; level < 200; ++level) {
+                Assert::IsTrue(schemas[level] == locator.get_event_schema(records[level]));
+            }
+
+            auto stats = locator.stats();
+            Assert::AreEqual((uint64_t)200, stats.hits);
+            Assert::AreEqual((uint64_t)200, stats.misses);
+        }
+
+        TEST_METHOD(should_allow_concurrent_lookups)
+        {
+            krabs::schema_locator locator;
+
+            std::vector<krabs::testing::synth_record> records;
+            for (size_t level = 0; level < 8; ++level) {
+                records.push_back(make_record(level));
+            }
+
+            const size_t thread_count = 4;
+            const size_t lookups = 10000;
+
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < thread_count; ++t) {
+                threads.emplace_back([&]() {
+                    for (size_t i = 0; i < lookups; ++i) {
+                        locator.get_event_schema(records[i % records.size()]);
+                    }
+                });
+            }
+
+            for (auto &thread : threads) {
+                thread.join();
+            }
+
+            auto stats = locator.stats();
+            Assert::AreEqual((uint64_t)(thread_count * lookups), stats.hits + stats.misses);
+            Assert::IsTrue(stats.misses >= records.size());
+            Assert::IsTrue(stats.misses <= records.size() * thread_count);
+        }
+
+        TEST_METHOD(should_not_share_recent_schemas_between_locators)
+        {
+            auto record = make_record();
+
+            krabs::schema_locator first;
+            first.get_event_schema(record);
+
+            // The same thread just looked this record up through another
+            // locator, this one still has to fetch and own its schema.
+            krabs::schema_locator second;
+            second.get_event_schema(record);
+
+            Assert::AreEqual((uint64_t)1, second.stats().misses);
+            Assert::IsTrue(first.get_event_schema(record) != second.get_event_schema(record));
+        }
+
+        TEST_METHOD(should_tell_apart_interleaved_records)
+        {
+            krabs::schema_locator locator;
+
+            // More distinct records than a thread keeps recent schemas for.
+            std::vector<krabs::testing::synth_record> records;
+            std::vector<PTRACE_EVENT_INFO> schemas;
+            for (size_t level = 0; level < 6; ++level) {
+                records.push_back(make_record(level));
+                schemas.push_back(locator.get_event_schema(records.back()));
+            }
+
+            for (size_t i = 0; i < 100; ++i) {
+                auto index = (i * 7) % records.size();
+                Assert::IsTrue(schemas[index] == locator.get_event_schema(records[index]));
+            }
+
+            Assert::AreEqual((uint64_t)records.size(), locator.stats().misses);
+        }
+
+        TEST_METHOD(should_count_recent_schema_hits_of_every_thread)
+        {
+            // More locators than a thread keeps hit counters for, so the
+            // counters are looked up again while the threads run.
+            structured_schema_source source(structured);
+            std::vector<std::unique_ptr<krabs::schema_locator>> locators;
+            for (size_t i = 0; i < 6; ++i) {
+                locators.emplace_back(new krabs::schema_locator(source));
+            }
+
+            auto record = make_structured_record(structured);
+            const size_t thread_count = 4;
+            const size_t lookups = 1000;
+
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < thread_count; ++t) {
+                threads.emplace_back([&]() {
+                    for (size_t i = 0; i < lookups; ++i) {
+                        for (auto &locator : locators) {
+                            locator->get_event_schema(record);
+                        }
+                    }
+                });
+            }
+
+            for (auto &thread : threads) {
+                thread.join();
+            }
+
+            for (auto &locator : locators) {
+                auto stats = locator->stats();
+                Assert::AreEqual((uint64_t)(thread_count * lookups), stats.hits + stats.misses);
+            }
+
+            // Once the schema is known every lookup is a hit, and is counted
+            // as soon as it happens.
+            auto &last = *locators.back();
+            auto before = last.stats().hits;
+            for (size_t i = 0; i < lookups; ++i) {
+                last.get_event_schema(record);
+            }
+            Assert::AreEqual(before + lookups, last.stats().hits);
+        }
+
+        TEST_METHOD(should_fall_back_to_tdh_when_the_source_changes_between_calls)
+        {
+            structured_schema_source schemas(structured);
+            growing_schema_source source(schemas);
+            krabs::schema_locator locator(source);
+            auto record = make_structured_record(structured);
+
+            // The unfilled buffer is dropped, and TDH does not know the
+            // test provider either.
+            Assert::ExpectException<krabs::could_not_find_schema>([&] { locator.get_event_schema(record); });
+            Assert::AreEqual((uint64_t)1, locator.stats().tdh_lookups);
+        }
+
+        TEST_METHOD(should_expose_schema_stats_on_trace_context)
+        {
+            krabs::user_trace trace;
+            krabs::provider<> provider(powershell);
+
+            uint64_t hits = 0;
+            provider.add_on_event_callback([&](const EVENT_RECORD &record, const krabs::trace_context &trace_context) {
+                krabs::schema schema(record, trace_context.schema_locator);
+                hits = trace_context.schema_stats().hits;
+            });
+            trace.enable(provider);
+
+            krabs::testing::user_trace_proxy proxy(trace);
+            proxy.start();
+
+            auto record = make_record();
+            proxy.push_event(record);
+            proxy.push_event(record);
+
+            Assert::AreEqual((uint64_t)1, hits);
+        }
+
+        TEST_METHOD(should_serve_saved_schemas_without_tdh)
+        {
+            auto record = make_record();
+
+            krabs::schema_locator first;
+            first.get_event_schema(record);
+            auto contents = krabs::details::schema_cache_file::serialize(first, 1, 2);
+
+            krabs::schema_locator second;
+            auto loaded = krabs::details::schema_cache_file::deserialize(second, contents.data(), contents.size(), 1, 2);
+            Assert::AreEqual((size_t)1, loaded);
+
+            auto schema = second.get_event_schema(record);
+            Assert::AreEqual((size_t)0, (size_t)memcmp(schema, first.get_event_schema(record), sizeof(TRACE_EVENT_INFO)));
+
+            auto stats = second.stats();
+            Assert::AreEqual((uint64_t)1, stats.hits);
+            Assert::AreEqual((uint64_t)0, stats.tdh_lookups);
+        }
+
+        TEST_METHOD(should_ignore_saved_schemas_from_another_os_version)
+        {
+            krabs::schema_locator first;
+            first.get_event_schema(make_record());
+            auto contents = krabs::details::schema_cache_file::serialize(first, 1, 2);
+
+            krabs::schema_locator second;
+            Assert::AreEqual((size_t)0, krabs::details::schema_cache_file::deserialize(second, contents.data(), contents.size(), 1, 3));
+            Assert::AreEqual((size_t)0, krabs::details::schema_cache_file::deserialize(second, contents.data(), contents.size() - 8, 1, 2));
+        }
+
+        TEST_METHOD(should_fall_back_to_tdh_for_damaged_saved_schemas)
+        {
+            auto record = make_record();
+
+            krabs::schema_locator first;
+            first.get_event_schema(record);
+            auto contents = krabs::details::schema_cache_file::serialize(first, 1, 2);
+
+            // Flip a byte of the provider GUID inside the stored schema.
+            contents[sizeof(krabs::details::schema_cache_file_header) + sizeof(krabs::details::schema_cache_file_entry)] ^= 0xFF;
+
+            krabs::schema_locator second;
+            Assert::AreEqual((size_t)0, krabs::details::schema_cache_file::deserialize(second, contents.data(), contents.size(), 1, 2));
+
+            second.get_event_schema(record);
+            Assert::AreEqual((uint64_t)1, second.stats().tdh_lookups);
+        }
+
+        TEST_METHOD(should_save_and_load_schema_cache_files)
+        {
+            wchar_t directory[MAX_PATH];
+            GetTempPathW(MAX_PATH, directory);
+            std::wstring path = std::wstring(directory) + L"krabstests_schemas.bin";
+
+            auto record = make_record();
+
+            krabs::schema_locator first;
+            first.get_event_schema(record);
+            Assert::AreEqual((size_t)1, krabs::save_schema_cache(first, path));
+
+            krabs::schema_locator second;
+            Assert::AreEqual((size_t)1, krabs::load_schema_cache(second, path));
+            second.get_event_schema(record);
+            Assert::AreEqual((uint64_t)0, second.stats().tdh_lookups);
+
+            DeleteFileW(path.c_str());
+            krabs::schema_locator third;
+            Assert::AreEqual((size_t)0, krabs::load_schema_cache(third, path));
+        }
+    };
+}
@@ -0,0 +1,133 @@
+﻿// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+#include <type_traits>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+namespace kp = krabs::predicates;
+
+namespace krabstests
+{
+    TEST_CLASS(test_static_event_filter)
+    {
+        static krabs::testing::synth_record init()
+        {
+            krabs::guid powershell(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}");
+            krabs::testing::record_builder builder(powershell, krabs::id(7937), krabs::version(1));
+            builder.add_properties()(L"ContextInfo", L"Foo bar baz bingo");
+            return builder.pack_incomplete();
+        }
+
+        krabs::testing::synth_record record = init();
+
+        krabs::trace_context trace_context;
+
+    public:
+        TEST_METHOD(should_call_all_callbacks_in_order_when_predicate_matches)
+        {
+            std::vector<int> calls;
+            auto filter = krabs::make_static_event_filter(
+                kp::and_filter(kp::property_is(L"ContextInfo", L"Foo bar baz bingo"), kp::id_is(7937)),
+                [&](const EVENT_RECORD &, const krabs::trace_context &) { calls.push_back(1); },
+                [&](krabs::event_context &context) {
+                    Assert::AreEqual(std::wstring(L"Foo bar baz bingo"), context.parser().parse<std::wstring>(L"ContextInfo"));
+                    calls.push_back(2);
+                });
+
+            filter(record, trace_context);
+
+            Assert::AreEqual((size_t)2, calls.size());
+            Assert::AreEqual(1, calls[0]);
+            Assert::AreEqual(2, calls[1]);
+        }
+
+        TEST_METHOD(should_not_call_callbacks_when_predicate_does_not_match)
+        {
+            auto was_called = false;
+            auto filter = krabs::make_static_event_filter(
+                kp::or_filter(kp::id_is(1), kp::not_filter(kp::property_is(L"ContextInfo", L"Foo bar baz bingo"))),
+                [&](const EVENT_RECORD &, const krabs::trace_context &) { was_called = true; });
+
+            filter(record, trace_context);
+
+            Assert::IsFalse(was_called);
+        }
+
+        TEST_METHOD(should_order_header_predicates_before_schema_predicates)
+        {
+            typedef kp::details::property_is<std::wstring> property_pred;
+            typedef kp::details::and_filter<property_pred, kp::id_is> written;
+            typedef kp::details::and_filter<kp::id_is, property_pred> fused;
+
+            static_assert(std::is_same<krabs::details::fused_predicate<written>::type, fused>::value,
+                "header predicates should be moved first");
+
+            typedef kp::details::or_filter<kp::details::not_filter<written>, kp::opcode_is> nested;
+            typedef kp::details::or_filter<kp::opcode_is, kp::details::not_filter<fused>> nested_fused;
+
+            static_assert(std::is_same<krabs::details::fused_predicate<nested>::type, nested_fused>::value,
+                "reordering should apply to nested predicates");
+        }
+
+        TEST_METHOD(should_not_move_user_predicates_behind_header_predicates)
+        {
+            // It may count or log, so it has to be called as written.
+            struct user_pred {
+                bool operator()(const EVENT_RECORD &, const krabs::trace_context &) const { return true; }
+            };
+
+            typedef kp::details::and_filter<user_pred, kp::id_is> written;
+
+            static_assert(std::is_same<krabs::details::fused_predicate<written>::type, written>::value,
+                "user predicates should keep their place");
+
+            typedef kp::details::property_is<std::wstring> property_pred;
+            typedef kp::details::or_filter<kp::details::and_filter<property_pred, user_pred>, kp::opcode_is> nested;
+
+            static_assert(std::is_same<krabs::details::fused_predicate<nested>::type, nested>::value,
+                "trees holding user predicates should keep their place");
+        }
+
+        TEST_METHOD(should_not_look_up_schema_when_header_predicate_rejects_event)
+        {
+            // No provider has this GUID, a schema lookup would throw.
+            EVENT_RECORD unknown = {};
+            unknown.EventHeader.ProviderId = krabs::guid(L"{6A2E8E1D-3F4B-4C5D-9E6F-7A8B9C0D1E2F}");
+            unknown.EventHeader.EventDescriptor.Id = 1;
+
+            auto was_called = false;
+            auto filter = krabs::make_static_event_filter(
+                kp::and_filter(kp::property_is(L"ContextInfo", L"Foo"), kp::id_is(2)),
+                [&](const EVENT_RECORD &, const krabs::trace_context &) { was_called = true; });
+
+            filter(unknown, trace_context);
+
+            Assert::IsFalse(was_called);
+
+            auto stats = trace_context.schema_stats();
+            Assert::AreEqual((uint64_t)0, stats.hits + stats.misses);
+        }
+
+        TEST_METHOD(should_forward_events_when_added_to_a_provider)
+        {
+            krabs::user_trace trace;
+            krabs::provider<> provider(krabs::guid(L"{A0C1853B-5C40-4B15-8766-3CF1C58F985A}"));
+
+            auto count = 0;
+            provider.add_on_event_callback(krabs::make_static_event_filter(
+                kp::id_is(7937),
+                [&](krabs::event_context &) { ++count; }));
+            trace.enable(provider);
+
+            krabs::testing::user_trace_proxy proxy(trace);
+            proxy.start();
+            proxy.push_event(record);
+
+            Assert::AreEqual(1, count);
+        }
+    };
+}
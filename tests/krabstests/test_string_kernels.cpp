@@ -0,0 +1,260 @@
+﻿// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+
+#include <algorithm>
+#include <cwchar>
+#include <list>
+#include <random>
+#include <string>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace kernels = krabs::details::string_kernels;
+
+namespace krabstests
+{
+    TEST_CLASS(test_string_kernels)
+    {
+        // Mostly ASCII letters in both cases so that matches are common,
+        // with some characters the vector kernels can not fold.
+        std::wstring make_wide_string(std::mt19937 &random, size_t length) const
+        {
+            static const wchar_t alphabet[] = L"abcABC\x00e9\x00c9\x0101\x0100";
+            std::uniform_int_distribution<size_t> pick(0, _countof(alphabet) - 2);
+
+            std::wstring string;
+            for (size_t i = 0; i < length; ++i) {
+                string.push_back(alphabet[pick(random)]);
+            }
+
+            return string;
+        }
+
+        std::string make_narrow_string(std::mt19937 &random, size_t length) const
+        {
+            static const char alphabet[] = "abcABC\xe9\xc9";
+            std::uniform_int_distribution<size_t> pick(0, _countof(alphabet) - 2);
+
+            std::string string;
+            for (size_t i = 0; i < length; ++i) {
+                string.push_back(alphabet[pick(random)]);
+            }
+
+            return string;
+        }
+
+        template <typename T, typename Equal>
+        size_t reference_find(const std::basic_string<T> &haystack, const std::basic_string<T> &needle, Equal equal) const
+        {
+            auto it = std::search(haystack.begin(), haystack.end(), needle.begin(), needle.end(), equal);
+            if (it == haystack.end()) {
+                return needle.empty() ? 0 : kernels::npos;
+            }
+
+            return static_cast<size_t>(it - haystack.begin());
+        }
+
+        template <typename Comparer, typename T>
+        void assert_same_as_iterator_version(const std::basic_string<T> &input, const std::basic_string<T> &expected) const
+        {
+            // std::list iterators are not contiguous and take the iterator
+            // based path, std::basic_string iterators take the kernels.
+            std::list<T> input_list(input.begin(), input.end());
+            std::list<T> expected_list(expected.begin(), expected.end());
+
+            Assert::AreEqual(
+                Comparer()(input_list.begin(), input_list.end(), expected_list.begin(), expected_list.end()),
+                Comparer()(input.begin(), input.end(), expected.begin(), expected.end()));
+        }
+
+        template <typename T>
+        void assert_comparers_agree(const std::basic_string<T> &input, const std::basic_string<T> &expected) const
+        {
+            using namespace krabs::predicates::comparers;
+
+            assert_same_as_iterator_version<equals<std::equal_to<T>>>(input, expected);
+            assert_same_as_iterator_version<equals<iequal_to<T>>>(input, expected);
+            assert_same_as_iterator_version<contains<std::equal_to<T>>>(input, expected);
+            assert_same_as_iterator_version<contains<iequal_to<T>>>(input, expected);
+            assert_same_as_iterator_version<starts_with<std::equal_to<T>>>(input, expected);
+            assert_same_as_iterator_version<starts_with<iequal_to<T>>>(input, expected);
+            assert_same_as_iterator_version<ends_with<std::equal_to<T>>>(input, expected);
+            assert_same_as_iterator_version<ends_with<iequal_to<T>>>(input, expected);
+        }
+
+        // Runs the test with every instruction set the processor supports,
+        // the widest one last.
+        template <typename Test>
+        void at_every_level(Test test) const
+        {
+            struct restore_level {
+                ~restore_level() { kernels::limit_level(kernels::simd_level::avx2); }
+            } restore;
+
+            for (auto level : { kernels::simd_level::scalar, kernels::simd_level::sse2, kernels::simd_level::avx2 }) {
+                kernels::limit_level(level);
+                if (kernels::current_level() == level) {
+                    test();
+                }
+            }
+        }
+
+        TEST_METHOD(should_find_null_at_every_position)
+        {
+            at_every_level([&] {
+                // Covers every position in and after the vector sized blocks, at
+                // every alignment of the start of the string.
+                for (size_t offset = 0; offset < 4; ++offset) {
+                    for (size_t length = 0; length < 80; ++length) {
+                        std::wstring wide(offset + length, L'x');
+                        std::string narrow(offset + length, 'x');
+
+                        Assert::AreEqual(length, kernels::find_null(wide.data() + offset, length));
+                        Assert::AreEqual(length, kernels::find_null(narrow.data() + offset, length));
+
+                        for (size_t position = 0; position < length; ++position) {
+                            wide[offset + position] = L'\0';
+                            narrow[offset + position] = '\0';
+
+                            Assert::AreEqual(position, kernels::find_null(wide.data() + offset, length));
+                            Assert::AreEqual(position, kernels::find_null(narrow.data() + offset, length));
+
+                            wide[offset + position] = L'x';
+                            narrow[offset + position] = 'x';
+                        }
+                    }
+                }
+            });
+        }
+
+        TEST_METHOD(should_find_the_same_positions_as_std_search)
+        {
+            at_every_level([&] {
+                std::mt19937 random(42);
+                krabs::predicates::comparers::iequal_to<wchar_t> wide_iequal;
+                krabs::predicates::comparers::iequal_to<char> narrow_iequal;
+
+                for (size_t length = 0; length < 100; ++length) {
+                    for (size_t count = 0; count <= 6; ++count) {
+                        auto wide_haystack = make_wide_string(random, length);
+                        auto wide_needle = make_wide_string(random, count);
+                        auto narrow_haystack = make_narrow_string(random, length);
+                        auto narrow_needle = make_narrow_string(random, count);
+
+                        Assert::AreEqual(
+                            reference_find(wide_haystack, wide_needle, std::equal_to<wchar_t>()),
+                            kernels::find(wide_haystack.data(), length, wide_needle.data(), count));
+                        Assert::AreEqual(
+                            reference_find(wide_haystack, wide_needle, wide_iequal),
+                            kernels::ifind(wide_haystack.data(), length, wide_needle.data(), count, wide_iequal));
+                        Assert::AreEqual(
+                            reference_find(narrow_haystack, narrow_needle, std::equal_to<char>()),
+                            kernels::find(narrow_haystack.data(), length, narrow_needle.data(), count));
+                        Assert::AreEqual(
+                            reference_find(narrow_haystack, narrow_needle, narrow_iequal),
+                            kernels::ifind(narrow_haystack.data(), length, narrow_needle.data(), count, narrow_iequal));
+                    }
+                }
+            });
+        }
+
+        TEST_METHOD(should_compare_case_insensitively_like_iequal_to)
+        {
+            at_every_level([&] {
+                krabs::predicates::comparers::iequal_to<wchar_t> iequal;
+
+                std::wstring upper(70, L'A');
+                std::wstring lower(70, L'a');
+                Assert::IsTrue(kernels::iequal(upper.data(), lower.data(), upper.size(), iequal));
+
+                // A difference in the last character of a block and in the tail.
+                for (size_t position : { size_t(7), size_t(15), size_t(31), size_t(69) }) {
+                    auto other = lower;
+                    other[position] = L'b';
+                    Assert::IsFalse(kernels::iequal(upper.data(), other.data(), upper.size(), iequal));
+                }
+
+                // Characters the vector kernels do not fold are left to iequal_to.
+                std::wstring accented(40, L'\x00e9');
+                std::wstring accented_upper(40, static_cast<wchar_t>(towupper(L'\x00e9')));
+                Assert::AreEqual(
+                    std::equal(accented.begin(), accented.end(), accented_upper.begin(), iequal),
+                    kernels::iequal(accented.data(), accented_upper.data(), accented.size(), iequal));
+
+                // Characters at and above 0x8000 are negative in signed compares.
+                std::wstring high(40, L'\x8061');
+                std::wstring high_upper(40, L'\x8041');
+                Assert::AreEqual(
+                    std::equal(high.begin(), high.end(), high_upper.begin(), iequal),
+                    kernels::iequal(high.data(), high_upper.data(), high.size(), iequal));
+
+#if WCHAR_MAX > 0xFFFF
+                // Beyond the BMP the low 16 bits may look like ASCII letters.
+                std::wstring beyond(40, static_cast<wchar_t>(0x10061));
+                std::wstring beyond_upper(40, static_cast<wchar_t>(0x10041));
+                Assert::IsFalse(kernels::iequal(beyond.data(), beyond_upper.data(), beyond.size(), iequal));
+                Assert::AreEqual(kernels::npos, kernels::ifind(beyond.data(), beyond.size(), L"A", 1, iequal));
+                Assert::AreEqual(kernels::npos, kernels::find(beyond.data(), beyond.size(), L"a", 1));
+#endif
+            });
+        }
+
+        TEST_METHOD(should_only_treat_ascii_code_points_as_ascii)
+        {
+            Assert::IsTrue(kernels::is_ascii(L'A'));
+            Assert::IsTrue(kernels::is_ascii(L'\x007f'));
+            Assert::IsFalse(kernels::is_ascii(L'\x0080'));
+            Assert::IsFalse(kernels::is_ascii(L'\x8041'));
+
+#if WCHAR_MAX > 0xFFFF
+            // Beyond the BMP the low 16 bits may look like ASCII.
+            Assert::IsFalse(kernels::is_ascii(static_cast<wchar_t>(0x10041)));
+            Assert::IsFalse(kernels::is_ascii(static_cast<wchar_t>(0x10FFFF)));
+#endif
+        }
+
+        TEST_METHOD(comparers_should_agree_with_iterator_versions)
+        {
+            at_every_level([&] {
+                std::mt19937 random(7);
+
+                for (size_t length = 0; length < 70; length += 3) {
+                    for (size_t count = 0; count <= length + 1; count += 2) {
+                        auto wide_input = make_wide_string(random, length);
+                        auto narrow_input = make_narrow_string(random, length);
+
+                        assert_comparers_agree(wide_input, make_wide_string(random, count));
+                        assert_comparers_agree(narrow_input, make_narrow_string(random, count));
+
+                        if (count <= length) {
+                            // Ranges taken from the input make equals, starts_with
+                            // and ends_with succeed as well.
+                            assert_comparers_agree(wide_input, wide_input.substr(0, count));
+                            assert_comparers_agree(wide_input, wide_input.substr(length - count));
+                            assert_comparers_agree(narrow_input, narrow_input.substr(0, count));
+                            assert_comparers_agree(narrow_input, narrow_input.substr(length - count));
+                        }
+                    }
+                }
+            });
+        }
+
+        TEST_METHOD(comparers_should_accept_raw_pointers)
+        {
+            using namespace krabs::predicates::comparers;
+
+            const wchar_t input[] = L"C:\\Windows\\System32\\WindowsPowerShell\\v1.0\\powershell.exe";
+            const std::wstring expected(L"POWERSHELL.EXE");
+
+            Assert::IsTrue(ends_with<iequal_to<wchar_t>>()(
+                std::begin(input), std::end(input) - 1, expected.begin(), expected.end()));
+            Assert::IsFalse(ends_with<std::equal_to<wchar_t>>()(
+                std::begin(input), std::end(input) - 1, expected.begin(), expected.end()));
+            Assert::IsTrue(contains<iequal_to<wchar_t>>()(
+                std::begin(input), std::end(input) - 1, expected.begin(), expected.end()));
+        }
+    };
+}
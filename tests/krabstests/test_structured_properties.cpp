@@ -0,0 +1,271 @@
+﻿// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+#include <bluekrabs/searching/wevt.hpp>
+
+#include "structured_schema_source.hpp"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    // Serves the schema of an event with an array of strings whose count
+    // comes from the event.
+    class string_array_schema_source : public krabs::schema_source {
+    public:
+        explicit string_array_schema_source(const krabs::guid &provider)
+            : provider_(provider)
+        {
+            EVENT_DESCRIPTOR descriptor;
+            memset(&descriptor, 0, sizeof(descriptor));
+            descriptor.Id = 2;
+
+            schema_ = krabs::details::build_trace_event_info(
+                provider, descriptor, L"Krabs-Test-Provider", L"", L"", L"", {
+                    { L"NameCount", 0, TDH_INTYPE_UINT32, 0, 1, 0, 0, 0 },
+                    { L"Names", PropertyParamCount, TDH_INTYPE_UNICODESTRING, 0, 0, 0, 0, 0 },
+                    { L"Trailer", 0, TDH_INTYPE_UINT32, 0, 1, 0, 0, 0 },
+                });
+        }
+
+        size_t get_event_schema(const EVENT_RECORD &record, void *buffer, size_t size) const override
+        {
+            if (record.EventHeader.ProviderId != provider_ ||
+                record.EventHeader.EventDescriptor.Id != 2) {
+                return 0;
+            }
+
+            if (size >= schema_.size()) {
+                memcpy(buffer, schema_.data(), schema_.size());
+            }
+
+            return schema_.size();
+        }
+
+    private:
+        krabs::guid provider_;
+        std::vector<BYTE> schema_;
+    };
+
+    // Serves the schema of an event with an array of pointers whose count
+    // comes from the event.
+    class pointer_array_schema_source : public krabs::schema_source {
+    public:
+        explicit pointer_array_schema_source(const krabs::guid &provider)
+            : provider_(provider)
+        {
+            EVENT_DESCRIPTOR descriptor;
+            memset(&descriptor, 0, sizeof(descriptor));
+            descriptor.Id = 3;
+
+            schema_ = krabs::details::build_trace_event_info(
+                provider, descriptor, L"Krabs-Test-Provider", L"", L"", L"", {
+                    { L"PointerCount", 0, TDH_INTYPE_UINT32, 0, 1, 0, 0, 0 },
+                    { L"Pointers", PropertyParamCount, TDH_INTYPE_POINTER, 0, 0, 8, 0, 0 },
+                    { L"Trailer", 0, TDH_INTYPE_UINT32, 0, 1, 0, 0, 0 },
+                });
+        }
+
+        size_t get_event_schema(const EVENT_RECORD &record, void *buffer, size_t size) const override
+        {
+            if (record.EventHeader.ProviderId != provider_ ||
+                record.EventHeader.EventDescriptor.Id != 3) {
+                return 0;
+            }
+
+            if (size >= schema_.size()) {
+                memcpy(buffer, schema_.data(), schema_.size());
+            }
+
+            return schema_.size();
+        }
+
+    private:
+        krabs::guid provider_;
+        std::vector<BYTE> schema_;
+    };
+
+    TEST_CLASS(test_structured_properties)
+    {
+        const krabs::guid provider = krabs::guid(L"{3E5A7C91-2B4D-4F60-8A1C-9D7E6B5F4A32}");
+
+        template <typename T>
+        static void put(std::vector<BYTE> &data, const T &value)
+        {
+            data.insert(data.end(), reinterpret_cast<const BYTE*>(&value), reinterpret_cast<const BYTE*>(&value) + sizeof(value));
+        }
+
+        static void put_string(std::vector<BYTE> &data, const wchar_t *value)
+        {
+            data.insert(data.end(), reinterpret_cast<const BYTE*>(value), reinterpret_cast<const BYTE*>(value + wcslen(value) + 1));
+        }
+
+        krabs::testing::synth_record make_record() const
+        {
+            return make_structured_record(provider);
+        }
+
+    public:
+
+        TEST_METHOD(should_size_arrays_and_structures_from_the_event)
+        {
+            structured_schema_source source(provider);
+            krabs::schema_locator locator(source);
+            auto record = make_record();
+            krabs::schema schema(record, locator);
+            krabs::parser parser(schema);
+
+            // Reaching the last property takes sizing every one before it.
+            Assert::AreEqual((uint32_t)0xDEADBEEF, parser.parse<uint32_t>(L"Trailer"));
+            Assert::AreEqual((uint32_t)2, parser.parse<uint32_t>(L"EntryCount"));
+            Assert::AreEqual(std::wstring(L"label"), parser.parse<std::wstring>(L"Label"));
+
+            // None of them needs Tdh.
+            Assert::AreEqual((uint64_t)0, locator.stats().tdh_size_lookups);
+        }
+
+        TEST_METHOD(should_not_walk_a_huge_count_past_a_truncated_event)
+        {
+            string_array_schema_source source(provider);
+            krabs::schema_locator locator(source);
+
+            EVENT_RECORD record;
+            memset(&record, 0, sizeof(record));
+            record.EventHeader.ProviderId = provider;
+            record.EventHeader.EventDescriptor.Id = 2;
+
+            // One string where the count claims billions, and no trailer.
+            std::vector<BYTE> data;
+            put(data, (uint32_t)0xFFFFFFFE);
+            put_string(data, L"a");
+            krabs::testing::synth_record truncated(record, data);
+
+            krabs::schema schema(truncated, locator);
+            krabs::parser parser(schema);
+
+            // The strings past the data size to nothing, which leaves the
+            // array to Tdh instead of counting through every one of them.
+            uint32_t trailer = 0;
+            parser.try_parse(L"Trailer", trailer);
+            Assert::AreEqual((uint64_t)1, locator.stats().tdh_size_lookups);
+        }
+
+        TEST_METHOD(parse_array_should_borrow_the_elements)
+        {
+            structured_schema_source source(provider);
+            krabs::schema_locator locator(source);
+            auto record = make_record();
+            krabs::schema schema(record, locator);
+            krabs::parser parser(schema);
+
+            auto ports = parser.parse_array<uint16_t>(L"Ports");
+            Assert::AreEqual((size_t)2, ports.size());
+            Assert::AreEqual((uint16_t)80, ports[0]);
+            Assert::AreEqual((uint16_t)443, ports[1]);
+
+            auto tags = parser.parse_array<uint32_t>(krabs::property_key(L"Tags"));
+            Assert::AreEqual((size_t)3, tags.size());
+            Assert::AreEqual((uint32_t)3, tags[2]);
+
+            auto blob = parser.parse_array<BYTE>(L"Blob");
+            Assert::AreEqual(std::string("abc"), std::string(blob.begin(), blob.end()));
+
+            const EVENT_RECORD &raw = record;
+            Assert::IsTrue(reinterpret_cast<const BYTE*>(ports.data()) == static_cast<const BYTE*>(raw.UserData) + 2);
+        }
+
+        TEST_METHOD(should_size_counted_pointer_arrays_by_the_event_bitness)
+        {
+            pointer_array_schema_source source(provider);
+            krabs::schema_locator locator(source);
+
+            EVENT_RECORD record;
+            memset(&record, 0, sizeof(record));
+            record.EventHeader.ProviderId = provider;
+            record.EventHeader.EventDescriptor.Id = 3;
+
+            std::vector<BYTE> data64;
+            put(data64, (uint32_t)2);
+            put(data64, (uint64_t)0x1000);
+            put(data64, (uint64_t)0x2000);
+            put(data64, (uint32_t)0xDEADBEEF);
+            krabs::testing::synth_record record64(record, data64);
+
+            krabs::schema schema64(record64, locator);
+            krabs::parser parser64(schema64);
+
+            auto pointers64 = parser64.parse_array<uint64_t>(L"Pointers");
+            Assert::AreEqual((size_t)2, pointers64.size());
+            Assert::AreEqual((uint64_t)0x2000, pointers64[1]);
+            Assert::AreEqual((uint32_t)0xDEADBEEF, parser64.parse<uint32_t>(L"Trailer"));
+
+            record.EventHeader.Flags |= EVENT_HEADER_FLAG_32_BIT_HEADER;
+
+            std::vector<BYTE> data32;
+            put(data32, (uint32_t)2);
+            put(data32, (uint32_t)0x1000);
+            put(data32, (uint32_t)0x2000);
+            put(data32, (uint32_t)0xDEADBEEF);
+            krabs::testing::synth_record record32(record, data32);
+
+            krabs::schema schema32(record32, locator);
+            krabs::parser parser32(schema32);
+
+            auto pointers32 = parser32.parse_array<uint32_t>(L"Pointers");
+            Assert::AreEqual((size_t)2, pointers32.size());
+            Assert::AreEqual((uint32_t)0x2000, pointers32[1]);
+            Assert::AreEqual((uint32_t)0xDEADBEEF, parser32.parse<uint32_t>(L"Trailer"));
+
+            Assert::AreEqual((uint64_t)0, locator.stats().tdh_size_lookups);
+        }
+
+        TEST_METHOD(parse_array_should_reject_elements_of_another_size)
+        {
+            structured_schema_source source(provider);
+            krabs::schema_locator locator(source);
+            auto record = make_record();
+            krabs::schema schema(record, locator);
+            krabs::parser parser(schema);
+
+            Assert::ExpectException<std::runtime_error>([&] { parser.parse_array<uint64_t>(L"Ports"); });
+            Assert::ExpectException<std::runtime_error>([&] { parser.parse_array<uint16_t>(L"Names"); });
+            Assert::ExpectException<std::runtime_error>([&] { parser.parse_array<uint16_t>(L"Entries"); });
+        }
+
+        TEST_METHOD(struct_cursor_should_walk_each_element)
+        {
+            structured_schema_source source(provider);
+            krabs::schema_locator locator(source);
+            auto record = make_record();
+            krabs::schema schema(record, locator);
+            krabs::parser parser(schema);
+
+            auto entries = parser.parse_struct(L"Entries");
+            Assert::AreEqual((size_t)2, entries.count());
+
+            Assert::IsTrue(entries.next());
+            Assert::AreEqual(std::wstring(L"Run"), entries.parse<std::wstring>(L"Key"));
+            auto value = entries.parse_array<BYTE>(L"Value");
+            Assert::AreEqual((size_t)2, value.size());
+            Assert::AreEqual((BYTE)0x20, value[1]);
+
+            Assert::IsTrue(entries.next());
+            Assert::AreEqual(std::wstring(L"RunOnce"), entries.parse<std::wstring>(L"Key"));
+            Assert::AreEqual((uint16_t)0, entries.parse<uint16_t>(L"ValueSize"));
+            Assert::IsTrue(entries.parse_array<BYTE>(L"Value").empty());
+
+            std::wstring missing;
+            Assert::IsFalse(entries.try_parse(L"NoSuchMember", missing));
+
+            Assert::IsFalse(entries.next());
+            Assert::ExpectException<std::out_of_range>([&] { entries.bytes(); });
+            Assert::ExpectException<std::runtime_error>([&] { parser.parse_struct(L"Ports"); });
+        }
+    };
+}
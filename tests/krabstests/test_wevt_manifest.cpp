@@ -0,0 +1,262 @@
+﻿// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "CppUnitTest.h"
+#include <krabs.hpp>
+#include <bluekrabs/searching/wevt.hpp>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace krabstests
+{
+    // Writes a WEVT_TEMPLATE resource the way the message compiler lays
+    // it out, with just the elements the decoder reads. It shares the
+    // decoder's reading of the format, so these tests check the decoding
+    // and not that reading; that needs a resource taken from a real image.
+    class wevt_writer {
+    public:
+        size_t offset() const { return data.size(); }
+
+        size_t put(const void *value, size_t size)
+        {
+            auto at = data.size();
+            data.insert(data.end(), static_cast<const BYTE*>(value), static_cast<const BYTE*>(value) + size);
+            return at;
+        }
+
+        size_t put_signature(const char *signature) { return put(signature, 4); }
+        size_t put8(BYTE value) { return put(&value, sizeof(value)); }
+        size_t put16(USHORT value) { return put(&value, sizeof(value)); }
+        size_t put32(ULONG value) { return put(&value, sizeof(value)); }
+        size_t put64(ULONGLONG value) { return put(&value, sizeof(value)); }
+
+        size_t put_string(const std::wstring &value)
+        {
+            // Resource strings are UTF-16 whatever the size of wchar_t.
+            auto at = put32(static_cast<ULONG>(sizeof(ULONG) + (value.size() + 1) * sizeof(uint16_t)));
+            for (size_t i = 0; i <= value.size(); ++i) {
+                auto unit = static_cast<uint16_t>(value.c_str()[i]);
+                put(&unit, sizeof(unit));
+            }
+
+            return at;
+        }
+
+        void patch32(size_t at, size_t value)
+        {
+            auto narrowed = static_cast<ULONG>(value);
+            memcpy(&data[at], &narrowed, sizeof(narrowed));
+        }
+
+        std::vector<BYTE> data;
+    };
+
+    TEST_CLASS(test_wevt_manifest)
+    {
+        const krabs::guid provider = krabs::guid(L"{8C2B53E1-9A62-4E0B-A1F4-0E7A5D4C3B21}");
+
+        struct template_item {
+            ULONG flags;
+            BYTE in_type;
+            BYTE out_type;
+            USHORT count;
+            USHORT length;
+            std::wstring name;
+        };
+
+        void put_template(wevt_writer &writer, size_t at, const std::vector<template_item> &items) const
+        {
+            writer.patch32(at, writer.offset());
+            auto start = writer.put_signature("TEMP");
+            writer.put32(0);
+            writer.put32(static_cast<ULONG>(items.size()));
+            writer.put32(static_cast<ULONG>(items.size()));
+            auto itemsOffset = writer.put32(0);
+            writer.put32(1);
+            writer.put(&static_cast<const GUID &>(provider), sizeof(GUID));
+
+            writer.patch32(itemsOffset, writer.offset());
+            std::vector<size_t> names;
+            for (auto &item : items) {
+                writer.put32(item.flags);
+                writer.put8(item.in_type);
+                writer.put8(item.out_type);
+                writer.put16(0);
+                writer.put32(0);
+                writer.put16(item.count);
+                writer.put16(item.length);
+                names.push_back(writer.put32(0));
+            }
+
+            for (size_t i = 0; i < items.size(); ++i) {
+                writer.patch32(names[i], writer.offset());
+                writer.put_string(items[i].name);
+            }
+
+            writer.patch32(start + 4, writer.offset() - start);
+        }
+
+        // Event 1 takes a process id, an image name and a blob whose length
+        // is given by the property before it. Event 2 uses a structure.
+        std::vector<BYTE> make_manifest() const
+        {
+            wevt_writer writer;
+
+            writer.put_signature("CRIM");
+            auto crimSize = writer.put32(0);
+            writer.put16(3);
+            writer.put16(1);
+            writer.put32(1);
+            writer.put(&static_cast<const GUID &>(provider), sizeof(GUID));
+            auto wevtOffset = writer.put32(0);
+
+            writer.patch32(wevtOffset, writer.offset());
+            auto wevt = writer.put_signature("WEVT");
+            auto wevtSize = writer.put32(0);
+            writer.put32(0xFFFFFFFF);
+            writer.put32(2);
+            writer.put32(0);
+            auto taskElement = writer.put32(0);
+            writer.put32(0);
+            auto eventElement = writer.put32(0);
+            writer.put32(0);
+
+            writer.patch32(taskElement, writer.offset());
+            auto task = writer.put_signature("TASK");
+            writer.put32(0);
+            writer.put32(1);
+            auto taskEntry = writer.put32(1);
+            writer.put32(0xFFFFFFFF);
+            writer.put(&static_cast<const GUID &>(provider), sizeof(GUID));
+            auto taskName = writer.put32(0);
+            writer.patch32(taskName, writer.offset());
+            writer.put_string(L"Startup");
+            writer.patch32(task + 4, writer.offset() - task);
+
+            writer.patch32(eventElement, writer.offset());
+            auto evnt = writer.put_signature("EVNT");
+            writer.put32(0);
+            writer.put32(2);
+            writer.put32(0);
+
+            std::vector<size_t> templates;
+            for (USHORT id = 1; id <= 2; ++id) {
+                writer.put16(id);
+                writer.put8(0);
+                writer.put8(0);
+                writer.put8(4);
+                writer.put8(0);
+                writer.put16(1);
+                writer.put64(0x8000000000000000ULL);
+                writer.put32(0xFFFFFFFF);
+                templates.push_back(writer.put32(0));
+                writer.put32(0);
+                writer.put32(0);
+                writer.put32(static_cast<ULONG>(taskEntry));
+                writer.put32(0);
+                writer.put32(0);
+                writer.put32(0);
+            }
+            writer.patch32(evnt + 4, writer.offset() - evnt);
+
+            put_template(writer, templates[0], {
+                { 0, TDH_INTYPE_UINT32, 0, 1, 0, L"ProcessId" },
+                { 0, TDH_INTYPE_UNICODESTRING, 0, 1, 0, L"ImageName" },
+                { 0, TDH_INTYPE_UINT32, 0, 1, 0, L"Size" },
+                { PropertyParamLength, TDH_INTYPE_BINARY, 0, 1, 2, L"Data" },
+            });
+
+            put_template(writer, templates[1], {
+                { PropertyStruct, 0, 0, 1, 0, L"Header" },
+            });
+
+            writer.patch32(wevtSize, writer.offset() - wevt);
+            writer.patch32(crimSize, writer.offset());
+            return writer.data;
+        }
+
+        krabs::testing::synth_record make_record(USHORT id) const
+        {
+            EVENT_RECORD record;
+            memset(&record, 0, sizeof(record));
+            record.EventHeader.ProviderId = provider;
+            record.EventHeader.EventDescriptor.Id = id;
+            record.EventHeader.EventDescriptor.Level = 4;
+            record.EventHeader.EventDescriptor.Task = 1;
+
+            wevt_writer data;
+            data.put32(42);
+            data.put(L"krabs.exe", sizeof(L"krabs.exe"));
+            data.put32(3);
+            data.put("abc", 3);
+
+            return krabs::testing::synth_record(record, data.data);
+        }
+
+    public:
+
+        TEST_METHOD(should_decode_events_from_the_resource)
+        {
+            auto contents = make_manifest();
+            krabs::wevt_manifest manifest(contents.data(), contents.size());
+
+            Assert::AreEqual((size_t)1, manifest.event_count());
+            Assert::AreEqual((size_t)1, manifest.skipped_count());
+            Assert::IsNull(manifest.find(provider, 2, 0));
+
+            auto info = manifest.find(provider, 1, 0);
+            Assert::IsNotNull(info);
+            Assert::AreEqual((ULONG)4, info->TopLevelPropertyCount);
+            Assert::AreEqual((USHORT)2, info->EventPropertyInfoArray[3].length);
+            Assert::AreEqual((ULONG)PropertyParamLength, (ULONG)info->EventPropertyInfoArray[3].Flags);
+            Assert::AreEqual((USHORT)4, info->EventPropertyInfoArray[0].length);
+            Assert::AreEqual((USHORT)TDH_OUTTYPE_STRING, info->EventPropertyInfoArray[1].nonStructType.OutType);
+        }
+
+        TEST_METHOD(should_parse_events_without_tdh)
+        {
+            auto contents = make_manifest();
+            krabs::wevt_manifest manifest(contents.data(), contents.size(), L"Krabs-Test-Provider");
+            krabs::schema_locator locator(manifest);
+
+            auto record = make_record(1);
+            krabs::schema schema(record, locator);
+            krabs::parser parser(schema);
+
+            Assert::AreEqual(L"Startup", schema.task_name());
+            Assert::AreEqual(L"Krabs-Test-Provider", schema.provider_name());
+            Assert::AreEqual((uint32_t)42, parser.parse<uint32_t>(L"ProcessId"));
+            Assert::AreEqual(std::wstring(L"krabs.exe"), parser.parse<std::wstring>(L"ImageName"));
+            Assert::AreEqual((uint32_t)3, parser.parse<uint32_t>(L"Size"));
+
+            Assert::AreEqual((uint64_t)0, locator.stats().tdh_lookups);
+        }
+
+        TEST_METHOD(should_leave_the_provider_name_empty_when_none_is_given)
+        {
+            auto contents = make_manifest();
+            krabs::wevt_manifest manifest(contents.data(), contents.size());
+            krabs::schema_locator locator(manifest);
+
+            auto record = make_record(1);
+            krabs::schema schema(record, locator);
+
+            Assert::AreEqual(L"", schema.provider_name());
+            Assert::AreEqual(L"Startup", schema.task_name());
+        }
+
+        TEST_METHOD(should_reject_truncated_resources)
+        {
+            auto contents = make_manifest();
+            contents.resize(contents.size() - 8);
+
+            Assert::ExpectException<krabs::invalid_manifest>([&] {
+                krabs::wevt_manifest manifest(contents.data(), contents.size());
+            });
+        }
+    };
+}